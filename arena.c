@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2023 Analog Devices, Inc.
+ */
+
+#include "iio-lock.h"
+#include "iio-private.h"
+
+#include <errno.h>
+#include <string.h>
+
+/* Memory is carved out of chunks of this size; larger requests get a chunk
+ * of their own */
+#define IIO_ARENA_CHUNK_SIZE 16384
+
+struct iio_arena_chunk {
+	struct iio_arena_chunk *next;
+	size_t size, used;
+	char data[];
+};
+
+/* Bump allocator, whose memory is only released when the arena is
+ * destroyed, and set of interned strings stored in it. */
+struct iio_arena {
+	struct iio_arena_chunk *chunks;
+
+	/* The arena of a cloned context references the one of the original
+	 * context, which holds the strings it uses */
+	struct iio_arena *parent;
+	struct iio_mutex *lock;
+	unsigned int refcount;
+
+	/* Open addressing hash table of the interned strings */
+	char **strings;
+	size_t nb_strings, mask;
+};
+
+static struct iio_arena * iio_arena_ref(struct iio_arena *arena)
+{
+	iio_mutex_lock(arena->lock);
+	arena->refcount++;
+	iio_mutex_unlock(arena->lock);
+
+	return arena;
+}
+
+struct iio_arena * iio_arena_create(struct iio_arena *parent)
+{
+	struct iio_arena *arena;
+
+	arena = zalloc(sizeof(*arena));
+	if (!arena)
+		return NULL;
+
+	arena->lock = iio_mutex_create();
+	if (!arena->lock) {
+		free(arena);
+		return NULL;
+	}
+
+	arena->refcount = 1;
+
+	if (parent)
+		arena->parent = iio_arena_ref(parent);
+
+	return arena;
+}
+
+void iio_arena_unref(struct iio_arena *arena)
+{
+	struct iio_arena_chunk *chunk, *next;
+	unsigned int refcount;
+
+	iio_mutex_lock(arena->lock);
+	refcount = --arena->refcount;
+	iio_mutex_unlock(arena->lock);
+
+	if (refcount)
+		return;
+
+	for (chunk = arena->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+
+	if (arena->parent)
+		iio_arena_unref(arena->parent);
+
+	free(arena->strings);
+	iio_mutex_destroy(arena->lock);
+	free(arena);
+}
+
+static void * iio_arena_alloc(struct iio_arena *arena, size_t size)
+{
+	struct iio_arena_chunk *chunk = arena->chunks;
+	size_t chunk_size;
+	void *ptr;
+
+	/* Keep the allocations aligned to the size of a pointer */
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+	if (!chunk || chunk->size - chunk->used < size) {
+		chunk_size = size > IIO_ARENA_CHUNK_SIZE / 4 ?
+			size : IIO_ARENA_CHUNK_SIZE;
+
+		chunk = malloc(sizeof(*chunk) + chunk_size);
+		if (!chunk)
+			return NULL;
+
+		chunk->size = chunk_size;
+		chunk->used = 0;
+
+		/* A dedicated chunk goes after the current one, so that the
+		 * space left in the latter can still be used */
+		if (arena->chunks && chunk_size != IIO_ARENA_CHUNK_SIZE) {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		} else {
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+	}
+
+	ptr = &chunk->data[chunk->used];
+	chunk->used += size;
+
+	return ptr;
+}
+
+void * iio_arena_zalloc(struct iio_arena *arena, size_t size)
+{
+	void *ptr = iio_arena_alloc(arena, size);
+
+	if (ptr)
+		memset(ptr, 0, size);
+
+	return ptr;
+}
+
+void * iio_arena_dup(struct iio_arena *arena, const void *src, size_t size)
+{
+	void *ptr;
+
+	if (!size)
+		return NULL;
+
+	ptr = iio_arena_alloc(arena, size);
+	if (ptr)
+		memcpy(ptr, src, size);
+
+	return ptr;
+}
+
+/* The capacity of an array grown one element at a time is the smallest
+ * power of two not lower than its number of elements; it is full when that
+ * number is zero or a power of two. The old copies are only released with
+ * the arena; together, they are smaller than the capacity of the array. */
+void * iio_arena_grow(struct iio_arena *arena, void *array,
+		      size_t nb, size_t size)
+{
+	void *ptr;
+
+	if (nb & (nb - 1))
+		return array;
+
+	ptr = iio_arena_alloc(arena, (nb ? 2 * nb : 1) * size);
+	if (ptr && nb)
+		memcpy(ptr, array, nb * size);
+
+	return ptr;
+}
+
+static size_t iio_arena_hash(const char *str, size_t len)
+{
+	/* FNV-1a */
+	uint64_t hash = 0xcbf29ce484222325ull;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char) str[i];
+		hash *= 0x100000001b3ull;
+	}
+
+	return (size_t) (hash ^ (hash >> 32));
+}
+
+static char ** iio_arena_lookup(char **strings, size_t mask,
+				const char *str, size_t len)
+{
+	size_t i;
+
+	for (i = iio_arena_hash(str, len) & mask; strings[i] &&
+	     (strncmp(strings[i], str, len) || strings[i][len]);
+	     i = (i + 1) & mask);
+
+	return &strings[i];
+}
+
+static int iio_arena_grow_table(struct iio_arena *arena)
+{
+	size_t i, size = arena->strings ? 2 * (arena->mask + 1) : 256;
+	char **strings;
+
+	strings = calloc(size, sizeof(*strings));
+	if (!strings)
+		return -ENOMEM;
+
+	if (arena->strings) {
+		for (i = 0; i <= arena->mask; i++) {
+			if (arena->strings[i]) {
+				*iio_arena_lookup(strings, size - 1,
+						  arena->strings[i],
+						  strlen(arena->strings[i])) =
+					arena->strings[i];
+			}
+		}
+
+		free(arena->strings);
+	}
+
+	arena->strings = strings;
+	arena->mask = size - 1;
+
+	return 0;
+}
+
+char * iio_arena_intern_len(struct iio_arena *arena,
+			    const char *str, size_t len)
+{
+	char **slot;
+
+	/* Keep the load factor under 50% */
+	if (2 * (arena->nb_strings + 1) > (arena->strings ? arena->mask + 1 : 0)
+	    && iio_arena_grow_table(arena) < 0)
+		return NULL;
+
+	slot = iio_arena_lookup(arena->strings, arena->mask, str, len);
+	if (*slot)
+		return *slot;
+
+	*slot = iio_arena_alloc(arena, len + 1);
+	if (!*slot)
+		return NULL;
+
+	memcpy(*slot, str, len);
+	(*slot)[len] = '\0';
+	arena->nb_strings++;
+
+	return *slot;
+}
+
+char * iio_arena_intern(struct iio_arena *arena, const char *str)
+{
+	return iio_arena_intern_len(arena, str, strlen(str));
+}
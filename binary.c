@@ -0,0 +1,725 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2023 Analog Devices, Inc.
+ */
+
+#include "debug.h"
+#include "iio-private.h"
+
+#include <errno.h>
+#include <string.h>
+
+/* Binary representation of a context, exchanged between iiod and its
+ * clients as an alternative to the XML string:
+ *
+ *   "IIOB" magic, version
+ *   string table: count, then (length, bytes) for each string
+ *   context: description, major, minor, git tag, attributes, devices
+ *   device: id, name, label, channels, attributes, buffer attributes,
+ *           debug attributes
+ *   channel: id, name, flags, [index, format], attributes (name, filename)
+ *
+ * All the integers are unsigned LEB128 varints; arrays are prefixed by their
+ * number of elements. Strings are stored once, and referenced by their index
+ * in the table plus one, zero meaning NULL. The scale is stored as the
+ * 8 bytes of the IEEE 754 double, most significant first. */
+
+#define BINARY_MAGIC "IIOB"
+#define BINARY_VERSION 1
+
+enum binary_channel_flags {
+	BINARY_CHN_OUTPUT = 1 << 0,
+	BINARY_CHN_SCAN_ELEMENT = 1 << 1,
+	BINARY_CHN_BE = 1 << 2,
+	BINARY_CHN_SIGNED = 1 << 3,
+	BINARY_CHN_FULLY_DEFINED = 1 << 4,
+	BINARY_CHN_WITH_SCALE = 1 << 5,
+};
+
+struct binary_encoder {
+	struct iio_strbuf body;
+
+	/* Open addressing hash table of the indexes (plus one) of the
+	 * strings already added to the table */
+	const char **strings;
+	size_t nb_strings;
+	uint32_t *slots;
+	size_t mask;
+};
+
+static void binary_put_varint(struct iio_strbuf *sb, uint64_t val)
+{
+	char bytes[10];
+	size_t nb = 0;
+
+	do {
+		bytes[nb] = (char) (val & 0x7f);
+		val >>= 7;
+		if (val)
+			bytes[nb] |= (char) 0x80;
+		nb++;
+	} while (val);
+
+	iio_strbuf_append(sb, bytes, nb);
+}
+
+static size_t binary_hash(const char *str)
+{
+	/* FNV-1a */
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	for (; *str; str++) {
+		hash ^= (unsigned char) *str;
+		hash *= 0x100000001b3ull;
+	}
+
+	return (size_t) (hash ^ (hash >> 32));
+}
+
+static uint32_t * binary_lookup(const struct binary_encoder *enc,
+				const char *str)
+{
+	size_t i;
+
+	for (i = binary_hash(str) & enc->mask; enc->slots[i] &&
+	     strcmp(enc->strings[enc->slots[i] - 1], str);
+	     i = (i + 1) & enc->mask);
+
+	return &enc->slots[i];
+}
+
+static int binary_grow(struct binary_encoder *enc)
+{
+	size_t i, size = enc->slots ? 2 * (enc->mask + 1) : 256;
+	const char **strings;
+	uint32_t *slots, *old_slots = enc->slots;
+
+	strings = realloc(enc->strings, size / 2 * sizeof(*strings));
+	if (!strings)
+		return -ENOMEM;
+
+	enc->strings = strings;
+
+	slots = calloc(size, sizeof(*slots));
+	if (!slots)
+		return -ENOMEM;
+
+	enc->slots = slots;
+	enc->mask = size - 1;
+
+	for (i = 0; i < enc->nb_strings; i++)
+		*binary_lookup(enc, enc->strings[i]) = (uint32_t) i + 1;
+
+	free(old_slots);
+
+	return 0;
+}
+
+static void binary_put_string(struct binary_encoder *enc, const char *str)
+{
+	uint32_t *slot;
+
+	if (!str) {
+		binary_put_varint(&enc->body, 0);
+		return;
+	}
+
+	/* Keep the load factor under 50% */
+	if (2 * (enc->nb_strings + 1) > (enc->slots ? enc->mask + 1 : 0)
+	    && binary_grow(enc) < 0) {
+		enc->body.err = -ENOMEM;
+		return;
+	}
+
+	slot = binary_lookup(enc, str);
+	if (!*slot) {
+		enc->strings[enc->nb_strings++] = str;
+		*slot = (uint32_t) enc->nb_strings;
+	}
+
+	binary_put_varint(&enc->body, *slot);
+}
+
+static void binary_put_dev_attrs(struct binary_encoder *enc,
+				 const struct iio_dev_attrs *attrs)
+{
+	unsigned int i;
+
+	binary_put_varint(&enc->body, attrs->num);
+
+	for (i = 0; i < attrs->num; i++)
+		binary_put_string(enc, attrs->names[i]);
+}
+
+static void binary_put_channel(struct binary_encoder *enc,
+			       const struct iio_channel *chn)
+{
+	const struct iio_data_format *fmt = &chn->format;
+	unsigned int i, flags = 0;
+	uint64_t scale;
+	char bytes[8];
+
+	binary_put_string(enc, chn->id);
+	binary_put_string(enc, chn->name);
+
+	if (chn->is_output)
+		flags |= BINARY_CHN_OUTPUT;
+	if (chn->is_scan_element)
+		flags |= BINARY_CHN_SCAN_ELEMENT;
+	if (fmt->is_be)
+		flags |= BINARY_CHN_BE;
+	if (fmt->is_signed)
+		flags |= BINARY_CHN_SIGNED;
+	if (fmt->is_fully_defined)
+		flags |= BINARY_CHN_FULLY_DEFINED;
+	if (fmt->with_scale)
+		flags |= BINARY_CHN_WITH_SCALE;
+
+	binary_put_varint(&enc->body, flags);
+
+	/* Like in the XML, only scan elements have an index and a format */
+	if (chn->is_scan_element) {
+		binary_put_varint(&enc->body, (uint64_t) chn->index);
+		binary_put_varint(&enc->body, fmt->length);
+		binary_put_varint(&enc->body, fmt->bits);
+		binary_put_varint(&enc->body, fmt->shift);
+		binary_put_varint(&enc->body, fmt->repeat);
+
+		if (fmt->with_scale) {
+			memcpy(&scale, &fmt->scale, sizeof(scale));
+
+			for (i = 0; i < sizeof(bytes); i++)
+				bytes[i] = (char) (scale >> (56 - 8 * i));
+
+			iio_strbuf_append(&enc->body, bytes, sizeof(bytes));
+		}
+	}
+
+	binary_put_varint(&enc->body, chn->nb_attrs);
+
+	for (i = 0; i < chn->nb_attrs; i++) {
+		binary_put_string(enc, chn->attrs[i].name);
+		binary_put_string(enc, chn->attrs[i].filename);
+	}
+}
+
+static void binary_put_device(struct binary_encoder *enc,
+			      const struct iio_device *dev)
+{
+	unsigned int i;
+
+	binary_put_string(enc, dev->id);
+	binary_put_string(enc, dev->name);
+	binary_put_string(enc, dev->label);
+
+	binary_put_varint(&enc->body, dev->nb_channels);
+
+	for (i = 0; i < dev->nb_channels; i++)
+		binary_put_channel(enc, dev->channels[i]);
+
+	binary_put_dev_attrs(enc, &dev->attrs);
+	binary_put_dev_attrs(enc, &dev->buffer_attrs);
+	binary_put_dev_attrs(enc, &dev->debug_attrs);
+}
+
+ssize_t iio_context_get_binary(const struct iio_context *ctx,
+			       void *dst, size_t len)
+{
+	struct binary_encoder enc = { 0 };
+	struct iio_strbuf head = { 0 };
+	unsigned int i, major, minor;
+	char git_tag[8];
+	size_t slen;
+	ssize_t ret;
+
+	ret = iio_context_get_version(ctx, &major, &minor, git_tag);
+	if (ret < 0)
+		return ret;
+
+	binary_put_string(&enc, ctx->description);
+	binary_put_varint(&enc.body, major);
+	binary_put_varint(&enc.body, minor);
+	binary_put_string(&enc, git_tag);
+
+	binary_put_varint(&enc.body, ctx->nb_attrs);
+
+	for (i = 0; i < ctx->nb_attrs; i++) {
+		binary_put_string(&enc, ctx->attrs[i]);
+		binary_put_string(&enc, ctx->values[i]);
+	}
+
+	binary_put_varint(&enc.body, ctx->nb_devices);
+
+	for (i = 0; i < ctx->nb_devices; i++)
+		binary_put_device(&enc, ctx->devices[i]);
+
+	/* The string table goes first, so that the decoder can resolve the
+	 * references as it reads the context */
+	iio_strbuf_append(&head, BINARY_MAGIC, sizeof(BINARY_MAGIC) - 1);
+	binary_put_varint(&head, BINARY_VERSION);
+	binary_put_varint(&head, enc.nb_strings);
+
+	for (i = 0; i < enc.nb_strings; i++) {
+		slen = strlen(enc.strings[i]);
+		binary_put_varint(&head, slen);
+		iio_strbuf_append(&head, enc.strings[i], slen);
+	}
+
+	ret = head.err ? head.err : enc.body.err;
+	if (ret < 0)
+		goto out_free;
+
+	ret = (ssize_t) (head.len + enc.body.len);
+
+	if (dst) {
+		if (len < (size_t) ret) {
+			ret = -ERANGE;
+			goto out_free;
+		}
+
+		memcpy(dst, head.str, head.len);
+		memcpy((char *) dst + head.len, enc.body.str, enc.body.len);
+	}
+
+out_free:
+	free(head.str);
+	free(enc.body.str);
+	free(enc.strings);
+	free(enc.slots);
+	return ret;
+}
+
+struct binary_string {
+	const char *ptr;
+	size_t len;
+	char *interned;
+};
+
+struct binary_decoder {
+	const uint8_t *ptr, *end;
+	struct iio_arena *arena;
+
+	struct binary_string *strings;
+	size_t nb_strings;
+
+	/* The first error is kept, and turns the following reads into
+	 * no-ops */
+	int err;
+};
+
+static uint64_t binary_get_varint(struct binary_decoder *dec)
+{
+	uint64_t val = 0;
+	unsigned int shift;
+	uint8_t byte;
+
+	for (shift = 0; !dec->err; shift += 7) {
+		if (dec->ptr == dec->end || shift > 63) {
+			dec->err = -EINVAL;
+			break;
+		}
+
+		byte = *dec->ptr++;
+		val |= (uint64_t) (byte & 0x7f) << shift;
+
+		if (!(byte & 0x80))
+			return val;
+	}
+
+	return 0;
+}
+
+/* Reads a number of elements, each one using at least one byte, so that a
+ * corrupted count cannot trigger a huge allocation */
+static unsigned int binary_get_count(struct binary_decoder *dec)
+{
+	uint64_t val = binary_get_varint(dec);
+
+	if (val > (uint64_t) (dec->end - dec->ptr)) {
+		dec->err = -EINVAL;
+		return 0;
+	}
+
+	return (unsigned int) val;
+}
+
+static struct binary_string * binary_get_string(struct binary_decoder *dec)
+{
+	uint64_t idx = binary_get_varint(dec);
+
+	if (dec->err || !idx)
+		return NULL;
+
+	if (idx > dec->nb_strings) {
+		dec->err = -EINVAL;
+		return NULL;
+	}
+
+	return &dec->strings[idx - 1];
+}
+
+/* Returns the string stored in the arena of the context */
+static char * binary_get_interned(struct binary_decoder *dec)
+{
+	struct binary_string *str = binary_get_string(dec);
+
+	if (!str)
+		return NULL;
+
+	if (!str->interned) {
+		str->interned = iio_arena_intern_len(dec->arena,
+						     str->ptr, str->len);
+		if (!str->interned)
+			dec->err = -ENOMEM;
+	}
+
+	return str->interned;
+}
+
+static void binary_get_dev_attrs(struct binary_decoder *dec,
+				 struct iio_dev_attrs *attrs)
+{
+	unsigned int i, nb = binary_get_count(dec);
+
+	if (dec->err || !nb)
+		return;
+
+	attrs->names = iio_arena_zalloc(dec->arena, nb * sizeof(*attrs->names));
+	if (!attrs->names) {
+		dec->err = -ENOMEM;
+		return;
+	}
+
+	for (i = 0; i < nb && !dec->err; i++) {
+		attrs->names[i] = binary_get_interned(dec);
+		if (attrs->names[i])
+			attrs->num++;
+		else
+			dec->err = dec->err ? dec->err : -EINVAL;
+	}
+}
+
+static void binary_get_format(struct binary_decoder *dec,
+			      struct iio_channel *chn, unsigned int flags)
+{
+	struct iio_data_format *fmt = &chn->format;
+	uint64_t scale = 0;
+	unsigned int i;
+
+	fmt->is_be = !!(flags & BINARY_CHN_BE);
+	fmt->is_signed = !!(flags & BINARY_CHN_SIGNED);
+	fmt->is_fully_defined = !!(flags & BINARY_CHN_FULLY_DEFINED);
+	fmt->with_scale = !!(flags & BINARY_CHN_WITH_SCALE);
+
+	chn->index = (long) binary_get_varint(dec);
+	fmt->length = (unsigned int) binary_get_varint(dec);
+	fmt->bits = (unsigned int) binary_get_varint(dec);
+	fmt->shift = (unsigned int) binary_get_varint(dec);
+	fmt->repeat = (unsigned int) binary_get_varint(dec);
+
+	if (fmt->with_scale && !dec->err) {
+		if (dec->end - dec->ptr < 8) {
+			dec->err = -EINVAL;
+			return;
+		}
+
+		for (i = 0; i < 8; i++)
+			scale = (scale << 8) | *dec->ptr++;
+
+		memcpy(&fmt->scale, &scale, sizeof(fmt->scale));
+	}
+}
+
+static struct iio_channel * binary_get_channel(struct binary_decoder *dec,
+					       struct iio_device *dev)
+{
+	struct iio_channel *chn;
+	unsigned int i, nb, flags;
+
+	chn = iio_arena_zalloc(dec->arena, sizeof(*chn));
+	if (!chn) {
+		dec->err = -ENOMEM;
+		return NULL;
+	}
+
+	chn->dev = dev;
+	chn->index = -ENOENT;
+
+	chn->id = binary_get_interned(dec);
+	chn->name = binary_get_interned(dec);
+
+	flags = (unsigned int) binary_get_varint(dec);
+	chn->is_output = !!(flags & BINARY_CHN_OUTPUT);
+	chn->is_scan_element = !!(flags & BINARY_CHN_SCAN_ELEMENT);
+
+	if (chn->is_scan_element)
+		binary_get_format(dec, chn, flags);
+
+	nb = binary_get_count(dec);
+	if (nb && !dec->err) {
+		chn->attrs = iio_arena_zalloc(dec->arena,
+					      nb * sizeof(*chn->attrs));
+		if (!chn->attrs)
+			dec->err = -ENOMEM;
+	}
+
+	for (i = 0; i < nb && !dec->err; i++) {
+		chn->attrs[i].name = binary_get_interned(dec);
+		chn->attrs[i].filename = binary_get_interned(dec);
+		chn->nb_attrs++;
+
+		if (!chn->attrs[i].name && !dec->err)
+			dec->err = -EINVAL;
+	}
+
+	if (!chn->id && !dec->err)
+		dec->err = -EINVAL;
+
+	if (dec->err)
+		return NULL;
+
+	iio_channel_init_finalize(chn);
+
+	return chn;
+}
+
+static struct iio_device * binary_get_device(struct binary_decoder *dec,
+					     struct iio_context *ctx)
+{
+	struct iio_device *dev;
+	unsigned int nb;
+
+	dev = iio_arena_zalloc(dec->arena, sizeof(*dev));
+	if (!dev) {
+		dec->err = -ENOMEM;
+		return NULL;
+	}
+
+	dev->ctx = ctx;
+
+	dev->id = binary_get_interned(dec);
+	dev->name = binary_get_interned(dec);
+	dev->label = binary_get_interned(dec);
+
+	if (!dev->id && !dec->err)
+		dec->err = -EINVAL;
+
+	nb = binary_get_count(dec);
+	if (nb && !dec->err) {
+		dev->channels = iio_arena_zalloc(dec->arena,
+						 nb * sizeof(*dev->channels));
+		if (!dev->channels)
+			dec->err = -ENOMEM;
+	}
+
+	while (dev->nb_channels < nb && !dec->err) {
+		dev->channels[dev->nb_channels] = binary_get_channel(dec, dev);
+		if (dev->channels[dev->nb_channels])
+			dev->nb_channels++;
+	}
+
+	binary_get_dev_attrs(dec, &dev->attrs);
+	binary_get_dev_attrs(dec, &dev->buffer_attrs);
+	binary_get_dev_attrs(dec, &dev->debug_attrs);
+
+	dev->words = (dev->nb_channels + 31) / 32;
+	if (dev->words && !dec->err) {
+		dev->mask = iio_arena_zalloc(dec->arena,
+					     dev->words * sizeof(*dev->mask));
+		if (!dev->mask)
+			dec->err = -ENOMEM;
+	}
+
+	if (dec->err)
+		return NULL;
+
+	return dev;
+}
+
+static int binary_get_string_table(struct binary_decoder *dec)
+{
+	size_t i, nb = binary_get_count(dec);
+	uint64_t len;
+
+	if (dec->err)
+		return dec->err;
+
+	dec->strings = calloc(nb ? nb : 1, sizeof(*dec->strings));
+	if (!dec->strings)
+		return -ENOMEM;
+
+	for (i = 0; i < nb; i++) {
+		len = binary_get_varint(dec);
+		if (dec->err)
+			return dec->err;
+
+		if (len > (uint64_t) (dec->end - dec->ptr) ||
+		    memchr(dec->ptr, '\0', (size_t) len))
+			return -EINVAL;
+
+		dec->strings[i].ptr = (const char *) dec->ptr;
+		dec->strings[i].len = (size_t) len;
+		dec->ptr += len;
+	}
+
+	dec->nb_strings = nb;
+
+	return 0;
+}
+
+static int binary_populate_context(struct binary_decoder *dec,
+				   struct iio_context *ctx)
+{
+	struct binary_string *key, *value;
+	struct iio_device *dev;
+	char *str_key, *str_value;
+	unsigned int i, nb;
+	int ret;
+
+	nb = binary_get_count(dec);
+
+	for (i = 0; i < nb && !dec->err; i++) {
+		key = binary_get_string(dec);
+		value = binary_get_string(dec);
+		if (dec->err)
+			break;
+
+		if (!key || !value)
+			return -EINVAL;
+
+		str_key = iio_strndup(key->ptr, key->len);
+		str_value = iio_strndup(value->ptr, value->len);
+
+		if (str_key && str_value)
+			ret = iio_context_add_attr(ctx, str_key, str_value);
+		else
+			ret = -ENOMEM;
+
+		free(str_key);
+		free(str_value);
+
+		if (ret < 0)
+			return ret;
+	}
+
+	nb = binary_get_count(dec);
+
+	for (i = 0; i < nb && !dec->err; i++) {
+		dev = binary_get_device(dec, ctx);
+		if (!dev)
+			break;
+
+		ret = iio_context_add_device(ctx, dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (dec->err)
+		return dec->err;
+
+	return iio_context_init(ctx);
+}
+
+static struct iio_context * binary_clone(const struct iio_context *ctx)
+{
+	return iio_context_create_shared(ctx);
+}
+
+static const struct iio_backend_ops binary_ops = {
+	.clone = binary_clone,
+};
+
+static const struct iio_backend binary_backend = {
+	.api_version = IIO_BACKEND_API_V1,
+	.name = "binary",
+	.ops = &binary_ops,
+};
+
+struct iio_context * binary_create_context_mem(const void *data, size_t len)
+{
+	struct binary_decoder dec = {
+		.ptr = data,
+		.end = (const uint8_t *) data + len,
+	};
+	struct binary_string *description, *git_tag;
+	struct iio_context *ctx = NULL;
+	char *str = NULL;
+	unsigned int major, minor;
+	uint64_t version;
+	int ret = -EINVAL;
+
+	if (len < sizeof(BINARY_MAGIC) - 1 ||
+	    memcmp(data, BINARY_MAGIC, sizeof(BINARY_MAGIC) - 1)) {
+		IIO_ERROR("Invalid binary context\n");
+		goto err_set_errno;
+	}
+
+	dec.ptr += sizeof(BINARY_MAGIC) - 1;
+
+	version = binary_get_varint(&dec);
+	if (!dec.err && version != BINARY_VERSION) {
+		IIO_ERROR("Unsupported binary context version %u\n",
+			  (unsigned int) version);
+		ret = -EPROTONOSUPPORT;
+		goto err_set_errno;
+	}
+
+	ret = binary_get_string_table(&dec);
+	if (ret < 0)
+		goto err_free_strings;
+
+	description = binary_get_string(&dec);
+	major = (unsigned int) binary_get_varint(&dec);
+	minor = (unsigned int) binary_get_varint(&dec);
+	git_tag = binary_get_string(&dec);
+
+	ret = dec.err;
+	if (ret < 0)
+		goto err_free_strings;
+
+	if (description) {
+		str = iio_strndup(description->ptr, description->len);
+		if (!str) {
+			ret = -ENOMEM;
+			goto err_free_strings;
+		}
+	}
+
+	ctx = iio_context_create_from_backend(&binary_backend, str);
+	free(str);
+	if (!ctx) {
+		ret = -errno;
+		goto err_free_strings;
+	}
+
+	if (git_tag) {
+		ctx->major = major;
+		ctx->minor = minor;
+
+		ctx->git_tag = iio_strndup(git_tag->ptr, git_tag->len);
+		if (!ctx->git_tag) {
+			ret = -ENOMEM;
+			goto err_destroy_context;
+		}
+	}
+
+	dec.arena = ctx->arena;
+
+	ret = binary_populate_context(&dec, ctx);
+	if (ret < 0)
+		goto err_destroy_context;
+
+	free(dec.strings);
+
+	return ctx;
+
+err_destroy_context:
+	iio_context_destroy(ctx);
+err_free_strings:
+	free(dec.strings);
+err_set_errno:
+	errno = -ret;
+	return NULL;
+}
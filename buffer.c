@@ -12,6 +12,20 @@
 #include <errno.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <time.h>
+#endif
+
+/* Bounds of the number of kernel blocks chosen by the automatic tuning */
+#define TUNING_MIN_NB_BLOCKS 2
+#define TUNING_MAX_NB_BLOCKS 64
+
+/* Number of refills after which the suggested number of blocks is updated */
+#define TUNING_WINDOW 16
+
 static bool device_is_high_speed(const struct iio_device *dev)
 {
 	/* Little trick: We call the backend's get_buffer() function, which is
@@ -47,6 +61,10 @@ struct iio_buffer * iio_device_create_buffer(const struct iio_device *dev,
 	buf->dev_sample_size = (unsigned int) sample_size;
 	buf->length = sample_size * samples_count;
 	buf->dev = dev;
+	buf->realtime = false;
+	buf->rt_hook = NULL;
+	buf->rt_hook_data = NULL;
+	buf->block_ns = 0;
 	buf->mask = calloc(dev->words, sizeof(*buf->mask));
 	if (!buf->mask) {
 		ret = -ENOMEM;
@@ -101,8 +119,173 @@ err_set_errno:
 	return NULL;
 }
 
+static int device_get_sampling_frequency(const struct iio_device *dev,
+		double *freq)
+{
+	const struct iio_channel *chn;
+	unsigned int i;
+
+	if (iio_device_find_attr(dev, "sampling_frequency"))
+		return iio_device_attr_read_double(dev,
+				"sampling_frequency", freq);
+
+	if (iio_device_find_buffer_attr(dev, "sampling_frequency"))
+		return iio_device_buffer_attr_read_double(dev,
+				"sampling_frequency", freq);
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		chn = dev->channels[i];
+
+		if (iio_channel_is_enabled(chn) &&
+		    iio_channel_find_attr(chn, "sampling_frequency"))
+			return iio_channel_attr_read_double(chn,
+					"sampling_frequency", freq);
+	}
+
+	return -ENOENT;
+}
+
+struct iio_buffer * iio_device_create_tuned_buffer(const struct iio_device *dev,
+		const struct iio_buffer_tuning *tuning, bool cyclic)
+{
+	ssize_t sample_size = iio_device_get_sample_size(dev);
+	unsigned int nb_blocks, min_nb_blocks;
+	double freq, samples, block_us;
+	struct iio_buffer *buf;
+	size_t samples_count;
+	int ret = -EINVAL;
+
+	if (!tuning->latency_us || !sample_size)
+		goto err_set_errno;
+
+	if (sample_size < 0) {
+		ret = (int) sample_size;
+		goto err_set_errno;
+	}
+
+	ret = device_get_sampling_frequency(dev, &freq);
+	if (ret < 0)
+		goto err_set_errno;
+
+	ret = -EINVAL;
+	if (!(freq > 0.0))
+		goto err_set_errno;
+
+	/* Enough samples per block to fill it within the target latency */
+	samples = freq * (double) tuning->latency_us / 1000000.0;
+	if (samples >= (double) (SIZE_MAX / (size_t) sample_size))
+		goto err_set_errno;
+
+	samples_count = (size_t) samples;
+	if (!samples_count)
+		samples_count = 1;
+
+	/* Enough blocks to cover the headroom, in addition to the one being
+	 * processed by the application */
+	block_us = (double) samples_count * 1000000.0 / freq;
+	min_nb_blocks = (unsigned int) ((double) tuning->headroom_us / block_us);
+	if ((double) min_nb_blocks * block_us < (double) tuning->headroom_us)
+		min_nb_blocks++;
+	min_nb_blocks++;
+
+	if (min_nb_blocks < TUNING_MIN_NB_BLOCKS)
+		min_nb_blocks = TUNING_MIN_NB_BLOCKS;
+	if (min_nb_blocks > TUNING_MAX_NB_BLOCKS)
+		min_nb_blocks = TUNING_MAX_NB_BLOCKS;
+
+	nb_blocks = min_nb_blocks;
+	if (tuning->min_nb_blocks > nb_blocks)
+		nb_blocks = tuning->min_nb_blocks;
+	if (nb_blocks > TUNING_MAX_NB_BLOCKS)
+		nb_blocks = TUNING_MAX_NB_BLOCKS;
+
+	/* Not every backend lets the application choose the number of blocks */
+	ret = iio_device_set_kernel_buffers_count(dev, nb_blocks);
+	if (ret < 0 && ret != -ENOSYS)
+		goto err_set_errno;
+
+	buf = iio_device_create_buffer(dev, samples_count, cyclic);
+	if (!buf)
+		return NULL;
+
+	buf->tuning.sampling_frequency = freq;
+	buf->tuning.sample_size = (size_t) sample_size;
+	buf->tuning.samples_count = samples_count;
+	buf->tuning.nb_blocks = nb_blocks;
+	buf->tuning.suggested_nb_blocks = nb_blocks;
+	buf->min_nb_blocks = min_nb_blocks;
+	buf->block_ns = (uint64_t) (block_us * 1000.0);
+	buf->window_count = 0;
+
+	return buf;
+
+err_set_errno:
+	errno = -ret;
+	return NULL;
+}
+
+int iio_buffer_get_tuning(const struct iio_buffer *buffer,
+		struct iio_buffer_tuning_result *result)
+{
+	if (!buffer->block_ns)
+		return -EINVAL;
+
+	*result = buffer->tuning;
+	return 0;
+}
+
+static uint64_t buffer_get_time_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, freq;
+
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+
+	return (uint64_t) ((double) count.QuadPart * 1000000000.0 /
+			   (double) freq.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+static void buffer_tuning_update(struct iio_buffer *buffer, uint64_t wait_ns)
+{
+	unsigned int *nb_blocks = &buffer->tuning.suggested_nb_blocks;
+
+	if (!buffer->window_count || wait_ns < buffer->window_min_ns)
+		buffer->window_min_ns = wait_ns;
+	if (!buffer->window_count || wait_ns > buffer->window_max_ns)
+		buffer->window_max_ns = wait_ns;
+
+	if (++buffer->window_count < TUNING_WINDOW)
+		return;
+
+	buffer->window_count = 0;
+
+	if (buffer->window_max_ns < buffer->block_ns / 8) {
+		/* The samples were always ready: the application is lagging
+		 * behind, and the kernel queue does not get a chance to drain */
+		*nb_blocks *= 2;
+		if (*nb_blocks > TUNING_MAX_NB_BLOCKS)
+			*nb_blocks = TUNING_MAX_NB_BLOCKS;
+	} else if (buffer->window_min_ns > buffer->block_ns / 2) {
+		/* The application always waited for most of a block: the
+		 * kernel never queued more than one block */
+		if (*nb_blocks > buffer->min_nb_blocks)
+			(*nb_blocks)--;
+	}
+}
+
 void iio_buffer_destroy(struct iio_buffer *buffer)
 {
+	if (buffer->realtime)
+		(void) iio_buffer_set_realtime_mode(buffer, false);
+
 	iio_device_close(buffer->dev);
 	if (!buffer->dev_is_high_speed)
 		free(buffer->buffer);
@@ -120,12 +303,135 @@ int iio_buffer_set_blocking_mode(struct iio_buffer *buffer, bool blocking)
 	return iio_device_set_blocking_mode(buffer->dev, blocking);
 }
 
+int iio_buffer_set_wait_policy(struct iio_buffer *buffer,
+		enum iio_buffer_wait_policy policy, unsigned int spin_us)
+{
+	const struct iio_backend_ops *ops = buffer->dev->ctx->ops;
+
+	if (policy > IIO_BUFFER_WAIT_HYBRID)
+		return -EINVAL;
+
+	if (ops->set_wait_policy)
+		return ops->set_wait_policy(buffer->dev, policy, spin_us);
+	else
+		return -ENOSYS;
+}
+
+int iio_buffer_get_wait_stats(const struct iio_buffer *buffer,
+		struct iio_buffer_wait_stats *stats)
+{
+	const struct iio_backend_ops *ops = buffer->dev->ctx->ops;
+
+	if (ops->get_wait_stats)
+		return ops->get_wait_stats(buffer->dev, stats);
+	else
+		return -ENOSYS;
+}
+
+int iio_buffer_get_stream_stats(const struct iio_buffer *buffer,
+		struct iio_buffer_stream_stats *stats)
+{
+	const struct iio_backend_ops *ops = buffer->dev->ctx->ops;
+
+	if (ops->get_stream_stats)
+		return ops->get_stream_stats(buffer->dev, stats);
+	else
+		return -ENOSYS;
+}
+
+static int buffer_lock_memory(struct iio_buffer *buffer, bool lock)
+{
+#ifdef _WIN32
+	return -ENOSYS;
+#else
+	int ret;
+
+	/* The blocks of high-speed devices are locked by the backend */
+	if (buffer->dev_is_high_speed)
+		return 0;
+
+	if (lock)
+		ret = mlock(buffer->buffer, buffer->length);
+	else
+		ret = munlock(buffer->buffer, buffer->length);
+
+	return ret ? -errno : 0;
+#endif
+}
+
+int iio_buffer_set_compression(struct iio_buffer *buffer,
+		const char *codec, int level)
+{
+	const struct iio_backend_ops *ops = buffer->dev->ctx->ops;
+
+	if (!ops->set_compression)
+		return -ENOSYS;
+
+	return ops->set_compression(buffer->dev, codec, level);
+}
+
+int iio_buffer_flush(struct iio_buffer *buffer)
+{
+	const struct iio_backend_ops *ops = buffer->dev->ctx->ops;
+
+	/* The other backends are done with the samples once pushed */
+	if (!ops->flush)
+		return 0;
+
+	return ops->flush(buffer->dev);
+}
+
+int iio_buffer_set_realtime_mode(struct iio_buffer *buffer, bool enable)
+{
+	const struct iio_backend_ops *ops = buffer->dev->ctx->ops;
+	int ret;
+
+	if (buffer->realtime == enable)
+		return 0;
+
+	if (!ops->set_realtime_mode)
+		return -ENOSYS;
+
+	ret = buffer_lock_memory(buffer, enable);
+	if (ret < 0 && enable)
+		return ret;
+
+	ret = ops->set_realtime_mode(buffer->dev, buffer->length, enable);
+	if (ret < 0 && enable) {
+		(void) buffer_lock_memory(buffer, false);
+		return ret;
+	}
+
+	buffer->realtime = enable;
+	return 0;
+}
+
+void iio_buffer_set_realtime_hook(struct iio_buffer *buffer,
+		void (*hook)(const struct iio_buffer *buf, bool enter, void *d),
+		void *data)
+{
+	buffer->rt_hook = hook;
+	buffer->rt_hook_data = data;
+}
+
+static void buffer_rt_hook(const struct iio_buffer *buffer, bool enter)
+{
+	if (buffer->realtime && buffer->rt_hook)
+		buffer->rt_hook(buffer, enter, buffer->rt_hook_data);
+}
+
 ssize_t iio_buffer_refill(struct iio_buffer *buffer)
 {
 	ssize_t read;
 	const struct iio_device *dev = buffer->dev;
+	uint64_t start = 0;
 	ssize_t ret;
 
+	buffer_rt_hook(buffer, true);
+
+	if (buffer->block_ns)
+		start = buffer_get_time_ns();
+
 	if (buffer->dev_is_high_speed) {
 		read = dev->ctx->ops->get_buffer(dev, &buffer->buffer,
 				buffer->length, buffer->mask, dev->words);
@@ -134,13 +440,21 @@ ssize_t iio_buffer_refill(struct iio_buffer *buffer)
 				buffer->mask, dev->words);
 	}
 
+	if (read >= 0 && buffer->block_ns)
+		buffer_tuning_update(buffer, buffer_get_time_ns() - start);
+
 	if (read >= 0) {
 		buffer->data_length = read;
 		ret = iio_device_get_sample_size_mask(dev, buffer->mask, dev->words);
-		if (ret < 0)
-			return ret;
+		if (ret < 0) {
+			read = ret;
+			goto out_rt_hook;
+		}
 		buffer->sample_size = (unsigned int)ret;
 	}
+
+out_rt_hook:
+	buffer_rt_hook(buffer, false);
 	return read;
 }
 
@@ -149,6 +463,8 @@ ssize_t iio_buffer_push(struct iio_buffer *buffer)
 	const struct iio_device *dev = buffer->dev;
 	ssize_t ret;
 
+	buffer_rt_hook(buffer, true);
+
 	if (buffer->dev_is_high_speed) {
 		void *buf;
 		ret = dev->ctx->ops->get_buffer(dev, &buf,
@@ -177,6 +493,7 @@ ssize_t iio_buffer_push(struct iio_buffer *buffer)
 
 out_reset_data_length:
 	buffer->data_length = buffer->length;
+	buffer_rt_hook(buffer, false);
 	return ret;
 }
 
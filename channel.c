@@ -212,30 +212,23 @@ void iio_channel_init_finalize(struct iio_channel *chn)
 	}
 }
 
-static ssize_t iio_snprintf_chan_attr_xml(char *str, ssize_t len,
-					  struct iio_channel_attr *attr)
+static void iio_channel_write_attr_xml(struct iio_strbuf *sb,
+				      const struct iio_channel_attr *attr)
 {
-	ssize_t ret, alen = 0;
+	iio_strbuf_puts(sb, "<attribute name=\"");
+	iio_strbuf_puts(sb, attr->name);
 
-	if (!attr->filename)
-		return iio_snprintf(str, len, "<attribute name=\"%s\" />", attr->name);
-
-	ret = iio_snprintf(str, len, "<attribute name=\"%s\" ", attr->name);
-	if (ret < 0)
-		return ret;
-
-	iio_update_xml_indexes(ret, &str, &len, &alen);
-
-	ret = iio_xml_print_and_sanitized_param(str, len, "filename=\"",
-						attr->filename, "\" />");
-	if (ret < 0)
-		return ret;
-
-	return alen + ret;
+	if (attr->filename) {
+		iio_strbuf_puts(sb, "\" filename=\"");
+		iio_strbuf_puts_sanitized(sb, attr->filename);
+		iio_strbuf_puts(sb, "\" />");
+	} else {
+		iio_strbuf_puts(sb, "\" />");
+	}
 }
 
-static ssize_t iio_snprintf_scan_element_xml(char *str, ssize_t len,
-					     const struct iio_channel *chn)
+static void iio_channel_write_scan_element_xml(struct iio_strbuf *sb,
+					       const struct iio_channel *chn)
 {
 	char processed = (chn->format.is_fully_defined ? 'A' - 'a' : 0);
 	char repeat[12] = "", scale[48] = "";
@@ -246,7 +239,7 @@ static ssize_t iio_snprintf_scan_element_xml(char *str, ssize_t len,
 	if (chn->format.with_scale)
 		iio_snprintf(scale, sizeof(scale), "scale=\"%f\" ", chn->format.scale);
 
-	return iio_snprintf(str, len,
+	iio_strbuf_printf(sb,
 			"<scan-element index=\"%li\" format=\"%ce:%c%u/%u%s&gt;&gt;%u\" %s/>",
 			chn->index, chn->format.is_be ? 'b' : 'l',
 			chn->format.is_signed ? 's' + processed : 'u' + processed,
@@ -254,50 +247,31 @@ static ssize_t iio_snprintf_scan_element_xml(char *str, ssize_t len,
 			chn->format.shift, scale);
 }
 
-ssize_t iio_snprintf_channel_xml(char *ptr, ssize_t len,
-				 const struct iio_channel *chn)
+void iio_channel_write_xml(struct iio_strbuf *sb,
+			   const struct iio_channel *chn)
 {
-	ssize_t ret, alen = 0;
 	unsigned int i;
 
-
-	ret = iio_xml_print_and_sanitized_param(ptr, len, "<channel id=\"",
-						chn->id, "\"");
-	if (ret < 0)
-		return ret;
-	iio_update_xml_indexes(ret, &ptr, &len, &alen);
+	iio_strbuf_puts(sb, "<channel id=\"");
+	iio_strbuf_puts_sanitized(sb, chn->id);
+	iio_strbuf_puts(sb, "\"");
 
 	if (chn->name) {
-		ret = iio_snprintf(ptr, len, " name=\"%s\"", chn->name);
-		if (ret < 0)
-			return ret;
-		iio_update_xml_indexes(ret, &ptr, &len, &alen);
+		iio_strbuf_puts(sb, " name=\"");
+		iio_strbuf_puts(sb, chn->name);
+		iio_strbuf_puts(sb, "\"");
 	}
 
-	ret = iio_snprintf(ptr, len, " type=\"%s\" >", chn->is_output ? "output" : "input");
-	if (ret < 0)
-		return ret;
-	iio_update_xml_indexes(ret, &ptr, &len, &alen);
-
-	if (chn->is_scan_element) {
-		ret = iio_snprintf_scan_element_xml(ptr, len, chn);
-		if (ret < 0)
-			return ret;
-		iio_update_xml_indexes(ret, &ptr, &len, &alen);
-	}
+	iio_strbuf_puts(sb, chn->is_output ? " type=\"output\" >"
+			: " type=\"input\" >");
 
-	for (i = 0; i < chn->nb_attrs; i++) {
-		ret = iio_snprintf_chan_attr_xml(ptr, len, &chn->attrs[i]);
-		if (ret < 0)
-			return ret;
-		iio_update_xml_indexes(ret, &ptr, &len, &alen);
-	}
+	if (chn->is_scan_element)
+		iio_channel_write_scan_element_xml(sb, chn);
 
-	ret = iio_snprintf(ptr, len, "</channel>");
-	if (ret < 0)
-		return ret;
+	for (i = 0; i < chn->nb_attrs; i++)
+		iio_channel_write_attr_xml(sb, &chn->attrs[i]);
 
-	return alen + ret;
+	iio_strbuf_puts(sb, "</channel>");
 }
 
 const char * iio_channel_get_id(const struct iio_channel *chn)
@@ -349,6 +323,11 @@ iio_channel_do_find_attr(const struct iio_channel *chn, const char *name)
 {
 	unsigned int i;
 
+	if (chn->dev->ctx->hash) {
+		return iio_hash_find(chn->dev->ctx->hash, chn,
+				     IIO_HASH_CHANNEL_ATTR, name);
+	}
+
 	for (i = 0; i < chn->nb_attrs; i++) {
 		const char *attr = chn->attrs[i].name;
 		if (!strcmp(attr, name))
@@ -459,19 +438,6 @@ void iio_channel_disable(struct iio_channel *chn)
 		CLEAR_BIT(chn->dev->mask, chn->number);
 }
 
-void free_channel(struct iio_channel *chn)
-{
-	size_t i;
-	for (i = 0; i < chn->nb_attrs; i++) {
-		free(chn->attrs[i].name);
-		free(chn->attrs[i].filename);
-	}
-	free(chn->attrs);
-	free(chn->name);
-	free(chn->id);
-	free(chn);
-}
-
 static void byte_swap(uint8_t *dst, const uint8_t *src, size_t len)
 {
 	size_t i;
@@ -687,18 +653,12 @@ size_t iio_channel_write(const struct iio_channel *chn,
 int iio_channel_attr_read_longlong(const struct iio_channel *chn,
 		const char *attr, long long *val)
 {
-	char *end, buf[1024];
-	long long value;
+	char buf[1024];
 	ssize_t ret = iio_channel_attr_read(chn, attr, buf, sizeof(buf));
 	if (ret < 0)
 		return (int) ret;
-
-	errno = 0;
-	value = strtoll(buf, &end, 0);
-	if (end == buf || errno == ERANGE)
-		return -EINVAL;
-	*val = value;
-	return 0;
+	else
+		return read_longlong(buf, val);
 }
 
 int iio_channel_attr_read_bool(const struct iio_channel *chn,
@@ -724,6 +684,68 @@ int iio_channel_attr_read_double(const struct iio_channel *chn,
 		return read_double(buf, val);
 }
 
+enum attr_value_type {
+	ATTR_VALUE_LONGLONG,
+	ATTR_VALUE_BOOL,
+	ATTR_VALUE_DOUBLE,
+};
+
+static int channels_attr_read_values(const struct iio_channel * const *chns,
+		const char * const *attrs, void *vals, size_t nb,
+		enum attr_value_type type)
+{
+	char buf[1024];
+	long long value;
+	int ret, err = 0;
+	size_t i;
+
+	for (i = 0; i < nb; i++) {
+		ret = (int) iio_channel_attr_read(chns[i], attrs[i],
+						  buf, sizeof(buf));
+		if (ret >= 0) {
+			switch (type) {
+			case ATTR_VALUE_LONGLONG:
+				ret = read_longlong(buf, &((long long *) vals)[i]);
+				break;
+			case ATTR_VALUE_BOOL:
+				ret = read_longlong(buf, &value);
+				if (!ret)
+					((bool *) vals)[i] = !!value;
+				break;
+			default:
+				ret = read_double(buf, &((double *) vals)[i]);
+				break;
+			}
+		}
+
+		if (ret < 0 && !err)
+			err = ret;
+	}
+
+	return err;
+}
+
+int iio_channels_attr_read_longlong(const struct iio_channel * const *chns,
+		const char * const *attrs, long long *vals, size_t nb)
+{
+	return channels_attr_read_values(chns, attrs, vals, nb,
+					 ATTR_VALUE_LONGLONG);
+}
+
+int iio_channels_attr_read_bool(const struct iio_channel * const *chns,
+		const char * const *attrs, bool *vals, size_t nb)
+{
+	return channels_attr_read_values(chns, attrs, vals, nb,
+					 ATTR_VALUE_BOOL);
+}
+
+int iio_channels_attr_read_double(const struct iio_channel * const *chns,
+		const char * const *attrs, double *vals, size_t nb)
+{
+	return channels_attr_read_values(chns, attrs, vals, nb,
+					 ATTR_VALUE_DOUBLE);
+}
+
 int iio_channel_attr_write_longlong(const struct iio_channel *chn,
 		const char *attr, long long val)
 {
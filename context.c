@@ -35,157 +35,51 @@ static const char xml_header[] = "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
 "<!ATTLIST buffer-attribute name CDATA #REQUIRED>"
 "]>";
 
-static ssize_t sanitize_xml(char *ptr, ssize_t len, const char *str)
-{
-	ssize_t count = 0;
-	ssize_t ret;
-
-	for (; *str; str++) {
-		switch(*str) {
-		case '&':
-			ret = iio_snprintf(ptr, len, "%s", "&amp;");
-			break;
-		case '<':
-			ret = iio_snprintf(ptr, len, "%s", "&lt;");
-			break;
-		case '>':
-			ret = iio_snprintf(ptr, len, "%s", "&gt;");
-			break;
-		case '\'':
-			ret = iio_snprintf(ptr, len, "%s", "&apos;");
-			break;
-		case '"':
-			ret = iio_snprintf(ptr, len, "%s", "&quot;");
-			break;
-		default:
-			ret = iio_snprintf(ptr, len, "%c", *str);
-			break;
-		}
-
-		if (ret < 0)
-			return ret;
-
-		iio_update_xml_indexes(ret, &ptr, &len, &count);
-	}
-
-	return count;
-}
-
-ssize_t iio_xml_print_and_sanitized_param(char *ptr, ssize_t len,
-					  const char *before, char *param,
-					  const char *after)
-{
-	ssize_t ret, alen = 0;
-
-	/* Print before */
-	ret = iio_snprintf(ptr, len, "%s", before);
-	if (ret < 0)
-		return ret;
-	iio_update_xml_indexes(ret, &ptr, &len, &alen);
-
-	/* Print param */
-	ret = sanitize_xml(ptr, len, param);
-	if (ret < 0)
-		return ret;
-	iio_update_xml_indexes(ret, &ptr, &len, &alen);
-
-	/* Print after */
-	ret = iio_snprintf(ptr, len, "%s", after);
-	if (ret < 0)
-		return ret;
-
-	return alen + ret;
-}
-
-static ssize_t iio_snprintf_context_xml(char *ptr, ssize_t len,
-					const struct iio_context *ctx)
+/* Returns a string containing the XML representation of this context,
+ * generated in a single pass */
+static char * iio_context_create_xml(const struct iio_context *ctx)
 {
-	ssize_t ret, alen = 0;
+	struct iio_strbuf sb = { 0 };
 	unsigned int i, major, minor;
 	char git_tag[64];
+	int ret;
 
 	ret = iio_context_get_version(ctx, &major, &minor, git_tag);
 	if (ret < 0)
-		return ret;
-
-	ret = iio_snprintf(ptr, len,
-			   "%s<context name=\"%s\" version-major=\"%u\" "
-			   "version-minor=\"%u\" version-git=\"%s\" ",
-			   xml_header, ctx->name, major, minor, git_tag);
-	if (ret < 0)
-		return ret;
+		return ERR_PTR(ret);
 
-	iio_update_xml_indexes(ret, &ptr, &len, &alen);
+	iio_strbuf_puts(&sb, xml_header);
+	iio_strbuf_printf(&sb, "<context name=\"%s\" version-major=\"%u\" "
+			  "version-minor=\"%u\" version-git=\"%s\" ",
+			  ctx->name, major, minor, git_tag);
 
 	if (ctx->description) {
-		ret = iio_xml_print_and_sanitized_param(ptr, len,
-							"description=\"",
-							ctx->description,
-							"\" >");
+		iio_strbuf_puts(&sb, "description=\"");
+		iio_strbuf_puts_sanitized(&sb, ctx->description);
+		iio_strbuf_puts(&sb, "\" >");
 	} else {
-		ret = iio_snprintf(ptr, len, ">");
+		iio_strbuf_puts(&sb, ">");
 	}
-	if (ret < 0)
-		return ret;
-
-	iio_update_xml_indexes(ret, &ptr, &len, &alen);
 
 	for (i = 0; i < ctx->nb_attrs; i++) {
-		ret = iio_snprintf(ptr, len,
-				   "<context-attribute name=\"%s\" ",
-				   ctx->attrs[i]);
-		if (ret < 0)
-			return ret;
-
-		iio_update_xml_indexes(ret, &ptr, &len, &alen);
-
-		ret = iio_xml_print_and_sanitized_param(ptr, len,
-							"value=\"",
-							ctx->values[i],
-							"\" />");
-		if (ret < 0)
-			return ret;
-
-		iio_update_xml_indexes(ret, &ptr, &len, &alen);
+		iio_strbuf_puts(&sb, "<context-attribute name=\"");
+		iio_strbuf_puts(&sb, ctx->attrs[i]);
+		iio_strbuf_puts(&sb, "\" value=\"");
+		iio_strbuf_puts_sanitized(&sb, ctx->values[i]);
+		iio_strbuf_puts(&sb, "\" />");
 	}
 
-	for (i = 0; i < ctx->nb_devices; i++) {
-		ret = iio_snprintf_device_xml(ptr, len, ctx->devices[i]);
-		if (ret < 0)
-			return ret;
-
-		iio_update_xml_indexes(ret, &ptr, &len, &alen);
-	}
-
-	ret = iio_snprintf(ptr, len, "</context>");
-	if (ret < 0)
-		return ret;
+	for (i = 0; i < ctx->nb_devices; i++)
+		iio_device_write_xml(&sb, ctx->devices[i]);
 
-	return alen + ret;
-}
+	iio_strbuf_puts(&sb, "</context>");
 
-/* Returns a string containing the XML representation of this context */
-static char * iio_context_create_xml(const struct iio_context *ctx)
-{
-	ssize_t len;
-	char *str;
-
-	len = iio_snprintf_context_xml(NULL, 0, ctx);
-	if (len < 0)
-		return ERR_PTR((int) len);
-
-	len++; /* room for terminating NULL */
-	str = malloc(len);
-	if (!str)
-		return ERR_PTR(-ENOMEM);
-
-	len = iio_snprintf_context_xml(str, len, ctx);
-	if (len < 0) {
-		free(str);
-		return ERR_PTR((int) len);
+	if (sb.err) {
+		free(sb.str);
+		return ERR_PTR(sb.err);
 	}
 
-	return str;
+	return sb.str;
 }
 
 struct iio_context * iio_context_create_from_backend(
@@ -207,10 +101,14 @@ struct iio_context * iio_context_create_from_backend(
 	}
 
 	ret = -ENOMEM;
+	ctx->arena = iio_arena_create(NULL);
+	if (!ctx->arena)
+		goto err_free_ctx;
+
 	if (backend->sizeof_context_pdata) {
 		ctx->pdata = zalloc(backend->sizeof_context_pdata);
 		if (!ctx->pdata)
-			goto err_free_ctx;
+			goto err_free_arena;
 	}
 
 	if (description) {
@@ -226,6 +124,8 @@ struct iio_context * iio_context_create_from_backend(
 
 err_free_pdata:
 	free(ctx->pdata);
+err_free_arena:
+	iio_arena_unref(ctx->arena);
 err_free_ctx:
 	free(ctx);
 	errno = -ret;
@@ -267,13 +167,16 @@ void iio_context_destroy(struct iio_context *ctx)
 	}
 	free(ctx->attrs);
 	free(ctx->values);
-	for (i = 0; i < ctx->nb_devices; i++)
-		free_device(ctx->devices[i]);
+	if (ctx->hash)
+		iio_hash_destroy(ctx->hash);
+
+	/* The devices, channels and their strings are stored in the arena */
 	free(ctx->devices);
 	free(ctx->xml);
 	free(ctx->description);
 	free(ctx->git_tag);
 	free(ctx->pdata);
+	iio_arena_unref(ctx->arena);
 	free(ctx);
 }
 
@@ -295,6 +198,10 @@ struct iio_device * iio_context_find_device(const struct iio_context *ctx,
 		const char *name)
 {
 	unsigned int i;
+
+	if (ctx->hash)
+		return iio_hash_find(ctx->hash, ctx, IIO_HASH_DEVICE, name);
+
 	for (i = 0; i < ctx->nb_devices; i++) {
 		struct iio_device *dev = ctx->devices[i];
 		if (!strcmp(dev->id, name) ||
@@ -339,10 +246,21 @@ static void reorder_channels(struct iio_device *dev)
 int iio_context_init(struct iio_context *ctx)
 {
 	unsigned int i;
+	int ret;
 
 	for (i = 0; i < ctx->nb_devices; i++)
 		reorder_channels(ctx->devices[i]);
 
+	/* The channels must be in their final order, so that the index
+	 * returns the same ones as the linear searches */
+	ctx->hash = iio_hash_create(ctx);
+	if (IS_ERR(ctx->hash)) {
+		ret = PTR_ERR(ctx->hash);
+
+		ctx->hash = NULL;
+		return ret;
+	}
+
 	if (!ctx->xml) {
 		ctx->xml = iio_context_create_xml(ctx);
 		if (IS_ERR(ctx->xml))
@@ -393,8 +311,8 @@ struct iio_context * iio_context_clone(const struct iio_context *ctx)
 
 struct iio_context * iio_create_context_from_uri(const char *uri)
 {
-	if (WITH_LOCAL_BACKEND && strcmp(uri, "local:") == 0) /* No address part */
-		return iio_create_local_context();
+	if (WITH_LOCAL_BACKEND && strncmp(uri, "local:", sizeof("local:") - 1) == 0)
+		return local_create_context_from_uri(uri);
 
 	if (WITH_XML_BACKEND && strncmp(uri, "xml:", sizeof("xml:") - 1) == 0)
 		return iio_create_xml_context(uri + sizeof("xml:") - 1);
@@ -555,3 +473,170 @@ int iio_context_add_attr(struct iio_context *ctx,
 	ctx->nb_attrs++;
 	return 0;
 }
+
+static int copy_dev_attrs(struct iio_arena *arena, struct iio_dev_attrs *dst,
+			  const struct iio_dev_attrs *src)
+{
+	if (!src->num)
+		return 0;
+
+	/* The names themselves are stored in the arena of the original */
+	dst->names = iio_arena_dup(arena, src->names,
+				   src->num * sizeof(*dst->names));
+	if (!dst->names)
+		return -ENOMEM;
+
+	dst->num = src->num;
+
+	return 0;
+}
+
+static struct iio_channel * copy_channel(struct iio_device *dev,
+					 const struct iio_channel *src)
+{
+	struct iio_arena *arena = dev->ctx->arena;
+	struct iio_channel *chn;
+
+	chn = iio_arena_dup(arena, src, sizeof(*chn));
+	if (!chn)
+		return NULL;
+
+	chn->dev = dev;
+	chn->pdata = NULL;
+	chn->userdata = NULL;
+
+	if (src->nb_attrs) {
+		chn->attrs = iio_arena_dup(arena, src->attrs,
+					   src->nb_attrs * sizeof(*chn->attrs));
+		if (!chn->attrs)
+			return NULL;
+	}
+
+	return chn;
+}
+
+static struct iio_device * copy_device(const struct iio_context *ctx,
+				       const struct iio_device *src)
+{
+	struct iio_arena *arena = ctx->arena;
+	struct iio_device *dev;
+	unsigned int i;
+
+	dev = iio_arena_zalloc(arena, sizeof(*dev));
+	if (!dev)
+		return NULL;
+
+	dev->ctx = ctx;
+	dev->id = src->id;
+	dev->name = src->name;
+	dev->label = src->label;
+
+	if (copy_dev_attrs(arena, &dev->attrs, &src->attrs) < 0 ||
+	    copy_dev_attrs(arena, &dev->buffer_attrs, &src->buffer_attrs) < 0 ||
+	    copy_dev_attrs(arena, &dev->debug_attrs, &src->debug_attrs) < 0)
+		return NULL;
+
+	dev->words = src->words;
+	if (dev->words) {
+		dev->mask = iio_arena_zalloc(arena,
+					     dev->words * sizeof(*dev->mask));
+		if (!dev->mask)
+			return NULL;
+	}
+
+	if (src->nb_channels) {
+		dev->channels = iio_arena_zalloc(arena, src->nb_channels *
+						 sizeof(*dev->channels));
+		if (!dev->channels)
+			return NULL;
+	}
+
+	for (i = 0; i < src->nb_channels; i++) {
+		dev->channels[i] = copy_channel(dev, src->channels[i]);
+		if (!dev->channels[i])
+			return NULL;
+
+		dev->nb_channels++;
+	}
+
+	return dev;
+}
+
+/* Creates a context with the same devices, channels and attributes as the
+ * given one, without any backend-specific data. The strings interned in the
+ * arena of the original context are shared instead of being copied. */
+struct iio_context * iio_context_create_shared(const struct iio_context *src)
+{
+	/* The backend operations are only set once the context is complete,
+	 * so that its shutdown callback never sees it half-initialized */
+	static const struct iio_backend_ops shared_ops;
+	struct iio_backend backend = {
+		.api_version = IIO_BACKEND_API_V1,
+		.name = src->name,
+		.ops = &shared_ops,
+	};
+	struct iio_context *ctx;
+	struct iio_arena *arena;
+	unsigned int i;
+	int ret;
+
+	ctx = iio_context_create_from_backend(&backend, src->description);
+	if (!ctx)
+		return NULL;
+
+	ret = -ENOMEM;
+	arena = iio_arena_create(src->arena);
+	if (!arena)
+		goto err_context_destroy;
+
+	iio_arena_unref(ctx->arena);
+	ctx->arena = arena;
+
+	ctx->major = src->major;
+	ctx->minor = src->minor;
+	if (src->git_tag) {
+		ctx->git_tag = iio_strdup(src->git_tag);
+		if (!ctx->git_tag)
+			goto err_context_destroy;
+	}
+
+	for (i = 0; i < src->nb_attrs; i++) {
+		ret = iio_context_add_attr(ctx, src->attrs[i], src->values[i]);
+		if (ret < 0)
+			goto err_context_destroy;
+	}
+
+	ret = -ENOMEM;
+	if (src->xml) {
+		ctx->xml = iio_strdup(src->xml);
+		if (!ctx->xml)
+			goto err_context_destroy;
+	}
+
+	if (src->nb_devices) {
+		ctx->devices = malloc(src->nb_devices * sizeof(*ctx->devices));
+		if (!ctx->devices)
+			goto err_context_destroy;
+	}
+
+	for (i = 0; i < src->nb_devices; i++) {
+		ctx->devices[i] = copy_device(ctx, src->devices[i]);
+		if (!ctx->devices[i])
+			goto err_context_destroy;
+
+		ctx->nb_devices++;
+	}
+
+	ret = iio_context_init(ctx);
+	if (ret < 0)
+		goto err_context_destroy;
+
+	ctx->ops = src->ops;
+
+	return ctx;
+
+err_context_destroy:
+	iio_context_destroy(ctx);
+	errno = -ret;
+	return NULL;
+}
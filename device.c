@@ -14,114 +14,70 @@
 #include <stdio.h>
 #include <string.h>
 
-static ssize_t iio_snprintf_xml_attr(char *buf, ssize_t len, const char *attr,
-				     enum iio_attr_type type)
+static void iio_device_write_attrs_xml(struct iio_strbuf *sb,
+				      const struct iio_dev_attrs *attrs,
+				      const char *element)
 {
-	switch (type) {
-		case IIO_ATTR_TYPE_DEVICE:
-			return iio_snprintf(buf, len, "<attribute name=\"%s\" />", attr);
-		case IIO_ATTR_TYPE_DEBUG:
-			return iio_snprintf(buf, len, "<debug-attribute name=\"%s\" />", attr);
-		case IIO_ATTR_TYPE_BUFFER:
-			return iio_snprintf(buf, len, "<buffer-attribute name=\"%s\" />", attr);
-		default:
-			return -EINVAL;
+	unsigned int i;
+
+	for (i = 0; i < attrs->num; i++) {
+		iio_strbuf_puts(sb, element);
+		iio_strbuf_puts(sb, attrs->names[i]);
+		iio_strbuf_puts(sb, "\" />");
 	}
 }
 
-ssize_t iio_snprintf_device_xml(char *ptr, ssize_t len,
-				const struct iio_device *dev)
+void iio_device_write_xml(struct iio_strbuf *sb, const struct iio_device *dev)
 {
-	ssize_t ret, alen = 0;
 	unsigned int i;
 
-	ret = iio_snprintf(ptr, len, "<device id=\"%s\"", dev->id);
-	if (ret < 0)
-		return ret;
+	iio_strbuf_puts(sb, "<device id=\"");
+	iio_strbuf_puts(sb, dev->id);
+	iio_strbuf_puts(sb, "\"");
 
-	iio_update_xml_indexes(ret, &ptr, &len, &alen);
 	if (dev->name) {
-		ret = iio_snprintf(ptr, len, " name=\"%s\"", dev->name);
-		if (ret < 0)
-			return ret;
-	
-		iio_update_xml_indexes(ret, &ptr, &len, &alen);
+		iio_strbuf_puts(sb, " name=\"");
+		iio_strbuf_puts(sb, dev->name);
+		iio_strbuf_puts(sb, "\"");
 	}
 
 	if (dev->label) {
-		ret = iio_snprintf(ptr, len, " label=\"%s\"", dev->label);
-		if (ret < 0)
-			return ret;
-
-		iio_update_xml_indexes(ret, &ptr, &len, &alen);
-	}
-
-	ret = iio_snprintf(ptr, len, " >");
-	if (ret < 0)
-		return ret;
-	
-	iio_update_xml_indexes(ret, &ptr, &len, &alen);
-
-	for (i = 0; i < dev->nb_channels; i++) {
-		ret = iio_snprintf_channel_xml(ptr, len, dev->channels[i]);
-		if (ret < 0)
-			return ret;
-
-		iio_update_xml_indexes(ret, &ptr, &len, &alen);
+		iio_strbuf_puts(sb, " label=\"");
+		iio_strbuf_puts(sb, dev->label);
+		iio_strbuf_puts(sb, "\"");
 	}
 
-	for (i = 0; i < dev->attrs.num; i++) {
-		ret = iio_snprintf_xml_attr(ptr, len, dev->attrs.names[i],
-					    IIO_ATTR_TYPE_DEVICE);
-		if (ret < 0)
-			return ret;
-		
-		iio_update_xml_indexes(ret, &ptr, &len, &alen);
-	}
-
-	for (i = 0; i < dev->buffer_attrs.num; i++) {
-		ret = iio_snprintf_xml_attr(ptr, len, dev->buffer_attrs.names[i],
-					    IIO_ATTR_TYPE_BUFFER);
-		if (ret < 0)
-			return ret;
+	iio_strbuf_puts(sb, " >");
 
-		iio_update_xml_indexes(ret, &ptr, &len, &alen);
-	}
-
-	for (i = 0; i < dev->debug_attrs.num; i++) {
-		ret = iio_snprintf_xml_attr(ptr, len, dev->debug_attrs.names[i],
-					    IIO_ATTR_TYPE_DEBUG);
-		if (ret < 0)
-			return ret;
+	for (i = 0; i < dev->nb_channels; i++)
+		iio_channel_write_xml(sb, dev->channels[i]);
 
-		iio_update_xml_indexes(ret, &ptr, &len, &alen);
-	}
+	iio_device_write_attrs_xml(sb, &dev->attrs, "<attribute name=\"");
+	iio_device_write_attrs_xml(sb, &dev->buffer_attrs,
+				   "<buffer-attribute name=\"");
+	iio_device_write_attrs_xml(sb, &dev->debug_attrs,
+				   "<debug-attribute name=\"");
 
-	ret = iio_snprintf(ptr, len, "</device>");
-	if (ret < 0)
-		return ret;
-
-	return alen + ret;
+	iio_strbuf_puts(sb, "</device>");
 }
 
-int add_iio_dev_attr(struct iio_dev_attrs *attrs, const char *attr,
-		     const char *type, const char *dev_id)
+int add_iio_dev_attr(struct iio_device *dev, struct iio_dev_attrs *attrs,
+		     const char *attr, const char *type)
 {
+	struct iio_arena *arena = dev->ctx->arena;
 	char **names, *name;
 
-	name = iio_strdup(attr);
+	name = iio_arena_intern(arena, attr);
 	if (!name)
 		return -ENOMEM;
 
-	names = realloc(attrs->names, (1 + attrs->num) * sizeof(char *));
-	if (!names) {
-		free(name);
+	names = iio_arena_grow(arena, attrs->names, attrs->num, sizeof(char *));
+	if (!names)
 		return -ENOMEM;
-	}
 
 	names[attrs->num++] = name;
 	attrs->names = names;
-	IIO_DEBUG("Added%s attr \'%s\' to device \'%s\'\n", type, attr, dev_id);
+	IIO_DEBUG("Added%s attr \'%s\' to device \'%s\'\n", type, attr, dev->id);
 	return 0;
 }
 
@@ -158,6 +114,13 @@ struct iio_channel * iio_device_find_channel(const struct iio_device *dev,
 		const char *name, bool output)
 {
 	unsigned int i;
+
+	if (dev->ctx->hash) {
+		return iio_hash_find(dev->ctx->hash, dev, output ?
+				     IIO_HASH_CHANNEL_OUTPUT :
+				     IIO_HASH_CHANNEL_INPUT, name);
+	}
+
 	for (i = 0; i < dev->nb_channels; i++) {
 		struct iio_channel *chn = dev->channels[i];
 		if (iio_channel_is_output(chn) != output)
@@ -179,10 +142,15 @@ static const char * iio_device_get_dev_attr(const struct iio_dev_attrs *attrs,
 		return attrs->names[index];
 }
 
-const char * iio_device_find_dev_attr(const struct iio_dev_attrs *attrs,
+static const char * iio_device_find_dev_attr(const struct iio_device *dev,
+		const struct iio_dev_attrs *attrs, enum iio_hash_kind kind,
 		const char *name)
 {
 	unsigned int i;
+
+	if (dev->ctx->hash)
+		return iio_hash_find(dev->ctx->hash, dev, kind, name);
+
 	for (i = 0; i < attrs->num; i++) {
 		const char *attr = attrs->names[i];
 		if (!strcmp(attr, name))
@@ -205,7 +173,8 @@ const char * iio_device_get_attr(const struct iio_device *dev,
 const char * iio_device_find_attr(const struct iio_device *dev,
 		const char *name)
 {
-	return iio_device_find_dev_attr(&dev->attrs, name);
+	return iio_device_find_dev_attr(dev, &dev->attrs,
+					IIO_HASH_DEVICE_ATTR, name);
 }
 
 unsigned int iio_device_get_buffer_attrs_count(const struct iio_device *dev)
@@ -222,13 +191,15 @@ const char * iio_device_get_buffer_attr(const struct iio_device *dev,
 const char * iio_device_find_buffer_attr(const struct iio_device *dev,
 		const char *name)
 {
-	return iio_device_find_dev_attr(&dev->buffer_attrs, name);
+	return iio_device_find_dev_attr(dev, &dev->buffer_attrs,
+					IIO_HASH_BUFFER_ATTR, name);
 }
 
 const char * iio_device_find_debug_attr(const struct iio_device *dev,
 		const char *name)
 {
-	return iio_device_find_dev_attr(&dev->debug_attrs, name);
+	return iio_device_find_dev_attr(dev, &dev->debug_attrs,
+					IIO_HASH_DEBUG_ATTR, name);
 }
 
 bool iio_device_is_tx(const struct iio_device *dev)
@@ -410,34 +381,6 @@ int iio_device_set_trigger(const struct iio_device *dev,
 		return -ENOSYS;
 }
 
-static void free_iio_dev_attrs(struct iio_dev_attrs *attrs)
-{
-	unsigned int i;
-
-	for (i = 0; i <  attrs->num; i++)
-		free(attrs->names[i]);
-
-	free(attrs->names);
-}
-
-void free_device(struct iio_device *dev)
-{
-	unsigned int i;
-
-	free_iio_dev_attrs(&dev->attrs);
-	free_iio_dev_attrs(&dev->buffer_attrs);
-	free_iio_dev_attrs(&dev->debug_attrs);
-
-	for (i = 0; i < dev->nb_channels; i++)
-		free_channel(dev->channels[i]);
-	free(dev->channels);
-	free(dev->mask);
-	free(dev->label);
-	free(dev->name);
-	free(dev->id);
-	free(dev);
-}
-
 ssize_t iio_device_get_sample_size_mask(const struct iio_device *dev,
 		const uint32_t *mask, size_t words)
 {
@@ -488,18 +431,12 @@ ssize_t iio_device_get_sample_size(const struct iio_device *dev)
 int iio_device_attr_read_longlong(const struct iio_device *dev,
 		const char *attr, long long *val)
 {
-	char *end, buf[1024];
-	long long value;
+	char buf[1024];
 	ssize_t ret = iio_device_attr_read(dev, attr, buf, sizeof(buf));
 	if (ret < 0)
 		return (int) ret;
-
-	errno = 0;
-	value = strtoll(buf, &end, 0);
-	if (end == buf || errno == ERANGE)
-		return -EINVAL;
-	*val = value;
-	return 0;
+	else
+		return read_longlong(buf, val);
 }
 
 int iio_device_attr_read_bool(const struct iio_device *dev,
@@ -565,18 +502,12 @@ int iio_device_attr_write_bool(const struct iio_device *dev,
 int iio_device_buffer_attr_read_longlong(const struct iio_device *dev,
 		const char *attr, long long *val)
 {
-	char *end, buf[1024];
-	long long value;
+	char buf[1024];
 	ssize_t ret = iio_device_buffer_attr_read(dev, attr, buf, sizeof(buf));
 	if (ret < 0)
 		return (int) ret;
-
-	errno = 0;
-	value = strtoll(buf, &end, 0);
-	if (end == buf || errno == ERANGE)
-		return -EINVAL;
-	*val = value;
-	return 0;
+	else
+		return read_longlong(buf, val);
 }
 
 int iio_device_buffer_attr_read_bool(const struct iio_device *dev,
@@ -679,18 +610,12 @@ const char * iio_device_get_debug_attr(const struct iio_device *dev,
 int iio_device_debug_attr_read_longlong(const struct iio_device *dev,
 		const char *attr, long long *val)
 {
-	char *end, buf[1024];
-	long long value;
+	char buf[1024];
 	ssize_t ret = iio_device_debug_attr_read(dev, attr, buf, sizeof(buf));
 	if (ret < 0)
 		return (int) ret;
-
-	errno = 0;
-	value = strtoll(buf, &end, 0);
-	if (end == buf || errno == ERANGE)
-		return -EINVAL;
-	*val = value;
-	return 0;
+	else
+		return read_longlong(buf, val);
 }
 
 int iio_device_debug_attr_read_bool(const struct iio_device *dev,
@@ -792,7 +717,7 @@ int iio_device_identify_filename(const struct iio_device *dev,
 	return -EINVAL;
 }
 
-int iio_device_reg_write(struct iio_device *dev,
+static int reg_write_attr(struct iio_device *dev,
 		uint32_t address, uint32_t value)
 {
 	ssize_t ret;
@@ -805,7 +730,7 @@ int iio_device_reg_write(struct iio_device *dev,
 	return (int) (ret < 0 ? ret : 0);
 }
 
-int iio_device_reg_read(struct iio_device *dev,
+static int reg_read_attr(struct iio_device *dev,
 		uint32_t address, uint32_t *value)
 {
 	/* NOTE: There is a race condition here. But it is extremely unlikely to
@@ -825,6 +750,70 @@ int iio_device_reg_read(struct iio_device *dev,
 	return ret;
 }
 
+int iio_device_reg_write_batch(struct iio_device *dev,
+		const uint32_t *addresses, const uint32_t *values, size_t nb)
+{
+	const struct iio_backend_ops *ops = dev->ctx->ops;
+	size_t i;
+	int ret;
+
+	if (!nb)
+		return 0;
+
+	if (ops->write_regs) {
+		ret = ops->write_regs(dev, addresses, values, nb);
+		if (ret != -ENOSYS)
+			return ret;
+	}
+
+	/* Fall back to one debug attribute write per register */
+	for (i = 0; i < nb; i++) {
+		ret = reg_write_attr(dev, addresses[i], values[i]);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+int iio_device_reg_read_batch(struct iio_device *dev,
+		const uint32_t *addresses, uint32_t *values, size_t nb)
+{
+	const struct iio_backend_ops *ops = dev->ctx->ops;
+	size_t i;
+	int ret;
+
+	if (!nb)
+		return 0;
+
+	if (ops->read_regs) {
+		ret = ops->read_regs(dev, addresses, values, nb);
+		if (ret != -ENOSYS)
+			return ret;
+	}
+
+	/* Fall back to one debug attribute write and read per register */
+	for (i = 0; i < nb; i++) {
+		ret = reg_read_attr(dev, addresses[i], &values[i]);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+int iio_device_reg_write(struct iio_device *dev,
+		uint32_t address, uint32_t value)
+{
+	return iio_device_reg_write_batch(dev, &address, &value, 1);
+}
+
+int iio_device_reg_read(struct iio_device *dev,
+		uint32_t address, uint32_t *value)
+{
+	return iio_device_reg_read_batch(dev, &address, value, 1);
+}
+
 static int read_each_attr(struct iio_device *dev, enum iio_attr_type type,
 		int (*cb)(struct iio_device *dev,
 			const char *attr, const char *val, size_t len, void *d),
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2023 Analog Devices, Inc.
+ */
+
+#include "iio-config.h"
+#include "iio-private.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct iio_event_stream * iio_device_create_event_stream(const struct iio_device *dev)
+{
+	const struct iio_backend_ops *ops = dev->ctx->ops;
+	struct iio_event_stream *stream;
+	int ret;
+
+	if (!ops->open_ev || !ops->close_ev || !ops->read_ev) {
+		errno = ENOSYS;
+		return NULL;
+	}
+
+	stream = zalloc(sizeof(*stream));
+	if (!stream) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	stream->dev = dev;
+	stream->pdata = ops->open_ev(dev);
+	if (IS_ERR(stream->pdata)) {
+		ret = PTR_ERR(stream->pdata);
+		free(stream);
+		errno = -ret;
+		return NULL;
+	}
+
+	return stream;
+}
+
+void iio_event_stream_destroy(struct iio_event_stream *stream)
+{
+	stream->dev->ctx->ops->close_ev(stream->pdata);
+	free(stream);
+}
+
+void iio_event_stream_cancel(struct iio_event_stream *stream)
+{
+	const struct iio_backend_ops *ops = stream->dev->ctx->ops;
+
+	if (ops->cancel_ev)
+		ops->cancel_ev(stream->pdata);
+}
+
+const struct iio_device *
+iio_event_stream_get_device(const struct iio_event_stream *stream)
+{
+	return stream->dev;
+}
+
+int iio_event_stream_get_poll_fd(const struct iio_event_stream *stream)
+{
+	const struct iio_backend_ops *ops = stream->dev->ctx->ops;
+
+	if (ops->get_ev_fd)
+		return ops->get_ev_fd(stream->pdata);
+	else
+		return -ENOSYS;
+}
+
+ssize_t iio_event_stream_read(struct iio_event_stream *stream,
+		struct iio_event *events, size_t nb, bool nonblock)
+{
+	const struct iio_backend_ops *ops = stream->dev->ctx->ops;
+	ssize_t ret;
+
+	if (!nb)
+		return 0;
+
+	/* Only go to the backend once all the queued events were consumed;
+	 * the backend retrieves as many events as it can in one go. */
+	if (!stream->count) {
+		ret = ops->read_ev(stream->pdata, stream->queue,
+				   ARRAY_SIZE(stream->queue), nonblock);
+		if (ret < 0)
+			return ret;
+
+		stream->head = 0;
+		stream->count = (unsigned int) ret;
+	}
+
+	if (nb > stream->count)
+		nb = stream->count;
+
+	memcpy(events, &stream->queue[stream->head], nb * sizeof(*events));
+	stream->head += (unsigned int) nb;
+	stream->count -= (unsigned int) nb;
+
+	return (ssize_t) nb;
+}
+
+/* Returns the first number found in the given channel ID, before the
+ * optional '-' separating the two channels of a differential pair.
+ * The end pointer is set to the character following the number. */
+static long channel_id_get_number(const char *id, const char **end)
+{
+	char *ptr;
+	long nb;
+
+	for (; *id && *id != '-'; id++) {
+		if (*id >= '0' && *id <= '9') {
+			nb = strtol(id, &ptr, 10);
+			*end = ptr;
+			return nb;
+		}
+	}
+
+	*end = id;
+	return -1;
+}
+
+static bool channel_match_event(const struct iio_channel *chn,
+		enum iio_chan_type type, enum iio_modifier mod,
+		long number, long number2)
+{
+	const char *ptr;
+	long nb;
+
+	if (chn->is_output || chn->type != type || chn->modifier != mod)
+		return false;
+
+	nb = channel_id_get_number(chn->id, &ptr);
+
+	/* Channels without index (e.g. "accel_x") match any number */
+	if (nb >= 0 && nb != number)
+		return false;
+
+	ptr = strchr(ptr, '-');
+	if (!ptr)
+		return number2 < 0;
+	if (number2 < 0)
+		return false;
+
+	return channel_id_get_number(ptr + 1, &ptr) == number2;
+}
+
+const struct iio_channel *
+iio_event_get_channel(const struct iio_event *event,
+		const struct iio_device *dev, bool diff)
+{
+	enum iio_chan_type type = (enum iio_chan_type)((event->id >> 32) & 0xff);
+	enum iio_modifier mod = (enum iio_modifier)((event->id >> 40) & 0xff);
+	bool is_diff = (event->id >> 55) & 0x1;
+	long chan = (int16_t) (event->id & 0xffff);
+	long chan2 = (int16_t) ((event->id >> 16) & 0xffff);
+	unsigned int i;
+
+	if (diff && !is_diff)
+		return NULL;
+
+	if (diff) {
+		chan = chan2;
+	} else if (is_diff) {
+		/* Look for the differential channel first */
+		for (i = 0; i < dev->nb_channels; i++) {
+			if (channel_match_event(dev->channels[i],
+						type, mod, chan, chan2))
+				return dev->channels[i];
+		}
+	}
+
+	if (chan < 0)
+		return NULL;
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		if (channel_match_event(dev->channels[i], type, mod, chan, -1))
+			return dev->channels[i];
+	}
+
+	return NULL;
+}
@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2023 Analog Devices, Inc.
+ */
+
+#include "iio-private.h"
+
+#include <errno.h>
+#include <string.h>
+
+/* Hash table indexing the devices, channels and attributes of a context by
+ * name. Each entry is identified by its owner (context, device or channel),
+ * its kind, and its name; the names are not copied, and point to the
+ * strings of the context. The table uses open addressing with linear
+ * probing, and is never modified once built. */
+
+struct iio_hash_entry {
+	const void *owner;
+	const char *key;
+	void *value;
+	enum iio_hash_kind kind;
+};
+
+struct iio_hash {
+	struct iio_hash_entry *entries;
+	size_t mask;
+};
+
+static size_t iio_hash_compute(const void *owner,
+		enum iio_hash_kind kind, const char *key)
+{
+	/* FNV-1a on the name, mixed with the owner and the kind */
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	for (; *key; key++) {
+		hash ^= (unsigned char) *key;
+		hash *= 0x100000001b3ull;
+	}
+
+	hash ^= ((uint64_t) (uintptr_t) owner + (uint64_t) kind) *
+		0x9e3779b97f4a7c15ull;
+	hash ^= hash >> 29;
+
+	return (size_t) hash;
+}
+
+static struct iio_hash_entry *
+iio_hash_lookup(const struct iio_hash *hash, const void *owner,
+		enum iio_hash_kind kind, const char *key)
+{
+	size_t i = iio_hash_compute(owner, kind, key) & hash->mask;
+	struct iio_hash_entry *entry;
+
+	for (;; i = (i + 1) & hash->mask) {
+		entry = &hash->entries[i];
+
+		if (!entry->key || (entry->owner == owner &&
+				    entry->kind == kind &&
+				    !strcmp(entry->key, key)))
+			return entry;
+	}
+}
+
+static void iio_hash_add(struct iio_hash *hash, const void *owner,
+		enum iio_hash_kind kind, const char *key, void *value)
+{
+	struct iio_hash_entry *entry;
+
+	if (!key)
+		return;
+
+	/* The first object added under a given name wins, like with the
+	 * linear searches */
+	entry = iio_hash_lookup(hash, owner, kind, key);
+	if (entry->key)
+		return;
+
+	entry->owner = owner;
+	entry->kind = kind;
+	entry->key = key;
+	entry->value = value;
+}
+
+static size_t iio_hash_count(const struct iio_context *ctx)
+{
+	const struct iio_device *dev;
+	size_t nb = 3 * ctx->nb_devices;
+	unsigned int i, j;
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		dev = ctx->devices[i];
+
+		nb += 2 * dev->nb_channels + dev->attrs.num +
+			dev->buffer_attrs.num + dev->debug_attrs.num;
+
+		for (j = 0; j < dev->nb_channels; j++)
+			nb += dev->channels[j]->nb_attrs;
+	}
+
+	return nb;
+}
+
+static void iio_hash_add_dev_attrs(struct iio_hash *hash,
+		const struct iio_device *dev, const struct iio_dev_attrs *attrs,
+		enum iio_hash_kind kind)
+{
+	unsigned int i;
+
+	for (i = 0; i < attrs->num; i++)
+		iio_hash_add(hash, dev, kind, attrs->names[i], attrs->names[i]);
+}
+
+struct iio_hash * iio_hash_create(const struct iio_context *ctx)
+{
+	struct iio_device *dev;
+	struct iio_channel *chn;
+	struct iio_hash *hash;
+	enum iio_hash_kind kind;
+	size_t size = 16, nb = iio_hash_count(ctx);
+	unsigned int i, j, k;
+
+	/* Keep the load factor under 50% */
+	while (size < 2 * nb)
+		size <<= 1;
+
+	hash = zalloc(sizeof(*hash));
+	if (!hash)
+		return ERR_PTR(-ENOMEM);
+
+	hash->entries = calloc(size, sizeof(*hash->entries));
+	if (!hash->entries) {
+		free(hash);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	hash->mask = size - 1;
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		dev = ctx->devices[i];
+
+		iio_hash_add(hash, ctx, IIO_HASH_DEVICE, dev->id, dev);
+		iio_hash_add(hash, ctx, IIO_HASH_DEVICE, dev->label, dev);
+		iio_hash_add(hash, ctx, IIO_HASH_DEVICE, dev->name, dev);
+	}
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		dev = ctx->devices[i];
+
+		for (j = 0; j < dev->nb_channels; j++) {
+			chn = dev->channels[j];
+			kind = chn->is_output ? IIO_HASH_CHANNEL_OUTPUT
+				: IIO_HASH_CHANNEL_INPUT;
+
+			iio_hash_add(hash, dev, kind, chn->id, chn);
+			iio_hash_add(hash, dev, kind, chn->name, chn);
+
+			for (k = 0; k < chn->nb_attrs; k++) {
+				iio_hash_add(hash, chn, IIO_HASH_CHANNEL_ATTR,
+					     chn->attrs[k].name,
+					     chn->attrs[k].name);
+			}
+		}
+
+		iio_hash_add_dev_attrs(hash, dev, &dev->attrs,
+				       IIO_HASH_DEVICE_ATTR);
+		iio_hash_add_dev_attrs(hash, dev, &dev->buffer_attrs,
+				       IIO_HASH_BUFFER_ATTR);
+		iio_hash_add_dev_attrs(hash, dev, &dev->debug_attrs,
+				       IIO_HASH_DEBUG_ATTR);
+	}
+
+	return hash;
+}
+
+void iio_hash_destroy(struct iio_hash *hash)
+{
+	free(hash->entries);
+	free(hash);
+}
+
+void * iio_hash_find(const struct iio_hash *hash, const void *owner,
+		enum iio_hash_kind kind, const char *key)
+{
+	return iio_hash_lookup(hash, owner, kind, key)->value;
+}
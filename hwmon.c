@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2023 Analog Devices, Inc.
+ */
+
+#include "iio-config.h"
+#include "iio-private.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Scale to apply to the raw values, as defined in the kernel's
+ * Documentation/hwmon/sysfs-interface.rst */
+static const double hwmon_chan_type_scale[] = {
+	[HWMON_VOLTAGE] = 0.001,	/* millivolts */
+	[HWMON_FAN] = 1.0,		/* RPM */
+	[HWMON_PWM] = 1.0,		/* 0 to 255 */
+	[HWMON_TEMP] = 0.001,		/* millidegrees Celsius */
+	[HWMON_CURRENT] = 0.001,	/* milliamperes */
+	[HWMON_POWER] = 0.000001,	/* microwatts */
+	[HWMON_ENERGY] = 0.000001,	/* microjoules */
+	[HWMON_HUMIDITY] = 0.001,	/* millipercents */
+	[HWMON_INTRUSION] = 1.0,	/* boolean */
+};
+
+/* Returns the name of the attribute containing the value of the channel */
+static const char * hwmon_channel_get_value_attr(const struct iio_channel *chn)
+{
+	switch (hwmon_channel_get_type(chn)) {
+	case HWMON_PWM:
+		/* The duty cycle is in the 'pwmX' file itself */
+		return iio_channel_find_attr(chn, chn->id);
+	case HWMON_INTRUSION:
+		return iio_channel_find_attr(chn, "alarm");
+	case HWMON_CHAN_TYPE_UNKNOWN:
+		return NULL;
+	default:
+		return iio_channel_find_attr(chn, "input");
+	}
+}
+
+static unsigned int
+hwmon_snapshot_add_channels(struct iio_hwmon_snapshot *snapshot, bool count_only)
+{
+	const struct iio_context *ctx = snapshot->ctx;
+	unsigned int i, j, nb = 0;
+	const char *attr;
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		const struct iio_device *dev = ctx->devices[i];
+
+		if (!iio_device_is_hwmon(dev))
+			continue;
+
+		for (j = 0; j < dev->nb_channels; j++) {
+			attr = hwmon_channel_get_value_attr(dev->channels[j]);
+			if (!attr)
+				continue;
+
+			if (!count_only) {
+				snapshot->chns[nb] = dev->channels[j];
+				snapshot->attrs[nb] = attr;
+			}
+
+			nb++;
+		}
+	}
+
+	return nb;
+}
+
+struct iio_hwmon_snapshot *
+iio_context_create_hwmon_snapshot(const struct iio_context *ctx)
+{
+	const struct iio_backend_ops *ops = ctx->ops;
+	struct iio_hwmon_snapshot *snapshot;
+	int ret = -ENOMEM;
+
+	snapshot = zalloc(sizeof(*snapshot));
+	if (!snapshot)
+		goto err_set_errno;
+
+	snapshot->ctx = ctx;
+	snapshot->nb = hwmon_snapshot_add_channels(snapshot, true);
+
+	if (snapshot->nb) {
+		snapshot->chns = calloc(snapshot->nb, sizeof(*snapshot->chns));
+		snapshot->attrs = calloc(snapshot->nb, sizeof(*snapshot->attrs));
+		snapshot->values = calloc(snapshot->nb, sizeof(*snapshot->values));
+		if (!snapshot->chns || !snapshot->attrs || !snapshot->values)
+			goto err_free_snapshot;
+
+		hwmon_snapshot_add_channels(snapshot, false);
+	}
+
+	if (ops->open_hwmon && ops->close_hwmon && ops->read_hwmon) {
+		snapshot->pdata = ops->open_hwmon(ctx, snapshot->chns,
+						  snapshot->attrs, snapshot->nb);
+		if (IS_ERR(snapshot->pdata)) {
+			ret = PTR_ERR(snapshot->pdata);
+			goto err_free_snapshot;
+		}
+	}
+
+	return snapshot;
+
+err_free_snapshot:
+	free(snapshot->chns);
+	free(snapshot->attrs);
+	free(snapshot->values);
+	free(snapshot);
+err_set_errno:
+	errno = -ret;
+	return NULL;
+}
+
+void iio_hwmon_snapshot_destroy(struct iio_hwmon_snapshot *snapshot)
+{
+	if (snapshot->pdata)
+		snapshot->ctx->ops->close_hwmon(snapshot->pdata);
+
+	free(snapshot->chns);
+	free(snapshot->attrs);
+	free(snapshot->values);
+	free(snapshot);
+}
+
+int iio_hwmon_snapshot_refresh(struct iio_hwmon_snapshot *snapshot)
+{
+	struct iio_hwmon_value *values = snapshot->values;
+	enum hwmon_chan_type type;
+	unsigned int i;
+	int ret, nb_errors = 0;
+	long long val = 0;
+
+	if (snapshot->pdata) {
+		ret = snapshot->ctx->ops->read_hwmon(snapshot->pdata, values);
+		if (ret < 0)
+			return ret;
+	} else {
+		/* Generic implementation, one attribute read at a time */
+		for (i = 0; i < snapshot->nb; i++) {
+			values[i].error = iio_channel_attr_read_longlong(
+					snapshot->chns[i],
+					snapshot->attrs[i], &val);
+			values[i].value = (double) val;
+		}
+	}
+
+	for (i = 0; i < snapshot->nb; i++) {
+		if (values[i].error) {
+			values[i].value = 0.0;
+			nb_errors++;
+			continue;
+		}
+
+		type = hwmon_channel_get_type(snapshot->chns[i]);
+		values[i].value *= hwmon_chan_type_scale[type];
+	}
+
+	return nb_errors;
+}
+
+unsigned int
+iio_hwmon_snapshot_get_channels_count(const struct iio_hwmon_snapshot *snapshot)
+{
+	return snapshot->nb;
+}
+
+const struct iio_channel *
+iio_hwmon_snapshot_get_channel(const struct iio_hwmon_snapshot *snapshot,
+		unsigned int index)
+{
+	if (index >= snapshot->nb)
+		return NULL;
+
+	return snapshot->chns[index];
+}
+
+const struct iio_hwmon_value *
+iio_hwmon_snapshot_get_values(const struct iio_hwmon_snapshot *snapshot)
+{
+	return snapshot->values;
+}
@@ -12,6 +12,11 @@
 
 struct iio_device;
 struct iio_context;
+struct iio_event;
+struct iio_event_stream_pdata;
+struct iio_hwmon_snapshot_pdata;
+struct iio_hwmon_value;
+struct iio_buffer_wait_stats;
 
 enum iio_backend_api_ver {
 	IIO_BACKEND_API_V1 = 1,
@@ -34,6 +39,18 @@ struct iio_backend_ops {
 	int (*close)(const struct iio_device *dev);
 	int (*get_fd)(const struct iio_device *dev);
 	int (*set_blocking_mode)(const struct iio_device *dev, bool blocking);
+	int (*set_wait_policy)(const struct iio_device *dev,
+			enum iio_buffer_wait_policy policy, unsigned int spin_us);
+	int (*get_wait_stats)(const struct iio_device *dev,
+			struct iio_buffer_wait_stats *stats);
+	/* len is the size in bytes of the blocks of the buffer */
+	int (*set_realtime_mode)(const struct iio_device *dev,
+			size_t len, bool enable);
+	int (*set_compression)(const struct iio_device *dev,
+			const char *codec, int level);
+	int (*get_stream_stats)(const struct iio_device *dev,
+			struct iio_buffer_stream_stats *stats);
+	int (*flush)(const struct iio_device *dev);
 
 	void (*cancel)(const struct iio_device *dev);
 
@@ -53,6 +70,11 @@ struct iio_backend_ops {
 	ssize_t (*write_channel_attr)(const struct iio_channel *chn,
 			const char *attr, const char *src, size_t len);
 
+	int (*read_regs)(const struct iio_device *dev,
+			const uint32_t *addrs, uint32_t *values, size_t nb);
+	int (*write_regs)(const struct iio_device *dev,
+			const uint32_t *addrs, const uint32_t *values, size_t nb);
+
 	int (*get_trigger)(const struct iio_device *dev,
 			const struct iio_device **trigger);
 	int (*set_trigger)(const struct iio_device *dev,
@@ -64,6 +86,23 @@ struct iio_backend_ops {
 			unsigned int *minor, char git_tag[8]);
 
 	int (*set_timeout)(struct iio_context *ctx, unsigned int timeout);
+
+	struct iio_event_stream_pdata *(*open_ev)(const struct iio_device *dev);
+	void (*close_ev)(struct iio_event_stream_pdata *pdata);
+	ssize_t (*read_ev)(struct iio_event_stream_pdata *pdata,
+			struct iio_event *events, size_t nb, bool nonblock);
+	int (*get_ev_fd)(const struct iio_event_stream_pdata *pdata);
+	void (*cancel_ev)(struct iio_event_stream_pdata *pdata);
+
+	/* read_hwmon stores the raw integer read from each channel in the
+	 * value field; it is then scaled by the core. */
+	struct iio_hwmon_snapshot_pdata *(*open_hwmon)(
+			const struct iio_context *ctx,
+			const struct iio_channel * const *chns,
+			const char * const *attrs, unsigned int nb);
+	void (*close_hwmon)(struct iio_hwmon_snapshot_pdata *pdata);
+	int (*read_hwmon)(struct iio_hwmon_snapshot_pdata *pdata,
+			struct iio_hwmon_value *values);
 };
 
 /**
@@ -17,4 +17,13 @@ void iio_mutex_destroy(struct iio_mutex *lock);
 void iio_mutex_lock(struct iio_mutex *lock);
 void iio_mutex_unlock(struct iio_mutex *lock);
 
+struct iio_cond;
+
+struct iio_cond * iio_cond_create(void);
+void iio_cond_destroy(struct iio_cond *cond);
+
+/* Must be called with the mutex locked */
+void iio_cond_wait(struct iio_cond *cond, struct iio_mutex *lock);
+void iio_cond_broadcast(struct iio_cond *cond);
+
 #endif /* _IIO_LOCK_H */
@@ -14,6 +14,7 @@
 #include "iio-backend.h"
 #include "iio-config.h"
 
+#include <stdarg.h>
 #include <stdbool.h>
 
 #ifdef _MSC_BUILD
@@ -95,6 +96,33 @@ static inline uint32_t iio_htobe32(uint32_t word)
 	return iio_be32toh(word);
 }
 
+static inline uint16_t iio_be16toh(uint16_t word)
+{
+	if (!is_little_endian())
+		return word;
+
+	return (uint16_t) ((word << 8) | (word >> 8));
+}
+
+static inline uint16_t iio_htobe16(uint16_t word)
+{
+	return iio_be16toh(word);
+}
+
+static inline uint64_t iio_be64toh(uint64_t word)
+{
+	if (!is_little_endian())
+		return word;
+
+	return ((uint64_t) iio_be32toh((uint32_t) word) << 32) |
+		iio_be32toh((uint32_t) (word >> 32));
+}
+
+static inline uint64_t iio_htobe64(uint64_t word)
+{
+	return iio_be64toh(word);
+}
+
 /* Allocate zeroed out memory */
 static inline void *zalloc(size_t size)
 {
@@ -148,6 +176,13 @@ struct iio_context {
 	char **attrs;
 	char **values;
 	unsigned int nb_attrs;
+
+	/* Index of the devices, channels and attributes; built by
+	 * iio_context_init(), NULL until then */
+	struct iio_hash *hash;
+
+	/* Storage of the strings shared by the devices and channels */
+	struct iio_arena *arena;
 };
 
 struct iio_channel {
@@ -201,6 +236,36 @@ struct iio_buffer {
 	unsigned int dev_sample_size;
 	unsigned int sample_size;
 	bool dev_is_high_speed;
+
+	bool realtime;
+	void (*rt_hook)(const struct iio_buffer *buf, bool enter, void *d);
+	void *rt_hook_data;
+
+	/* Automatic tuning, disabled if block_ns is zero */
+	struct iio_buffer_tuning_result tuning;
+	unsigned int min_nb_blocks, window_count;
+	uint64_t block_ns, window_min_ns, window_max_ns;
+};
+
+/* Number of events that can be queued by an event stream */
+#define IIO_EVENT_STREAM_QUEUE_SIZE 64
+
+struct iio_event_stream {
+	const struct iio_device *dev;
+	struct iio_event_stream_pdata *pdata;
+
+	struct iio_event queue[IIO_EVENT_STREAM_QUEUE_SIZE];
+	unsigned int head, count;
+};
+
+struct iio_hwmon_snapshot {
+	const struct iio_context *ctx;
+	struct iio_hwmon_snapshot_pdata *pdata;
+
+	unsigned int nb;
+	const struct iio_channel **chns;
+	const char **attrs;
+	struct iio_hwmon_value *values;
 };
 
 struct iio_context_info {
@@ -216,16 +281,66 @@ struct iio_scan_result {
 struct iio_context_info *
 iio_scan_result_add(struct iio_scan_result *scan_result);
 
-void free_channel(struct iio_channel *chn);
-void free_device(struct iio_device *dev);
+/* Growable string. An error on a write is kept in the 'err' field, and
+ * turns the following writes into no-ops. */
+struct iio_strbuf {
+	char *str;
+	size_t len, size;
+	int err;
+};
+
+void iio_strbuf_append(struct iio_strbuf *sb, const char *str, size_t len);
+void iio_strbuf_puts(struct iio_strbuf *sb, const char *str);
+void iio_strbuf_printf(struct iio_strbuf *sb, const char *fmt, ...);
+
+/* Appends the string with the XML special characters escaped */
+void iio_strbuf_puts_sanitized(struct iio_strbuf *sb, const char *str);
 
-ssize_t iio_snprintf_channel_xml(char *str, ssize_t slen,
-				 const struct iio_channel *chn);
-ssize_t iio_snprintf_device_xml(char *str, ssize_t slen,
-				const struct iio_device *dev);
+void iio_channel_write_xml(struct iio_strbuf *sb,
+			   const struct iio_channel *chn);
+void iio_device_write_xml(struct iio_strbuf *sb, const struct iio_device *dev);
 
 int iio_context_init(struct iio_context *ctx);
 
+/* Copies the context, sharing the strings of its arena */
+struct iio_context * iio_context_create_shared(const struct iio_context *src);
+
+enum iio_hash_kind {
+	IIO_HASH_DEVICE,
+	IIO_HASH_CHANNEL_INPUT,
+	IIO_HASH_CHANNEL_OUTPUT,
+	IIO_HASH_DEVICE_ATTR,
+	IIO_HASH_BUFFER_ATTR,
+	IIO_HASH_DEBUG_ATTR,
+	IIO_HASH_CHANNEL_ATTR,
+};
+
+struct iio_hash * iio_hash_create(const struct iio_context *ctx);
+void iio_hash_destroy(struct iio_hash *hash);
+void * iio_hash_find(const struct iio_hash *hash, const void *owner,
+		enum iio_hash_kind kind, const char *key);
+
+/* The arena of a cloned context references the arena of the original
+ * context, given as the parent, so that both can share its memory */
+struct iio_arena * iio_arena_create(struct iio_arena *parent);
+void iio_arena_unref(struct iio_arena *arena);
+
+/* The memory is only released when the arena is destroyed */
+void * iio_arena_zalloc(struct iio_arena *arena, size_t size);
+void * iio_arena_dup(struct iio_arena *arena, const void *src, size_t size);
+
+/* Returns the array, with room for one more element, or NULL on error.
+ * It only works with arrays which always grew by one element at a time from
+ * an empty one; arrays copied with iio_arena_dup() can't grow. */
+void * iio_arena_grow(struct iio_arena *arena, void *array,
+		      size_t nb, size_t size);
+
+/* Returns a copy of the string stored in the arena, shared with all the
+ * previous copies of the same string, or NULL on error */
+char * iio_arena_intern(struct iio_arena *arena, const char *str);
+char * iio_arena_intern_len(struct iio_arena *arena,
+			    const char *str, size_t len);
+
 bool iio_device_is_tx(const struct iio_device *dev);
 int iio_device_open(const struct iio_device *dev,
 		size_t samples_count, bool cyclic);
@@ -239,10 +354,13 @@ int iio_device_get_poll_fd(const struct iio_device *dev);
 
 int read_double(const char *str, double *val);
 int write_double(char *buf, size_t len, double val);
+int read_longlong(const char *str, long long *val);
 
 struct iio_context * local_create_context(void);
+struct iio_context * local_create_context_from_uri(const char *uri);
 struct iio_context * network_create_context(const char *hostname);
 struct iio_context * xml_create_context_mem(const char *xml, size_t len);
+struct iio_context * binary_create_context_mem(const void *data, size_t len);
 struct iio_context * xml_create_context(const char *xml_file);
 struct iio_context * usb_create_context_from_uri(const char *uri);
 struct iio_context * serial_create_context_from_uri(const char *uri);
@@ -273,24 +391,11 @@ int iio_context_add_attr(struct iio_context *ctx,
 
 struct iio_context_pdata * iio_context_get_pdata(const struct iio_context *ctx);
 
-int add_iio_dev_attr(struct iio_dev_attrs *attrs, const char *attr,
-		     const char *type, const char *dev_id);
+int add_iio_dev_attr(struct iio_device *dev, struct iio_dev_attrs *attrs,
+		     const char *attr, const char *type);
 
 ssize_t __iio_printf iio_snprintf(char *buf, size_t len, const char *fmt, ...);
-
-ssize_t iio_xml_print_and_sanitized_param(char *ptr, ssize_t len,
-					  const char *before, char *param,
-					  const char *after);
-
-static inline void iio_update_xml_indexes(ssize_t ret, char **ptr, ssize_t *len,
-					  ssize_t *alen)
-{
-	if (*ptr) {
-		*ptr += ret;
-		*len -= ret;
-	}
-	*alen += ret;
-}
+ssize_t iio_vsnprintf(char *buf, size_t len, const char *fmt, va_list ap);
 
 bool iio_channel_is_hwmon(const char *id);
 
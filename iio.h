@@ -79,6 +79,8 @@ struct iio_context;
 struct iio_device;
 struct iio_channel;
 struct iio_buffer;
+struct iio_event_stream;
+struct iio_hwmon_snapshot;
 
 struct iio_context_info;
 struct iio_scan_context;
@@ -443,7 +445,17 @@ __api __check_ret struct iio_context * iio_create_xml_context_mem(
 /** @brief Create a context from the network
  * @param host Hostname, IPv4 or IPv6 address where the IIO Daemon is running
  * @return On success, a pointer to an iio_context structure
- * @return On failure, NULL is returned and errno is set appropriately */
+ * @return On failure, NULL is returned and errno is set appropriately
+ *
+ * <b>NOTE:</b> The samples of the input buffers are sent compressed if a
+ * codec is selected with iio_buffer_set_compression(), or if the
+ * IIOD_COMPRESSION environment variable names one when the buffer is
+ * created, optionally followed by a compression level, e.g. "zstd:3". The
+ * "zstd" codec requires libiio and the IIO Daemon to be built with WITH_ZSTD.
+ * The "packed" codec only sends the significant bits of each sample; the
+ * bits of the samples that are outside of them read back as zero, or as
+ * copies of the sign bit for signed channels. Otherwise, the samples are
+ * sent uncompressed. */
 __api __check_ret struct iio_context * iio_create_network_context(const char *host);
 
 
@@ -455,7 +467,10 @@ __api __check_ret struct iio_context * iio_create_network_context(const char *ho
  * <b>NOTE:</b> The following URIs are supported based on compile time backend
  * support:
  * - Local backend, "local:"\n
- *   Does not have an address part. For example <i>"local:"</i>
+ *   Does not have an address part. For example <i>"local:"</i>\n
+ *   The optional <i>root=</i> parameter prefixes the sysfs, debugfs and
+ *   /dev paths with the given directory, which allows to use a synthetic
+ *   device tree. For example <i>"local:root=/tmp/fake-iio"</i>
  * - XML backend, "xml:"\n Requires a path to the XML file for the address part.
  *   For example <i>"xml:/home/user/file.xml"</i>
  * - Network backend, "ip:"\n Requires a hostname, IPv4, or IPv6 to connect to
@@ -529,6 +544,22 @@ __api __check_ret int iio_context_get_version(const struct iio_context *ctx,
 __api __check_ret __pure const char * iio_context_get_xml(const struct iio_context *ctx);
 
 
+/** @brief Obtain a binary representation of the given context
+ * @param ctx A pointer to an iio_context structure
+ * @param dst A pointer to the destination buffer, or NULL to only compute
+ * the size of the binary representation
+ * @param len The size of the destination buffer
+ * @return On success, the size of the binary representation
+ * @return On error, a negative errno code is returned; -ERANGE if the
+ * destination buffer is too small
+ *
+ * <b>NOTE:</b> The binary representation is a compact alternative to the
+ * XML string, served by iiod to its clients. Its format is versioned, and
+ * is internal to libiio. */
+__api __check_ret ssize_t iio_context_get_binary(const struct iio_context *ctx,
+		void *dst, size_t len);
+
+
 /** @brief Get the name of the given context
  * @param ctx A pointer to an iio_context structure
  * @return A pointer to a static NULL-terminated string
@@ -1098,6 +1129,13 @@ __api __check_ret __pure bool iio_device_is_trigger(const struct iio_device *dev
 /** @brief Configure the number of kernel buffers for a device
  *
  * This function allows to change the number of buffers on kernel side.
+ *
+ * <b>NOTE:</b> With the network backend, a count above one also lets
+ * iio_buffer_push() send up to that many blocks of an output buffer without
+ * waiting for the server to acknowledge them, if the server supports it. An
+ * error is then reported by a later call to iio_buffer_push(), or by
+ * iio_buffer_flush(); call the latter before iio_buffer_destroy() to know if
+ * the last blocks were written. By default, each push waits for the server.
  * @param dev A pointer to an iio_device structure
  * @param nb_buffers The number of buffers
  * @return On success, 0 is returned
@@ -1265,6 +1303,48 @@ __api __check_ret int iio_channel_attr_read_double(const struct iio_channel *chn
 		const char *attr, double *val);
 
 
+/** @brief Read the content of multiple channel-specific attributes as integers
+ * @param chns An array of nb pointers to iio_channel structures
+ * @param attrs An array of nb NULL-terminated strings; attrs[i] is the name of
+ * the attribute of chns[i] to read
+ * @param vals An array where the nb values will be stored
+ * @param nb The number of attributes to read
+ * @return On success, 0 is returned
+ * @return On error, the negative errno code of the first attribute that could
+ * not be read is returned; the other values are still stored */
+__api __check_ret int iio_channels_attr_read_longlong(
+		const struct iio_channel * const *chns,
+		const char * const *attrs, long long *vals, size_t nb);
+
+
+/** @brief Read the content of multiple channel-specific attributes as booleans
+ * @param chns An array of nb pointers to iio_channel structures
+ * @param attrs An array of nb NULL-terminated strings; attrs[i] is the name of
+ * the attribute of chns[i] to read
+ * @param vals An array where the nb values will be stored
+ * @param nb The number of attributes to read
+ * @return On success, 0 is returned
+ * @return On error, the negative errno code of the first attribute that could
+ * not be read is returned; the other values are still stored */
+__api __check_ret int iio_channels_attr_read_bool(
+		const struct iio_channel * const *chns,
+		const char * const *attrs, bool *vals, size_t nb);
+
+
+/** @brief Read the content of multiple channel-specific attributes as doubles
+ * @param chns An array of nb pointers to iio_channel structures
+ * @param attrs An array of nb NULL-terminated strings; attrs[i] is the name of
+ * the attribute of chns[i] to read
+ * @param vals An array where the nb values will be stored
+ * @param nb The number of attributes to read
+ * @return On success, 0 is returned
+ * @return On error, the negative errno code of the first attribute that could
+ * not be read is returned; the other values are still stored */
+__api __check_ret int iio_channels_attr_read_double(
+		const struct iio_channel * const *chns,
+		const char * const *attrs, double *vals, size_t nb);
+
+
 /** @brief Set the value of the given channel-specific attribute
  * @param chn A pointer to an iio_channel structure
  * @param attr A NULL-terminated string corresponding to the name of the
@@ -1466,6 +1546,76 @@ __api __check_ret struct iio_buffer * iio_device_create_buffer(const struct iio_
 		size_t samples_count, bool cyclic);
 
 
+/** @brief Parameters of the automatic tuning of a buffer */
+struct iio_buffer_tuning {
+	/** @brief Maximum time, in microseconds, between the acquisition of a
+	 * sample and its availability to the application. Determines the
+	 * number of samples per block. */
+	unsigned int latency_us;
+
+	/** @brief Time, in microseconds, during which the kernel must be able
+	 * to store samples while the application is busy. Determines the
+	 * number of kernel blocks. */
+	unsigned int headroom_us;
+
+	/** @brief Minimum number of kernel blocks, e.g. the suggested_nb_blocks
+	 * reported for a previous buffer; or zero */
+	unsigned int min_nb_blocks;
+};
+
+
+/** @brief Parameters chosen by the automatic tuning of a buffer */
+struct iio_buffer_tuning_result {
+	/** @brief Sampling frequency of the device, in samples per second */
+	double sampling_frequency;
+
+	/** @brief Size of one sample, in bytes */
+	size_t sample_size;
+
+	/** @brief Number of samples per block */
+	size_t samples_count;
+
+	/** @brief Number of kernel blocks */
+	unsigned int nb_blocks;
+
+	/** @brief Number of kernel blocks recommended from the wait times
+	 * observed by iio_buffer_refill */
+	unsigned int suggested_nb_blocks;
+};
+
+
+/** @brief Create an input or output buffer sized from the sampling frequency
+ * @param dev A pointer to an iio_device structure
+ * @param tuning A pointer to an iio_buffer_tuning structure
+ * @param cyclic If True, enable cyclic mode
+ * @return On success, a pointer to an iio_buffer structure
+ * @return On error, NULL is returned, and errno is set to the error code
+ *
+ * <b>NOTE:</b> The sampling frequency is read from the 'sampling_frequency'
+ * attribute of the device, of its buffer, or of its enabled channels. The
+ * number of samples and of kernel blocks used can be retrieved with
+ * iio_buffer_get_tuning. */
+__api __check_ret struct iio_buffer * iio_device_create_tuned_buffer(
+		const struct iio_device *dev,
+		const struct iio_buffer_tuning *tuning, bool cyclic);
+
+
+/** @brief Retrieve the parameters chosen for a tuned buffer
+ * @param buf A pointer to an iio_buffer structure
+ * @param result A pointer to an iio_buffer_tuning_result structure
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The number of kernel blocks cannot change while the buffer
+ * exists. When the refills of an input buffer never have to wait for samples,
+ * the application is lagging behind, and suggested_nb_blocks increases; when
+ * they always have to wait for most of a block, it decreases. A new buffer
+ * created with suggested_nb_blocks as its min_nb_blocks parameter will use
+ * that value. */
+__api __check_ret int iio_buffer_get_tuning(const struct iio_buffer *buf,
+		struct iio_buffer_tuning_result *result);
+
+
 /** @brief Destroy the given buffer
  * @param buf A pointer to an iio_buffer structure
  *
@@ -1496,6 +1646,163 @@ __api __check_ret int iio_buffer_get_poll_fd(struct iio_buffer *buf);
 __api __check_ret int iio_buffer_set_blocking_mode(struct iio_buffer *buf, bool blocking);
 
 
+/**
+ * @enum iio_buffer_wait_policy
+ * @brief How a blocking buffer waits for the device to be ready
+ */
+enum iio_buffer_wait_policy {
+	/** @brief Sleep until the device is ready (default) */
+	IIO_BUFFER_WAIT_SLEEP = 0,
+
+	/** @brief Busy-poll the device until it is ready, or until the
+	 * timeout of the context expires */
+	IIO_BUFFER_WAIT_SPIN,
+
+	/** @brief Busy-poll the device for a bounded time, then sleep */
+	IIO_BUFFER_WAIT_HYBRID,
+};
+
+
+/**
+ * @struct iio_buffer_wait_stats
+ * @brief Statistics about the waits of a buffer for its device
+ */
+struct iio_buffer_wait_stats {
+	/** @brief Number of waits for the device to be ready */
+	uint64_t nb_waits;
+
+	/** @brief Number of waits which completed without sleeping */
+	uint64_t nb_spin_hits;
+
+	/** @brief Total, minimum and maximum duration of the waits, in
+	 * nanoseconds */
+	uint64_t total_ns, min_ns, max_ns;
+};
+
+
+/** @brief Configure how iio_buffer_refill() and iio_buffer_push() wait for
+ * the device
+ *
+ * Spinning avoids the wakeup latency of the sleeping wait, at the cost of
+ * keeping a CPU core busy. The buffer can still be cancelled with
+ * iio_buffer_cancel() while spinning. This setting only applies to blocking
+ * buffers. Setting the policy also resets the wait statistics.
+ * @param buf A pointer to an iio_buffer structure
+ * @param policy The wait policy
+ * @param spin_us With IIO_BUFFER_WAIT_HYBRID, the time to busy-poll before
+ * sleeping, in microseconds
+ * @return On success, 0
+ * @return On error, a negative errno code is returned */
+__api __check_ret int iio_buffer_set_wait_policy(struct iio_buffer *buf,
+		enum iio_buffer_wait_policy policy, unsigned int spin_us);
+
+
+/** @brief Retrieve the wait statistics of a buffer
+ * @param buf A pointer to an iio_buffer structure
+ * @param stats A pointer to an iio_buffer_wait_stats structure, to be filled
+ * @return On success, 0
+ * @return On error, a negative errno code is returned */
+__api __check_ret int iio_buffer_get_wait_stats(const struct iio_buffer *buf,
+		struct iio_buffer_wait_stats *stats);
+
+
+/**
+ * @struct iio_buffer_stream_stats
+ * @brief Amount of data received by the stream of samples of a buffer
+ */
+struct iio_buffer_stream_stats {
+	/** @brief Number of bytes of samples received */
+	uint64_t nb_bytes;
+
+	/** @brief Number of bytes actually sent by the server for them, once
+	 * encoded with the codec of the stream */
+	uint64_t nb_encoded_bytes;
+};
+
+
+/** @brief Retrieve the amount of data received by the stream of an input
+ * buffer
+ *
+ * The counters start when the buffer is created, and also cover the blocks
+ * read before the codec is changed with iio_buffer_set_compression().
+ * @param buf A pointer to an iio_buffer structure
+ * @param stats A pointer to an iio_buffer_stream_stats structure, to be
+ * filled
+ * @return On success, 0
+ * @return On error, a negative errno code is returned. -ENOSYS is returned
+ * if the samples of this buffer are not streamed. */
+__api __check_ret int iio_buffer_get_stream_stats(const struct iio_buffer *buf,
+		struct iio_buffer_stream_stats *stats);
+
+
+/** @brief Select the compression of the samples of an input buffer
+ *
+ * The samples of the buffers of network contexts, and of USB contexts if
+ * libiio and the IIO Daemon are built with WITH_USB_STREAM, can be sent
+ * compressed by the IIO Daemon. This overrides the codec selected by the
+ * IIOD_COMPRESSION environment variable for this buffer. If the server does
+ * not support the codec, the samples are sent uncompressed.
+ * @param buf A pointer to an iio_buffer structure
+ * @param codec The name of the codec, "zstd" or "packed"; or NULL to send
+ * the samples uncompressed
+ * @param level The compression level; only used by the "zstd" codec
+ * @return On success, 0
+ * @return On error, a negative errno code is returned. -ENOSYS is returned
+ * if the backend cannot compress the samples of this buffer.
+ *
+ * <b>NOTE:</b> The stream of samples is restarted with the new codec, which
+ * allocates memory; select the codec before enabling the real-time mode. */
+__api __check_ret int iio_buffer_set_compression(struct iio_buffer *buf,
+		const char *codec, int level);
+
+
+/** @brief Wait until the blocks pushed to an output buffer are written
+ *
+ * With the network backend, iio_buffer_push() may return before the server
+ * has written the block; see iio_device_set_kernel_buffers_count(). This
+ * function waits for all of them, and returns the first error reported.
+ * With the other backends, it returns immediately.
+ * @param buf A pointer to an iio_buffer structure
+ * @return On success, 0
+ * @return On error, a negative errno code is returned */
+__api __check_ret int iio_buffer_flush(struct iio_buffer *buf);
+
+
+/** @brief Enable or disable the real-time mode of a buffer
+ *
+ * In real-time mode, the memory of the buffer is locked into RAM, so that
+ * accessing it never causes a page fault. The backends that support this
+ * mode do not allocate heap memory in iio_buffer_refill() and
+ * iio_buffer_push(); all the objects they need are allocated when the
+ * buffer is created.
+ * @param buf A pointer to an iio_buffer structure
+ * @param enable If True, enable the real-time mode
+ * @return On success, 0
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> Locking memory may require the CAP_IPC_LOCK capability, or a
+ * large enough RLIMIT_MEMLOCK limit. */
+__api __check_ret int iio_buffer_set_realtime_mode(struct iio_buffer *buf,
+		bool enable);
+
+
+/** @brief Install an instrumentation hook for the real-time mode
+ *
+ * When the real-time mode is enabled, the hook is called when entering and
+ * when leaving iio_buffer_refill() and iio_buffer_push(). This allows a test
+ * harness to detect forbidden operations, like heap allocations, performed
+ * by the library on the real-time path. The iio_rtcheck test program uses
+ * it to count the heap allocations and page faults of the real-time path.
+ * @param buf A pointer to an iio_buffer structure
+ * @param hook A pointer to a function, called with enter set to True when
+ * entering the real-time path, and to False when leaving it; or NULL to
+ * remove the hook
+ * @param data A pointer passed as the last argument of the hook */
+__api void iio_buffer_set_realtime_hook(struct iio_buffer *buf,
+		void (*hook)(const struct iio_buffer *buf, bool enter, void *d),
+		void *data);
+
+
 /** @brief Fetch more samples from the hardware
  * @param buf A pointer to an iio_buffer structure
  * @return On success, the number of bytes read is returned
@@ -1616,6 +1923,126 @@ __api void iio_buffer_set_data(struct iio_buffer *buf, void *data);
  * @return The pointer previously associated if present, or NULL */
 __api void * iio_buffer_get_data(const struct iio_buffer *buf);
 
+/** @} *//* ------------------------------------------------------------------*/
+/* ------------------------- Event functions ---------------------------------*/
+/** @defgroup Event Event
+ * @{
+ * @struct iio_event
+ * @brief An event generated by an IIO device
+ *
+ * The layout of this structure matches the one of the events delivered by
+ * the Linux kernel. The id field encodes the type and direction of the event,
+ * as well as the channel that generated it. */
+struct iio_event {
+	uint64_t id;
+	int64_t timestamp;
+};
+
+/** @struct iio_event_stream
+ * @brief A stream of events generated by an IIO device */
+
+
+/** @brief Create a stream of events for the given device
+ * @param dev A pointer to an iio_device structure
+ * @return On success, a pointer to an iio_event_stream structure
+ * @return On error, NULL is returned, and errno is set to the error code
+ *
+ * <b>NOTE:</b> The kernel supports only one event stream per device. */
+__api __check_ret struct iio_event_stream *
+iio_device_create_event_stream(const struct iio_device *dev);
+
+
+/** @brief Destroy the given event stream
+ * @param stream A pointer to an iio_event_stream structure
+ *
+ * <b>NOTE:</b> If another thread is blocked in iio_event_stream_read(), it
+ * has to be woken up with iio_event_stream_cancel() and to return before
+ * the stream is destroyed. */
+__api void iio_event_stream_destroy(struct iio_event_stream *stream);
+
+
+/** @brief Cancel the pending and future reads of the given event stream
+ * @param stream A pointer to an iio_event_stream structure
+ *
+ * A blocking iio_event_stream_read() returns -EBADF once the stream is
+ * cancelled, and so do all the later reads; the stream can then only be
+ * destroyed. Cancelling a stream more than once has no additional effect.
+ *
+ * This function is thread-safe, but not signal-safe, i.e. it must not be
+ * called from a signal handler. */
+__api void iio_event_stream_cancel(struct iio_event_stream *stream);
+
+
+/** @brief Retrieve a pointer to the iio_device structure
+ * @param stream A pointer to an iio_event_stream structure
+ * @return A pointer to an iio_device structure */
+__api __check_ret __pure const struct iio_device *
+iio_event_stream_get_device(const struct iio_event_stream *stream);
+
+
+/** @brief Get a pollable file descriptor
+ * @param stream A pointer to an iio_event_stream structure
+ * @return On success, valid file descriptor
+ * @return On error, a negative errno code is returned
+ *
+ * The file descriptor becomes readable when new events are available.
+ * Events that have already been retrieved from the kernel are queued by the
+ * stream and do not make the file descriptor readable; before polling, the
+ * application should call iio_event_stream_read() in non-blocking mode until
+ * it returns -EAGAIN. */
+__api __check_ret int
+iio_event_stream_get_poll_fd(const struct iio_event_stream *stream);
+
+
+/** @brief Read events from the given event stream
+ * @param stream A pointer to an iio_event_stream structure
+ * @param events A pointer to an array of iio_event structures, where the
+ * events will be stored
+ * @param nb The number of elements in the array
+ * @param nonblock if True, the operation won't block and return -EAGAIN
+ * if no events are available
+ * @return On success, the number of events read is returned
+ * @return On error, a negative errno code is returned
+ *
+ * Events are retrieved from the kernel in batches and queued by the stream;
+ * a single call may return several events. In blocking mode, this function
+ * returns as soon as at least one event is available, or when the timeout
+ * configured with iio_context_set_timeout() expires. */
+__api __check_ret ssize_t
+iio_event_stream_read(struct iio_event_stream *stream,
+		struct iio_event *events, size_t nb, bool nonblock);
+
+
+/** @brief Get the type of the given event
+ * @param event A pointer to an iio_event structure
+ * @return The type of the event */
+static inline enum iio_event_type
+iio_event_get_type(const struct iio_event *event)
+{
+	return (enum iio_event_type)((event->id >> 56) & 0xff);
+}
+
+
+/** @brief Get the direction of the given event
+ * @param event A pointer to an iio_event structure
+ * @return The direction of the event */
+static inline enum iio_event_direction
+iio_event_get_direction(const struct iio_event *event)
+{
+	return (enum iio_event_direction)((event->id >> 48) & 0x7f);
+}
+
+
+/** @brief Get the channel that generated the given event
+ * @param event A pointer to an iio_event structure
+ * @param dev A pointer to the iio_device structure that generated the event
+ * @param diff If True, return the second channel of a differential event
+ * @return On success, a pointer to an iio_channel structure
+ * @return If the channel cannot be found, NULL is returned */
+__api __check_ret const struct iio_channel *
+iio_event_get_channel(const struct iio_event *event,
+		const struct iio_device *dev, bool diff);
+
 /** @} *//* ------------------------------------------------------------------*/
 /* ---------------------------- HWMON support --------------------------------*/
 /** @defgroup Hwmon Compatibility with hardware monitoring (hwmon) devices
@@ -1666,6 +2093,77 @@ static inline bool iio_device_is_hwmon(const struct iio_device *dev)
 }
 
 
+/**
+ * @struct iio_hwmon_value
+ * @brief A value read from a hwmon channel by a snapshot
+ */
+struct iio_hwmon_value {
+	/** @brief Value of the channel, in volts (voltage), RPM (fan), raw
+	 * duty cycle (pwm), degrees Celsius (temp), amperes (current), watts
+	 * (power), joules (energy), percents (humidity) or boolean
+	 * (intrusion) */
+	double value;
+
+	/** @brief Zero on success, or a negative errno code if the channel
+	 * could not be read */
+	int error;
+};
+
+
+/** @brief Create a snapshot of all the hwmon sensors of a context
+ * @param ctx A pointer to an iio_context structure
+ * @return On success, a pointer to an iio_hwmon_snapshot structure
+ * @return On error, NULL is returned, and errno is set to the error code
+ *
+ * The snapshot contains one entry per hwmon channel that provides a value,
+ * in the order of the devices and channels of the context. The index of a
+ * channel is stable for the lifetime of the snapshot. The values are only
+ * read when iio_hwmon_snapshot_refresh() is called. */
+__api __check_ret struct iio_hwmon_snapshot *
+iio_context_create_hwmon_snapshot(const struct iio_context *ctx);
+
+
+/** @brief Destroy the given hwmon snapshot
+ * @param snapshot A pointer to an iio_hwmon_snapshot structure */
+__api void iio_hwmon_snapshot_destroy(struct iio_hwmon_snapshot *snapshot);
+
+
+/** @brief Read the values of all the channels of a hwmon snapshot
+ * @param snapshot A pointer to an iio_hwmon_snapshot structure
+ * @return On success, the number of channels that could not be read
+ * @return On error, a negative errno code is returned
+ *
+ * The errors specific to one channel are reported in the error field of
+ * its iio_hwmon_value structure. */
+__api __check_ret int
+iio_hwmon_snapshot_refresh(struct iio_hwmon_snapshot *snapshot);
+
+
+/** @brief Enumerate the channels of a hwmon snapshot
+ * @param snapshot A pointer to an iio_hwmon_snapshot structure
+ * @return The number of channels in the snapshot */
+__api __check_ret __pure unsigned int
+iio_hwmon_snapshot_get_channels_count(const struct iio_hwmon_snapshot *snapshot);
+
+
+/** @brief Get the channel present at the given index of a hwmon snapshot
+ * @param snapshot A pointer to an iio_hwmon_snapshot structure
+ * @param index The index corresponding to the channel
+ * @return On success, a pointer to an iio_channel structure
+ * @return If the index is invalid, NULL is returned */
+__api __check_ret __pure const struct iio_channel *
+iio_hwmon_snapshot_get_channel(const struct iio_hwmon_snapshot *snapshot,
+		unsigned int index);
+
+
+/** @brief Get the values read by the last refresh of a hwmon snapshot
+ * @param snapshot A pointer to an iio_hwmon_snapshot structure
+ * @return A pointer to an array of iio_hwmon_value structures, indexed like
+ * the channels of the snapshot */
+__api __check_ret __pure const struct iio_hwmon_value *
+iio_hwmon_snapshot_get_values(const struct iio_hwmon_snapshot *snapshot);
+
+
 /** @} *//* ------------------------------------------------------------------*/
 /* ------------------------- Low-level functions -----------------------------*/
 /** @defgroup Debug Debug and low-level functions
@@ -1975,6 +2473,35 @@ __api __check_ret int iio_device_reg_read(struct iio_device *dev,
 		uint32_t address, uint32_t *value);
 
 
+/** @brief Set the values of multiple hardware registers
+ * @param dev A pointer to an iio_device structure
+ * @param addresses An array of nb register addresses
+ * @param values An array of nb values, written to the registers in order
+ * @param nb The number of registers to write
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> When supported by the backend, the whole batch is executed in
+ * one go, e.g. in one request to the IIOD server. If an error occurs, some
+ * of the registers may have been written already. */
+__api __check_ret int iio_device_reg_write_batch(struct iio_device *dev,
+		const uint32_t *addresses, const uint32_t *values, size_t nb);
+
+
+/** @brief Get the values of multiple hardware registers
+ * @param dev A pointer to an iio_device structure
+ * @param addresses An array of nb register addresses
+ * @param values An array where the nb values will be written
+ * @param nb The number of registers to read
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> When supported by the backend, the whole batch is executed in
+ * one go, e.g. in one request to the IIOD server. */
+__api __check_ret int iio_device_reg_read_batch(struct iio_device *dev,
+		const uint32_t *addresses, uint32_t *values, size_t nb);
+
+
 /** @} */
 
 #ifdef __cplusplus
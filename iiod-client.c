@@ -8,6 +8,7 @@
 
 #include "debug.h"
 #include "iiod-client.h"
+#include "iiod-protocol.h"
 #include "iio-config.h"
 #include "iio-lock.h"
 #include "iio-private.h"
@@ -20,10 +21,94 @@
 #include <zstd.h>
 #endif
 
+/* Request sent with the binary framing, waiting for its response */
+struct iiod_client_request {
+	struct iiod_client_request *next;
+	uint16_t id;
+	bool done;
+
+	/* Result of the operation */
+	int32_t code;
+
+	/* Destination of the payload of the response. If 'alloc' is set,
+	 * it is allocated once the size of the payload is known. */
+	void *dst;
+	size_t len;
+	bool alloc;
+};
+
 struct iiod_client {
 	struct iio_context_pdata *pdata;
 	const struct iiod_client_ops *ops;
 	struct iio_mutex *lock;
+
+	/* Connection that uses the binary framing, if negotiated */
+	struct iiod_client_pdata *binary_desc;
+	bool binary;
+
+	/* Serializes the frames sent */
+	struct iio_mutex *write_lock;
+
+	/* Protects the fields below */
+	struct iio_mutex *req_lock;
+	struct iio_cond *req_cond;
+
+	/* Requests waiting for their response */
+	struct iiod_client_request *requests;
+	uint16_t next_id;
+
+	/* Set while a thread reads a response on behalf of the others */
+	bool reading;
+
+	/* Once the stream is out of sync, all the requests fail */
+	int err;
+
+	/* Whether the server knows the REGREAD and REGWRITE commands, once
+	 * the first batch answered */
+	bool regs_checked, regs_supported;
+
+	/* Whether the server reads the data of the pipelined WRITEBUF
+	 * commands it rejects, once the first one answered */
+	bool pipelined_write_checked, pipelined_write_supported;
+};
+
+struct iiod_client_buf {
+	const void *ptr;
+	size_t len;
+};
+
+enum iiod_client_codec {
+	IIOD_CLIENT_CODEC_NONE,
+	IIOD_CLIENT_CODEC_ZSTD,
+	IIOD_CLIENT_CODEC_PACKED,
+};
+
+/* Position and format of the samples of a channel, for the packed codec */
+struct iiod_client_packed_chn {
+	unsigned int offset, length, bits, shift, repeat;
+	bool is_signed, is_be;
+};
+
+/* Stream of blocks started with READBUF */
+struct iiod_client_stream {
+	const struct iio_device *dev;
+	size_t len;
+	enum iiod_client_codec codec;
+
+	/* Number of bytes of the blocks received, as sent by the server */
+	uint64_t nb_encoded;
+
+	/* Encoded data of the current answer, followed by the data once
+	 * decompressed with zstd */
+	uint8_t *zbuf;
+
+	/* Layout of the samples of the current block, for the packed codec */
+	struct iiod_client_packed_chn *layout;
+	unsigned int nb_layout;
+	size_t sample_size;
+#if WITH_ZSTD
+	ZSTD_DCtx *dctx;
+#endif
 };
 
 void iiod_client_mutex_lock(struct iiod_client *client)
@@ -145,12 +230,35 @@ static ssize_t iiod_client_read_all(struct iiod_client *client,
 	return (ssize_t) (ptr - (uintptr_t) dst);
 }
 
+static int iiod_client_discard(struct iiod_client *client,
+			       struct iiod_client_pdata *desc,
+			       char *buf, size_t buf_len, size_t to_discard)
+{
+	do {
+		size_t read_len;
+		ssize_t ret;
+
+		if (to_discard > buf_len)
+			read_len = buf_len;
+		else
+			read_len = to_discard;
+
+		ret = iiod_client_read_all(client, desc, buf, read_len);
+		if (ret < 0)
+			return (int) ret;
+
+		to_discard -= (size_t) ret;
+	} while (to_discard);
+
+	return 0;
+}
+
 struct iiod_client * iiod_client_new(struct iio_context_pdata *pdata,
 				     const struct iiod_client_ops *ops)
 {
 	struct iiod_client *client;
 
-	client = malloc(sizeof(*client));
+	client = zalloc(sizeof(*client));
 	if (!client) {
 		errno = ENOMEM;
 		return NULL;
@@ -162,10 +270,34 @@ struct iiod_client * iiod_client_new(struct iio_context_pdata *pdata,
 		goto err_free_client;
 	}
 
+	client->write_lock = iio_mutex_create();
+	if (!client->write_lock) {
+		errno = ENOMEM;
+		goto err_destroy_lock;
+	}
+
+	client->req_lock = iio_mutex_create();
+	if (!client->req_lock) {
+		errno = ENOMEM;
+		goto err_destroy_write_lock;
+	}
+
+	client->req_cond = iio_cond_create();
+	if (!client->req_cond) {
+		errno = ENOMEM;
+		goto err_destroy_req_lock;
+	}
+
 	client->pdata = pdata;
 	client->ops = ops;
 	return client;
 
+err_destroy_req_lock:
+	iio_mutex_destroy(client->req_lock);
+err_destroy_write_lock:
+	iio_mutex_destroy(client->write_lock);
+err_destroy_lock:
+	iio_mutex_destroy(client->lock);
 err_free_client:
 	free(client);
 	return NULL;
@@ -173,10 +305,309 @@ err_free_client:
 
 void iiod_client_destroy(struct iiod_client *client)
 {
+	iio_cond_destroy(client->req_cond);
+	iio_mutex_destroy(client->req_lock);
+	iio_mutex_destroy(client->write_lock);
 	iio_mutex_destroy(client->lock);
 	free(client);
 }
 
+static bool iiod_client_is_binary(const struct iiod_client *client,
+				  const struct iiod_client_pdata *desc)
+{
+	return client->binary && desc == client->binary_desc;
+}
+
+int iiod_client_enable_binary(struct iiod_client *client,
+			      struct iiod_client_pdata *desc)
+{
+	int ret;
+
+	iio_mutex_lock(client->lock);
+
+	ret = iiod_client_exec_command(client, desc, "BINARY\r\n");
+	if (!ret) {
+		client->binary_desc = desc;
+		client->binary = true;
+	} else if (ret == -EINVAL) {
+		/* Older IIOD, which only knows the text protocol */
+		ret = -ENOSYS;
+	}
+
+	iio_mutex_unlock(client->lock);
+	return ret;
+}
+
+/* Payloads up to this size are sent in the same write as the header */
+#define IIOD_CLIENT_INLINE_SIZE 512
+
+static int iiod_client_send_frame(struct iiod_client *client,
+				  struct iiod_client_pdata *desc,
+				  const struct iiod_frame *frame,
+				  const struct iiod_client_buf *bufs,
+				  unsigned int nb_bufs)
+{
+	char buf[sizeof(*frame) + IIOD_CLIENT_INLINE_SIZE];
+	struct iiod_frame hdr;
+	size_t len = 0;
+	unsigned int i;
+	ssize_t ret;
+
+	for (i = 0; i < nb_bufs; i++)
+		len += bufs[i].len;
+
+	hdr.id = iio_htobe16(frame->id);
+	hdr.op = frame->op;
+	hdr.flags = frame->flags;
+	hdr.dev = iio_htobe16(frame->dev);
+	hdr.chn = iio_htobe16(frame->chn);
+	hdr.code = (int32_t) iio_htobe32((uint32_t) frame->code);
+	hdr.len = iio_htobe32((uint32_t) len);
+
+	memcpy(buf, &hdr, sizeof(hdr));
+	len = sizeof(hdr);
+
+	for (i = 0; i < nb_bufs && len + bufs[i].len <= sizeof(buf); i++) {
+		memcpy(&buf[len], bufs[i].ptr, bufs[i].len);
+		len += bufs[i].len;
+	}
+
+	ret = iiod_client_write_all(client, desc, buf, len);
+
+	for (; ret >= 0 && i < nb_bufs; i++)
+		ret = iiod_client_write_all(client, desc,
+					    bufs[i].ptr, bufs[i].len);
+
+	return ret < 0 ? (int) ret : 0;
+}
+
+void iiod_client_exit(struct iiod_client *client,
+		      struct iiod_client_pdata *desc)
+{
+	struct iiod_frame frame = { .op = IIOD_OP_EXIT };
+
+	if (iiod_client_is_binary(client, desc)) {
+		iio_mutex_lock(client->write_lock);
+		iiod_client_send_frame(client, desc, &frame, NULL, 0);
+		iio_mutex_unlock(client->write_lock);
+	} else {
+		iiod_client_write_all(client, desc, "\r\nEXIT\r\n",
+				      sizeof("\r\nEXIT\r\n") - 1);
+	}
+}
+
+/* Reads one response, and hands it to the request it belongs to */
+static int iiod_client_read_frame(struct iiod_client *client,
+				  struct iiod_client_pdata *desc)
+{
+	struct iiod_client_request *req;
+	struct iiod_frame frame;
+	size_t len, to_read;
+	void *dst = NULL;
+	int32_t code;
+	char tmp[256];
+	ssize_t ret;
+
+	do {
+		ret = client->ops->read(client->pdata, desc,
+					(char *) &frame, sizeof(frame));
+	} while (ret == -EINTR);
+
+	/* Nothing was received: the stream is still in sync */
+	if (ret <= 0)
+		return ret ? (int) ret : -EPIPE;
+
+	if ((size_t) ret < sizeof(frame)) {
+		ret = iiod_client_read_all(client, desc, (char *) &frame + ret,
+					   sizeof(frame) - (size_t) ret);
+		if (ret < 0)
+			goto err_out_of_sync;
+	}
+
+	code = (int32_t) iio_be32toh((uint32_t) frame.code);
+	len = iio_be32toh(frame.len);
+	frame.id = iio_be16toh(frame.id);
+
+	iio_mutex_lock(client->req_lock);
+	for (req = client->requests; req; req = req->next)
+		if (req->id == frame.id && !req->done)
+			break;
+	iio_mutex_unlock(client->req_lock);
+
+	if (!req) {
+		/* Response to a request that already failed */
+		IIO_DEBUG("Dropping response to request %u\n", frame.id);
+
+		ret = iiod_client_discard(client, desc, tmp, sizeof(tmp), len);
+		if (ret < 0)
+			goto err_out_of_sync;
+
+		return 0;
+	}
+
+	/* The requester waits until 'done' is set, so its buffer can be
+	 * filled without holding the lock */
+	if (req->alloc) {
+		dst = malloc(len + 1);
+		to_read = dst ? len : 0;
+		if (!dst)
+			code = -ENOMEM;
+	} else {
+		dst = req->dst;
+		to_read = len < req->len ? len : req->len;
+		if (to_read < len && code >= 0)
+			code = -EIO;
+	}
+
+	ret = iiod_client_read_all(client, desc, dst, to_read);
+	if (ret >= 0 && to_read < len)
+		ret = iiod_client_discard(client, desc, tmp, sizeof(tmp),
+					  len - to_read);
+	if (ret < 0) {
+		if (req->alloc)
+			free(dst);
+		goto err_out_of_sync;
+	}
+
+	iio_mutex_lock(client->req_lock);
+	req->code = code;
+	req->dst = dst;
+	req->len = to_read;
+	req->done = true;
+	iio_mutex_unlock(client->req_lock);
+
+	return 0;
+
+err_out_of_sync:
+	IIO_ERROR("Lost the synchronization with IIOD: %zd\n", ret);
+
+	iio_mutex_lock(client->req_lock);
+	client->err = (int) ret;
+	iio_mutex_unlock(client->req_lock);
+
+	return (int) ret;
+}
+
+/* Sends the request, and waits for its response. Meanwhile, other threads
+ * can send their own requests on the same connection; the first one waiting
+ * reads the responses, and wakes up the others as their response arrives. */
+static int iiod_client_exec_frame(struct iiod_client *client,
+				  struct iiod_client_pdata *desc,
+				  struct iiod_frame *frame,
+				  const struct iiod_client_buf *bufs,
+				  unsigned int nb_bufs,
+				  struct iiod_client_request *req)
+{
+	struct iiod_client_request **ptr, *cur;
+	bool failed;
+	int ret;
+
+	iio_mutex_lock(client->req_lock);
+
+	if (client->err) {
+		iio_mutex_unlock(client->req_lock);
+		return client->err;
+	}
+
+	frame->id = client->next_id++;
+	req->id = frame->id;
+	req->done = false;
+	req->next = client->requests;
+	client->requests = req;
+
+	iio_mutex_unlock(client->req_lock);
+
+	iio_mutex_lock(client->write_lock);
+	ret = iiod_client_send_frame(client, desc, frame, bufs, nb_bufs);
+	iio_mutex_unlock(client->write_lock);
+
+	iio_mutex_lock(client->req_lock);
+
+	failed = ret < 0;
+	if (failed) {
+		/* Part of the frame may have been sent */
+		client->err = ret;
+		req->code = ret;
+	}
+
+	while (!req->done) {
+		if (client->reading) {
+			iio_cond_wait(client->req_cond, client->req_lock);
+			continue;
+		}
+
+		/* Only give up once no reader can access the request */
+		if (failed) {
+			req->done = true;
+			break;
+		}
+
+		client->reading = true;
+		iio_mutex_unlock(client->req_lock);
+
+		ret = iiod_client_read_frame(client, desc);
+
+		iio_mutex_lock(client->req_lock);
+		client->reading = false;
+
+		if (ret < 0) {
+			for (cur = client->requests; cur; cur = cur->next) {
+				if (!cur->done) {
+					cur->code = ret;
+					cur->done = true;
+				}
+			}
+		}
+
+		iio_cond_broadcast(client->req_cond);
+	}
+
+	for (ptr = &client->requests; *ptr != req; ptr = &(*ptr)->next);
+	*ptr = req->next;
+
+	iio_mutex_unlock(client->req_lock);
+
+	return req->code;
+}
+
+static uint16_t iiod_client_device_index(const struct iio_device *dev)
+{
+	const struct iio_context *ctx = dev->ctx;
+	unsigned int i;
+
+	for (i = 0; i < ctx->nb_devices && ctx->devices[i] != dev; i++);
+
+	return (uint16_t) i;
+}
+
+static uint8_t iiod_client_attr_flags(const struct iio_channel *chn,
+				      enum iio_attr_type type)
+{
+	if (chn)
+		return IIOD_FRAME_CHANNEL;
+	if (type == IIO_ATTR_TYPE_DEBUG)
+		return IIOD_FRAME_DEBUG;
+	if (type == IIO_ATTR_TYPE_BUFFER)
+		return IIOD_FRAME_BUFFER;
+
+	return 0;
+}
+
+/* For the requests without payload, in both directions */
+static int iiod_client_exec_op(struct iiod_client *client,
+			       struct iiod_client_pdata *desc, uint8_t op,
+			       const struct iio_device *dev, int32_t code)
+{
+	struct iiod_client_request req = { 0 };
+	struct iiod_frame frame = {
+		.op = op,
+		.dev = dev ? iiod_client_device_index(dev) : 0,
+		.code = code,
+	};
+
+	return iiod_client_exec_frame(client, desc, &frame, NULL, 0, &req);
+}
+
 int iiod_client_get_version(struct iiod_client *client,
 			    struct iiod_client_pdata *desc,
 			    unsigned int *major, unsigned int *minor,
@@ -188,6 +619,26 @@ int iiod_client_get_version(struct iiod_client *client,
 	long maj, min;
 	int ret;
 
+	if (iiod_client_is_binary(client, desc)) {
+		struct iiod_client_request req = { .dst = buf, .len = 8 };
+		struct iiod_frame frame = { .op = IIOD_OP_VERSION };
+
+		ret = iiod_client_exec_frame(client, desc, &frame,
+					     NULL, 0, &req);
+		if (ret < 0)
+			return ret;
+
+		buf[req.len] = '\0';
+
+		if (major)
+			*major = (unsigned int) ret >> 16;
+		if (minor)
+			*minor = (unsigned int) ret & 0xffff;
+		if (git_tag)
+			iio_strlcpy(git_tag, buf, 8);
+		return 0;
+	}
+
 	iio_mutex_lock(client->lock);
 
 	ret = (int) iiod_client_write_all(client, desc,
@@ -241,6 +692,17 @@ int iiod_client_get_trigger(struct iiod_client *client,
 	unsigned int name_len;
 	int ret;
 
+	if (iiod_client_is_binary(client, desc)) {
+		ret = iiod_client_exec_op(client, desc, IIOD_OP_GETTRIG, dev, 0);
+		if (ret < 0)
+			return ret;
+		if ((unsigned int) ret > nb_devices)
+			return -EIO;
+
+		*trigger = ret ? iio_context_get_device(ctx, ret - 1) : NULL;
+		return 0;
+	}
+
 	iio_snprintf(buf, sizeof(buf), "GETTRIG %s\r\n",
 			iio_device_get_id(dev));
 
@@ -295,6 +757,11 @@ int iiod_client_set_trigger(struct iiod_client *client,
 	char buf[1024];
 	int ret;
 
+	if (iiod_client_is_binary(client, desc)) {
+		return iiod_client_exec_op(client, desc, IIOD_OP_SETTRIG, dev,
+				trigger ? iiod_client_device_index(trigger) + 1 : 0);
+	}
+
 	if (trigger) {
 		iio_snprintf(buf, sizeof(buf), "SETTRIG %s %s\r\n",
 				iio_device_get_id(dev),
@@ -318,6 +785,12 @@ int iiod_client_set_kernel_buffers_count(struct iiod_client *client,
 	int ret;
 	char buf[1024];
 
+	if (iiod_client_is_binary(client, desc)) {
+		return iiod_client_exec_op(client, desc,
+					   IIOD_OP_SET_BUFFERS_COUNT,
+					   dev, (int32_t) nb_blocks);
+	}
+
 	iio_snprintf(buf, sizeof(buf), "SET %s BUFFERS_COUNT %u\r\n",
 			iio_device_get_id(dev), nb_blocks);
 
@@ -334,6 +807,11 @@ int iiod_client_set_timeout(struct iiod_client *client,
 	int ret;
 	char buf[1024];
 
+	if (iiod_client_is_binary(client, desc)) {
+		return iiod_client_exec_op(client, desc, IIOD_OP_TIMEOUT,
+					   NULL, (int32_t) timeout);
+	}
+
 	iio_snprintf(buf, sizeof(buf), "TIMEOUT %u\r\n", timeout);
 
 	iio_mutex_lock(client->lock);
@@ -342,27 +820,34 @@ int iiod_client_set_timeout(struct iiod_client *client,
 	return ret;
 }
 
-static int iiod_client_discard(struct iiod_client *client,
-			       struct iiod_client_pdata *desc,
-			       char *buf, size_t buf_len, size_t to_discard)
+static ssize_t iiod_client_read_attr_binary(struct iiod_client *client,
+					    struct iiod_client_pdata *desc,
+					    const struct iio_device *dev,
+					    const struct iio_channel *chn,
+					    const char *attr, char *dest,
+					    size_t len, enum iio_attr_type type)
 {
-	do {
-		size_t read_len;
-		ssize_t ret;
+	struct iiod_client_buf name = { attr, attr ? strlen(attr) : 0 };
+	struct iiod_client_request req = { .dst = dest, .len = len - 1 };
+	struct iiod_frame frame = {
+		.op = IIOD_OP_READ_ATTR,
+		.flags = iiod_client_attr_flags(chn, type),
+		.dev = iiod_client_device_index(dev),
+		.chn = chn ? (uint16_t) chn->number : 0,
+	};
+	int ret;
 
-		if (to_discard > buf_len)
-			read_len = buf_len;
-		else
-			read_len = to_discard;
+	/* Keep room for the trailing \0 */
+	if (!len)
+		return -EIO;
 
-		ret = iiod_client_read_all(client, desc, buf, read_len);
-		if (ret < 0)
-			return (int) ret;
+	ret = iiod_client_exec_frame(client, desc, &frame, &name, 1, &req);
+	if (ret < 0)
+		return ret;
 
-		to_discard -= (size_t) ret;
-	} while (to_discard);
+	dest[req.len] = '\0';
 
-	return 0;
+	return (ssize_t) req.len;
 }
 
 ssize_t iiod_client_read_attr(struct iiod_client *client,
@@ -400,6 +885,11 @@ ssize_t iiod_client_read_attr(struct iiod_client *client,
 		}
 	}
 
+	if (iiod_client_is_binary(client, desc)) {
+		return iiod_client_read_attr_binary(client, desc, dev, chn,
+						    attr, dest, len, type);
+	}
+
 	if (chn) {
 		iio_snprintf(buf, sizeof(buf), "READ %s %s %s %s\r\n", id,
 				iio_channel_is_output(chn) ? "OUTPUT" : "INPUT",
@@ -449,6 +939,30 @@ out_unlock:
 	return ret;
 }
 
+static ssize_t iiod_client_write_attr_binary(struct iiod_client *client,
+					     struct iiod_client_pdata *desc,
+					     const struct iio_device *dev,
+					     const struct iio_channel *chn,
+					     const char *attr, const char *src,
+					     size_t len, enum iio_attr_type type)
+{
+	/* The name of the attribute, with its \0, then the value */
+	struct iiod_client_buf bufs[] = {
+		{ attr ? attr : "", attr ? strlen(attr) + 1 : 1 },
+		{ src, len },
+	};
+	struct iiod_client_request req = { 0 };
+	struct iiod_frame frame = {
+		.op = IIOD_OP_WRITE_ATTR,
+		.flags = iiod_client_attr_flags(chn, type),
+		.dev = iiod_client_device_index(dev),
+		.chn = chn ? (uint16_t) chn->number : 0,
+	};
+
+	return iiod_client_exec_frame(client, desc, &frame,
+				      bufs, ARRAY_SIZE(bufs), &req);
+}
+
 ssize_t iiod_client_write_attr(struct iiod_client *client,
 			       struct iiod_client_pdata *desc,
 			       const struct iio_device *dev,
@@ -485,6 +999,11 @@ ssize_t iiod_client_write_attr(struct iiod_client *client,
 		}
 	}
 
+	if (iiod_client_is_binary(client, desc)) {
+		return iiod_client_write_attr_binary(client, desc, dev, chn,
+						     attr, src, len, type);
+	}
+
 	if (chn) {
 		iio_snprintf(buf, sizeof(buf), "WRITE %s %s %s %s %lu\r\n", id,
 				iio_channel_is_output(chn) ? "OUTPUT" : "INPUT",
@@ -527,60 +1046,336 @@ out_unlock:
 	return ret;
 }
 
-static struct iio_context *
-iiod_client_create_context_private(struct iiod_client *client,
-				   struct iiod_client_pdata *desc, bool zstd)
+/* Maximum number of registers sent in one REGREAD or REGWRITE command */
+#define IIOD_CLIENT_REGS_BATCH 4096
+
+static int iiod_client_regs_cmd(struct iiod_client *client,
+				struct iiod_client_pdata *desc,
+				const struct iio_device *dev,
+				const char *cmd, size_t nb)
 {
-	const char *cmd = zstd ? "ZPRINT\r\n" : "PRINT\r\n";
-	struct iio_context *ctx = NULL;
-	size_t xml_len;
-	char *xml;
+	char buf[1024];
 	int ret;
 
-	iio_mutex_lock(client->lock);
-	ret = iiod_client_exec_command(client, desc, cmd);
-	if (ret < 0) {
-		if (ret == -EINVAL && zstd) {
-			/* If the ZPRINT command does not exist, try again
-			 * with the regular PRINT command. */
-			iio_mutex_unlock(client->lock);
+	if (client->regs_checked && !client->regs_supported)
+		return -ENOSYS;
 
-			return iiod_client_create_context_private(client, desc, false);
-		}
+	iio_snprintf(buf, sizeof(buf), "%s %s %lu\r\n", cmd,
+		     iio_device_get_id(dev), (unsigned long) nb);
 
-		goto out_unlock;
-	}
+	/* IIOD answers before the payload is sent. Older versions do not
+	 * know the command, and report a syntax error to the first one;
+	 * the later ones fall back without a round trip. */
+	ret = iiod_client_exec_command(client, desc, buf);
+	if (!client->regs_checked && (ret >= 0 || ret == -EINVAL)) {
+		client->regs_checked = true;
+		client->regs_supported = ret != -EINVAL;
 
-	xml_len = (size_t) ret;
-	xml = malloc(xml_len + 1);
-	if (!xml) {
-		ret = -ENOMEM;
-		goto out_unlock;
+		if (ret == -EINVAL)
+			return -ENOSYS;
 	}
 
-	/* +1: Also read the trailing \n */
-	ret = (int) iiod_client_read_all(client, desc, xml, xml_len + 1);
-	if (ret < 0)
-		goto out_free_xml;
+	return ret;
+}
 
-#if WITH_ZSTD
-	if (zstd) {
-		unsigned long long len;
-		char *xml_zstd;
+static int iiod_client_regs_binary(struct iiod_client *client,
+				   struct iiod_client_pdata *desc,
+				   const struct iio_device *dev,
+				   const uint32_t *addrs, const uint32_t *values,
+				   uint32_t *dst, size_t nb, uint32_t *buf)
+{
+	struct iiod_client_buf payload = { buf, 0 };
+	struct iiod_client_request req = { .dst = buf };
+	struct iiod_frame frame = {
+		.op = values ? IIOD_OP_REGWRITE : IIOD_OP_REGREAD,
+		.dev = iiod_client_device_index(dev),
+	};
+	size_t i, count, done;
+	int ret = 0;
+
+	count = nb < IIOD_CLIENT_REGS_BATCH ? nb : IIOD_CLIENT_REGS_BATCH;
+
+	for (done = 0; done < nb; done += count) {
+		if (nb - done < count)
+			count = nb - done;
+
+		/* All the addresses, followed by all the values */
+		for (i = 0; i < count; i++) {
+			buf[i] = iio_htobe32(addrs[done + i]);
+			if (values)
+				buf[count + i] = iio_htobe32(values[done + i]);
+		}
 
-		IIO_DEBUG("Received ZSTD-compressed XML string.\n");
+		payload.len = (values ? 2 : 1) * count * sizeof(*buf);
 
-		len = ZSTD_getFrameContentSize(xml, xml_len);
-		if (len == ZSTD_CONTENTSIZE_UNKNOWN ||
-		    len == ZSTD_CONTENTSIZE_ERROR) {
+		/* The response overwrites the request, which is entirely
+		 * sent by then */
+		req.len = values ? 0 : count * sizeof(*buf);
+
+		ret = iiod_client_exec_frame(client, desc, &frame,
+					     &payload, 1, &req);
+		if (ret < 0)
+			break;
+
+		if (!values && req.len != count * sizeof(*buf)) {
+			IIO_ERROR("Invalid register batch size: %zu\n", req.len);
 			ret = -EIO;
-			goto out_free_xml;
+			break;
 		}
 
-		xml_zstd = malloc(len);
-		if (!xml_zstd) {
-			ret = -ENOMEM;
-			goto out_free_xml;
+		for (i = 0; dst && i < count; i++)
+			dst[done + i] = iio_be32toh(buf[i]);
+	}
+
+	return ret < 0 ? ret : 0;
+}
+
+int iiod_client_read_regs(struct iiod_client *client,
+			  struct iiod_client_pdata *desc,
+			  const struct iio_device *dev,
+			  const uint32_t *addrs, uint32_t *values, size_t nb)
+{
+	size_t i, count, done;
+	uint32_t *buf;
+	ssize_t ret = 0;
+	int resp;
+
+	count = nb < IIOD_CLIENT_REGS_BATCH ? nb : IIOD_CLIENT_REGS_BATCH;
+
+	buf = malloc(count * sizeof(*buf));
+	if (!buf)
+		return -ENOMEM;
+
+	if (iiod_client_is_binary(client, desc)) {
+		ret = iiod_client_regs_binary(client, desc, dev, addrs, NULL,
+					      values, nb, buf);
+		free(buf);
+		return (int) ret;
+	}
+
+	iio_mutex_lock(client->lock);
+
+	for (done = 0; done < nb; done += count) {
+		if (nb - done < count)
+			count = nb - done;
+
+		ret = iiod_client_regs_cmd(client, desc, dev, "REGREAD", count);
+		if (ret < 0)
+			break;
+
+		/* Addresses and values are sent in big-endian */
+		for (i = 0; i < count; i++)
+			buf[i] = iio_htobe32(addrs[done + i]);
+
+		ret = iiod_client_write_all(client, desc, buf,
+					    count * sizeof(*buf));
+		if (ret < 0)
+			break;
+
+		ret = iiod_client_read_integer(client, desc, &resp);
+		if (ret < 0)
+			break;
+
+		if (resp < 0) {
+			ret = resp;
+			break;
+		}
+
+		if ((size_t) resp != count * sizeof(*buf)) {
+			IIO_ERROR("Invalid register batch size: %i\n", resp);
+			ret = -EIO;
+			break;
+		}
+
+		ret = iiod_client_read_all(client, desc, buf, (size_t) resp);
+		if (ret < 0)
+			break;
+
+		for (i = 0; i < count; i++)
+			values[done + i] = iio_be32toh(buf[i]);
+	}
+
+	iio_mutex_unlock(client->lock);
+	free(buf);
+
+	return ret < 0 ? (int) ret : 0;
+}
+
+int iiod_client_write_regs(struct iiod_client *client,
+			   struct iiod_client_pdata *desc,
+			   const struct iio_device *dev,
+			   const uint32_t *addrs, const uint32_t *values,
+			   size_t nb)
+{
+	size_t i, count, done;
+	uint32_t *buf;
+	ssize_t ret = 0;
+	int resp;
+
+	count = nb < IIOD_CLIENT_REGS_BATCH ? nb : IIOD_CLIENT_REGS_BATCH;
+
+	buf = malloc(2 * count * sizeof(*buf));
+	if (!buf)
+		return -ENOMEM;
+
+	if (iiod_client_is_binary(client, desc)) {
+		ret = iiod_client_regs_binary(client, desc, dev, addrs, values,
+					      NULL, nb, buf);
+		free(buf);
+		return (int) ret;
+	}
+
+	iio_mutex_lock(client->lock);
+
+	for (done = 0; done < nb; done += count) {
+		if (nb - done < count)
+			count = nb - done;
+
+		ret = iiod_client_regs_cmd(client, desc, dev, "REGWRITE", count);
+		if (ret < 0)
+			break;
+
+		/* All the addresses, followed by all the values */
+		for (i = 0; i < count; i++) {
+			buf[i] = iio_htobe32(addrs[done + i]);
+			buf[count + i] = iio_htobe32(values[done + i]);
+		}
+
+		ret = iiod_client_write_all(client, desc, buf,
+					    2 * count * sizeof(*buf));
+		if (ret < 0)
+			break;
+
+		ret = iiod_client_read_integer(client, desc, &resp);
+		if (ret < 0)
+			break;
+
+		if (resp < 0) {
+			ret = resp;
+			break;
+		}
+	}
+
+	iio_mutex_unlock(client->lock);
+	free(buf);
+
+	return ret < 0 ? (int) ret : 0;
+}
+
+static const char * const iiod_context_cmds[] = {
+	[IIOD_PRINT_BINARY] = "BINPRINT\r\n",
+	[IIOD_PRINT_XML_ZSTD] = "ZPRINT\r\n",
+	[IIOD_PRINT_XML] = "PRINT\r\n",
+};
+
+static int iiod_client_get_context_data(struct iiod_client *client,
+					struct iiod_client_pdata *desc,
+					enum iiod_print_format format,
+					char **data, size_t *len)
+{
+	char *buf;
+	int ret;
+
+	if (iiod_client_is_binary(client, desc)) {
+		struct iiod_client_request req = { .alloc = true };
+		struct iiod_frame frame = {
+			.op = IIOD_OP_PRINT,
+			.code = format,
+		};
+
+		ret = iiod_client_exec_frame(client, desc, &frame,
+					     NULL, 0, &req);
+		if (ret < 0) {
+			free(req.dst);
+			return ret;
+		}
+
+		*data = req.dst;
+		*len = req.len;
+		return 0;
+	}
+
+	iio_mutex_lock(client->lock);
+
+	ret = iiod_client_exec_command(client, desc, iiod_context_cmds[format]);
+	if (ret < 0)
+		goto out_unlock;
+
+	*len = (size_t) ret;
+	buf = malloc(*len + 1);
+	if (!buf) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	/* +1: Also read the trailing \n */
+	ret = (int) iiod_client_read_all(client, desc, buf, *len + 1);
+	if (ret < 0)
+		free(buf);
+	else
+		*data = buf;
+
+out_unlock:
+	iio_mutex_unlock(client->lock);
+	return ret < 0 ? ret : 0;
+}
+
+static struct iio_context *
+iiod_client_create_context_private(struct iiod_client *client,
+				   struct iiod_client_pdata *desc,
+				   enum iiod_print_format format)
+{
+	struct iio_context *ctx = NULL;
+	size_t xml_len;
+	char *xml;
+	int ret;
+
+	ret = iiod_client_get_context_data(client, desc, format,
+					   &xml, &xml_len);
+	if (ret < 0) {
+		if (ret == -EINVAL && format != IIOD_PRINT_XML) {
+			/* If the command does not exist, try again with the
+			 * next format, down to the regular PRINT command. */
+			if (format == IIOD_PRINT_BINARY && WITH_ZSTD)
+				format = IIOD_PRINT_XML_ZSTD;
+			else
+				format = IIOD_PRINT_XML;
+
+			return iiod_client_create_context_private(client, desc,
+								  format);
+		}
+
+		errno = -ret;
+		return NULL;
+	}
+
+	if (format == IIOD_PRINT_BINARY) {
+		IIO_DEBUG("Received binary context.\n");
+
+		ctx = binary_create_context_mem(xml, xml_len);
+		if (!ctx)
+			ret = -errno;
+		goto out_free_xml;
+	}
+
+#if WITH_ZSTD
+	if (format == IIOD_PRINT_XML_ZSTD) {
+		unsigned long long len;
+		char *xml_zstd;
+
+		IIO_DEBUG("Received ZSTD-compressed XML string.\n");
+
+		len = ZSTD_getFrameContentSize(xml, xml_len);
+		if (len == ZSTD_CONTENTSIZE_UNKNOWN ||
+		    len == ZSTD_CONTENTSIZE_ERROR) {
+			ret = -EIO;
+			goto out_free_xml;
+		}
+
+		xml_zstd = malloc(len);
+		if (!xml_zstd) {
+			ret = -ENOMEM;
+			goto out_free_xml;
 		}
 
 		xml_len = ZSTD_decompress(xml_zstd, len, xml, xml_len);
@@ -604,8 +1399,14 @@ iiod_client_create_context_private(struct iiod_client *client,
 
 out_free_xml:
 	free(xml);
-out_unlock:
-	iio_mutex_unlock(client->lock);
+
+	if (!ctx && ret == -EPROTONOSUPPORT && format == IIOD_PRINT_BINARY) {
+		/* The server uses a newer version of the binary format */
+		return iiod_client_create_context_private(client, desc,
+				WITH_ZSTD ? IIOD_PRINT_XML_ZSTD
+				: IIOD_PRINT_XML);
+	}
+
 	if (!ctx)
 		errno = -ret;
 	return ctx;
@@ -614,7 +1415,8 @@ out_unlock:
 struct iio_context * iiod_client_create_context(struct iiod_client *client,
 						struct iiod_client_pdata *desc)
 {
-	return iiod_client_create_context_private(client, desc, WITH_ZSTD);
+	return iiod_client_create_context_private(client, desc,
+						  IIOD_PRINT_BINARY);
 }
 
 int iiod_client_open_unlocked(struct iiod_client *client,
@@ -660,60 +1462,327 @@ static int iiod_client_read_mask(struct iiod_client *client,
 				 struct iiod_client_pdata *desc,
 				 uint32_t *mask, size_t words)
 {
-	size_t i;
+	size_t i, j, nb;
 	ssize_t ret;
-	char *buf, *ptr;
+	char buf[8 * 8 + 1];
 
-	buf = malloc(words * 8 + 1);
-	if (!buf)
-		return -ENOMEM;
+	IIO_DEBUG("Reading mask\n");
 
-	ret = iiod_client_read_all(client, desc, buf, words * 8 + 1);
-	if (ret < 0) {
-		IIO_ERROR("READ ALL: %zd\n", ret);
-		goto out_buf_free;
-	} else
-		ret = 0;
+	/* Read the mask by chunks of up to 8 words, without allocating;
+	 * the last word is the first one to be received. */
+	for (i = words; i > 0; i -= nb) {
+		nb = i < 8 ? i : 8;
 
-	buf[words*8] = '\0';
+		/* Also read the trailing newline with the last chunk */
+		ret = iiod_client_read_all(client, desc, buf,
+					   nb * 8 + (i == nb));
+		if (ret < 0) {
+			IIO_ERROR("READ ALL: %zd\n", ret);
+			return (int) ret;
+		}
 
-	IIO_DEBUG("Reading mask\n");
+		buf[nb * 8] = '\0';
+
+		for (j = 0; j < nb; j++) {
+			iio_sscanf(&buf[j * 8], "%08" PRIx32, &mask[i - j - 1]);
+			IIO_DEBUG("mask[%lu] = 0x%08" PRIx32 "\n",
+					(unsigned long)(i - j - 1),
+					mask[i - j - 1]);
+		}
+	}
+
+	return 0;
+}
 
-	for (i = words, ptr = buf; i > 0; i--) {
-		iio_sscanf(ptr, "%08" PRIx32, &mask[i - 1]);
-		IIO_DEBUG("mask[%lu] = 0x%08" PRIx32 "\n",
-				(unsigned long)(i - 1), mask[i - 1]);
+#if WITH_ZSTD
+/* Reverts the filter applied by the server before compressing: the data is
+ * made of the planes of the bytes at the same offset of each sample, each
+ * one holding the differences between consecutive bytes. */
+static void iiod_client_merge_planes(uint8_t *dst, const uint8_t *src,
+				     size_t len, size_t stride)
+{
+	size_t i, j, nb = len / stride;
+	uint8_t val;
 
-		ptr = (char *) ((uintptr_t) ptr + 8);
+	for (i = 0; i < stride; i++) {
+		for (j = 0, val = 0; j < nb; j++) {
+			val += *src++;
+			dst[j * stride + i] = val;
+		}
 	}
 
-out_buf_free:
-	free(buf);
-	return (int) ret;
+	memcpy(&dst[nb * stride], src, len - nb * stride);
 }
+#endif
 
-ssize_t iiod_client_read_unlocked(struct iiod_client *client,
-				  struct iiod_client_pdata *desc,
-				  const struct iio_device *dev,
-				  void *dst, size_t len,
-				  uint32_t *mask, size_t words)
+#if WITH_ZSTD
+static ssize_t iiod_client_decode_zstd(struct iiod_client_stream *stream,
+				       void *dst, const void *src,
+				       size_t size, size_t len, size_t stride)
 {
-	unsigned int nb_channels = iio_device_get_channels_count(dev);
-	uintptr_t ptr = (uintptr_t) dst;
-	char buf[1024];
-	ssize_t ret, read = 0;
+	uint8_t *planes = stream->zbuf + stream->len;
+	size_t ret;
+
+	ret = ZSTD_decompressDCtx(stream->dctx, planes, len, src, size);
+	if (ZSTD_isError(ret) || ret != len) {
+		IIO_ERROR("Unable to decompress ZSTD data: %s\n",
+			  ZSTD_isError(ret) ? ZSTD_getErrorName(ret) :
+			  "Wrong size");
+		return -EIO;
+	}
 
-	if (!len || words != (nb_channels + 31) / 32)
-		return -EINVAL;
+	iiod_client_merge_planes(dst, planes, len, stride);
 
-	iio_snprintf(buf, sizeof(buf), "READBUF %s %lu\r\n",
-			iio_device_get_id(dev), (unsigned long) len);
+	return (ssize_t) len;
+}
+#endif
 
-	ret = iiod_client_write_all(client, desc, buf, strlen(buf));
-	if (ret < 0) {
-		IIO_ERROR("WRITE ALL: %zd\n", ret);
-		return ret;
+/* Computes where the samples of the channels enabled in the mask are found
+ * in the blocks of the stream, like iio_buffer_foreach_sample() does.
+ * Channels which cannot be packed leave the layout empty. */
+static void iiod_client_get_packed_layout(struct iiod_client_stream *stream,
+					  const uint32_t *mask)
+{
+	const struct iio_device *dev = stream->dev;
+	struct iiod_client_packed_chn *layout = stream->layout;
+	unsigned int i, nb = 0, offset = 0;
+	ssize_t sample_size;
+	long index = -1;
+
+	stream->nb_layout = 0;
+
+	sample_size = iio_device_get_sample_size_mask(dev, mask, dev->words);
+	if (sample_size <= 0)
+		return;
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		const struct iio_channel *chn = dev->channels[i];
+		const struct iio_data_format *fmt = &chn->format;
+		unsigned int length = fmt->length / 8;
+
+		if (chn->index < 0)
+			break;
+		if (!TEST_BIT(mask, chn->number))
+			continue;
+
+		/* Channels with the same index share their samples */
+		if (nb && chn->index == index)
+			continue;
+
+		if (!length || length > 8 || (length & (length - 1)) ||
+		    !fmt->bits || fmt->bits + fmt->shift > fmt->length)
+			return;
+
+		if (offset % length)
+			offset += length - offset % length;
+
+		layout[nb].offset = offset;
+		layout[nb].length = length;
+		layout[nb].bits = fmt->bits;
+		layout[nb].shift = fmt->shift;
+		layout[nb].repeat = fmt->repeat;
+		layout[nb].is_signed = fmt->is_signed;
+		layout[nb].is_be = fmt->is_be;
+
+		index = chn->index;
+		offset += length * fmt->repeat;
+		nb++;
+	}
+
+	if (offset <= (size_t) sample_size) {
+		stream->nb_layout = nb;
+		stream->sample_size = (size_t) sample_size;
+	}
+}
+
+/* Reads values of up to 32 bits, least significant bits first */
+struct iiod_client_bit_reader {
+	const uint8_t *src;
+	uint64_t acc;
+	unsigned int nbits;
+};
+
+static inline uint64_t iiod_client_get_bits(struct iiod_client_bit_reader *r,
+					    unsigned int bits)
+{
+	uint64_t val;
+
+	while (r->nbits < bits) {
+		r->acc |= (uint64_t) *r->src++ << r->nbits;
+		r->nbits += 8;
+	}
+
+	val = r->acc & ((UINT64_C(1) << bits) - 1);
+	r->acc >>= bits;
+	r->nbits -= bits;
+
+	return val;
+}
+
+static inline void iiod_client_store_sample(uint8_t *dst, uint64_t val,
+					    unsigned int length, bool is_be)
+{
+	unsigned int i;
+
+	for (i = 0; i < length; i++, val >>= 8)
+		dst[is_be ? length - 1 - i : i] = (uint8_t) val;
+}
+
+/* Restores a sample from its significant bits */
+static inline uint64_t
+iiod_client_expand_sample(const struct iiod_client_packed_chn *chn,
+			  uint64_t val)
+{
+	if (chn->is_signed && chn->bits < 64 && (val >> (chn->bits - 1)) & 1)
+		val |= ~UINT64_C(0) << chn->bits;
+
+	return val << chn->shift;
+}
+
+static void iiod_client_unpack16(uint8_t *dst, const uint8_t *src, size_t nb,
+				 const struct iiod_client_packed_chn *chn)
+{
+	struct iiod_client_bit_reader r = { .src = src };
+	uint64_t val;
+	size_t i;
+
+	for (i = 0; i < nb; i++, dst += 2) {
+		val = iiod_client_expand_sample(chn,
+				iiod_client_get_bits(&r, chn->bits));
+
+		if (chn->is_be) {
+			dst[0] = (uint8_t) (val >> 8);
+			dst[1] = (uint8_t) val;
+		} else {
+			dst[0] = (uint8_t) val;
+			dst[1] = (uint8_t) (val >> 8);
+		}
+	}
+}
+
+/* Reverts the packing done by the server: the significant bits of each
+ * sample are stored one after the other. */
+static ssize_t iiod_client_decode_packed(struct iiod_client_stream *stream,
+					 void *dst, const uint8_t *src,
+					 size_t size, size_t len, size_t stride)
+{
+	const struct iiod_client_packed_chn *chn, *layout = stream->layout;
+	struct iiod_client_bit_reader r = { .src = src };
+	unsigned int i, j, nb = stream->nb_layout;
+	size_t k, bits = 0, covered = 0;
+	bool uniform16 = true;
+	uint8_t *ptr = dst;
+	uint64_t val;
+
+	if (!nb || stride != stream->sample_size || len % stride)
+		return -EIO;
+
+	for (i = 0, chn = layout; i < nb; i++, chn++) {
+		uniform16 &= chn->length == 2 && chn->offset == covered &&
+			chn->bits == layout[0].bits &&
+			chn->shift == layout[0].shift &&
+			chn->is_signed == layout[0].is_signed &&
+			chn->is_be == layout[0].is_be;
+
+		bits += (size_t) chn->bits * chn->repeat;
+		covered += (size_t) chn->length * chn->repeat;
+	}
+
+	/* The packed data must hold exactly the samples of the block */
+	if (size != (len / stride * bits + 7) / 8)
+		return -EIO;
+
+	if (uniform16 && covered == stride) {
+		iiod_client_unpack16(dst, src, len / 2, layout);
+		return (ssize_t) len;
+	}
+
+	/* The padding between the samples is not sent */
+	if (covered < stride)
+		memset(dst, 0, len);
+
+	for (k = 0; k < len; k += stride, ptr += stride) {
+		for (i = 0, chn = layout; i < nb; i++, chn++) {
+			for (j = 0; j < chn->repeat; j++) {
+				if (chn->bits > 32) {
+					val = iiod_client_get_bits(&r, 32);
+					val |= iiod_client_get_bits(&r,
+						chn->bits - 32) << 32;
+				} else {
+					val = iiod_client_get_bits(&r,
+						chn->bits);
+				}
+
+				iiod_client_store_sample(ptr + chn->offset +
+						j * chn->length,
+						iiod_client_expand_sample(chn, val),
+						chn->length, chn->is_be);
+			}
+		}
+	}
+
+	return (ssize_t) len;
+}
+
+/* Reads the data of an answer of an encoded stream. It is preceded by its
+ * encoded size and the size of the samples, or by a single zero if it is
+ * sent as it is. */
+static ssize_t iiod_client_read_encoded(struct iiod_client *client,
+					struct iiod_client_pdata *desc,
+					struct iiod_client_stream *stream,
+					void *dst, size_t len)
+{
+	int size, stride;
+	ssize_t err;
+
+	err = iiod_client_read_integer(client, desc, &size);
+	if (err < 0)
+		return err;
+	if (!size) {
+		/* The block could not be made smaller */
+		err = iiod_client_read_all(client, desc, dst, len);
+		if (err > 0)
+			stream->nb_encoded += (size_t) err;
+		return err;
+	}
+
+	err = iiod_client_read_integer(client, desc, &stride);
+	if (err < 0)
+		return err;
+
+	if (size < 0 || (size_t) size >= len || stride <= 0 ||
+	    (size_t) stride > len)
+		return -EIO;
+
+	err = iiod_client_read_all(client, desc, stream->zbuf, size);
+	if (err < 0)
+		return err;
+
+	stream->nb_encoded += (size_t) size;
+
+	switch (stream->codec) {
+#if WITH_ZSTD
+	case IIOD_CLIENT_CODEC_ZSTD:
+		return iiod_client_decode_zstd(stream, dst, stream->zbuf,
+					       size, len, stride);
+#endif
+	case IIOD_CLIENT_CODEC_PACKED:
+		return iiod_client_decode_packed(stream, dst, stream->zbuf,
+						 size, len, stride);
+	default:
+		return -EIO;
 	}
+}
+
+/* Reads the answer to a READBUF command, or one block of a stream */
+static ssize_t iiod_client_read_block(struct iiod_client *client,
+				      struct iiod_client_pdata *desc,
+				      struct iiod_client_stream *stream,
+				      void *dst, size_t len,
+				      uint32_t *mask, size_t words)
+{
+	uintptr_t ptr = (uintptr_t) dst;
+	ssize_t ret, read = 0;
 
 	do {
 		int to_read;
@@ -735,10 +1804,21 @@ ssize_t iiod_client_read_unlocked(struct iiod_client *client,
 				return ret;
 			}
 
+			if (stream && stream->codec == IIOD_CLIENT_CODEC_PACKED)
+				iiod_client_get_packed_layout(stream, mask);
+
 			mask = NULL; /* We read the mask only once */
 		}
 
-		ret = iiod_client_read_all(client, desc, (char *) ptr, to_read);
+		if (stream && stream->codec != IIOD_CLIENT_CODEC_NONE) {
+			ret = iiod_client_read_encoded(client, desc, stream,
+						       (void *) ptr, to_read);
+		} else {
+			ret = iiod_client_read_all(client, desc,
+						   (char *) ptr, to_read);
+			if (stream && ret > 0)
+				stream->nb_encoded += (size_t) ret;
+		}
 		if (ret < 0)
 			return ret;
 
@@ -750,6 +1830,282 @@ ssize_t iiod_client_read_unlocked(struct iiod_client *client,
 	return read;
 }
 
+ssize_t iiod_client_read_unlocked(struct iiod_client *client,
+				  struct iiod_client_pdata *desc,
+				  const struct iio_device *dev,
+				  void *dst, size_t len,
+				  uint32_t *mask, size_t words)
+{
+	unsigned int nb_channels = iio_device_get_channels_count(dev);
+	char buf[1024];
+	ssize_t ret;
+
+	if (!len || words != (nb_channels + 31) / 32)
+		return -EINVAL;
+
+	iio_snprintf(buf, sizeof(buf), "READBUF %s %lu\r\n",
+			iio_device_get_id(dev), (unsigned long) len);
+
+	ret = iiod_client_write_all(client, desc, buf, strlen(buf));
+	if (ret < 0) {
+		IIO_ERROR("WRITE ALL: %zd\n", ret);
+		return ret;
+	}
+
+	return iiod_client_read_block(client, desc, NULL,
+				      dst, len, mask, words);
+}
+
+/* Compression level of the streams, if the IIOD_COMPRESSION environment
+ * variable names a codec but no level */
+#define IIOD_CLIENT_DEFAULT_LEVEL 1
+
+char * iiod_client_get_default_codec(int *level)
+{
+	char *codec, *ptr;
+
+	codec = iio_getenv("IIOD_COMPRESSION");
+	*level = IIOD_CLIENT_DEFAULT_LEVEL;
+
+	if (codec) {
+		ptr = strchr(codec, ':');
+		if (ptr) {
+			*ptr = '\0';
+			*level = atoi(ptr + 1);
+		}
+	}
+
+	return codec;
+}
+
+void iiod_client_free_stream(struct iiod_client_stream *stream)
+{
+#if WITH_ZSTD
+	ZSTD_freeDCtx(stream->dctx);
+#endif
+	free(stream->layout);
+	free(stream->zbuf);
+	free(stream);
+}
+
+struct iiod_client_stream *
+iiod_client_open_stream_unlocked(struct iiod_client *client,
+				 struct iiod_client_pdata *desc,
+				 const struct iio_device *dev,
+				 size_t len, unsigned int credits,
+				 const char *codec, int level)
+{
+	struct iiod_client_stream *stream;
+	char buf[1024];
+	int ret;
+
+	if (!len || !credits)
+		return ERR_PTR(-EINVAL);
+
+	stream = zalloc(sizeof(*stream));
+	if (!stream)
+		return ERR_PTR(-ENOMEM);
+
+	stream->dev = dev;
+	stream->len = len;
+
+	/* An encoded answer is always smaller than the block */
+	if (!codec) {
+		stream->codec = IIOD_CLIENT_CODEC_NONE;
+	} else if (!strcmp(codec, "packed")) {
+		stream->codec = IIOD_CLIENT_CODEC_PACKED;
+		stream->zbuf = malloc(len);
+		stream->layout = calloc(dev->nb_channels,
+					sizeof(*stream->layout));
+		if (!stream->zbuf || !stream->layout) {
+			ret = -ENOMEM;
+			goto err_free_stream;
+		}
+#if WITH_ZSTD
+	} else if (!strcmp(codec, "zstd")) {
+		stream->codec = IIOD_CLIENT_CODEC_ZSTD;
+		stream->dctx = ZSTD_createDCtx();
+		stream->zbuf = malloc(2 * len);
+		if (!stream->dctx || !stream->zbuf) {
+			ret = -ENOMEM;
+			goto err_free_stream;
+		}
+#endif
+	} else {
+		ret = -ENOSYS;
+		goto err_free_stream;
+	}
+
+	if (codec) {
+		iio_snprintf(buf, sizeof(buf), "READBUF %s %lu %u %s %d\r\n",
+			     iio_device_get_id(dev), (unsigned long) len,
+			     credits, codec, level);
+	} else {
+		iio_snprintf(buf, sizeof(buf), "READBUF %s %lu %u\r\n",
+			     iio_device_get_id(dev), (unsigned long) len,
+			     credits);
+	}
+
+	/* Servers which don't support streaming answer -EINVAL, and the ones
+	 * which don't support the codec answer -ENOSYS */
+	ret = iiod_client_exec_command(client, desc, buf);
+	if (ret < 0)
+		goto err_free_stream;
+
+	return stream;
+
+err_free_stream:
+	iiod_client_free_stream(stream);
+	return ERR_PTR(ret);
+}
+
+int iiod_client_grant_credits_unlocked(struct iiod_client *client,
+				       struct iiod_client_pdata *desc,
+				       unsigned int credits)
+{
+	char buf[16];
+	ssize_t ret;
+
+	iio_snprintf(buf, sizeof(buf), "%u\r\n", credits);
+
+	ret = iiod_client_write_all(client, desc, buf, strlen(buf));
+	return ret < 0 ? (int) ret : 0;
+}
+
+ssize_t iiod_client_read_stream_unlocked(struct iiod_client *client,
+					 struct iiod_client_pdata *desc,
+					 struct iiod_client_stream *stream,
+					 void *dst, uint32_t *mask, size_t words)
+{
+	ssize_t ret;
+
+	ret = iiod_client_read_block(client, desc, stream,
+				     dst, stream->len, mask, words);
+
+	/* Only a stopped stream sends an empty block */
+	return ret ? ret : -EPIPE;
+}
+
+int iiod_client_close_stream_unlocked(struct iiod_client *client,
+				      struct iiod_client_pdata *desc,
+				      struct iiod_client_stream *stream,
+				      size_t words)
+{
+	size_t len = stream->len;
+	uint32_t *mask;
+	void *block;
+	ssize_t ret;
+
+	block = malloc(len);
+	mask = malloc(words * sizeof(*mask));
+	if (!block || !mask) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	ret = iiod_client_grant_credits_unlocked(client, desc, 0);
+	if (ret < 0)
+		goto out_free;
+
+	/* Discard the blocks still in flight, up to the empty one */
+	do {
+		ret = iiod_client_read_block(client, desc, stream, block, len,
+					     mask, words);
+	} while (ret > 0);
+out_free:
+	free(block);
+	free(mask);
+	iiod_client_free_stream(stream);
+	return ret < 0 ? (int) ret : 0;
+}
+
+int iiod_client_rx_open_unlocked(struct iiod_client *client,
+				 struct iiod_client_pdata *desc,
+				 const struct iio_device *dev,
+				 struct iiod_client_rx *rx, size_t len,
+				 unsigned int credits, size_t words)
+{
+	struct iiod_client_stream *stream;
+	int ret;
+
+	if (rx->len) {
+		ret = iiod_client_close_stream_unlocked(client, desc,
+							rx->stream, words);
+		rx->len = 0;
+		if (ret < 0)
+			return ret;
+	}
+
+	stream = iiod_client_open_stream_unlocked(client, desc, dev, len,
+			credits, rx->codec, rx->codec_level);
+	if (IS_ERR(stream) && rx->codec &&
+	    (PTR_ERR(stream) == -ENOSYS || PTR_ERR(stream) == -EINVAL)) {
+		IIO_DEBUG("Codec %s unsupported, streaming uncompressed\n",
+			  rx->codec);
+		free(rx->codec);
+		rx->codec = NULL;
+
+		stream = iiod_client_open_stream_unlocked(client, desc, dev,
+				len, credits, NULL, 0);
+	}
+	if (IS_ERR(stream)) {
+		ret = PTR_ERR(stream);
+		if (ret == -EINVAL) {
+			IIO_DEBUG("Streaming unsupported by the server\n");
+			rx->supported = false;
+			return -ENOSYS;
+		}
+
+		return ret;
+	}
+
+	rx->stream = stream;
+	rx->len = len;
+
+	return 0;
+}
+
+ssize_t iiod_client_rx_read_unlocked(struct iiod_client *client,
+				     struct iiod_client_pdata *desc,
+				     const struct iio_device *dev,
+				     struct iiod_client_rx *rx,
+				     void *dst, size_t len,
+				     unsigned int credits,
+				     uint32_t *mask, size_t words)
+{
+	uint64_t nb_encoded;
+	ssize_t ret;
+	int err;
+
+	if (rx->len != len) {
+		err = iiod_client_rx_open_unlocked(client, desc, dev, rx, len,
+						   credits, words);
+		if (err < 0)
+			return err;
+	}
+
+	nb_encoded = rx->stream->nb_encoded;
+
+	ret = iiod_client_read_stream_unlocked(client, desc, rx->stream,
+					       dst, mask, words);
+	if (ret < 0) {
+		/* The server ends the stream on errors */
+		iiod_client_free_stream(rx->stream);
+		rx->len = 0;
+		return ret;
+	}
+
+	rx->stats.nb_bytes += (uint64_t) ret;
+	rx->stats.nb_encoded_bytes += rx->stream->nb_encoded - nb_encoded;
+
+	/* Let the server send one more block */
+	err = iiod_client_grant_credits_unlocked(client, desc, 1);
+	if (err < 0)
+		return err;
+
+	return ret;
+}
+
 ssize_t iiod_client_write_unlocked(struct iiod_client *client,
 				   struct iiod_client_pdata *desc,
 				   const struct iio_device *dev,
@@ -784,3 +2140,139 @@ ssize_t iiod_client_write_unlocked(struct iiod_client *client,
 
 	return (ssize_t) len;
 }
+
+bool iiod_client_can_pipeline_write_unlocked(struct iiod_client *client,
+					    struct iiod_client_pdata *desc,
+					    const struct iio_device *dev)
+{
+	ssize_t ret;
+	char buf[1024];
+	int val;
+
+	if (client->pipelined_write_checked)
+		return client->pipelined_write_supported;
+
+	/* An empty block is accepted by the servers that know the flag;
+	 * older ones report a syntax error. */
+	iio_snprintf(buf, sizeof(buf), "WRITEBUF %s 0 PIPELINED\r\n", dev->id);
+
+	ret = iiod_client_write_all(client, desc, buf, strlen(buf));
+	if (ret < 0)
+		return false;
+
+	ret = iiod_client_read_integer(client, desc, &val);
+	if (ret < 0)
+		return false;
+
+	if (val >= 0 || val == -EINVAL) {
+		client->pipelined_write_checked = true;
+		client->pipelined_write_supported = val >= 0;
+	}
+
+	return val >= 0;
+}
+
+int iiod_client_start_write_unlocked(struct iiod_client *client,
+				     struct iiod_client_pdata *desc,
+				     const struct iio_device *dev, size_t len)
+{
+	ssize_t ret;
+	char buf[1024];
+	int val;
+
+	iio_snprintf(buf, sizeof(buf), "WRITEBUF %s %lu\r\n",
+			dev->id, (unsigned long) len);
+
+	ret = iiod_client_write_all(client, desc, buf, strlen(buf));
+	if (ret < 0)
+		return (int) ret;
+
+	ret = iiod_client_read_integer(client, desc, &val);
+	if (ret < 0)
+		return (int) ret;
+
+	return val;
+}
+
+int iiod_client_send_write_unlocked(struct iiod_client *client,
+				    struct iiod_client_pdata *desc,
+				    const struct iio_device *dev,
+				    const void *src, size_t len)
+{
+	ssize_t ret;
+	char buf[1024];
+
+	iio_snprintf(buf, sizeof(buf), "WRITEBUF %s %lu PIPELINED\r\n",
+			dev->id, (unsigned long) len);
+
+	ret = iiod_client_write_all(client, desc, buf, strlen(buf));
+	if (ret < 0)
+		return (int) ret;
+
+	if (src) {
+		ret = iiod_client_write_all(client, desc, src, len);
+		if (ret < 0)
+			return (int) ret;
+	}
+
+	return 0;
+}
+
+ssize_t iiod_client_write_result_unlocked(struct iiod_client *client,
+					  struct iiod_client_pdata *desc)
+{
+	ssize_t ret;
+	int val;
+
+	ret = iiod_client_read_integer(client, desc, &val);
+	if (ret < 0)
+		return ret;
+
+	return (ssize_t) val;
+}
+
+int iiod_client_open_event_stream(struct iiod_client *client,
+				  struct iiod_client_pdata *desc,
+				  const struct iio_device *dev)
+{
+	char buf[1024];
+
+	iio_snprintf(buf, sizeof(buf), "EVENTS %s\r\n", iio_device_get_id(dev));
+	return iiod_client_exec_command(client, desc, buf);
+}
+
+ssize_t iiod_client_read_events(struct iiod_client *client,
+				struct iiod_client_pdata *desc,
+				struct iio_event *events, size_t nb)
+{
+	size_t i, count;
+	ssize_t ret;
+	int len;
+
+	/* Once subscribed, iiod sends the events in batches, each one
+	 * prefixed by its size in bytes */
+	ret = iiod_client_read_integer(client, desc, &len);
+	if (ret < 0)
+		return ret;
+	if (len < 0)
+		return (ssize_t) len;
+
+	count = (size_t) len / sizeof(*events);
+	if ((size_t) len % sizeof(*events) || count > nb) {
+		IIO_ERROR("Invalid event batch size: %i\n", len);
+		return -EIO;
+	}
+
+	ret = iiod_client_read_all(client, desc, events, (size_t) len);
+	if (ret < 0)
+		return ret;
+
+	/* Events are sent in big-endian */
+	for (i = 0; i < count; i++) {
+		events[i].id = iio_be64toh(events[i].id);
+		events[i].timestamp = (int64_t) iio_be64toh(
+				(uint64_t) events[i].timestamp);
+	}
+
+	return (ssize_t) count;
+}
@@ -14,6 +14,7 @@
 struct iio_mutex;
 struct iiod_client;
 struct iiod_client_pdata;
+struct iiod_client_stream;
 struct iio_context_pdata;
 
 struct iiod_client_ops {
@@ -35,6 +36,15 @@ struct iiod_client * iiod_client_new(struct iio_context_pdata *pdata,
 				     const struct iiod_client_ops *ops);
 void iiod_client_destroy(struct iiod_client *client);
 
+/* Switches the connection to the binary framing of the protocol. Returns
+ * -ENOSYS if the server only supports the text protocol. */
+int iiod_client_enable_binary(struct iiod_client *client,
+			      struct iiod_client_pdata *desc);
+
+/* Ends the session; the connection can be closed afterwards */
+void iiod_client_exit(struct iiod_client *client,
+		      struct iiod_client_pdata *desc);
+
 int iiod_client_get_version(struct iiod_client *client,
 			    struct iiod_client_pdata *desc,
 			    unsigned int *major, unsigned int *minor,
@@ -73,6 +83,17 @@ ssize_t iiod_client_write_attr(struct iiod_client *client,
 			       const char *attr, const char *src,
 			       size_t len, enum iio_attr_type type);
 
+int iiod_client_read_regs(struct iiod_client *client,
+			  struct iiod_client_pdata *desc,
+			  const struct iio_device *dev,
+			  const uint32_t *addrs, uint32_t *values, size_t nb);
+
+int iiod_client_write_regs(struct iiod_client *client,
+			   struct iiod_client_pdata *desc,
+			   const struct iio_device *dev,
+			   const uint32_t *addrs, const uint32_t *values,
+			   size_t nb);
+
 int iiod_client_open_unlocked(struct iiod_client *client,
 			      struct iiod_client_pdata *desc,
 			      const struct iio_device *dev,
@@ -88,11 +109,115 @@ ssize_t iiod_client_read_unlocked(struct iiod_client *client,
 				  void *dst, size_t len,
 				  uint32_t *mask, size_t words);
 
+/* Returns the codec of the streams named by the IIOD_COMPRESSION
+ * environment variable as "<codec>[:<level>]", or NULL if unset; the
+ * string must be freed by the caller. */
+char * iiod_client_get_default_codec(int *level);
+
+/* Starts streaming blocks of 'len' bytes, optionally encoded by the
+ * server with the given codec and level. Returns -EINVAL if the server
+ * cannot stream, and -ENOSYS if the codec is not supported. */
+struct iiod_client_stream *
+iiod_client_open_stream_unlocked(struct iiod_client *client,
+				 struct iiod_client_pdata *desc,
+				 const struct iio_device *dev,
+				 size_t len, unsigned int credits,
+				 const char *codec, int level);
+
+int iiod_client_grant_credits_unlocked(struct iiod_client *client,
+				       struct iiod_client_pdata *desc,
+				       unsigned int credits);
+
+ssize_t iiod_client_read_stream_unlocked(struct iiod_client *client,
+					 struct iiod_client_pdata *desc,
+					 struct iiod_client_stream *stream,
+					 void *dst, uint32_t *mask, size_t words);
+
+/* Stops the stream, discards the blocks in flight and frees the stream */
+int iiod_client_close_stream_unlocked(struct iiod_client *client,
+				      struct iiod_client_pdata *desc,
+				      struct iiod_client_stream *stream,
+				      size_t words);
+
+/* Frees a stream that was ended by the server, or whose connection is
+ * closed */
+void iiod_client_free_stream(struct iiod_client_stream *stream);
+
+/* Stream of the input samples of a device, as kept by the backends */
+struct iiod_client_rx {
+	/* Current stream, and size of its blocks; zero if none */
+	struct iiod_client_stream *stream;
+	size_t len;
+
+	/* Cleared once the server refused to stream */
+	bool supported;
+
+	/* Codec requested for the stream, NULL if uncompressed */
+	char *codec;
+	int codec_level;
+
+	/* Data received by all the streams of the buffer */
+	struct iio_buffer_stream_stats stats;
+};
+
+/* (Re)opens the stream with blocks of 'len' bytes. If the server does not
+ * know the codec, the blocks are sent uncompressed and the codec is
+ * cleared. Returns -ENOSYS if the server cannot stream. */
+int iiod_client_rx_open_unlocked(struct iiod_client *client,
+				 struct iiod_client_pdata *desc,
+				 const struct iio_device *dev,
+				 struct iiod_client_rx *rx, size_t len,
+				 unsigned int credits, size_t words);
+
+/* Reads the next block of the stream, (re)opening it first if its blocks
+ * are not 'len' bytes long, and lets the server send one more */
+ssize_t iiod_client_rx_read_unlocked(struct iiod_client *client,
+				     struct iiod_client_pdata *desc,
+				     const struct iio_device *dev,
+				     struct iiod_client_rx *rx,
+				     void *dst, size_t len,
+				     unsigned int credits,
+				     uint32_t *mask, size_t words);
+
 ssize_t iiod_client_write_unlocked(struct iiod_client *client,
 				   struct iiod_client_pdata *desc,
 				   const struct iio_device *dev,
 				   const void *src, size_t len);
 
+/* Tells if the server reads the data of the WRITEBUF commands it rejects,
+ * so that the data can be sent along with the command. The answer is probed
+ * once per client, on the connection of a device that is open. */
+bool iiod_client_can_pipeline_write_unlocked(struct iiod_client *client,
+					    struct iiod_client_pdata *desc,
+					    const struct iio_device *dev);
+
+/* Sends a WRITEBUF command and returns its status; on success, the data is
+ * to be sent next, and iiod_client_write_result_unlocked() reads the number
+ * of bytes written. */
+int iiod_client_start_write_unlocked(struct iiod_client *client,
+				     struct iiod_client_pdata *desc,
+				     const struct iio_device *dev, size_t len);
+
+/* Sends a pipelined WRITEBUF command, followed by the data if 'src' is set,
+ * without waiting for the answer; iiod_client_write_result_unlocked() reads
+ * it. Only for servers that support it. */
+int iiod_client_send_write_unlocked(struct iiod_client *client,
+				    struct iiod_client_pdata *desc,
+				    const struct iio_device *dev,
+				    const void *src, size_t len);
+
+/* Reads the number of bytes written by a WRITEBUF command, or its error */
+ssize_t iiod_client_write_result_unlocked(struct iiod_client *client,
+					  struct iiod_client_pdata *desc);
+
+int iiod_client_open_event_stream(struct iiod_client *client,
+				  struct iiod_client_pdata *desc,
+				  const struct iio_device *dev);
+
+ssize_t iiod_client_read_events(struct iiod_client *client,
+				struct iiod_client_pdata *desc,
+				struct iio_event *events, size_t nb);
+
 struct iio_context * iiod_client_create_context(struct iiod_client *client,
 						struct iiod_client_pdata *desc);
 
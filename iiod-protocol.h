@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2023 Analog Devices, Inc.
+ */
+
+#ifndef _IIOD_PROTOCOL_H
+#define _IIOD_PROTOCOL_H
+
+#include <stdint.h>
+
+/*
+ * Binary framing of the IIOD protocol.
+ *
+ * A client switches a connection from the text protocol with the "BINARY"
+ * command; older servers answer it with a syntax error, and the connection
+ * then keeps using the text protocol.
+ *
+ * After a successful answer, every request and every response is a frame
+ * header, in big-endian, followed by "len" bytes of payload. The response
+ * to a request carries the same ID and opcode as the request; as the IDs
+ * are picked by the client, several requests can be in flight at once.
+ */
+struct iiod_frame {
+	uint16_t id;
+	uint8_t op;
+	uint8_t flags;
+
+	/* Index of the device and of the channel the request is about */
+	uint16_t dev;
+	uint16_t chn;
+
+	/* Argument of the request, or result of the operation */
+	int32_t code;
+
+	uint32_t len;
+};
+
+enum iiod_opcode {
+	/* Close the connection. Has no response. */
+	IIOD_OP_EXIT,
+
+	/* Response code: major << 16 | minor. Payload: git tag. */
+	IIOD_OP_VERSION,
+
+	/* Code: one of the iiod_print_format values.
+	 * Response payload: the description of the context. */
+	IIOD_OP_PRINT,
+
+	/* Code: timeout in milliseconds */
+	IIOD_OP_TIMEOUT,
+
+	/* Payload: name of the attribute, empty for all of them.
+	 * Response payload: value of the attribute(s). */
+	IIOD_OP_READ_ATTR,
+
+	/* Payload: name of the attribute, a NUL, and the value */
+	IIOD_OP_WRITE_ATTR,
+
+	/* Response code: index of the trigger plus one, zero if none */
+	IIOD_OP_GETTRIG,
+
+	/* Code: index of the trigger plus one, zero to remove it */
+	IIOD_OP_SETTRIG,
+
+	/* Code: number of kernel buffers */
+	IIOD_OP_SET_BUFFERS_COUNT,
+
+	/* Payload: addresses. Response payload: values. */
+	IIOD_OP_REGREAD,
+
+	/* Payload: addresses, followed by the values */
+	IIOD_OP_REGWRITE,
+};
+
+enum iiod_print_format {
+	IIOD_PRINT_BINARY,
+	IIOD_PRINT_XML_ZSTD,
+	IIOD_PRINT_XML,
+};
+
+/* Flags of the attribute requests */
+#define IIOD_FRAME_CHANNEL	(1 << 0)
+#define IIOD_FRAME_DEBUG	(1 << 1)
+#define IIOD_FRAME_BUFFER	(1 << 2)
+
+#endif /* _IIOD_PROTOCOL_H */
@@ -55,6 +55,8 @@ struct client_data {
 	struct iio_context *ctx;
 	const void *xml_zstd;
 	size_t xml_zstd_len;
+	const void *ctx_bin;
+	size_t ctx_bin_len;
 };
 
 bool server_demux;
@@ -123,7 +125,8 @@ static void client_thd(struct thread_pool *pool, void *d)
 
 	interpreter(cdata->ctx, cdata->fd, cdata->fd, cdata->debug,
 			true, false, false, pool,
-			cdata->xml_zstd, cdata->xml_zstd_len);
+			cdata->xml_zstd, cdata->xml_zstd_len,
+			cdata->ctx_bin, cdata->ctx_bin_len);
 
 	IIO_INFO("Client exited\n");
 	close(cdata->fd);
@@ -152,7 +155,8 @@ static void sig_handler_usr1(int sig)
 }
 
 static int main_interactive(struct iio_context *ctx, bool verbose, bool use_aio,
-			    const void *xml_zstd, size_t xml_zstd_len)
+			    const void *xml_zstd, size_t xml_zstd_len,
+			    const void *ctx_bin, size_t ctx_bin_len)
 {
 	int flags;
 
@@ -180,12 +184,14 @@ static int main_interactive(struct iio_context *ctx, bool verbose, bool use_aio,
 
 	interpreter(ctx, STDIN_FILENO, STDOUT_FILENO, verbose,
 			false, false, use_aio, main_thread_pool,
-			xml_zstd, xml_zstd_len);
+			xml_zstd, xml_zstd_len,
+			ctx_bin, ctx_bin_len);
 	return EXIT_SUCCESS;
 }
 
 static int main_server(struct iio_context *ctx, bool debug,
 		       const void *xml_zstd, size_t xml_zstd_len,
+		       const void *ctx_bin, size_t ctx_bin_len,
 		       uint16_t port)
 {
 	int ret, fd = -1, yes = 1,
@@ -341,6 +347,8 @@ static int main_server(struct iio_context *ctx, bool debug,
 		cdata->debug = debug;
 		cdata->xml_zstd = xml_zstd;
 		cdata->xml_zstd_len = xml_zstd_len;
+		cdata->ctx_bin = ctx_bin;
+		cdata->ctx_bin_len = ctx_bin_len;
 
 		if (LOG_LEVEL >= Info_L) {
 			struct sockaddr_in *caddr4 = (struct sockaddr_in *)&caddr;
@@ -430,6 +438,31 @@ static void *get_xml_zstd_data(const struct iio_context *ctx, size_t *out_len)
 #endif
 }
 
+static void *get_binary_data(const struct iio_context *ctx, size_t *out_len)
+{
+	ssize_t len;
+	void *buf;
+
+	len = iio_context_get_binary(ctx, NULL, 0);
+	if (len < 0)
+		return NULL;
+
+	buf = malloc(len);
+	if (!buf)
+		return NULL;
+
+	len = iio_context_get_binary(ctx, buf, len);
+	if (len < 0) {
+		IIO_WARNING("Unable to create binary context: %zd\n", len);
+		free(buf);
+		return NULL;
+	}
+
+	*out_len = len;
+
+	return buf;
+}
+
 int main(int argc, char **argv)
 {
 	bool debug = false, interactive = false, use_aio = false;
@@ -565,8 +598,8 @@ static int start_iiod(const char *uri, const char *ffs_mountpoint,
 {
 	struct iio_context *ctx;
 	char err_str[1024];
-	void *xml_zstd;
-	size_t xml_zstd_len = 0;
+	void *xml_zstd, *ctx_bin;
+	size_t xml_zstd_len = 0, ctx_bin_len = 0;
 	int ret;
 
 	ctx = iio_create_context_from_uri(uri);
@@ -577,13 +610,15 @@ static int start_iiod(const char *uri, const char *ffs_mountpoint,
 	}
 
 	xml_zstd = get_xml_zstd_data(ctx, &xml_zstd_len);
+	ctx_bin = get_binary_data(ctx, &ctx_bin_len);
 
 	if (WITH_IIOD_USBD && ffs_mountpoint) {
 		/* We pass use_aio == true directly, this is ensured to be true
 		 * by the CMake script. */
 		ret = start_usb_daemon(ctx, ffs_mountpoint,
 				debug, true, (unsigned int) nb_pipes, ep0_fd,
-				main_thread_pool, xml_zstd, xml_zstd_len);
+				main_thread_pool, xml_zstd, xml_zstd_len,
+				ctx_bin, ctx_bin_len);
 		if (ret) {
 			iio_strerror(-ret, err_str, sizeof(err_str));
 			IIO_ERROR("Unable to start USB daemon: %s\n", err_str);
@@ -595,7 +630,8 @@ static int start_iiod(const char *uri, const char *ffs_mountpoint,
 	if (WITH_IIOD_SERIAL && uart_params) {
 		ret = start_serial_daemon(ctx, uart_params,
 					  debug, main_thread_pool,
-					  xml_zstd, xml_zstd_len);
+					  xml_zstd, xml_zstd_len,
+					  ctx_bin, ctx_bin_len);
 		if (ret) {
 			iio_strerror(-ret, err_str, sizeof(err_str));
 			IIO_ERROR("Unable to start serial daemon: %s\n", err_str);
@@ -605,9 +641,11 @@ static int start_iiod(const char *uri, const char *ffs_mountpoint,
 	}
 
 	if (interactive)
-		ret = main_interactive(ctx, debug, use_aio, xml_zstd, xml_zstd_len);
+		ret = main_interactive(ctx, debug, use_aio, xml_zstd, xml_zstd_len,
+				       ctx_bin, ctx_bin_len);
 	else
-		ret = main_server(ctx, debug, xml_zstd, xml_zstd_len, port);
+		ret = main_server(ctx, debug, xml_zstd, xml_zstd_len,
+				  ctx_bin, ctx_bin_len, port);
 
 out_thread_pool_stop:
 	/*
@@ -617,6 +655,7 @@ out_thread_pool_stop:
 	thread_pool_stop_and_wait(main_thread_pool);
 out_free_xml_data:
 	free(xml_zstd);
+	free(ctx_bin);
 	iio_context_destroy(ctx);
 
 	return ret;
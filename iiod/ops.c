@@ -10,6 +10,7 @@
 #include "parser.h"
 #include "thread-pool.h"
 #include "../debug.h"
+#include "../iiod-protocol.h"
 
 #include <errno.h>
 #include <limits.h>
@@ -22,10 +23,32 @@
 #include <fcntl.h>
 #include <signal.h>
 
+#if WITH_ZSTD
+#include <zstd.h>
+#endif
+
 int yyparse(yyscan_t scanner);
 
 struct DevEntry;
 
+enum stream_codec {
+	STREAM_CODEC_NONE,
+	STREAM_CODEC_ZSTD,
+	STREAM_CODEC_PACKED,
+};
+
+/* Position and format of the samples of a channel, for the packed codec */
+struct packed_chn {
+	unsigned int offset, length, bits, shift, repeat;
+	bool is_be;
+};
+
+/* Bytes found at the same place in each sample of the device buffer and in
+ * each sample of a client, when their channels differ */
+struct sample_run {
+	unsigned int dev_offset, thd_offset, length;
+};
+
 /* Corresponds to a thread reading from a device */
 struct ThdEntry {
 	SLIST_ENTRY(ThdEntry) parser_list_entry;
@@ -33,6 +56,31 @@ struct ThdEntry {
 	unsigned int nb, sample_size, samples_count;
 	ssize_t err;
 
+	/* Number of bytes of the current WRITEBUF received from the client */
+	unsigned int received;
+
+	/* When streaming, size of the blocks, and number of blocks that can
+	 * still be sent once the current one is complete */
+	unsigned int stream_nb, credits;
+
+	/* Encoding of the blocks of the stream. The context and the output
+	 * buffer are kept until the client closes the device. */
+	enum stream_codec codec;
+	void *zbuf;
+	size_t zbuf_len;
+	struct packed_chn *layout;
+#if WITH_ZSTD
+	int zstd_level;
+	ZSTD_CCtx *zstd_cctx;
+#endif
+
+	/* Runs of bytes to copy to demux or mux the samples of the client,
+	 * and the buffer holding them in the layout of the client */
+	struct sample_run *runs;
+	unsigned int nb_runs;
+	void *staging;
+	size_t staging_len;
+
 	int eventfd;
 
 	struct parser_pdata *pdata;
@@ -53,8 +101,10 @@ static void thd_entry_event_signal(struct ThdEntry *thd)
 	} while (ret == -1 && errno == EINTR);
 }
 
+/* Waits for the thread to be signaled. If 'want_input' is set, also returns
+ * (with 1) once data sent by the client can be read from 'fd_in'. */
 static int thd_entry_event_wait(struct ThdEntry *thd, pthread_mutex_t *mutex,
-	int fd_in)
+	int fd_in, bool want_input)
 {
 	struct pollfd pfd[3];
 	uint64_t e;
@@ -65,7 +115,7 @@ static int thd_entry_event_wait(struct ThdEntry *thd, pthread_mutex_t *mutex,
 	pfd[0].fd = thd->eventfd;
 	pfd[0].events = POLLIN;
 	pfd[1].fd = fd_in;
-	pfd[1].events = POLLRDHUP;
+	pfd[1].events = POLLRDHUP | (want_input ? POLLIN : 0);
 	pfd[2].fd = thread_pool_get_poll_fd(thd->pdata->pool);
 	pfd[2].events = POLLIN;
 
@@ -77,6 +127,11 @@ static int thd_entry_event_wait(struct ThdEntry *thd, pthread_mutex_t *mutex,
 			return -EPIPE;
 		}
 
+		if (pfd[1].revents & POLLIN) {
+			pthread_mutex_lock(mutex);
+			return 1;
+		}
+
 		do {
 			ret = read(thd->eventfd, &e, sizeof(e));
 		} while (ret == -1 && errno == EINTR);
@@ -111,12 +166,6 @@ struct DevEntry {
 	size_t nb_words;
 };
 
-struct sample_cb_info {
-	struct parser_pdata *pdata;
-	unsigned int nb_bytes, cpt;
-	uint32_t *mask;
-};
-
 /* Protects iio_device_{set,get}_data() from concurrent access from multiple
  * clients */
 static pthread_mutex_t devlist_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -155,6 +204,9 @@ static inline const char *dev_label_or_name_or_id(const struct iio_device *dev)
 static ssize_t async_io(struct parser_pdata *pdata, void *buf, size_t len,
 	bool do_read)
 {
+	/* Without streams over USB, both directions share one context */
+	struct parser_aio *aio = (do_read || !WITH_USB_STREAM) ?
+		&pdata->aio_in : &pdata->aio_out;
 	ssize_t ret;
 	struct pollfd pfd[2];
 	unsigned int num_pfds;
@@ -169,18 +221,18 @@ static ssize_t async_io(struct parser_pdata *pdata, void *buf, size_t len,
 	else
 		io_prep_pwrite(&iocb, pdata->fd_out, buf, len, 0);
 
-	io_set_eventfd(&iocb, pdata->aio_eventfd);
+	io_set_eventfd(&iocb, aio->eventfd);
 
-	pthread_mutex_lock(&pdata->aio_mutex);
+	pthread_mutex_lock(&aio->mutex);
 
-	ret = io_submit(pdata->aio_ctx, 1, ios);
+	ret = io_submit(aio->ctx, 1, ios);
 	if (ret != 1) {
-		pthread_mutex_unlock(&pdata->aio_mutex);
+		pthread_mutex_unlock(&aio->mutex);
 		IIO_ERROR("Failed to submit IO operation: %zd\n", ret);
 		return -EIO;
 	}
 
-	pfd[0].fd = pdata->aio_eventfd;
+	pfd[0].fd = aio->eventfd;
 	pfd[0].events = POLLIN;
 	pfd[0].revents = 0;
 	pfd[1].fd = thread_pool_get_poll_fd(pdata->pool);
@@ -193,14 +245,14 @@ static ssize_t async_io(struct parser_pdata *pdata, void *buf, size_t len,
 
 		if (pfd[0].revents & POLLIN) {
 			uint64_t event;
-			ret = read(pdata->aio_eventfd, &event, sizeof(event));
+			ret = read(aio->eventfd, &event, sizeof(event));
 			if (ret != sizeof(event)) {
 				IIO_ERROR("Failed to read from eventfd: %d\n", -errno);
 				ret = -EIO;
 				break;
 			}
 
-			ret = io_getevents(pdata->aio_ctx, 0, 1, e, NULL);
+			ret = io_getevents(aio->ctx, 0, 1, e, NULL);
 			if (ret != 1) {
 				IIO_ERROR("Failed to read IO events: %zd\n", ret);
 				ret = -EIO;
@@ -210,7 +262,7 @@ static ssize_t async_io(struct parser_pdata *pdata, void *buf, size_t len,
 			}
 		} else if ((num_pfds > 1 && pfd[1].revents & POLLIN)) {
 			/* Got a STOP event to abort this whole session */
-			ret = io_cancel(pdata->aio_ctx, &iocb, e);
+			ret = io_cancel(aio->ctx, &iocb, e);
 			if (ret != -EINPROGRESS && ret != -EINVAL) {
 				IIO_ERROR("Failed to cancel IO transfer: %zd\n", ret);
 				ret = -EIO;
@@ -221,7 +273,7 @@ static ssize_t async_io(struct parser_pdata *pdata, void *buf, size_t len,
 		}
 	} while (!(pfd[0].revents & POLLIN));
 
-	pthread_mutex_unlock(&pdata->aio_mutex);
+	pthread_mutex_unlock(&aio->mutex);
 
 	/* Got STOP event, treat it as EOF */
 	if (num_pfds == 1)
@@ -232,6 +284,32 @@ static ssize_t async_io(struct parser_pdata *pdata, void *buf, size_t len,
 
 #define MAX_AIO_REQ_SIZE (1024 * 1024)
 
+static int parser_aio_init(struct parser_aio *aio)
+{
+	int ret;
+
+	aio->eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (aio->eventfd < 0)
+		return -errno;
+
+	aio->ctx = 0;
+	ret = io_setup(1, &aio->ctx);
+	if (ret < 0) {
+		close(aio->eventfd);
+		return ret;
+	}
+
+	pthread_mutex_init(&aio->mutex, NULL);
+	return 0;
+}
+
+static void parser_aio_exit(struct parser_aio *aio)
+{
+	io_destroy(aio->ctx);
+	close(aio->eventfd);
+	pthread_mutex_destroy(&aio->mutex);
+}
+
 static ssize_t readfd_aio(struct parser_pdata *pdata, void *dest, size_t len)
 {
 	if (len > MAX_AIO_REQ_SIZE)
@@ -378,74 +456,389 @@ static void print_value(struct parser_pdata *pdata, long value)
 	}
 }
 
-static ssize_t send_sample(const struct iio_channel *chn,
-		void *src, size_t length, void *d)
+#if WITH_ZSTD
+/* Groups the bytes found at the same offset of each sample, and stores the
+ * difference between consecutive ones. Sampled signals change slowly, so
+ * this leaves mostly small values, which compress much better. */
+static void split_planes(uint8_t *dst, const uint8_t *src,
+		size_t len, size_t stride)
 {
-	unsigned int number = get_channel_number(chn);
-	struct sample_cb_info *info = d;
+	size_t i, j, nb = len / stride;
+	uint8_t prev;
 
-	if (iio_channel_get_index(chn) < 0 || !TEST_BIT(info->mask, number))
-		return 0;
-	if (info->nb_bytes < length)
-		return 0;
+	for (i = 0; i < stride; i++) {
+		for (j = 0, prev = 0; j < nb; j++) {
+			*dst++ = src[j * stride + i] - prev;
+			prev = src[j * stride + i];
+		}
+	}
 
-	if (info->cpt % length) {
-		unsigned int i, goal = length - info->cpt % length;
-		char zero = 0;
-		ssize_t ret;
+	memcpy(dst, &src[nb * stride], len - nb * stride);
+}
 
-		for (i = 0; i < goal; i++) {
-			ret = info->pdata->writefd(info->pdata, &zero, 1);
-			if (ret < 0)
-				return ret;
+static ssize_t encode_zstd(struct ThdEntry *thd, void *dst,
+		const void *src, size_t len, size_t sample_size)
+{
+	uint8_t *planes = thd->zbuf;
+	size_t size;
+
+	split_planes(planes, src, len, sample_size);
+
+	size = ZSTD_compressCCtx(thd->zstd_cctx, dst, len,
+				 planes, len, thd->zstd_level);
+	return ZSTD_isError(size) ? -EIO : (ssize_t) size;
+}
+#endif
+
+/* Computes where the samples of the channels enabled in the mask are found,
+ * with the same alignment rules as the library. Returns the number of
+ * entries, or zero if the samples cannot be packed. */
+static unsigned int get_packed_layout(const struct iio_device *dev,
+		const uint32_t *mask, size_t sample_size,
+		struct packed_chn *layout)
+{
+	unsigned int i, nb = 0, offset = 0;
+	long index = -1;
+
+	for (i = 0; i < iio_device_get_channels_count(dev); i++) {
+		const struct iio_channel *chn = iio_device_get_channel(dev, i);
+		const struct iio_data_format *fmt =
+			iio_channel_get_data_format(chn);
+		unsigned int length = fmt->length / 8;
+
+		if (iio_channel_get_index(chn) < 0)
+			break;
+		if (!TEST_BIT(mask, i))
+			continue;
+
+		/* Channels with the same index share their samples */
+		if (nb && iio_channel_get_index(chn) == index)
+			continue;
+
+		if (!length || length > 8 || (length & (length - 1)) ||
+		    !fmt->bits || fmt->bits + fmt->shift > fmt->length)
+			return 0;
+
+		if (offset % length)
+			offset += length - offset % length;
+
+		layout[nb].offset = offset;
+		layout[nb].length = length;
+		layout[nb].bits = fmt->bits;
+		layout[nb].shift = fmt->shift;
+		layout[nb].repeat = fmt->repeat;
+		layout[nb].is_be = fmt->is_be;
+
+		index = iio_channel_get_index(chn);
+		offset += length * fmt->repeat;
+		nb++;
+	}
+
+	return offset <= sample_size ? nb : 0;
+}
+
+/* Accumulates values of up to 32 bits, least significant bits first */
+struct bit_writer {
+	uint8_t *dst;
+	uint64_t acc;
+	unsigned int nbits;
+};
+
+static inline void put_bits(struct bit_writer *w, uint64_t val,
+		unsigned int bits)
+{
+	w->acc |= (val & ((UINT64_C(1) << bits) - 1)) << w->nbits;
+	w->nbits += bits;
+
+	if (w->nbits >= 32) {
+		w->dst[0] = (uint8_t) w->acc;
+		w->dst[1] = (uint8_t) (w->acc >> 8);
+		w->dst[2] = (uint8_t) (w->acc >> 16);
+		w->dst[3] = (uint8_t) (w->acc >> 24);
+		w->dst += 4;
+		w->acc >>= 32;
+		w->nbits -= 32;
+	}
+}
+
+static uint8_t * bit_writer_flush(struct bit_writer *w)
+{
+	while (w->nbits > 0) {
+		*w->dst++ = (uint8_t) w->acc;
+		w->acc >>= 8;
+		w->nbits = w->nbits > 8 ? w->nbits - 8 : 0;
+	}
+
+	return w->dst;
+}
+
+static inline uint64_t load_sample(const uint8_t *src,
+		unsigned int length, bool is_be)
+{
+	uint64_t val = 0;
+	unsigned int i;
+
+	for (i = 0; i < length; i++)
+		val = val << 8 | src[is_be ? i : length - 1 - i];
+
+	return val;
+}
+
+/* Returns true if the samples are made of 16-bit elements of the same
+ * format and without padding, which can be packed as a single array. */
+static bool packed_layout_is_uniform16(const struct packed_chn *layout,
+		unsigned int nb, size_t sample_size)
+{
+	unsigned int i, offset = 0;
+
+	for (i = 0; i < nb; i++) {
+		if (layout[i].length != 2 || layout[i].offset != offset ||
+		    layout[i].bits != layout[0].bits ||
+		    layout[i].shift != layout[0].shift ||
+		    layout[i].is_be != layout[0].is_be)
+			return false;
+
+		offset += 2 * layout[i].repeat;
+	}
+
+	return offset == sample_size;
+}
+
+static size_t pack16(uint8_t *dst, const uint8_t *src, size_t nb,
+		const struct packed_chn *fmt)
+{
+	struct bit_writer w = { .dst = dst };
+	unsigned int val;
+	size_t i;
+
+	for (i = 0; i < nb; i++, src += 2) {
+		if (fmt->is_be)
+			val = (unsigned int) src[0] << 8 | src[1];
+		else
+			val = (unsigned int) src[1] << 8 | src[0];
+
+		put_bits(&w, val >> fmt->shift, fmt->bits);
+	}
+
+	return bit_writer_flush(&w) - dst;
+}
+
+/* Stores only the significant bits of each sample, one after the other */
+static ssize_t encode_packed(struct ThdEntry *thd, const uint32_t *mask,
+		void *dst, const void *src, size_t len, size_t sample_size)
+{
+	const uint8_t *ptr = src;
+	struct bit_writer w = { .dst = dst };
+	const struct packed_chn *chn;
+	unsigned int i, j, nb;
+	uint64_t val;
+	size_t k;
+
+	nb = get_packed_layout(thd->dev, mask, sample_size, thd->layout);
+	if (!nb || len % sample_size)
+		return -EINVAL;
+
+	if (packed_layout_is_uniform16(thd->layout, nb, sample_size))
+		return pack16(dst, src, len / 2, thd->layout);
+
+	for (k = 0; k < len; k += sample_size, ptr += sample_size) {
+		for (i = 0, chn = thd->layout; i < nb; i++, chn++) {
+			for (j = 0; j < chn->repeat; j++) {
+				val = load_sample(ptr + chn->offset +
+						  j * chn->length,
+						  chn->length, chn->is_be);
+				val >>= chn->shift;
+
+				if (chn->bits > 32) {
+					put_bits(&w, val, 32);
+					put_bits(&w, val >> 32, chn->bits - 32);
+				} else {
+					put_bits(&w, val, chn->bits);
+				}
+			}
 		}
-		info->cpt += goal;
 	}
 
-	info->cpt += length;
-	info->nb_bytes -= length;
-	return write_all(info->pdata, src, length);
+	return bit_writer_flush(&w) - (uint8_t *) dst;
 }
 
-static ssize_t receive_sample(const struct iio_channel *chn,
-		void *dst, size_t length, void *d)
+/* Sends the data of an encoded stream, whose samples hold the channels of
+ * the mask. It is preceded by the size of the encoded data and by the size
+ * of the samples, or by a single zero if it is sent as it is. */
+static ssize_t send_encoded(struct ThdEntry *thd, const uint32_t *mask,
+		const void *src, size_t len, size_t sample_size)
 {
-	unsigned int number = get_channel_number(chn);
-	struct sample_cb_info *info = d;
+	struct parser_pdata *pdata = thd->pdata;
+	void *out = (uint8_t *) thd->zbuf + thd->zbuf_len - len;
+	ssize_t ret, size = -ENOSYS;
+
+	switch (thd->codec) {
+#if WITH_ZSTD
+	case STREAM_CODEC_ZSTD:
+		size = encode_zstd(thd, out, src, len, sample_size);
+		break;
+#endif
+	case STREAM_CODEC_PACKED:
+		size = encode_packed(thd, mask, out, src, len, sample_size);
+		break;
+	default:
+		break;
+	}
 
-	if (iio_channel_get_index(chn) < 0 || !TEST_BIT(info->mask, number))
-		return 0;
-	if (info->cpt == info->nb_bytes)
-		return 0;
+	if (size > 0 && (size_t) size < len) {
+		print_value(pdata, (long) size);
+		print_value(pdata, (long) sample_size);
 
-	/* Skip the padding if needed */
-	if (info->cpt % length) {
-		unsigned int i, goal = length - info->cpt % length;
-		char foo;
-		ssize_t ret;
+		ret = write_all(pdata, out, size);
+		return ret < 0 ? ret : (ssize_t) len;
+	}
 
-		for (i = 0; i < goal; i++) {
-			ret = info->pdata->readfd(info->pdata, &foo, 1);
-			if (ret < 0)
-				return ret;
+	print_value(pdata, 0);
+	return write_all(pdata, src, len);
+}
+
+/* Computes the runs of bytes to copy between the samples of the device
+ * buffer, which hold the channels of the mask of the device, and the
+ * samples of the client, which hold the channels of its own mask. Both
+ * follow the alignment rules of iio_buffer_foreach_sample(). */
+static void thd_entry_update_runs(struct ThdEntry *thd,
+		const struct DevEntry *entry)
+{
+	const struct iio_device *dev = entry->dev;
+	unsigned int i, nb = 0, offset = 0, dev_offset = 0, thd_offset = 0;
+	long dev_index = -1, thd_index = -1;
+	struct sample_run *run = NULL;
+
+	for (i = 0; i < iio_device_get_channels_count(dev); i++) {
+		const struct iio_channel *chn = iio_device_get_channel(dev, i);
+		const struct iio_data_format *fmt =
+			iio_channel_get_data_format(chn);
+		unsigned int length = fmt->length / 8,
+			     size = length * fmt->repeat;
+		long index = iio_channel_get_index(chn);
+
+		if (index < 0)
+			break;
+		if (!TEST_BIT(entry->mask, i))
+			continue;
+
+		/* Channels with the same index share their samples */
+		if (index != dev_index) {
+			if (length && dev_offset % length)
+				dev_offset += length - dev_offset % length;
+
+			offset = dev_offset;
+			dev_offset += size;
+			dev_index = index;
+		}
+
+		if (!TEST_BIT(thd->mask, i) || index == thd_index)
+			continue;
+
+		if (length && thd_offset % length)
+			thd_offset += length - thd_offset % length;
+
+		if (run && run->dev_offset + run->length == offset &&
+		    run->thd_offset + run->length == thd_offset) {
+			run->length += size;
+		} else {
+			run = &thd->runs[nb++];
+			run->dev_offset = offset;
+			run->thd_offset = thd_offset;
+			run->length = size;
+		}
+
+		thd_offset += size;
+		thd_index = index;
+	}
+
+	thd->nb_runs = nb;
+}
+
+static inline void copy_run(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	/* Most runs are a single sample of a common size */
+	switch (len) {
+	case 2:
+		memcpy(dst, src, 2);
+		break;
+	case 4:
+		memcpy(dst, src, 4);
+		break;
+	case 8:
+		memcpy(dst, src, 8);
+		break;
+	default:
+		memcpy(dst, src, len);
+		break;
+	}
+}
+
+/* Copies 'nb' samples from the device buffer to the staging buffer of the
+ * client if 'demux' is set, or from the staging buffer to the device
+ * buffer otherwise */
+static void thd_entry_copy_samples(struct ThdEntry *thd,
+		const struct DevEntry *entry, bool demux, size_t nb)
+{
+	uint8_t *dev_ptr = iio_buffer_start(entry->buf), *thd_ptr = thd->staging;
+	const struct sample_run *run, *end = thd->runs + thd->nb_runs;
+	size_t i;
+
+	for (i = 0; i < nb; i++) {
+		for (run = thd->runs; run != end; run++) {
+			if (demux)
+				copy_run(thd_ptr + run->thd_offset,
+					 dev_ptr + run->dev_offset, run->length);
+			else
+				copy_run(dev_ptr + run->dev_offset,
+					 thd_ptr + run->thd_offset, run->length);
 		}
-		info->cpt += goal;
+
+		dev_ptr += entry->sample_size;
+		thd_ptr += thd->sample_size;
+	}
+}
+
+static int thd_entry_alloc_staging(struct ThdEntry *thd, size_t len)
+{
+	void *staging;
+
+	if (thd->staging_len < len) {
+		staging = realloc(thd->staging, len);
+		if (!staging)
+			return -ENOMEM;
+
+		/* The padding between the samples is never written */
+		memset(staging, 0, len);
+
+		thd->staging = staging;
+		thd->staging_len = len;
 	}
 
-	info->cpt += length;
-	return read_all(info->pdata, dst, length);
+	return 0;
 }
 
 static ssize_t send_data(struct DevEntry *dev, struct ThdEntry *thd, size_t len)
 {
 	struct parser_pdata *pdata = thd->pdata;
 	bool demux = server_demux && dev->sample_size != thd->sample_size;
+	size_t nb = 0;
 	void *start;
+	int err;
+
+	if (demux) {
+		nb = len / dev->sample_size;
+		if (nb > thd->nb / thd->sample_size)
+			nb = thd->nb / thd->sample_size;
 
-	if (demux)
-		len = (len / dev->sample_size) * thd->sample_size;
-	if (len > thd->nb)
+		len = nb * thd->sample_size;
+
+		err = thd_entry_alloc_staging(thd, len);
+		if (err < 0)
+			return err;
+	} else if (len > thd->nb) {
 		len = thd->nb;
+	}
 
 	print_value(pdata, len);
 
@@ -481,22 +874,45 @@ static ssize_t send_data(struct DevEntry *dev, struct ThdEntry *thd, size_t len)
 	if (!demux) {
 		/* Short path */
 		start = iio_buffer_start(dev->buf);
-		return write_all(pdata, start, len);
-	} else {
-		struct sample_cb_info info = {
-			.pdata = pdata,
-			.cpt = 0,
-			.nb_bytes = len,
-			.mask = thd->mask,
-		};
+		if (thd->codec != STREAM_CODEC_NONE)
+			return send_encoded(thd, dev->mask, start, len,
+					    dev->sample_size);
 
-		return iio_buffer_foreach_sample(dev->buf, send_sample, &info);
+		return write_all(pdata, start, len);
 	}
+
+	/* Long path: Demux the samples, and send them at once */
+	thd_entry_copy_samples(thd, dev, true, nb);
+
+	if (thd->codec != STREAM_CODEC_NONE)
+		return send_encoded(thd, thd->mask, thd->staging, len,
+				    thd->sample_size);
+
+	return write_all(pdata, thd->staging, len);
 }
 
 static ssize_t receive_data(struct DevEntry *dev, struct ThdEntry *thd)
 {
 	struct parser_pdata *pdata = thd->pdata;
+	bool mux = dev->sample_size != thd->sample_size;
+	size_t nb, len;
+	ssize_t ret;
+
+	if (mux) {
+		nb = dev->samples_count;
+		if (nb > thd->nb / thd->sample_size)
+			nb = thd->nb / thd->sample_size;
+
+		len = nb * thd->sample_size;
+
+		ret = thd_entry_alloc_staging(thd, len);
+		if (ret < 0)
+			return ret;
+	} else {
+		len = dev->sample_size * dev->samples_count;
+		if (thd->nb < len)
+			len = thd->nb;
+	}
 
 	/* Inform that no error occurred, and that we'll start reading data */
 	if (thd->new_client) {
@@ -504,27 +920,19 @@ static ssize_t receive_data(struct DevEntry *dev, struct ThdEntry *thd)
 		thd->new_client = false;
 	}
 
-	if (dev->sample_size == thd->sample_size) {
+	if (!mux) {
 		/* Short path: Receive directly in the buffer */
-
-		size_t len = dev->sample_size * dev->samples_count;
-		if (thd->nb < len)
-			len = thd->nb;
-
 		return read_all(pdata, iio_buffer_start(dev->buf), len);
-	} else {
-		/* Long path: Mux the samples to the buffer */
+	}
+
+	/* Long path: Receive all the samples, then mux them to the buffer */
+	ret = read_all(pdata, thd->staging, len);
+	if (ret < 0)
+		return ret;
 
-		struct sample_cb_info info = {
-			.pdata = pdata,
-			.cpt = 0,
-			.nb_bytes = thd->nb,
-			.mask = thd->mask,
-		};
+	thd_entry_copy_samples(thd, dev, false, nb);
 
-		return iio_buffer_foreach_sample(dev->buf,
-				receive_sample, &info);
-	}
+	return ret;
 }
 
 static void dev_entry_put(struct DevEntry *entry)
@@ -554,6 +962,16 @@ static void signal_thread(struct ThdEntry *thd, ssize_t ret)
 	thd_entry_event_signal(thd);
 }
 
+/* Starts sending the next block of a stream */
+static void thd_entry_next_block(struct ThdEntry *thd)
+{
+	thd->credits--;
+	thd->nb = thd->stream_nb;
+	thd->err = 0;
+	thd->new_client = true;
+	thd->active = true;
+}
+
 static void rw_thd(struct thread_pool *pool, void *d)
 {
 	struct DevEntry *entry = d;
@@ -632,6 +1050,9 @@ static void rw_thd(struct thread_pool *pool, void *d)
 			entry->sample_size = iio_device_get_sample_size(dev);
 			entry->samples_count = samples_count;
 			mask_updated = true;
+
+			SLIST_FOREACH(thd, &entry->thdlist_head, dev_list_entry)
+				thd_entry_update_runs(thd, entry);
 		}
 
 		sample_size = entry->sample_size;
@@ -713,16 +1134,25 @@ static void rw_thd(struct thread_pool *pool, void *d)
 				if (ret > 0)
 					thd->nb -= ret;
 
-				if (ret < 0 || thd->nb < sample_size)
+				if (ret >= 0 && thd->nb < sample_size &&
+				    thd->credits) {
+					/* Terminate the block if incomplete,
+					 * like rw_buffer() does */
+					if (thd->nb)
+						print_value(thd->pdata, 0);
+
+					thd_entry_next_block(thd);
+				} else if (ret < 0 || thd->nb < sample_size) {
 					signal_thread(thd, (ret < 0) ?
 							ret : (ssize_t) thd->nb);
+				}
 			}
 
 			pthread_mutex_unlock(&entry->thdlist_lock);
 		}
 
 		if (has_writers) {
-			ssize_t nb_bytes = 0;
+			size_t nb_samples = 0;
 
 			pthread_mutex_lock(&entry->thdlist_lock);
 
@@ -748,17 +1178,22 @@ static void rw_thd(struct thread_pool *pool, void *d)
 
 				ret = receive_data(entry, thd);
 				if (ret > 0) {
+					size_t n = (size_t) ret / thd->sample_size;
+
 					thd->nb -= ret;
-					if (ret > nb_bytes)
-						nb_bytes = ret;
+					thd->received += ret;
+
+					/* The muxed samples of the client are
+					 * smaller than the ones of the buffer */
+					if (n > nb_samples)
+						nb_samples = n;
 				}
 
 				if (ret < 0)
 					signal_thread(thd, ret);
 			}
 
-			ret = iio_buffer_push_partial(entry->buf,
-				nb_bytes / sample_size);
+			ret = iio_buffer_push_partial(entry->buf, nb_samples);
 			if (entry->cancelled) {
 				pthread_mutex_unlock(&entry->thdlist_lock);
 				continue;
@@ -822,13 +1257,20 @@ static struct ThdEntry *parser_lookup_thd_entry(struct parser_pdata *pdata,
 	return NULL;
 }
 
+/* With 'unread' set, the data of a write follows the command without waiting
+ * for the status; 'unread' is then set to the number of bytes of it that
+ * were not received. */
 static ssize_t rw_buffer(struct parser_pdata *pdata,
-		struct iio_device *dev, unsigned int nb, bool is_write)
+		struct iio_device *dev, unsigned int nb, bool is_write,
+		unsigned int *unread)
 {
 	struct DevEntry *entry;
 	struct ThdEntry *thd;
 	ssize_t ret;
 
+	if (unread)
+		*unread = nb;
+
 	if (!dev)
 		return -ENODEV;
 
@@ -852,8 +1294,9 @@ static ssize_t rw_buffer(struct parser_pdata *pdata,
 		return -EBUSY;
 	}
 
-	thd->new_client = true;
+	thd->new_client = !unread;
 	thd->nb = nb;
+	thd->received = 0;
 	thd->err = 0;
 	thd->is_writer = is_write;
 	thd->active = true;
@@ -862,15 +1305,20 @@ static ssize_t rw_buffer(struct parser_pdata *pdata,
 
 	IIO_DEBUG("Waiting for completion...\n");
 	while (thd->active) {
-		ret = thd_entry_event_wait(thd, &entry->thdlist_lock, pdata->fd_in);
+		ret = thd_entry_event_wait(thd, &entry->thdlist_lock, pdata->fd_in,
+					   false);
 		if (ret)
 			break;
 	}
 	if (ret == 0)
 		ret = thd->err;
+
+	/* If the connection is lost, the thread may still be receiving */
+	if (unread)
+		*unread = thd->active ? 0 : nb - thd->received;
 	pthread_mutex_unlock(&entry->thdlist_lock);
 
-	if (ret > 0 && ret < (ssize_t) nb)
+	if (ret > 0 && ret < (ssize_t) nb && !unread)
 		print_value(thd->pdata, 0);
 
 	IIO_DEBUG("Exiting rw_buffer with code %li\n", (long) ret);
@@ -880,77 +1328,294 @@ static ssize_t rw_buffer(struct parser_pdata *pdata,
 		return nb - ret;
 }
 
-static uint32_t *get_mask(const char *mask, size_t *len)
+static int thd_entry_alloc_zbuf(struct ThdEntry *thd, size_t len)
 {
-	size_t nb = (*len + 7) / 8;
-	uint32_t *ptr, *words = calloc(nb, sizeof(*words));
-	if (!words)
-		return NULL;
+	void *zbuf;
 
-	ptr = words + nb;
-	while (*mask) {
-		char buf[9];
-		snprintf(buf, sizeof(buf), "%.*s", 8, mask);
-		sscanf(buf, "%08x", --ptr);
-		mask += 8;
-		IIO_DEBUG("Mask[%lu]: 0x%08x\n",
-				(unsigned long) (words - ptr) / 4, *ptr);
+	if (thd->zbuf_len < len) {
+		zbuf = realloc(thd->zbuf, len);
+		if (!zbuf)
+			return -ENOMEM;
+
+		thd->zbuf = zbuf;
+		thd->zbuf_len = len;
 	}
 
-	*len = nb;
-	return words;
+	return 0;
 }
 
-static void free_thd_entry(struct ThdEntry *t)
+/* Prepares the encoding of blocks of up to 'nb' bytes with the given
+ * codec; no codec means that the blocks are sent as they are. Data that
+ * doesn't shrink is sent as it is, so the encoded data never needs more
+ * room than the input. */
+static int thd_entry_set_codec(struct ThdEntry *thd, const char *codec,
+		int level, size_t nb)
 {
-	close(t->eventfd);
-	free(t->mask);
-	free(t);
-}
+	struct packed_chn *layout;
+	int ret;
 
-static void remove_thd_entry(struct ThdEntry *t)
-{
-	struct DevEntry *entry = t->entry;
+	if (!codec)
+		return 0;
 
-	pthread_mutex_lock(&entry->thdlist_lock);
-	if (!entry->closed) {
-		entry->update_mask = true;
-		SLIST_REMOVE(&entry->thdlist_head, t, ThdEntry, dev_list_entry);
-		if (SLIST_EMPTY(&entry->thdlist_head) && entry->buf) {
-			entry->cancelled = true;
-			iio_buffer_cancel(entry->buf); /* Wakeup the rw thread */
+	if (!strcmp(codec, "packed")) {
+		if (!thd->layout) {
+			layout = calloc(iio_device_get_channels_count(thd->dev),
+					sizeof(*layout));
+			if (!layout)
+				return -ENOMEM;
+
+			thd->layout = layout;
 		}
 
-		pthread_cond_signal(&entry->rw_ready_cond);
-	}
-	pthread_mutex_unlock(&entry->thdlist_lock);
-	dev_entry_put(entry);
+		ret = thd_entry_alloc_zbuf(thd, nb);
+		if (ret < 0)
+			return ret;
 
-	free_thd_entry(t);
-}
+		thd->codec = STREAM_CODEC_PACKED;
+		return 0;
+	}
 
-static ssize_t get_dev_sample_size_mask(const struct iio_device *dev,
-					const uint32_t *mask, size_t words)
-{
-	unsigned int i, len, number,
-		     nb_channels = iio_device_get_channels_count(dev);
-	const struct iio_channel *prev = NULL;
-	const struct iio_channel *chn;
-	const struct iio_data_format *fmt;
-	long index;
-	ssize_t size = 0;
+#if WITH_ZSTD
+	if (!strcmp(codec, "zstd")) {
+		if (!thd->zstd_cctx) {
+			thd->zstd_cctx = ZSTD_createCCtx();
+			if (!thd->zstd_cctx)
+				return -ENOMEM;
+		}
 
-	if (words != (nb_channels + 31) / 32)
-		return -EINVAL;
+		/* Room for the filtered data, and for the compressed data */
+		ret = thd_entry_alloc_zbuf(thd, 2 * nb);
+		if (ret < 0)
+			return ret;
 
-	for (i = 0; i < nb_channels; i++) {
-		chn = iio_device_get_channel(dev, i);
-		number = get_channel_number(chn);
-		fmt = iio_channel_get_data_format(chn);
-		index = iio_channel_get_index(chn);
-		len = fmt->length / 8 * fmt->repeat;
+		if (level < ZSTD_minCLevel())
+			level = ZSTD_minCLevel();
+		else if (level > ZSTD_maxCLevel())
+			level = ZSTD_maxCLevel();
 
-		if (index < 0)
+		thd->zstd_level = level;
+		thd->codec = STREAM_CODEC_ZSTD;
+		return 0;
+	}
+#endif
+
+	return -ENOSYS;
+}
+
+/*
+ * Sends blocks of 'nb' bytes continuously, each one formatted like the answer
+ * to a READBUF command. The client grants the right to send more blocks by
+ * writing their number on a line; a value of zero stops the stream, which is
+ * then terminated by a block header of zero.
+ *
+ * With a codec, the data of each answer is preceded by its encoded size
+ * and the size of the samples, or by zero if it is sent as it is.
+ */
+static ssize_t stream_buffer(struct parser_pdata *pdata,
+		struct iio_device *dev, unsigned int nb, unsigned int credits,
+		const char *codec, int level)
+{
+	struct DevEntry *entry;
+	struct ThdEntry *thd;
+	bool stop = false;
+	char buf[32];
+	ssize_t ret;
+
+	if (!dev)
+		return -ENODEV;
+
+	/* The credits are read while the blocks are sent; only sockets are
+	 * known to support it, unless built with WITH_USB_STREAM */
+	if ((!WITH_USB_STREAM && !pdata->fd_in_is_socket) || !credits)
+		return -EINVAL;
+
+	thd = parser_lookup_thd_entry(pdata, dev);
+	if (!thd)
+		return -EBADF;
+
+	entry = thd->entry;
+
+	if (nb < entry->sample_size)
+		return -EINVAL;
+
+	pthread_mutex_lock(&entry->thdlist_lock);
+	if (entry->closed) {
+		pthread_mutex_unlock(&entry->thdlist_lock);
+		return -EBADF;
+	}
+
+	if (thd->nb) {
+		pthread_mutex_unlock(&entry->thdlist_lock);
+		return -EBUSY;
+	}
+
+	ret = thd_entry_set_codec(thd, codec, level, nb);
+	if (ret < 0) {
+		pthread_mutex_unlock(&entry->thdlist_lock);
+		return ret;
+	}
+
+	/* Acknowledge the request before the first block */
+	print_value(pdata, 0);
+
+	thd->stream_nb = nb;
+	thd->credits = credits;
+	thd->is_writer = false;
+	thd_entry_next_block(thd);
+
+	pthread_cond_signal(&entry->rw_ready_cond);
+
+	while (true) {
+		/* The credits are read while the blocks are sent. Nothing
+		 * else is sent by the client once the stream is stopped.
+		 * The endpoints of USB functions can't be polled and always
+		 * appear readable; the credits are then read as they come,
+		 * the client granting one after each block it reads. */
+		ret = thd_entry_event_wait(thd, &entry->thdlist_lock,
+					   pdata->fd_in, !stop);
+		if (ret < 0)
+			break;
+
+		if (ret > 0) {
+			pthread_mutex_unlock(&entry->thdlist_lock);
+			ret = read_line(pdata, buf, sizeof(buf));
+			pthread_mutex_lock(&entry->thdlist_lock);
+
+			if (ret <= 0) {
+				ret = ret ? ret : -EPIPE;
+				break;
+			}
+
+			buf[ret - 1] = '\0';
+			credits = (unsigned int) strtoul(buf, NULL, 10);
+			if (credits) {
+				thd->credits += credits;
+			} else {
+				thd->credits = 0;
+				stop = true;
+			}
+		}
+
+		if (thd->active)
+			continue;
+
+		ret = thd->err;
+		if (ret < 0)
+			break;
+
+		if (ret == (ssize_t) nb) {
+			/* The buffer was re-created before anything was sent;
+			 * the block will be sent again. */
+			thd->credits++;
+		} else if (ret > 0) {
+			print_value(pdata, 0);
+		}
+
+		thd->err = 0;
+
+		if (stop) {
+			ret = 0;
+			break;
+		}
+
+		if (thd->credits) {
+			thd_entry_next_block(thd);
+			pthread_cond_signal(&entry->rw_ready_cond);
+		}
+	}
+
+	/* If the client is gone, stop after the current block and end the
+	 * session, even if data is still pending. */
+	thd->stream_nb = 0;
+	thd->credits = 0;
+	thd->codec = STREAM_CODEC_NONE;
+	pthread_mutex_unlock(&entry->thdlist_lock);
+
+	if (ret == -EPIPE)
+		pdata->stop = true;
+
+	IIO_DEBUG("Exiting stream_buffer with code %li\n", (long) ret);
+	return ret;
+}
+
+static uint32_t *get_mask(const char *mask, size_t *len)
+{
+	size_t nb = (*len + 7) / 8;
+	uint32_t *ptr, *words = calloc(nb, sizeof(*words));
+	if (!words)
+		return NULL;
+
+	ptr = words + nb;
+	while (*mask) {
+		char buf[9];
+		snprintf(buf, sizeof(buf), "%.*s", 8, mask);
+		sscanf(buf, "%08x", --ptr);
+		mask += 8;
+		IIO_DEBUG("Mask[%lu]: 0x%08x\n",
+				(unsigned long) (words - ptr) / 4, *ptr);
+	}
+
+	*len = nb;
+	return words;
+}
+
+static void free_thd_entry(struct ThdEntry *t)
+{
+#if WITH_ZSTD
+	ZSTD_freeCCtx(t->zstd_cctx);
+#endif
+	free(t->layout);
+	free(t->zbuf);
+	free(t->staging);
+	free(t->runs);
+	close(t->eventfd);
+	free(t->mask);
+	free(t);
+}
+
+static void remove_thd_entry(struct ThdEntry *t)
+{
+	struct DevEntry *entry = t->entry;
+
+	pthread_mutex_lock(&entry->thdlist_lock);
+	if (!entry->closed) {
+		entry->update_mask = true;
+		SLIST_REMOVE(&entry->thdlist_head, t, ThdEntry, dev_list_entry);
+		if (SLIST_EMPTY(&entry->thdlist_head) && entry->buf) {
+			entry->cancelled = true;
+			iio_buffer_cancel(entry->buf); /* Wakeup the rw thread */
+		}
+
+		pthread_cond_signal(&entry->rw_ready_cond);
+	}
+	pthread_mutex_unlock(&entry->thdlist_lock);
+	dev_entry_put(entry);
+
+	free_thd_entry(t);
+}
+
+static ssize_t get_dev_sample_size_mask(const struct iio_device *dev,
+					const uint32_t *mask, size_t words)
+{
+	unsigned int i, len, number,
+		     nb_channels = iio_device_get_channels_count(dev);
+	const struct iio_channel *prev = NULL;
+	const struct iio_channel *chn;
+	const struct iio_data_format *fmt;
+	long index;
+	ssize_t size = 0;
+
+	if (words != (nb_channels + 31) / 32)
+		return -EINVAL;
+
+	for (i = 0; i < nb_channels; i++) {
+		chn = iio_device_get_channel(dev, i);
+		number = get_channel_number(chn);
+		fmt = iio_channel_get_data_format(chn);
+		index = iio_channel_get_index(chn);
+		len = fmt->length / 8 * fmt->repeat;
+
+		if (index < 0)
 			break;
 		if (!TEST_BIT(mask, number))
 			continue;
@@ -981,6 +1646,7 @@ static int open_dev_helper(struct parser_pdata *pdata, struct iio_device *dev,
 	uint32_t *words;
 	unsigned int nb_channels;
 	unsigned int cyclic_retry = 500;
+	ssize_t sample_size;
 
 	if (!dev)
 		return -ENODEV;
@@ -993,6 +1659,13 @@ static int open_dev_helper(struct parser_pdata *pdata, struct iio_device *dev,
 	if (!words)
 		return -ENOMEM;
 
+	/* The samples are demuxed by their size, which can't be zero */
+	sample_size = get_dev_sample_size_mask(dev, words, len);
+	if (sample_size <= 0) {
+		ret = sample_size ? (int) sample_size : -EINVAL;
+		goto err_free_words;
+	}
+
 	thd = zalloc(sizeof(*thd));
 	if (!thd)
 		goto err_free_words;
@@ -1001,11 +1674,15 @@ static int open_dev_helper(struct parser_pdata *pdata, struct iio_device *dev,
 	thd->mask = words;
 	thd->nb = 0;
 	thd->samples_count = samples_count;
-	thd->sample_size = get_dev_sample_size_mask(dev, words, len);
+	thd->sample_size = (unsigned int) sample_size;
 	thd->pdata = pdata;
 	thd->dev = dev;
 	thd->eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
 
+	thd->runs = calloc(nb_channels, sizeof(*thd->runs));
+	if (!thd->runs)
+		goto err_free_thd;
+
 retry:
 	/* Atomically look up the thread and make sure that it is still active
 	 * or allocate new one. */
@@ -1070,7 +1747,9 @@ retry:
 
 			/* Wait until the device is opened by the rw thread */
 			while (thd->wait_for_open) {
-				ret = thd_entry_event_wait(thd, &entry->thdlist_lock, pdata->fd_in);
+				ret = thd_entry_event_wait(thd,
+						&entry->thdlist_lock,
+						pdata->fd_in, false);
 				if (ret)
 					break;
 			}
@@ -1128,7 +1807,8 @@ retry:
 	pthread_mutex_lock(&entry->thdlist_lock);
 	/* Wait until the device is opened by the rw thread */
 	while (thd->wait_for_open) {
-		ret = thd_entry_event_wait(thd, &entry->thdlist_lock, pdata->fd_in);
+		ret = thd_entry_event_wait(thd, &entry->thdlist_lock, pdata->fd_in,
+					   false);
 		if (ret)
 			break;
 	}
@@ -1148,6 +1828,7 @@ err_free_entry:
 	free(entry);
 err_free_thd:
 	close(thd->eventfd);
+	free(thd->runs);
 	free(thd);
 err_free_words:
 	free(words);
@@ -1189,12 +1870,56 @@ int close_dev(struct parser_pdata *pdata, struct iio_device *dev)
 ssize_t rw_dev(struct parser_pdata *pdata, struct iio_device *dev,
 		unsigned int nb, bool is_write)
 {
-	ssize_t ret = rw_buffer(pdata, dev, nb, is_write);
+	ssize_t ret = rw_buffer(pdata, dev, nb, is_write, NULL);
 	if (ret <= 0 || is_write)
 		print_value(pdata, ret);
 	return ret;
 }
 
+static ssize_t discard_input(struct parser_pdata *pdata, size_t len)
+{
+	char buf[4096];
+	ssize_t ret;
+
+	while (len) {
+		ret = read_all(pdata, buf, len < sizeof(buf) ? len : sizeof(buf));
+		if (ret < 0)
+			return ret;
+
+		len -= (size_t) ret;
+	}
+
+	return 0;
+}
+
+ssize_t write_dev_pipelined(struct parser_pdata *pdata,
+		struct iio_device *dev, unsigned int nb)
+{
+	unsigned int unread;
+	ssize_t err, ret = rw_buffer(pdata, dev, nb, true, &unread);
+
+	/* The client does not wait for the status before sending the data;
+	 * the bytes that were not written must be read, or they would be
+	 * parsed as commands. */
+	err = discard_input(pdata, unread);
+	if (err < 0)
+		ret = err;
+
+	/* A single value is answered: the number of bytes written, or the
+	 * error code */
+	print_value(pdata, ret);
+	return ret;
+}
+
+ssize_t stream_dev(struct parser_pdata *pdata, struct iio_device *dev,
+		unsigned int nb, unsigned int credits,
+		const char *codec, int level)
+{
+	ssize_t ret = stream_buffer(pdata, dev, nb, credits, codec, level);
+	print_value(pdata, ret);
+	return ret;
+}
+
 ssize_t read_dev_attr(struct parser_pdata *pdata, struct iio_device *dev,
 		const char *attr, enum iio_attr_type type)
 {
@@ -1366,6 +2091,85 @@ ssize_t get_trigger(struct parser_pdata *pdata, struct iio_device *dev)
 	return ret;
 }
 
+/* Maximum number of events sent to the client in one batch */
+#define EVENTS_BATCH_SIZE 16
+
+int stream_events(struct parser_pdata *pdata, struct iio_device *dev)
+{
+	struct iio_event events[EVENTS_BATCH_SIZE];
+	struct iio_event_stream *stream;
+	struct pollfd pfd[3];
+	ssize_t i, ret;
+
+	if (!dev) {
+		print_value(pdata, -ENODEV);
+		return -ENODEV;
+	}
+
+	stream = iio_device_create_event_stream(dev);
+	if (!stream) {
+		ret = -errno;
+		print_value(pdata, ret);
+		return (int) ret;
+	}
+
+	ret = iio_event_stream_get_poll_fd(stream);
+	if (ret < 0) {
+		print_value(pdata, ret);
+		goto out_destroy_stream;
+	}
+
+	pfd[0].fd = (int) ret;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = pdata->fd_in;
+	pfd[1].events = POLLRDHUP;
+	pfd[2].fd = thread_pool_get_poll_fd(pdata->pool);
+	pfd[2].events = POLLIN;
+
+	print_value(pdata, 0);
+
+	/* From now on, the connection is dedicated to the event stream, and
+	 * will be closed by the client to unsubscribe. */
+	pdata->stop = true;
+
+	while (true) {
+		ret = iio_event_stream_read(stream, events,
+					    EVENTS_BATCH_SIZE, true);
+		if (ret == -EAGAIN) {
+			pfd[0].revents = pfd[1].revents = pfd[2].revents = 0;
+			poll_nointr(pfd, 3);
+
+			if ((pfd[1].revents & (POLLRDHUP | POLLHUP)) ||
+			    (pfd[2].revents & POLLIN)) {
+				ret = 0;
+				break;
+			}
+
+			continue;
+		}
+		if (ret < 0) {
+			print_value(pdata, ret);
+			break;
+		}
+
+		for (i = 0; i < ret; i++) {
+			events[i].id = htobe64(events[i].id);
+			events[i].timestamp = (int64_t) htobe64(
+					(uint64_t) events[i].timestamp);
+		}
+
+		print_value(pdata, ret * sizeof(*events));
+
+		ret = write_all(pdata, events, ret * sizeof(*events));
+		if (ret < 0)
+			break;
+	}
+
+out_destroy_stream:
+	iio_event_stream_destroy(stream);
+	return (int) ret;
+}
+
 int set_timeout(struct parser_pdata *pdata, unsigned int timeout)
 {
 	int ret = iio_context_set_timeout(pdata->ctx, timeout);
@@ -1373,18 +2177,12 @@ int set_timeout(struct parser_pdata *pdata, unsigned int timeout)
 	return ret;
 }
 
-int set_buffers_count(struct parser_pdata *pdata,
-		struct iio_device *dev, long value)
+static int do_set_buffers_count(struct iio_device *dev, unsigned int nb)
 {
-	unsigned int i, nb = (unsigned int) value;
 	struct timespec wait;
+	unsigned int i;
 	int ret = -EINVAL;
 
-	if (!dev) {
-		ret = -ENODEV;
-		goto err_print_value;
-	}
-
 	if (nb >= 1) {
 		/*
 		 * Avoid the same race condition described in open_dev_helper().
@@ -1403,11 +2201,493 @@ int set_buffers_count(struct parser_pdata *pdata,
 			} while (ret == -1 && errno == EINTR);
 		}
 	}
+
+	return ret;
+}
+
+int set_buffers_count(struct parser_pdata *pdata,
+		struct iio_device *dev, long value)
+{
+	int ret = -ENODEV;
+
+	if (dev)
+		ret = do_set_buffers_count(dev, (unsigned int) value);
+
+	print_value(pdata, ret);
+	return ret;
+}
+
+/* Bounds the memory allocated for a REGREAD or REGWRITE command */
+#define REGS_BATCH_MAX 65536
+
+int read_regs(struct parser_pdata *pdata,
+		struct iio_device *dev, unsigned long nb)
+{
+	uint32_t *addrs, *values;
+	unsigned long i;
+	ssize_t ret;
+
+	if (!dev) {
+		ret = -ENODEV;
+		goto err_print_value;
+	}
+
+	if (!nb || nb > REGS_BATCH_MAX) {
+		ret = -E2BIG;
+		goto err_print_value;
+	}
+
+	addrs = malloc(2 * nb * sizeof(*addrs));
+	if (!addrs) {
+		ret = -ENOMEM;
+		goto err_print_value;
+	}
+
+	values = &addrs[nb];
+
+	/* Ready to receive the addresses */
+	print_value(pdata, 0);
+
+	ret = read_all(pdata, addrs, nb * sizeof(*addrs));
+	if (ret < 0)
+		goto out_free_addrs;
+
+	for (i = 0; i < nb; i++)
+		addrs[i] = be32toh(addrs[i]);
+
+	ret = iio_device_reg_read_batch(dev, addrs, values, nb);
+	if (ret < 0) {
+		print_value(pdata, ret);
+		goto out_free_addrs;
+	}
+
+	for (i = 0; i < nb; i++)
+		values[i] = htobe32(values[i]);
+
+	print_value(pdata, nb * sizeof(*values));
+
+	ret = write_all(pdata, values, nb * sizeof(*values));
+
+out_free_addrs:
+	free(addrs);
+	return ret < 0 ? (int) ret : 0;
+
 err_print_value:
 	print_value(pdata, ret);
+	return (int) ret;
+}
+
+int write_regs(struct parser_pdata *pdata,
+		struct iio_device *dev, unsigned long nb)
+{
+	uint32_t *addrs, *values;
+	unsigned long i;
+	ssize_t ret;
+
+	if (!dev) {
+		ret = -ENODEV;
+		goto err_print_value;
+	}
+
+	if (!nb || nb > REGS_BATCH_MAX) {
+		ret = -E2BIG;
+		goto err_print_value;
+	}
+
+	addrs = malloc(2 * nb * sizeof(*addrs));
+	if (!addrs) {
+		ret = -ENOMEM;
+		goto err_print_value;
+	}
+
+	values = &addrs[nb];
+
+	/* Ready to receive the addresses, followed by the values */
+	print_value(pdata, 0);
+
+	ret = read_all(pdata, addrs, 2 * nb * sizeof(*addrs));
+	if (ret < 0)
+		goto out_free_addrs;
+
+	for (i = 0; i < 2 * nb; i++)
+		addrs[i] = be32toh(addrs[i]);
+
+	ret = iio_device_reg_write_batch(dev, addrs, values, nb);
+	print_value(pdata, ret);
+
+out_free_addrs:
+	free(addrs);
+	return ret < 0 ? (int) ret : 0;
+
+err_print_value:
+	print_value(pdata, ret);
+	return (int) ret;
+}
+
+/* Bounds the memory allocated for the payload of a binary request */
+#define BINARY_PAYLOAD_MAX (16 * 1024 * 1024)
+
+/* Payloads up to this size are sent in the same write as the header */
+#define BINARY_INLINE_SIZE 512
+
+static ssize_t binary_send(struct parser_pdata *pdata,
+		const struct iiod_frame *req, int32_t code,
+		const void *payload, size_t len)
+{
+	char buf[sizeof(struct iiod_frame) + BINARY_INLINE_SIZE];
+	struct iiod_frame resp = {
+		.id = htobe16(req->id),
+		.op = req->op,
+		.dev = htobe16(req->dev),
+		.chn = htobe16(req->chn),
+		.code = (int32_t) htobe32((uint32_t) code),
+		.len = htobe32((uint32_t) len),
+	};
+	ssize_t ret;
+
+	memcpy(buf, &resp, sizeof(resp));
+
+	if (len <= BINARY_INLINE_SIZE) {
+		memcpy(&buf[sizeof(resp)], payload, len);
+		return write_all(pdata, buf, sizeof(resp) + len);
+	}
+
+	ret = write_all(pdata, buf, sizeof(resp));
+	if (ret < 0)
+		return ret;
+
+	return write_all(pdata, payload, len);
+}
+
+static ssize_t binary_discard(struct parser_pdata *pdata, size_t len)
+{
+	char buf[256];
+	ssize_t ret = 0;
+
+	while (len) {
+		ret = read_all(pdata, buf, len < sizeof(buf) ? len : sizeof(buf));
+		if (ret < 0)
+			return ret;
+
+		len -= (size_t) ret;
+	}
+
 	return ret;
 }
 
+static int binary_get_device(struct parser_pdata *pdata,
+		const struct iiod_frame *frame,
+		struct iio_device **dev, struct iio_channel **chn)
+{
+	*dev = iio_context_get_device(pdata->ctx, frame->dev);
+	if (!*dev)
+		return -ENODEV;
+
+	if (chn && (frame->flags & IIOD_FRAME_CHANNEL)) {
+		*chn = iio_device_get_channel(*dev, frame->chn);
+		if (!*chn)
+			return -ENXIO;
+	} else if (chn) {
+		*chn = NULL;
+	}
+
+	return 0;
+}
+
+static int device_index(const struct iio_context *ctx,
+		const struct iio_device *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < iio_context_get_devices_count(ctx); i++)
+		if (iio_context_get_device(ctx, i) == dev)
+			return (int) i;
+
+	return -ENODEV;
+}
+
+static ssize_t binary_read_attr(struct parser_pdata *pdata,
+		const struct iiod_frame *frame, const char *attr)
+{
+	/* Large enough for all the attributes to be read at once */
+	char buf[0x10000];
+	struct iio_channel *chn;
+	struct iio_device *dev;
+	ssize_t ret;
+
+	ret = binary_get_device(pdata, frame, &dev, &chn);
+	if (ret < 0)
+		return binary_send(pdata, frame, (int32_t) ret, NULL, 0);
+
+	if (!attr[0])
+		attr = NULL;
+
+	if (chn)
+		ret = iio_channel_attr_read(chn, attr, buf, sizeof(buf));
+	else if (frame->flags & IIOD_FRAME_DEBUG)
+		ret = iio_device_debug_attr_read(dev, attr, buf, sizeof(buf));
+	else if (frame->flags & IIOD_FRAME_BUFFER)
+		ret = iio_device_buffer_attr_read(dev, attr, buf, sizeof(buf));
+	else
+		ret = iio_device_attr_read(dev, attr, buf, sizeof(buf));
+
+	if (ret < 0)
+		return binary_send(pdata, frame, (int32_t) ret, NULL, 0);
+
+	return binary_send(pdata, frame, (int32_t) ret, buf, (size_t) ret);
+}
+
+static int binary_write_attr(struct parser_pdata *pdata,
+		const struct iiod_frame *frame, char *payload, size_t len)
+{
+	struct iio_channel *chn;
+	struct iio_device *dev;
+	const char *attr = payload;
+	size_t name_len;
+	int ret;
+
+	ret = binary_get_device(pdata, frame, &dev, &chn);
+	if (ret < 0)
+		return ret;
+
+	name_len = strnlen(payload, len);
+	if (name_len == len)
+		return -EINVAL;
+
+	if (!attr[0])
+		attr = NULL;
+
+	payload += name_len + 1;
+	len -= name_len + 1;
+
+	if (chn)
+		return (int) iio_channel_attr_write_raw(chn, attr, payload, len);
+	if (frame->flags & IIOD_FRAME_DEBUG)
+		return (int) iio_device_debug_attr_write_raw(dev,
+				attr, payload, len);
+	if (frame->flags & IIOD_FRAME_BUFFER)
+		return (int) iio_device_buffer_attr_write_raw(dev,
+				attr, payload, len);
+
+	return (int) iio_device_attr_write_raw(dev, attr, payload, len);
+}
+
+static int binary_get_trigger(struct parser_pdata *pdata,
+		const struct iiod_frame *frame)
+{
+	const struct iio_device *trigger;
+	struct iio_device *dev;
+	int ret;
+
+	ret = binary_get_device(pdata, frame, &dev, NULL);
+	if (ret < 0)
+		return ret;
+
+	ret = iio_device_get_trigger(dev, &trigger);
+	if (ret < 0)
+		return ret;
+	if (!trigger)
+		return 0;
+
+	ret = device_index(pdata->ctx, trigger);
+	return ret < 0 ? ret : ret + 1;
+}
+
+static int binary_set_trigger(struct parser_pdata *pdata,
+		const struct iiod_frame *frame)
+{
+	struct iio_device *dev, *trigger = NULL;
+	int ret;
+
+	ret = binary_get_device(pdata, frame, &dev, NULL);
+	if (ret < 0)
+		return ret;
+
+	if (frame->code) {
+		trigger = iio_context_get_device(pdata->ctx,
+				(unsigned int) frame->code - 1);
+		if (!trigger)
+			return -ENOENT;
+	}
+
+	return iio_device_set_trigger(dev, trigger);
+}
+
+static ssize_t binary_rw_regs(struct parser_pdata *pdata,
+		const struct iiod_frame *frame, uint32_t *payload, size_t len)
+{
+	bool is_write = frame->op == IIOD_OP_REGWRITE;
+	size_t i, nb = len / ((is_write ? 2 : 1) * sizeof(*payload));
+	struct iio_device *dev;
+	uint32_t *values;
+	ssize_t ret;
+
+	ret = binary_get_device(pdata, frame, &dev, NULL);
+	if (ret < 0)
+		goto out_send;
+
+	if (!nb || nb > REGS_BATCH_MAX ||
+	    len != (is_write ? 2 : 1) * nb * sizeof(*payload)) {
+		ret = -E2BIG;
+		goto out_send;
+	}
+
+	for (i = 0; i < len / sizeof(*payload); i++)
+		payload[i] = be32toh(payload[i]);
+
+	if (is_write) {
+		ret = iio_device_reg_write_batch(dev, payload,
+						 &payload[nb], nb);
+		goto out_send;
+	}
+
+	values = malloc(len);
+	if (!values) {
+		ret = -ENOMEM;
+		goto out_send;
+	}
+
+	ret = iio_device_reg_read_batch(dev, payload, values, nb);
+	if (ret >= 0) {
+		for (i = 0; i < nb; i++)
+			values[i] = htobe32(values[i]);
+
+		ret = binary_send(pdata, frame, 0, values, len);
+		free(values);
+		return ret;
+	}
+
+	free(values);
+
+out_send:
+	return binary_send(pdata, frame, (int32_t) ret, NULL, 0);
+}
+
+static ssize_t binary_print(struct parser_pdata *pdata,
+		const struct iiod_frame *frame)
+{
+	const void *data = NULL;
+	size_t len = 0;
+
+	switch (frame->code) {
+	case IIOD_PRINT_BINARY:
+		data = pdata->ctx_bin;
+		len = pdata->ctx_bin_len;
+		break;
+	case IIOD_PRINT_XML_ZSTD:
+		data = pdata->xml_zstd;
+		len = pdata->xml_zstd_len;
+		break;
+	case IIOD_PRINT_XML:
+		data = iio_context_get_xml(pdata->ctx);
+		len = strlen(data);
+		break;
+	default:
+		break;
+	}
+
+	if (!data)
+		return binary_send(pdata, frame, -EINVAL, NULL, 0);
+
+	return binary_send(pdata, frame, (int32_t) len, data, len);
+}
+
+/* Handles one request received with the binary framing */
+static ssize_t binary_parse(struct parser_pdata *pdata)
+{
+	struct iiod_frame frame;
+	struct iio_device *dev;
+	char *payload = NULL;
+	ssize_t ret;
+	size_t len;
+
+	ret = read_all(pdata, &frame, sizeof(frame));
+	if (ret < 0)
+		return ret;
+
+	frame.id = be16toh(frame.id);
+	frame.dev = be16toh(frame.dev);
+	frame.chn = be16toh(frame.chn);
+	frame.code = (int32_t) be32toh((uint32_t) frame.code);
+	len = be32toh(frame.len);
+
+	if (len > BINARY_PAYLOAD_MAX) {
+		ret = binary_discard(pdata, len);
+		if (ret < 0)
+			return ret;
+
+		return binary_send(pdata, &frame, -E2BIG, NULL, 0);
+	}
+
+	/* Always NUL-terminated, as it often starts with a name */
+	payload = malloc(len + 1);
+	if (!payload) {
+		ret = binary_discard(pdata, len);
+		if (ret < 0)
+			return ret;
+
+		return binary_send(pdata, &frame, -ENOMEM, NULL, 0);
+	}
+
+	ret = read_all(pdata, payload, len);
+	if (ret < 0)
+		goto out_free_payload;
+
+	payload[len] = '\0';
+
+	switch (frame.op) {
+	case IIOD_OP_EXIT:
+		pdata->stop = true;
+		ret = 0;
+		break;
+	case IIOD_OP_VERSION:
+		ret = binary_send(pdata, &frame,
+				  LIBIIO_VERSION_MAJOR << 16 | LIBIIO_VERSION_MINOR,
+				  LIBIIO_VERSION_GIT, strlen(LIBIIO_VERSION_GIT));
+		break;
+	case IIOD_OP_PRINT:
+		ret = binary_print(pdata, &frame);
+		break;
+	case IIOD_OP_TIMEOUT:
+		ret = iio_context_set_timeout(pdata->ctx,
+					      (unsigned int) frame.code);
+		ret = binary_send(pdata, &frame, (int32_t) ret, NULL, 0);
+		break;
+	case IIOD_OP_READ_ATTR:
+		ret = binary_read_attr(pdata, &frame, payload);
+		break;
+	case IIOD_OP_WRITE_ATTR:
+		ret = binary_write_attr(pdata, &frame, payload, len);
+		ret = binary_send(pdata, &frame, (int32_t) ret, NULL, 0);
+		break;
+	case IIOD_OP_GETTRIG:
+		ret = binary_get_trigger(pdata, &frame);
+		ret = binary_send(pdata, &frame, (int32_t) ret, NULL, 0);
+		break;
+	case IIOD_OP_SETTRIG:
+		ret = binary_set_trigger(pdata, &frame);
+		ret = binary_send(pdata, &frame, (int32_t) ret, NULL, 0);
+		break;
+	case IIOD_OP_SET_BUFFERS_COUNT:
+		ret = binary_get_device(pdata, &frame, &dev, NULL);
+		if (!ret)
+			ret = do_set_buffers_count(dev, (unsigned int) frame.code);
+		ret = binary_send(pdata, &frame, (int32_t) ret, NULL, 0);
+		break;
+	case IIOD_OP_REGREAD:
+	case IIOD_OP_REGWRITE:
+		ret = binary_rw_regs(pdata, &frame, (uint32_t *) payload, len);
+		break;
+	default:
+		ret = binary_send(pdata, &frame, -ENOSYS, NULL, 0);
+		break;
+	}
+
+out_free_payload:
+	free(payload);
+	return ret < 0 ? ret : 0;
+}
+
 ssize_t read_line(struct parser_pdata *pdata, char *buf, size_t len)
 {
 	size_t bytes_read = 0;
@@ -1485,7 +2765,7 @@ ssize_t read_line(struct parser_pdata *pdata, char *buf, size_t len)
 void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
 		 bool is_socket, bool is_usb, bool use_aio,
 		 struct thread_pool *pool, const void *xml_zstd,
-		 size_t xml_zstd_len)
+		 size_t xml_zstd_len, const void *ctx_bin, size_t ctx_bin_len)
 {
 	yyscan_t scanner;
 	struct parser_pdata pdata;
@@ -1501,7 +2781,10 @@ void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
 
 	pdata.xml_zstd = xml_zstd;
 	pdata.xml_zstd_len = xml_zstd_len;
+	pdata.ctx_bin = ctx_bin;
+	pdata.ctx_bin_len = ctx_bin_len;
 
+	pdata.binary = false;
 	pdata.fd_in_is_socket = is_socket;
 	pdata.fd_out_is_socket = is_socket;
 	pdata.is_usb = is_usb;
@@ -1514,22 +2797,17 @@ void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
 #if WITH_AIO
 		char err_str[1024];
 
-		pdata.aio_eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
-		if (pdata.aio_eventfd < 0) {
-			iio_strerror(errno, err_str, sizeof(err_str));
-			IIO_ERROR("Failed to create AIO eventfd: %s\n", err_str);
-			return;
+		ret = parser_aio_init(&pdata.aio_in);
+		if (!ret && WITH_USB_STREAM) {
+			ret = parser_aio_init(&pdata.aio_out);
+			if (ret)
+				parser_aio_exit(&pdata.aio_in);
 		}
-
-		pdata.aio_ctx = 0;
-		ret = io_setup(1, &pdata.aio_ctx);
 		if (ret < 0) {
 			iio_strerror(-ret, err_str, sizeof(err_str));
 			IIO_ERROR("Failed to create AIO context: %s\n", err_str);
-			close(pdata.aio_eventfd);
 			return;
 		}
-		pthread_mutex_init(&pdata.aio_mutex, NULL);
 		pdata.readfd = readfd_aio;
 		pdata.writefd = writefd_aio;
 #endif
@@ -1541,6 +2819,11 @@ void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
 	yylex_init_extra(&pdata, &scanner);
 
 	do {
+		if (pdata.binary) {
+			ret = (int) binary_parse(&pdata);
+			continue;
+		}
+
 		if (verbose)
 			output(&pdata, "iio-daemon > ");
 		ret = yyparse(scanner);
@@ -1554,8 +2837,9 @@ void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
 
 #if WITH_AIO
 	if (use_aio) {
-		io_destroy(pdata.aio_ctx);
-		close(pdata.aio_eventfd);
+		parser_aio_exit(&pdata.aio_in);
+		if (WITH_USB_STREAM)
+			parser_aio_exit(&pdata.aio_out);
 	}
 #endif
 }
@@ -54,6 +54,14 @@ enum iio_attr_type {
 	IIO_ATTR_TYPE_BUFFER,
 };
 
+#if WITH_AIO
+struct parser_aio {
+	io_context_t ctx;
+	int eventfd;
+	pthread_mutex_t mutex;
+};
+#endif
+
 struct parser_pdata {
 	struct iio_context *ctx;
 	bool stop, verbose;
@@ -67,15 +75,20 @@ struct parser_pdata {
 	bool channel_is_output;
 	bool fd_in_is_socket, fd_out_is_socket;
 	bool is_usb;
+
+	/* Set once the client switched to the binary framing */
+	bool binary;
 #if WITH_AIO
-	io_context_t aio_ctx;
-	int aio_eventfd;
-	pthread_mutex_t aio_mutex;
+	/* One for each direction with WITH_USB_STREAM, as the credits of a
+	 * stream are read while its blocks are written */
+	struct parser_aio aio_in, aio_out;
 #endif
 	struct thread_pool *pool;
 
 	const void *xml_zstd;
 	size_t xml_zstd_len;
+	const void *ctx_bin;
+	size_t ctx_bin_len;
 
 	ssize_t (*writefd)(struct parser_pdata *pdata, const void *buf, size_t len);
 	ssize_t (*readfd)(struct parser_pdata *pdata, void *buf, size_t len);
@@ -90,16 +103,19 @@ static inline void *zalloc(size_t size)
 
 void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
 		 bool is_socket, bool is_usb, bool use_aio, struct thread_pool *pool,
-		 const void *xml_zstd, size_t xml_zstd_len);
+		 const void *xml_zstd, size_t xml_zstd_len,
+		 const void *ctx_bin, size_t ctx_bin_len);
 
 int init_usb_daemon(const char *ffs, unsigned int nb_pipes);
 int start_usb_daemon(struct iio_context *ctx, const char *ffs,
 		bool debug, bool use_aio, unsigned int nb_pipes,
 		int ep0_fd, struct thread_pool *pool,
-		const void *xml_zstd, size_t xml_zstd_len);
+		const void *xml_zstd, size_t xml_zstd_len,
+		const void *ctx_bin, size_t ctx_bin_len);
 int start_serial_daemon(struct iio_context *ctx, const char *uart_params,
 			bool debug, struct thread_pool *pool,
-			const void *xml_zstd, size_t xml_zstd_len);
+			const void *xml_zstd, size_t xml_zstd_len,
+			const void *ctx_bin, size_t ctx_bin_len);
 
 int open_dev(struct parser_pdata *pdata, struct iio_device *dev,
 		size_t samples_count, const char *mask, bool cyclic);
@@ -107,6 +123,11 @@ int close_dev(struct parser_pdata *pdata, struct iio_device *dev);
 
 ssize_t rw_dev(struct parser_pdata *pdata, struct iio_device *dev,
 		unsigned int nb, bool is_write);
+ssize_t write_dev_pipelined(struct parser_pdata *pdata,
+		struct iio_device *dev, unsigned int nb);
+ssize_t stream_dev(struct parser_pdata *pdata, struct iio_device *dev,
+		unsigned int nb, unsigned int credits,
+		const char *codec, int level);
 
 ssize_t read_dev_attr(struct parser_pdata *pdata, struct iio_device *dev,
 		const char *attr, enum iio_attr_type type);
@@ -122,6 +143,13 @@ ssize_t get_trigger(struct parser_pdata *pdata, struct iio_device *dev);
 ssize_t set_trigger(struct parser_pdata *pdata,
 		struct iio_device *dev, const char *trig);
 
+int stream_events(struct parser_pdata *pdata, struct iio_device *dev);
+
+int read_regs(struct parser_pdata *pdata,
+		struct iio_device *dev, unsigned long nb);
+int write_regs(struct parser_pdata *pdata,
+		struct iio_device *dev, unsigned long nb);
+
 int set_timeout(struct parser_pdata *pdata, unsigned int timeout);
 int set_buffers_count(struct parser_pdata *pdata,
 		struct iio_device *dev, long value);
@@ -67,6 +67,8 @@ ssize_t yy_input(yyscan_t scanner, char *buf, size_t max_size);
 %token CLOSE
 %token PRINT
 %token ZPRINT
+%token BINPRINT
+%token BINARY
 %token READ
 %token READBUF
 %token WRITEBUF
@@ -80,6 +82,9 @@ ssize_t yy_input(yyscan_t scanner, char *buf, size_t max_size);
 %token CYCLIC
 %token SET
 %token BUFFERS_COUNT
+%token EVENTS
+%token REGREAD
+%token REGWRITE
 
 %token <word> WORD
 %token <dev> DEVICE
@@ -111,6 +116,10 @@ Line:
 		"\t\tDisplays a XML string corresponding to the current IIO context\n"
 		"\tZPRINT\n"
 		"\t\tGet a compressed XML string corresponding to the current IIO context\n"
+		"\tBINPRINT\n"
+		"\t\tGet a binary representation of the current IIO context\n"
+		"\tBINARY\n"
+		"\t\tSwitch the session to the binary framing of the protocol\n"
 		"\tVERSION\n"
 		"\t\tGet the version of libiio in use\n"
 		"\tTIMEOUT <timeout_ms>\n"
@@ -123,16 +132,26 @@ Line:
 		"\t\tRead the value of an attribute\n"
 		"\tWRITE <device> DEBUG|BUFFER|[INPUT|OUTPUT <channel>] [<attribute>] <bytes_count>\n"
 		"\t\tSet the value of an attribute\n"
-		"\tREADBUF <device> <bytes_count>\n"
-		"\t\tRead raw data from the specified device\n"
-		"\tWRITEBUF <device> <bytes_count>\n"
-		"\t\tWrite raw data to the specified device\n"
+		"\tREADBUF <device> <bytes_count> [<credits> [<codec> <level>]]\n"
+		"\t\tRead raw data from the specified device; with credits, stream blocks\n"
+		"\t\tof <bytes_count> bytes, as many as granted by the client, optionally\n"
+		"\t\tencoded with the given codec (zstd, packed) and level\n"
+		"\tWRITEBUF <device> <bytes_count> [PIPELINED]\n"
+		"\t\tWrite raw data to the specified device; with PIPELINED, the data\n"
+		"\t\tfollows without waiting for the status, and is read even if the\n"
+		"\t\tcommand fails\n"
 		"\tGETTRIG <device>\n"
 		"\t\tGet the name of the trigger used by the specified device\n"
 		"\tSETTRIG <device> [<trigger>]\n"
 		"\t\tSet the trigger to use for the specified device\n"
 		"\tSET <device> BUFFERS_COUNT <count>\n"
-		"\t\tSet the number of kernel buffers for the specified device\n");
+		"\t\tSet the number of kernel buffers for the specified device\n"
+		"\tEVENTS <device>\n"
+		"\t\tStream the events of the specified device until the connection is closed\n"
+		"\tREGREAD <device> <count>\n"
+		"\t\tRead a batch of registers of the specified device\n"
+		"\tREGWRITE <device> <count>\n"
+		"\t\tWrite a batch of registers of the specified device\n");
 		YYACCEPT;
 	}
 	| VERSION END {
@@ -174,6 +193,33 @@ Line:
 			YYABORT;
 		}
 	}
+	| BINPRINT END {
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		if (pdata->ctx_bin) {
+			if (!pdata->verbose) {
+				char buf[128];
+				snprintf(buf, sizeof(buf), "%lu\n", (unsigned long)pdata->ctx_bin_len);
+				output(pdata, buf);
+			}
+			if (write_all(pdata, pdata->ctx_bin, pdata->ctx_bin_len) <= 0)
+				pdata->stop = true;
+			output(pdata, "\n");
+			YYACCEPT;
+		} else {
+			char buf[128];
+			snprintf(buf, sizeof(buf), "%d\n", -EINVAL);
+			output(pdata, buf);
+			YYABORT;
+		}
+	}
+	| BINARY END {
+		struct parser_pdata *pdata = yyget_extra(scanner);
+
+		/* The next requests are binary frames */
+		output(pdata, "0\n");
+		pdata->binary = true;
+		YYACCEPT;
+	}
 	| TIMEOUT SPACE WORD END {
 		char *word = $3;
 		struct parser_pdata *pdata = yyget_extra(scanner);
@@ -296,6 +342,33 @@ Line:
 		else
 			YYACCEPT;
 	}
+	| READBUF SPACE DEVICE SPACE WORD SPACE WORD END {
+		char *len = $5, *credits = $7;
+		unsigned long nb = atol(len);
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		ssize_t ret = stream_dev(pdata, $3, nb, atol(credits), NULL, 0);
+		free(len);
+		free(credits);
+		if (ret < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
+	| READBUF SPACE DEVICE SPACE WORD SPACE WORD SPACE WORD SPACE WORD END {
+		char *len = $5, *credits = $7, *codec = $9, *level = $11;
+		unsigned long nb = atol(len);
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		ssize_t ret = stream_dev(pdata, $3, nb, atol(credits),
+					 codec, atoi(level));
+		free(len);
+		free(credits);
+		free(codec);
+		free(level);
+		if (ret < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
 	| WRITEBUF SPACE DEVICE SPACE WORD END {
 		char *len = $5;
 		unsigned long nb = atol(len);
@@ -311,6 +384,28 @@ Line:
 		else
 			YYACCEPT;
 	}
+	| WRITEBUF SPACE DEVICE SPACE WORD SPACE WORD END {
+		char *len = $5, *mode = $7;
+		unsigned long nb = atol(len);
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		ssize_t ret;
+
+		if (strcmp(mode, "PIPELINED")) {
+			char buf[128];
+			snprintf(buf, sizeof(buf), "%d\n", -EINVAL);
+			output(pdata, buf);
+			ret = -EINVAL;
+		} else {
+			ret = write_dev_pipelined(pdata, $3, nb);
+		}
+
+		free(len);
+		free(mode);
+		if (ret < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
 	| WRITE SPACE DEVICE SPACE WORD END {
 		char *len = $5;
 		unsigned long nb = atol(len);
@@ -434,6 +529,33 @@ Line:
 		else
 			YYACCEPT;
 	}
+	| EVENTS SPACE DEVICE END {
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		if (stream_events(pdata, $3) < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
+	| REGREAD SPACE DEVICE SPACE WORD END {
+		char *nb = $5;
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		int ret = read_regs(pdata, $3, atol(nb));
+		free(nb);
+		if (ret < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
+	| REGWRITE SPACE DEVICE SPACE WORD END {
+		char *nb = $5;
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		int ret = write_regs(pdata, $3, atol(nb));
+		free(nb);
+		if (ret < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
 	| error END {
 		yyclearin;
 		yyerrok;
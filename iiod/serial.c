@@ -25,6 +25,8 @@ struct serial_pdata {
 	int fd;
 	const void *xml_zstd;
 	size_t xml_zstd_len;
+	const void *ctx_bin;
+	size_t ctx_bin_len;
 };
 
 static char *get_uart_params(const char *str,
@@ -59,7 +61,8 @@ static void serial_main(struct thread_pool *pool, void *d)
 	do {
 		interpreter(pdata->ctx, pdata->fd, pdata->fd, pdata->debug,
 			    false, false, false, pool,
-			    pdata->xml_zstd, pdata->xml_zstd_len);
+			    pdata->xml_zstd, pdata->xml_zstd_len,
+			    pdata->ctx_bin, pdata->ctx_bin_len);
 	} while (!thread_pool_is_stopped(pool));
 
 	close(pdata->fd);
@@ -230,7 +233,8 @@ static int serial_configure(int fd, unsigned int uart_bps,
 
 int start_serial_daemon(struct iio_context *ctx, const char *uart_params,
 			bool debug, struct thread_pool *pool,
-			const void *xml_zstd, size_t xml_zstd_len)
+			const void *xml_zstd, size_t xml_zstd_len,
+			const void *ctx_bin, size_t ctx_bin_len)
 {
 	struct serial_pdata *pdata;
 	char *dev, uart_parity, uart_flow;
@@ -262,6 +266,8 @@ int start_serial_daemon(struct iio_context *ctx, const char *uart_params,
 	pdata->fd = fd;
 	pdata->xml_zstd = xml_zstd;
 	pdata->xml_zstd_len = xml_zstd_len;
+	pdata->ctx_bin = ctx_bin;
+	pdata->ctx_bin_len = ctx_bin_len;
 
 	IIO_DEBUG("Serving over UART on %s at %u bps, %u bits\n",
 		  dev, uart_bps, uart_bits);
@@ -47,6 +47,8 @@ struct usbd_pdata {
 
 	const void *xml_zstd;
 	size_t xml_zstd_len;
+	const void *ctx_bin;
+	size_t ctx_bin_len;
 };
 
 struct usbd_client_pdata {
@@ -73,7 +75,8 @@ static void usbd_client_thread(struct thread_pool *pool, void *d)
 	interpreter(pdata->pdata->ctx, pdata->ep_in, pdata->ep_out,
 			pdata->pdata->debug, false, true,
 			pdata->pdata->use_aio, pool,
-			pdata->pdata->xml_zstd, pdata->pdata->xml_zstd_len);
+			pdata->pdata->xml_zstd, pdata->pdata->xml_zstd_len,
+			pdata->pdata->ctx_bin, pdata->pdata->ctx_bin_len);
 
 	close(pdata->ep_in);
 	close(pdata->ep_out);
@@ -351,7 +354,8 @@ int init_usb_daemon(const char *ffs, unsigned int nb_pipes)
 int start_usb_daemon(struct iio_context *ctx, const char *ffs,
 		bool debug, bool use_aio, unsigned int nb_pipes,
 		int ep0_fd, struct thread_pool *pool,
-		const void *xml_zstd, size_t xml_zstd_len)
+		const void *xml_zstd, size_t xml_zstd_len,
+		const void *ctx_bin, size_t ctx_bin_len)
 {
 	struct usbd_pdata *pdata;
 	unsigned int i;
@@ -388,6 +392,8 @@ int start_usb_daemon(struct iio_context *ctx, const char *ffs,
 	pdata->use_aio = use_aio;
 	pdata->xml_zstd = xml_zstd;
 	pdata->xml_zstd_len = xml_zstd_len;
+	pdata->ctx_bin = ctx_bin;
+	pdata->ctx_bin_len = ctx_bin_len;
 	pdata->ep0_fd = ep0_fd;
 
 	ret = thread_pool_add_thread(pool, usbd_main, pdata, "usbd_main_thd");
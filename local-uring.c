@@ -0,0 +1,419 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2023 Analog Devices, Inc.
+ */
+
+/* Required for syscall() and MAP_POPULATE */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "debug.h"
+#include "iio-private.h"
+#include "local.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOCAL_URING_ENTRIES 8
+
+enum local_uring_req {
+	LOCAL_URING_REQ_CANCEL = 1,
+	LOCAL_URING_REQ_POLL,
+	LOCAL_URING_REQ_RW,
+	LOCAL_URING_REQ_ABORT,
+};
+
+struct local_uring {
+	int ring_fd, fd, cancel_fd;
+
+	/* A poll request on the cancel file descriptor stays armed until the
+	 * file descriptor is signaled, which replaces the poll() on it */
+	bool cancel_armed, cancelled;
+
+	void *rings;
+	size_t rings_len;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+
+	unsigned int *sq_head, *sq_tail, *sq_array;
+	unsigned int sq_mask, sq_entries, to_submit;
+
+	unsigned int *cq_head, *cq_tail, cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/* Memory registered with the ring, which is then accessed without
+	 * mapping the user pages on each transfer. This is the destination
+	 * (or source) of the first transfer, i.e. the memory of the iio_buffer,
+	 * which is used for the whole lifetime of the ring. */
+	void *fixed_buf;
+	size_t fixed_len;
+	bool fixed_failed;
+
+	/* Results of the current transfer */
+	bool rw_done;
+	int poll_res, rw_res;
+};
+
+static int uring_enter(struct local_uring *ring, unsigned int min_complete,
+		       int timeout_ms)
+{
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg = { 0 };
+	unsigned int flags = IORING_ENTER_GETEVENTS;
+	long ret;
+
+	if (timeout_ms >= 0) {
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+		arg.ts = (uint64_t)(uintptr_t) &ts;
+		flags |= IORING_ENTER_EXT_ARG;
+	}
+
+	ret = syscall(__NR_io_uring_enter, ring->ring_fd, ring->to_submit,
+		      min_complete, flags,
+		      timeout_ms >= 0 ? &arg : NULL,
+		      timeout_ms >= 0 ? sizeof(arg) : 0);
+	if (ret < 0)
+		return -errno;
+
+	if ((unsigned int) ret >= ring->to_submit)
+		ring->to_submit = 0;
+	else
+		ring->to_submit -= (unsigned int) ret;
+
+	return 0;
+}
+
+static struct io_uring_sqe * uring_get_sqe(struct local_uring *ring,
+		uint8_t opcode, int fd, enum local_uring_req req)
+{
+	unsigned int tail = *ring->sq_tail, idx = tail & ring->sq_mask;
+	struct io_uring_sqe *sqe;
+
+	if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)
+	    >= ring->sq_entries)
+		return NULL;
+
+	sqe = &ring->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->user_data = req;
+
+	ring->sq_array[idx] = idx;
+
+	return sqe;
+}
+
+static void uring_commit_sqe(struct local_uring *ring)
+{
+	__atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+	ring->to_submit++;
+}
+
+static int uring_queue_poll(struct local_uring *ring, int fd,
+		uint32_t events, enum local_uring_req req, uint8_t flags)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = uring_get_sqe(ring, IORING_OP_POLL_ADD, fd, req);
+	if (!sqe)
+		return -EBUSY;
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+	events = (events << 16) | (events >> 16);
+#endif
+	sqe->poll32_events = events;
+	sqe->flags = flags;
+
+	uring_commit_sqe(ring);
+	return 0;
+}
+
+static void uring_reap(struct local_uring *ring)
+{
+	unsigned int head = *ring->cq_head;
+	struct io_uring_cqe *cqe;
+
+	while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		cqe = &ring->cqes[head & ring->cq_mask];
+
+		switch (cqe->user_data) {
+		case LOCAL_URING_REQ_CANCEL:
+			ring->cancel_armed = false;
+			ring->cancelled = cqe->res >= 0;
+			break;
+		case LOCAL_URING_REQ_POLL:
+			ring->poll_res = cqe->res;
+			break;
+		case LOCAL_URING_REQ_RW:
+			ring->rw_res = cqe->res;
+			ring->rw_done = true;
+			break;
+		default:
+			break;
+		}
+
+		head++;
+	}
+
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Cancels the pending poll, then waits for the completion of the linked
+ * read or write request. */
+static int uring_abort(struct local_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	int ret;
+
+	sqe = uring_get_sqe(ring, IORING_OP_ASYNC_CANCEL, -1,
+			    LOCAL_URING_REQ_ABORT);
+	if (sqe) {
+		sqe->addr = LOCAL_URING_REQ_POLL;
+		uring_commit_sqe(ring);
+	}
+
+	while (!ring->rw_done) {
+		ret = uring_enter(ring, 1, -1);
+		if (ret < 0 && ret != -EINTR)
+			return ret;
+
+		uring_reap(ring);
+	}
+
+	return 0;
+}
+
+static void uring_register_buffer(struct local_uring *ring,
+				  void *buf, size_t len)
+{
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = len,
+	};
+	long ret;
+
+	/* Pinning the pages counts against RLIMIT_MEMLOCK; the transfers
+	 * simply use the regular opcodes if that fails. */
+	ret = syscall(__NR_io_uring_register, ring->ring_fd,
+		      IORING_REGISTER_BUFFERS, &iov, 1);
+	if (ret < 0) {
+		IIO_DEBUG("Unable to register buffer with io_uring: %d\n",
+			  -errno);
+		ring->fixed_failed = true;
+		return;
+	}
+
+	ring->fixed_buf = buf;
+	ring->fixed_len = len;
+}
+
+static bool uring_is_fixed(const struct local_uring *ring,
+			   const void *buf, size_t len)
+{
+	uintptr_t start = (uintptr_t) ring->fixed_buf;
+
+	return ring->fixed_buf && (uintptr_t) buf >= start &&
+		(uintptr_t) buf + len <= start + ring->fixed_len;
+}
+
+static int get_elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (int) ((now.tv_sec - start->tv_sec) * 1000 +
+		      (now.tv_nsec - start->tv_nsec) / 1000000);
+}
+
+ssize_t local_uring_transfer(struct local_uring *ring, void *buf, size_t len,
+			     bool is_write, int timeout_ms)
+{
+	struct io_uring_sqe *sqe;
+	struct timespec start;
+	int ret, remaining = -1;
+	uint8_t opcode;
+	bool fixed;
+
+	if (ring->cancelled)
+		return -EBADF;
+
+	if (len > UINT32_MAX)
+		len = UINT32_MAX;
+
+	if (!ring->fixed_buf && !ring->fixed_failed)
+		uring_register_buffer(ring, buf, len);
+
+	fixed = uring_is_fixed(ring, buf, len);
+	if (is_write)
+		opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	else
+		opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+
+	if (!ring->cancel_armed) {
+		ret = uring_queue_poll(ring, ring->cancel_fd, POLLIN,
+				       LOCAL_URING_REQ_CANCEL, 0);
+		if (ret < 0)
+			return ret;
+
+		ring->cancel_armed = true;
+	}
+
+	/* The file descriptor is non-blocking; only issue the read or write
+	 * once it is ready, in the same submission. */
+	ret = uring_queue_poll(ring, ring->fd, is_write ? POLLOUT : POLLIN,
+			       LOCAL_URING_REQ_POLL, IOSQE_IO_LINK);
+	if (ret < 0)
+		return ret;
+
+	sqe = uring_get_sqe(ring, opcode, ring->fd, LOCAL_URING_REQ_RW);
+	if (!sqe)
+		return -EBUSY;
+
+	sqe->addr = (uint64_t)(uintptr_t) buf;
+	sqe->len = (uint32_t) len;
+	sqe->off = (uint64_t) -1;
+	sqe->buf_index = 0;
+	uring_commit_sqe(ring);
+
+	ring->rw_done = false;
+	ring->poll_res = 0;
+
+	if (timeout_ms >= 0)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (!ring->rw_done && !ring->cancelled) {
+		if (timeout_ms >= 0) {
+			remaining = timeout_ms - get_elapsed_ms(&start);
+			if (remaining < 0)
+				remaining = 0;
+		}
+
+		ret = uring_enter(ring, 1, remaining);
+		if (ret == -EINTR)
+			continue;
+
+		uring_reap(ring);
+
+		if (ret == -ETIME && !ring->rw_done) {
+			ret = uring_abort(ring);
+			if (ret < 0)
+				return ret;
+
+			return ring->rw_res > 0 ? ring->rw_res : -ETIMEDOUT;
+		}
+
+		if (ret < 0 && !ring->rw_done) {
+			uring_abort(ring);
+			return ret;
+		}
+	}
+
+	if (ring->cancelled) {
+		ret = uring_abort(ring);
+		return ret < 0 ? ret : -EBADF;
+	}
+
+	/* The read or write was not issued, as the poll failed */
+	if (ring->rw_res == -ECANCELED && ring->poll_res < 0)
+		return ring->poll_res;
+
+	return ring->rw_res;
+}
+
+struct local_uring * local_uring_create(int fd, int cancel_fd)
+{
+	struct io_uring_params params = { 0 };
+	struct local_uring *ring;
+	size_t sq_len, cq_len;
+	uint8_t *ptr;
+	int ret;
+
+	ring = zalloc(sizeof(*ring));
+	if (!ring)
+		return ERR_PTR(-ENOMEM);
+
+	ring->fd = fd;
+	ring->cancel_fd = cancel_fd;
+
+	ret = (int) syscall(__NR_io_uring_setup, LOCAL_URING_ENTRIES, &params);
+	if (ret < 0) {
+		ret = -errno;
+		goto err_free_ring;
+	}
+
+	ring->ring_fd = ret;
+
+	/* Timeouts on io_uring_enter() require Linux 5.11 */
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+	    !(params.features & IORING_FEAT_EXT_ARG)) {
+		ret = -ENOSYS;
+		goto err_close_ring_fd;
+	}
+
+	sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	cq_len = params.cq_off.cqes +
+		params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->rings_len = sq_len > cq_len ? sq_len : cq_len;
+
+	ring->rings = mmap(NULL, ring->rings_len, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, ring->ring_fd,
+			   IORING_OFF_SQ_RING);
+	if (ring->rings == MAP_FAILED) {
+		ret = -errno;
+		goto err_close_ring_fd;
+	}
+
+	ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->ring_fd,
+			  IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ret = -errno;
+		goto err_munmap_rings;
+	}
+
+	ptr = ring->rings;
+	ring->sq_head = (unsigned int *) (ptr + params.sq_off.head);
+	ring->sq_tail = (unsigned int *) (ptr + params.sq_off.tail);
+	ring->sq_array = (unsigned int *) (ptr + params.sq_off.array);
+	ring->sq_mask = *(unsigned int *) (ptr + params.sq_off.ring_mask);
+	ring->sq_entries = *(unsigned int *) (ptr + params.sq_off.ring_entries);
+	ring->cq_head = (unsigned int *) (ptr + params.cq_off.head);
+	ring->cq_tail = (unsigned int *) (ptr + params.cq_off.tail);
+	ring->cq_mask = *(unsigned int *) (ptr + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *) (ptr + params.cq_off.cqes);
+
+	return ring;
+
+err_munmap_rings:
+	munmap(ring->rings, ring->rings_len);
+err_close_ring_fd:
+	close(ring->ring_fd);
+err_free_ring:
+	free(ring);
+	return ERR_PTR(ret);
+}
+
+void local_uring_destroy(struct local_uring *ring)
+{
+	/* Closing the ring cancels the requests still in flight */
+	munmap(ring->sqes, ring->sqes_len);
+	munmap(ring->rings, ring->rings_len);
+	close(ring->ring_fd);
+	free(ring);
+}
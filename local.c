@@ -7,13 +7,16 @@
  */
 
 #include "debug.h"
+#include "iio-lock.h"
 #include "iio-private.h"
+#include "local.h"
 #include "sort.h"
 #include "deps/libini/ini.h"
 
 
 #include <dirent.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <poll.h>
 #include <stdbool.h>
@@ -44,6 +47,9 @@
 
 #define BLOCK_FLAG_CYCLIC BIT(1)
 
+#define IIO_GET_EVENT_FD_IOCTL _IOR('i', 0x90, int)
+#define IIO_BUFFER_GET_FD_IOCTL _IOWR('i', 0x91, int)
+
 /* Forward declarations */
 static ssize_t local_read_dev_attr(const struct iio_device *dev,
 		const char *attr, char *dst, size_t len, enum iio_attr_type type);
@@ -73,6 +79,9 @@ struct block {
 
 struct iio_context_pdata {
 	unsigned int rw_timeout_ms;
+
+	/* Prefix of the sysfs, debugfs and /dev paths; empty by default */
+	char *root;
 };
 
 struct iio_device_pdata {
@@ -88,10 +97,44 @@ struct iio_device_pdata {
 	bool is_high_speed, cyclic, cyclic_buffer_enqueued;
 
 	int cancel_fd;
+
+	/* Low-speed transfers through io_uring, if available */
+	struct local_uring *ring;
+
+	enum iio_buffer_wait_policy wait_policy;
+	unsigned int spin_us;
+	struct iio_buffer_wait_stats wait_stats;
+
+	/* Last values written to buffer/length and buffer/watermark;
+	 * zero when unknown */
+	unsigned long buffer_length, buffer_watermark;
+	bool high_speed_probed;
+
+	/* For the additional buffers (bufferN, N > 0) of an IIO device,
+	 * which are exposed as separate devices */
+	const struct iio_device *parent;
+	unsigned int buffer_idx;
+
+	/* debugfs direct_reg_access file, kept open once used */
+	struct iio_mutex *reg_lock;
+	int reg_fd;
+};
+
+enum channel_state {
+	CHANNEL_STATE_UNKNOWN = 0,
+	CHANNEL_STATE_DISABLED,
+	CHANNEL_STATE_ENABLED,
+};
+
+struct iio_event_stream_pdata {
+	const struct iio_device *dev;
+	int fd;
+	int cancel_fd;
 };
 
 struct iio_channel_pdata {
 	char *enable_fn;
+	enum channel_state state;
 	struct iio_channel_attr *protected_attrs;
 	unsigned int nb_protected_attrs;
 };
@@ -137,6 +180,10 @@ static void local_free_pdata(struct iio_device *device)
 		local_free_channel_pdata(device->channels[i]);
 
 	if (device->pdata) {
+		if (device->pdata->reg_fd != -1)
+			close(device->pdata->reg_fd);
+		if (device->pdata->reg_lock)
+			iio_mutex_destroy(device->pdata->reg_lock);
 		free(device->pdata->blocks);
 		free(device->pdata->addrs);
 		free(device->pdata);
@@ -154,6 +201,15 @@ static void local_shutdown(struct iio_context *ctx)
 		iio_device_close(dev);
 		local_free_pdata(dev);
 	}
+
+	free(iio_context_get_pdata(ctx)->root);
+}
+
+static const char * local_root(const struct iio_context *ctx)
+{
+	const char *root = iio_context_get_pdata(ctx)->root;
+
+	return root ? root : "";
 }
 
 /** Shrinks the first nb characters of a string
@@ -208,18 +264,23 @@ static int set_channel_name(struct iio_channel *chn)
 	}
 
 	if (prefix_len) {
-		char *name;
+		struct iio_arena *arena = chn->dev->ctx->arena;
 
-		name = malloc(prefix_len);
-		if (!name)
+		chn->name = iio_arena_intern_len(arena, attr0, prefix_len - 1);
+		if (!chn->name)
 			return -ENOMEM;
-		iio_strlcpy(name, attr0, prefix_len);
-		IIO_DEBUG("Setting name of channel %s to %s\n", chn->id, name);
-		chn->name = name;
 
-		/* Shrink the attribute name */
-		for (i = 0; i < chn->nb_attrs; i++)
-			strcut(chn->attrs[i].name, prefix_len);
+		IIO_DEBUG("Setting name of channel %s to %s\n",
+			  chn->id, chn->name);
+
+		/* Shrink the attribute name; the interned strings are shared,
+		 * so they are replaced instead of being modified */
+		for (i = 0; i < chn->nb_attrs; i++) {
+			chn->attrs[i].name = iio_arena_intern(arena,
+					chn->attrs[i].name + prefix_len);
+			if (!chn->attrs[i].name)
+				return -ENOMEM;
+		}
 		for (i = 0; i < pdata->nb_protected_attrs; i++)
 			strcut(pdata->protected_attrs[i].name, prefix_len);
 	}
@@ -266,6 +327,61 @@ static int get_rel_timeout_ms(struct timespec *start, unsigned int timeout_rel)
 	return (int) timeout_rel;
 }
 
+static uint64_t get_elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) (now.tv_sec - start->tv_sec) * 1000000000ull
+		+ now.tv_nsec - start->tv_nsec;
+}
+
+static void wait_stats_add(struct iio_device_pdata *pdata,
+		const struct timespec *wait_start, bool spin_hit)
+{
+	struct iio_buffer_wait_stats *stats = &pdata->wait_stats;
+	uint64_t ns = get_elapsed_ns(wait_start);
+
+	if (!stats->nb_waits || ns < stats->min_ns)
+		stats->min_ns = ns;
+	if (ns > stats->max_ns)
+		stats->max_ns = ns;
+
+	stats->total_ns += ns;
+	stats->nb_waits++;
+	stats->nb_spin_hits += spin_hit;
+}
+
+/*
+ * Busy-polls the file descriptors until one of them is ready. Spins until
+ * the rw timeout expires with the spin policy, or for pdata->spin_us with
+ * the hybrid policy. Returns the number of ready file descriptors, zero if
+ * the spin time expired, or a negative error code.
+ */
+static int device_spin(const struct iio_device *dev, struct pollfd *pollfd,
+	struct timespec *start, const struct timespec *wait_start)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	bool hybrid = pdata->wait_policy == IIO_BUFFER_WAIT_HYBRID;
+	uint64_t spin_ns = (uint64_t) pdata->spin_us * 1000;
+	int ret;
+
+	do {
+		ret = poll(pollfd, 2, 0);
+		if (ret == -1 && errno != EINTR)
+			return -errno;
+		if (ret > 0)
+			return ret;
+
+		if (hybrid && get_elapsed_ns(wait_start) >= spin_ns)
+			return 0;
+	} while (hybrid || get_rel_timeout_ms(start, ctx_pdata->rw_timeout_ms));
+
+	return 0;
+}
+
 static int device_check_ready(const struct iio_device *dev, short events,
 	struct timespec *start)
 {
@@ -280,16 +396,33 @@ static int device_check_ready(const struct iio_device *dev, short events,
 	};
 	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
 	unsigned int rw_timeout_ms = pdata->rw_timeout_ms;
+	enum iio_buffer_wait_policy policy = dev->pdata->wait_policy;
+	struct timespec wait_start;
+	bool spin_hit = false;
 	int timeout_rel;
 	int ret;
 
 	if (!dev->pdata->blocking)
 		return 0;
 
-	do {
-		timeout_rel = get_rel_timeout_ms(start, rw_timeout_ms);
-		ret = poll(pollfd, 2, timeout_rel);
-	} while (ret == -1 && errno == EINTR);
+	clock_gettime(CLOCK_MONOTONIC, &wait_start);
+
+	if (policy != IIO_BUFFER_WAIT_SLEEP) {
+		ret = device_spin(dev, pollfd, start, &wait_start);
+		if (ret < 0)
+			return ret;
+
+		spin_hit = ret > 0;
+		if (!spin_hit && policy == IIO_BUFFER_WAIT_SPIN)
+			return -ETIMEDOUT;
+	}
+
+	if (!spin_hit) {
+		do {
+			timeout_rel = get_rel_timeout_ms(start, rw_timeout_ms);
+			ret = poll(pollfd, 2, timeout_rel);
+		} while (ret == -1 && errno == EINTR);
+	}
 
 	if ((pollfd[1].revents & POLLIN))
 		return -EBADF;
@@ -302,9 +435,50 @@ static int device_check_ready(const struct iio_device *dev, short events,
 		return -EBADF;
 	if (!(pollfd[0].revents & events))
 		return -EIO;
+
+	wait_stats_add(dev->pdata, &wait_start, spin_hit);
 	return 0;
 }
 
+/* Performs a single read() or write() on the device, once it is ready */
+static ssize_t device_transfer(const struct iio_device *dev,
+		void *ptr, size_t len, bool is_write, struct timespec *start)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	ssize_t ret;
+
+	if (WITH_LOCAL_IO_URING && pdata->ring && pdata->blocking &&
+	    pdata->wait_policy == IIO_BUFFER_WAIT_SLEEP) {
+		struct iio_context_pdata *ctx_pdata =
+			iio_context_get_pdata(dev->ctx);
+		struct timespec wait_start;
+
+		/* The wait cannot be told apart from the transfer here */
+		clock_gettime(CLOCK_MONOTONIC, &wait_start);
+
+		ret = local_uring_transfer(pdata->ring, ptr, len, is_write,
+				get_rel_timeout_ms(start,
+						   ctx_pdata->rw_timeout_ms));
+		if (ret > 0)
+			wait_stats_add(pdata, &wait_start, false);
+
+		return ret;
+	}
+
+	ret = device_check_ready(dev, is_write ? POLLOUT : POLLIN, start);
+	if (ret < 0)
+		return ret;
+
+	do {
+		if (is_write)
+			ret = write(pdata->fd, ptr, len);
+		else
+			ret = read(pdata->fd, ptr, len);
+	} while (ret == -1 && errno == EINTR);
+
+	return ret == -1 ? -errno : ret;
+}
+
 static ssize_t local_read(const struct iio_device *dev,
 		void *dst, size_t len, uint32_t *mask, size_t words)
 {
@@ -327,18 +501,10 @@ static ssize_t local_read(const struct iio_device *dev,
 	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	while (len > 0) {
-		ret = device_check_ready(dev, POLLIN, &start);
-		if (ret < 0)
-			break;
-
-		do {
-			ret = read(pdata->fd, (void *) ptr, len);
-		} while (ret == -1 && errno == EINTR);
-
-		if (ret == -1) {
-			if (pdata->blocking && errno == EAGAIN)
+		ret = device_transfer(dev, (void *) ptr, len, false, &start);
+		if (ret < 0) {
+			if (pdata->blocking && ret == -EAGAIN)
 				continue;
-			ret = -errno;
 			break;
 		} else if (ret == 0) {
 			ret = -EIO;
@@ -374,19 +540,10 @@ static ssize_t local_write(const struct iio_device *dev,
 	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	while (len > 0) {
-		ret = device_check_ready(dev, POLLOUT, &start);
-		if (ret < 0)
-			break;
-
-		do {
-			ret = write(pdata->fd, (void *) ptr, len);
-		} while (ret == -1 && errno == EINTR);
-
-		if (ret == -1) {
-			if (pdata->blocking && errno == EAGAIN)
+		ret = device_transfer(dev, (void *) ptr, len, true, &start);
+		if (ret < 0) {
+			if (pdata->blocking && ret == -EAGAIN)
 				continue;
-
-			ret = -errno;
 			break;
 		} else if (ret == 0) {
 			ret = -EIO;
@@ -408,8 +565,8 @@ static int local_buffer_enabled_set(const struct iio_device *dev, bool en)
 {
 	int ret;
 
-	ret = (int) local_write_dev_attr(dev, "buffer/enable", en ? "1" : "0",
-					 2, false);
+	ret = (int) local_write_dev_attr(dev, "enable", en ? "1" : "0",
+					 2, IIO_ATTR_TYPE_BUFFER);
 	if (ret < 0)
 		return ret;
 
@@ -665,38 +822,66 @@ static ssize_t local_write_all_chn_attrs(const struct iio_channel *chn,
 	return ptr - src;
 }
 
-static ssize_t local_read_dev_attr(const struct iio_device *dev,
-		const char *attr, char *dst, size_t len, enum iio_attr_type type)
+/* Devices created for the additional buffers of an IIO device share the
+ * sysfs directory and character device of their parent. */
+static const char * device_sysfs_id(const struct iio_device *dev)
 {
-	FILE *f;
-	char buf[1024];
-	ssize_t ret;
+	if (dev->pdata->parent)
+		return dev->pdata->parent->id;
+	else
+		return dev->id;
+}
 
-	if (!attr)
-		return local_read_all_dev_attrs(dev, dst, len, type);
+static int get_attr_path(const struct iio_device *dev, const char *attr,
+		enum iio_attr_type type, char *buf, size_t len)
+{
+	const char *root = local_root(dev->ctx);
+	const char *id = device_sysfs_id(dev);
 
 	switch (type) {
 		case IIO_ATTR_TYPE_DEVICE:
 			if (WITH_HWMON && iio_device_is_hwmon(dev)) {
-				iio_snprintf(buf, sizeof(buf), "/sys/class/hwmon/%s/%s",
-							dev->id, attr);
+				iio_snprintf(buf, len, "%s/sys/class/hwmon/%s/%s",
+					root, id, attr);
 			} else {
-				iio_snprintf(buf, sizeof(buf), "/sys/bus/iio/devices/%s/%s",
-							dev->id, attr);
+				iio_snprintf(buf, len, "%s/sys/bus/iio/devices/%s/%s",
+					root, id, attr);
 			}
 			break;
 		case IIO_ATTR_TYPE_DEBUG:
-			iio_snprintf(buf, sizeof(buf), "/sys/kernel/debug/iio/%s/%s",
-					dev->id, attr);
+			iio_snprintf(buf, len, "%s/sys/kernel/debug/iio/%s/%s",
+					root, id, attr);
 			break;
 		case IIO_ATTR_TYPE_BUFFER:
-			iio_snprintf(buf, sizeof(buf), "/sys/bus/iio/devices/%s/buffer/%s",
-					dev->id, attr);
+			if (dev->pdata->buffer_idx) {
+				iio_snprintf(buf, len, "%s/sys/bus/iio/devices/%s/buffer%u/%s",
+					root, id, dev->pdata->buffer_idx, attr);
+			} else {
+				iio_snprintf(buf, len, "%s/sys/bus/iio/devices/%s/buffer/%s",
+					root, id, attr);
+			}
 			break;
 		default:
 			return -EINVAL;
 	}
 
+	return 0;
+}
+
+static ssize_t local_read_dev_attr(const struct iio_device *dev,
+		const char *attr, char *dst, size_t len, enum iio_attr_type type)
+{
+	FILE *f;
+	char buf[1024];
+	ssize_t ret;
+
+	if (!attr)
+		return local_read_all_dev_attrs(dev, dst, len, type);
+
+	ret = get_attr_path(dev, attr, type, buf, sizeof(buf));
+	if (ret < 0)
+		return ret;
+
 	f = fopen(buf, "re");
 	if (!f)
 		return -errno;
@@ -729,26 +914,16 @@ static ssize_t local_write_dev_attr(const struct iio_device *dev,
 	if (!attr)
 		return local_write_all_dev_attrs(dev, src, len, type);
 
-	switch (type) {
-		case IIO_ATTR_TYPE_DEVICE:
-			if (WITH_HWMON && iio_device_is_hwmon(dev)) {
-				iio_snprintf(buf, sizeof(buf), "/sys/class/hwmon/%s/%s",
-					dev->id, attr);
-			} else {
-				iio_snprintf(buf, sizeof(buf), "/sys/bus/iio/devices/%s/%s",
-					dev->id, attr);
-			}
-			break;
-		case IIO_ATTR_TYPE_DEBUG:
-			iio_snprintf(buf, sizeof(buf), "/sys/kernel/debug/iio/%s/%s",
-					dev->id, attr);
-			break;
-		case IIO_ATTR_TYPE_BUFFER:
-			iio_snprintf(buf, sizeof(buf), "/sys/bus/iio/devices/%s/buffer/%s",
-					dev->id, attr);
-			break;
-		default:
-			return -EINVAL;
+	ret = get_attr_path(dev, attr, type, buf, sizeof(buf));
+	if (ret < 0)
+		return ret;
+
+	if (type == IIO_ATTR_TYPE_BUFFER) {
+		/* Values cached by local_open() are no longer valid */
+		if (!strcmp(attr, "length"))
+			dev->pdata->buffer_length = 0;
+		else if (!strcmp(attr, "watermark"))
+			dev->pdata->buffer_watermark = 0;
 	}
 
 	f = fopen(buf, "we");
@@ -802,11 +977,40 @@ static int channel_write_state(const struct iio_channel *chn, bool en)
 		return -EINVAL;
 	}
 
+	/* Skip the write if the kernel already has the requested state */
+	if (chn->pdata->state == (en ? CHANNEL_STATE_ENABLED
+			      : CHANNEL_STATE_DISABLED))
+		return 0;
+
 	ret = local_write_chn_attr(chn, chn->pdata->enable_fn, en ? "1" : "0", 2);
-	if (ret < 0)
+	if (ret < 0) {
+		chn->pdata->state = CHANNEL_STATE_UNKNOWN;
 		return (int) ret;
-	else
+	}
+
+	chn->pdata->state = en ? CHANNEL_STATE_ENABLED : CHANNEL_STATE_DISABLED;
+	return 0;
+}
+
+static int buffer_write_param(const struct iio_device *dev, const char *attr,
+		unsigned long *cache, unsigned long value)
+{
+	char buf[32];
+	ssize_t ret;
+
+	if (*cache == value)
 		return 0;
+
+	iio_snprintf(buf, sizeof(buf), "%lu", value);
+	ret = local_write_dev_attr(dev, attr, buf, strlen(buf) + 1,
+				   IIO_ATTR_TYPE_BUFFER);
+	if (ret < 0) {
+		*cache = 0;
+		return (int) ret;
+	}
+
+	*cache = value;
+	return 0;
 }
 
 static int enable_high_speed(const struct iio_device *dev)
@@ -901,14 +1105,66 @@ err_freemem:
 	return ret;
 }
 
+static int set_nonblock(int fd)
+{
+	int ret = fcntl(fd, F_GETFL);
+
+	if (ret < 0 || fcntl(fd, F_SETFL, ret | O_NONBLOCK) < 0)
+		return -errno;
+
+	return 0;
+}
+
+static int open_buffer_fd(const struct iio_device *dev)
+{
+	const struct iio_device *parent = dev->pdata->parent;
+	char buf[1024];
+	int ret, fd, buf_fd;
+
+	iio_snprintf(buf, sizeof(buf), "%s/dev/%s",
+			local_root(dev->ctx), device_sysfs_id(dev));
+
+	if (!parent) {
+		fd = open(buf, O_RDWR | O_CLOEXEC | O_NONBLOCK);
+		return fd == -1 ? -errno : fd;
+	}
+
+	/* Additional buffers are accessed through an anonymous file
+	 * descriptor, obtained from the character device. The latter can
+	 * only be opened once; reuse the file descriptor of the parent's
+	 * buffer if there is one. */
+	fd = parent->pdata->fd;
+	if (fd == -1) {
+		fd = open(buf, O_RDWR | O_CLOEXEC);
+		if (fd == -1)
+			return -errno;
+	}
+
+	buf_fd = (int) dev->pdata->buffer_idx;
+	ret = ioctl_nointr(fd, IIO_BUFFER_GET_FD_IOCTL, &buf_fd);
+
+	if (fd != parent->pdata->fd)
+		close(fd);
+	if (ret < 0)
+		return ret;
+
+	ret = set_nonblock(buf_fd);
+	if (ret < 0) {
+		close(buf_fd);
+		return ret;
+	}
+
+	return buf_fd;
+}
+
 static int local_close(const struct iio_device *dev);
 
 static int local_open(const struct iio_device *dev,
 		size_t samples_count, bool cyclic)
 {
 	unsigned int i;
+	unsigned long length;
 	int ret;
-	char buf[1024];
 	struct iio_device_pdata *pdata = dev->pdata;
 
 	if (pdata->fd != -1)
@@ -918,9 +1174,18 @@ static int local_open(const struct iio_device *dev,
 	if (ret < 0)
 		return ret;
 
-	iio_snprintf(buf, sizeof(buf), "%lu", (unsigned long) samples_count);
-	ret = local_write_dev_attr(dev, "buffer/length",
-			buf, strlen(buf) + 1, false);
+	/*
+	 * If a previous open found that the high-speed interface is not
+	 * available, directly write the enlarged length used by the low-speed
+	 * path, so that it does not have to be rewritten below.
+	 */
+	if (pdata->high_speed_probed && !pdata->is_high_speed)
+		length = samples_count * pdata->max_nb_blocks;
+	else
+		length = samples_count;
+
+	ret = buffer_write_param(dev, "length",
+				 &pdata->buffer_length, length);
 	if (ret < 0)
 		return ret;
 
@@ -928,22 +1193,28 @@ static int local_open(const struct iio_device *dev,
 	 * Set watermark to the buffer size; the driver will adjust to its
 	 * maximum if it's too high without issuing an error.
 	 */
-	ret = local_write_dev_attr(dev, "buffer/watermark",
-				   buf, strlen(buf) + 1, false);
-	if (ret < 0 && ret != -ENOENT && ret != -EACCES)
+	ret = buffer_write_param(dev, "watermark",
+				 &pdata->buffer_watermark, samples_count);
+	if (ret == -ENOENT || ret == -EACCES)
+		pdata->buffer_watermark = samples_count;
+	else if (ret < 0)
 		return ret;
 
+	pdata->wait_policy = IIO_BUFFER_WAIT_SLEEP;
+	memset(&pdata->wait_stats, 0, sizeof(pdata->wait_stats));
+
 	pdata->cancel_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
 	if (pdata->cancel_fd == -1)
 		return -errno;
 
-	iio_snprintf(buf, sizeof(buf), "/dev/%s", dev->id);
-	pdata->fd = open(buf, O_RDWR | O_CLOEXEC | O_NONBLOCK);
-	if (pdata->fd == -1) {
+	ret = open_buffer_fd(dev);
+	if (ret < 0) {
 		close(pdata->cancel_fd);
-		return -errno;
+		return ret;
 	}
 
+	pdata->fd = ret;
+
 	/* Disable channels */
 	for (i = 0; i < dev->nb_channels; i++) {
 		struct iio_channel *chn = dev->channels[i];
@@ -975,8 +1246,9 @@ static int local_open(const struct iio_device *dev,
 		pdata->is_high_speed = !ret;
 	}
 
+	pdata->high_speed_probed = true;
+
 	if (!pdata->is_high_speed) {
-		unsigned long size = samples_count * pdata->max_nb_blocks;
 		IIO_WARNING("High-speed mode not enabled\n");
 
 		/* Cyclic mode is only supported in high-speed mode */
@@ -988,11 +1260,21 @@ static int local_open(const struct iio_device *dev,
 		/* Increase the size of the kernel buffer, when using the
 		 * low-speed interface. This avoids losing samples when
 		 * refilling the iio_buffer. */
-		iio_snprintf(buf, sizeof(buf), "%lu", size);
-		ret = local_write_dev_attr(dev, "buffer/length",
-				buf, strlen(buf) + 1, false);
+		ret = buffer_write_param(dev, "length",
+					 &pdata->buffer_length,
+					 samples_count * pdata->max_nb_blocks);
 		if (ret < 0)
 			goto err_close;
+
+		if (WITH_LOCAL_IO_URING) {
+			pdata->ring = local_uring_create(pdata->fd,
+							 pdata->cancel_fd);
+			if (IS_ERR(pdata->ring)) {
+				IIO_DEBUG("io_uring not available: %d\n",
+					  PTR_ERR(pdata->ring));
+				pdata->ring = NULL;
+			}
+		}
 	}
 
 	ret = local_buffer_enabled_set(dev, true);
@@ -1035,6 +1317,11 @@ static int local_close(const struct iio_device *dev)
 		pdata->blocks = NULL;
 	}
 
+	if (WITH_LOCAL_IO_URING && pdata->ring) {
+		local_uring_destroy(pdata->ring);
+		pdata->ring = NULL;
+	}
+
 	ret1 = close(pdata->fd);
 	if (ret1) {
 		ret1 = -errno;
@@ -1068,23 +1355,9 @@ static int local_close(const struct iio_device *dev)
 			ret = ret1;
 	}
 
-	for (i = 0; i < dev->nb_channels; i++) {
-		struct iio_channel *chn = dev->channels[i];
-
-		if (!chn->pdata->enable_fn)
-			continue;
-
-		ret1 = channel_write_state(chn, false);
-		if (ret1 == 0)
-			continue;
-
-		ret1 = -errno;
-		iio_strerror(errno, err_str, sizeof(err_str));
-		IIO_ERROR("Error during channel[%u] disable: %s\n",
-			  i, err_str);
-		if (ret == 0)
-			ret = ret1;
-	}
+	/* The channels are left enabled: they have no effect while the buffer
+	 * is disabled, and local_open() only writes the ones whose state
+	 * changes, so reopening with the same mask writes none of them. */
 
 	return ret;
 }
@@ -1110,53 +1383,239 @@ static int local_set_blocking_mode(const struct iio_device *dev, bool blocking)
 	return 0;
 }
 
-static int local_get_trigger(const struct iio_device *dev,
-		const struct iio_device **trigger)
+static int local_set_wait_policy(const struct iio_device *dev,
+		enum iio_buffer_wait_policy policy, unsigned int spin_us)
 {
-	char buf[1024];
-	unsigned int i;
-	ssize_t nb = local_read_dev_attr(dev, "trigger/current_trigger",
-			buf, sizeof(buf), false);
-	if (nb < 0) {
-		*trigger = NULL;
-		return (int) nb;
-	}
+	struct iio_device_pdata *pdata = dev->pdata;
 
-	if (buf[0] == '\0') {
-		*trigger = NULL;
-		return 0;
-	}
+	if (pdata->fd == -1)
+		return -EBADF;
 
-	nb = iio_context_get_devices_count(dev->ctx);
-	for (i = 0; i < (size_t) nb; i++) {
-		const struct iio_device *cur = iio_context_get_device(dev->ctx, i);
-		if (cur->name && !strcmp(cur->name, buf)) {
-			*trigger = cur;
-			return 0;
-		}
-	}
-	return -ENXIO;
+	pdata->wait_policy = policy;
+	pdata->spin_us = spin_us;
+	memset(&pdata->wait_stats, 0, sizeof(pdata->wait_stats));
+
+	return 0;
 }
 
-static int local_set_trigger(const struct iio_device *dev,
-		const struct iio_device *trigger)
+static int local_get_wait_stats(const struct iio_device *dev,
+		struct iio_buffer_wait_stats *stats)
 {
-	ssize_t nb;
-	const char *value = trigger ? trigger->name : "";
-	nb = local_write_dev_attr(dev, "trigger/current_trigger",
-			value, strlen(value) + 1, false);
-	if (nb < 0)
-		return (int) nb;
-	else
-		return 0;
+	if (dev->pdata->fd == -1)
+		return -EBADF;
+
+	*stats = dev->pdata->wait_stats;
+
+	return 0;
 }
 
-static bool is_channel(const struct iio_device *dev, const char *attr, bool strict)
+static int local_set_realtime_mode(const struct iio_device *dev,
+		size_t len, bool enable)
 {
-	char *ptr = NULL;
+	struct iio_device_pdata *pdata = dev->pdata;
+	unsigned int i;
+	int ret;
 
-	if (WITH_HWMON && iio_device_is_hwmon(dev))
-		return iio_channel_is_hwmon(attr);
+	if (pdata->fd == -1)
+		return -EBADF;
+
+	/* The low-speed interface does not allocate; the buffer memory is
+	 * locked by the core */
+	if (!pdata->is_high_speed)
+		return 0;
+
+	/* Locking the blocks also faults them in */
+	for (i = 0; i < pdata->allocated_nb_blocks; i++) {
+		if (enable)
+			ret = mlock(pdata->addrs[i], pdata->blocks[i].size);
+		else
+			ret = munlock(pdata->addrs[i], pdata->blocks[i].size);
+
+		if (ret && enable) {
+			ret = -errno;
+
+			for (; i > 0; i--)
+				munlock(pdata->addrs[i - 1],
+					pdata->blocks[i - 1].size);
+
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/* Returns the file descriptor of the direct_reg_access debugfs file, opened
+ * on first use. Called with the register lock held. */
+static int local_get_reg_fd(const struct iio_device *dev)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	char buf[1024];
+	int ret;
+
+	if (pdata->reg_fd != -1)
+		return pdata->reg_fd;
+
+	ret = get_attr_path(dev, "direct_reg_access",
+			    IIO_ATTR_TYPE_DEBUG, buf, sizeof(buf));
+	if (ret < 0)
+		return ret;
+
+	ret = open(buf, O_RDWR | O_CLOEXEC);
+	if (ret < 0)
+		return -errno;
+
+	pdata->reg_fd = ret;
+	return ret;
+}
+
+static int local_reg_pwrite(int fd, const char *buf, size_t len)
+{
+	ssize_t ret = pwrite(fd, buf, len, 0);
+
+	if (ret < 0)
+		return -errno;
+
+	return 0;
+}
+
+static int local_read_regs(const struct iio_device *dev,
+		const uint32_t *addrs, uint32_t *values, size_t nb)
+{
+	unsigned long long val;
+	char buf[32], *end;
+	size_t i;
+	ssize_t len;
+	int fd, ret = 0;
+
+	/* The registers belong to the IIO device, not to its buffers */
+	if (dev->pdata->parent)
+		dev = dev->pdata->parent;
+
+	if (!dev->pdata->reg_lock)
+		return -ENOSYS;
+
+	iio_mutex_lock(dev->pdata->reg_lock);
+
+	fd = local_get_reg_fd(dev);
+	if (fd < 0) {
+		ret = fd;
+		goto out_unlock;
+	}
+
+	for (i = 0; i < nb; i++) {
+		len = iio_snprintf(buf, sizeof(buf), "0x%" PRIx32, addrs[i]);
+
+		ret = local_reg_pwrite(fd, buf, (size_t) len);
+		if (ret < 0)
+			break;
+
+		len = pread(fd, buf, sizeof(buf) - 1, 0);
+		if (len < 0) {
+			ret = -errno;
+			break;
+		}
+
+		buf[len] = '\0';
+
+		errno = 0;
+		val = strtoull(buf, &end, 0);
+		if (end == buf || errno == ERANGE) {
+			ret = -EINVAL;
+			break;
+		}
+
+		values[i] = (uint32_t) val;
+	}
+
+out_unlock:
+	iio_mutex_unlock(dev->pdata->reg_lock);
+	return ret;
+}
+
+static int local_write_regs(const struct iio_device *dev,
+		const uint32_t *addrs, const uint32_t *values, size_t nb)
+{
+	char buf[32];
+	size_t i;
+	ssize_t len;
+	int fd, ret = 0;
+
+	if (dev->pdata->parent)
+		dev = dev->pdata->parent;
+
+	if (!dev->pdata->reg_lock)
+		return -ENOSYS;
+
+	iio_mutex_lock(dev->pdata->reg_lock);
+
+	fd = local_get_reg_fd(dev);
+	if (fd < 0) {
+		ret = fd;
+		goto out_unlock;
+	}
+
+	for (i = 0; i < nb; i++) {
+		len = iio_snprintf(buf, sizeof(buf), "0x%" PRIx32 " 0x%" PRIx32,
+				   addrs[i], values[i]);
+
+		ret = local_reg_pwrite(fd, buf, (size_t) len);
+		if (ret < 0)
+			break;
+	}
+
+out_unlock:
+	iio_mutex_unlock(dev->pdata->reg_lock);
+	return ret;
+}
+
+static int local_get_trigger(const struct iio_device *dev,
+		const struct iio_device **trigger)
+{
+	char buf[1024];
+	unsigned int i;
+	ssize_t nb = local_read_dev_attr(dev, "trigger/current_trigger",
+			buf, sizeof(buf), false);
+	if (nb < 0) {
+		*trigger = NULL;
+		return (int) nb;
+	}
+
+	if (buf[0] == '\0') {
+		*trigger = NULL;
+		return 0;
+	}
+
+	nb = iio_context_get_devices_count(dev->ctx);
+	for (i = 0; i < (size_t) nb; i++) {
+		const struct iio_device *cur = iio_context_get_device(dev->ctx, i);
+		if (cur->name && !strcmp(cur->name, buf)) {
+			*trigger = cur;
+			return 0;
+		}
+	}
+	return -ENXIO;
+}
+
+static int local_set_trigger(const struct iio_device *dev,
+		const struct iio_device *trigger)
+{
+	ssize_t nb;
+	const char *value = trigger ? trigger->name : "";
+	nb = local_write_dev_attr(dev, "trigger/current_trigger",
+			value, strlen(value) + 1, false);
+	if (nb < 0)
+		return (int) nb;
+	else
+		return 0;
+}
+
+static bool is_channel(const struct iio_device *dev, const char *attr, bool strict)
+{
+	char *ptr = NULL;
+
+	if (WITH_HWMON && iio_device_is_hwmon(dev))
+		return iio_channel_is_hwmon(attr);
 	if (!strncmp(attr, "in_timestamp_", sizeof("in_timestamp_") - 1))
 		return true;
 	if (!strncmp(attr, "in_", 3))
@@ -1177,7 +1636,8 @@ static bool is_channel(const struct iio_device *dev, const char *attr, bool stri
 
 static char * get_channel_id(struct iio_device *dev, const char *attr)
 {
-	char *res, *ptr = strchr(attr, '_');
+	struct iio_arena *arena = dev->ctx->arena;
+	char *ptr = strchr(attr, '_');
 	size_t len;
 
 	if (!WITH_HWMON || !iio_device_is_hwmon(dev)) {
@@ -1190,21 +1650,16 @@ static char * get_channel_id(struct iio_device *dev, const char *attr)
 		 * Attribute is 'pwmX' without underscore: the attribute name
 		 * is our channel ID.
 		 */
-		return iio_strdup(attr);
+		return iio_arena_intern(arena, attr);
 	}
 
-	res = malloc(ptr - attr + 1);
-	if (!res)
-		return NULL;
-
-	memcpy(res, attr, ptr - attr);
-	res[ptr - attr] = 0;
-	return res;
+	return iio_arena_intern_len(arena, attr, ptr - attr);
 }
 
-static char * get_short_attr_name(struct iio_channel *chn, const char *attr)
+static const char * get_short_attr_name(struct iio_channel *chn,
+					const char *attr)
 {
-	char *ptr = strchr(attr, '_');
+	const char *ptr = strchr(attr, '_');
 	size_t len;
 
 	if (WITH_HWMON && iio_device_is_hwmon(chn->dev)) {
@@ -1213,7 +1668,7 @@ static char * get_short_attr_name(struct iio_channel *chn, const char *attr)
 		 * the channel's ID; in that particular case we don't need to
 		 * strip the prefix.
 		 */
-		return iio_strdup(ptr ? ptr + 1 : attr);
+		return ptr ? ptr + 1 : attr;
 	}
 
 	ptr = strchr(ptr + 1, '_') + 1;
@@ -1226,7 +1681,7 @@ static char * get_short_attr_name(struct iio_channel *chn, const char *attr)
 			ptr += len + 1;
 	}
 
-	return iio_strdup(ptr);
+	return ptr;
 }
 
 static int read_device_name(struct iio_device *dev)
@@ -1238,7 +1693,7 @@ static int read_device_name(struct iio_device *dev)
 	else if (ret == 0)
 		return -EIO;
 
-	dev->name = iio_strdup(buf);
+	dev->name = iio_arena_intern(dev->ctx->arena, buf);
 	if (!dev->name)
 		return -ENOMEM;
 	else
@@ -1254,7 +1709,7 @@ static int read_device_label(struct iio_device *dev)
 	else if (ret == 0)
 		return -EIO;
 
-	dev->label = iio_strdup(buf);
+	dev->label = iio_arena_intern(dev->ctx->arena, buf);
 	if (!dev->label)
 		return -ENOMEM;
 	else
@@ -1274,7 +1729,7 @@ static int add_attr_to_device(struct iio_device *dev, const char *attr)
 	if (!strcmp(attr, "label"))
 		return read_device_label(dev);
 
-	return add_iio_dev_attr(&dev->attrs, attr, " ", dev->id);
+	return add_iio_dev_attr(dev, &dev->attrs, attr, " ");
 }
 
 static int handle_protected_scan_element_attr(struct iio_channel *chn,
@@ -1401,28 +1856,37 @@ static void free_protected_attrs(struct iio_channel *chn)
 static int add_attr_to_channel(struct iio_channel *chn,
 		const char *attr, const char *path, bool is_scan_element)
 {
+	struct iio_arena *arena = chn->dev->ctx->arena;
+	const char *short_name = get_short_attr_name(chn, attr);
 	struct iio_channel_attr *attrs;
-	char *fn, *name = get_short_attr_name(chn, attr);
-	if (!name)
-		return -ENOMEM;
-
-	fn = iio_strdup(path);
-	if (!fn)
-		goto err_free_name;
+	char *fn, *name;
+	int ret;
 
+	/* The names of the scan elements are shrunk in place, and freed once
+	 * they have been parsed; they can't be shared */
 	if (is_scan_element) {
-		int ret = add_protected_attr(chn, name, fn);
+		name = iio_strdup(short_name);
+		fn = iio_strdup(path);
+		if (!name || !fn) {
+			ret = -ENOMEM;
+			goto err_free_attr;
+		}
 
+		ret = add_protected_attr(chn, name, fn);
 		if (ret < 0)
-			goto err_free_fn;
+			goto err_free_attr;
 
 		return 0;
 	}
 
-	attrs = realloc(chn->attrs, (1 + chn->nb_attrs) *
-			sizeof(struct iio_channel_attr));
+	name = iio_arena_intern(arena, short_name);
+	fn = iio_arena_intern(arena, path);
+	if (!name || !fn)
+		return -ENOMEM;
+
+	attrs = iio_arena_grow(arena, chn->attrs, chn->nb_attrs, sizeof(*attrs));
 	if (!attrs)
-		goto err_free_fn;
+		return -ENOMEM;
 
 	attrs[chn->nb_attrs].filename = fn;
 	attrs[chn->nb_attrs++].name = name;
@@ -1430,18 +1894,19 @@ static int add_attr_to_channel(struct iio_channel *chn,
 	IIO_DEBUG("Added attr \'%s\' to channel \'%s\'\n", name, chn->id);
 	return 0;
 
-err_free_fn:
+err_free_attr:
 	free(fn);
-err_free_name:
 	free(name);
-	return -ENOMEM;
+	return ret;
 }
 
 static int add_channel_to_device(struct iio_device *dev,
 		struct iio_channel *chn)
 {
-	struct iio_channel **channels = realloc(dev->channels,
-			(dev->nb_channels + 1) * sizeof(struct iio_channel *));
+	struct iio_channel **channels;
+
+	channels = iio_arena_grow(dev->ctx->arena, dev->channels,
+				  dev->nb_channels, sizeof(*channels));
 	if (!channels)
 		return -ENOMEM;
 
@@ -1460,13 +1925,13 @@ static struct iio_channel *create_channel(struct iio_device *dev,
 	struct iio_channel *chn;
 	int err = -ENOMEM;
 
-	chn = zalloc(sizeof(*chn));
+	chn = iio_arena_zalloc(dev->ctx->arena, sizeof(*chn));
 	if (!chn)
 		return ERR_PTR(-ENOMEM);
 
 	chn->pdata = zalloc(sizeof(*chn->pdata));
 	if (!chn->pdata)
-		goto err_free_chn;
+		return ERR_PTR(-ENOMEM);
 
 	if (!WITH_HWMON || !iio_device_is_hwmon(dev)) {
 		if (!strncmp(attr, "out_", 4)) {
@@ -1491,8 +1956,6 @@ static struct iio_channel *create_channel(struct iio_device *dev,
 err_free_chn_pdata:
 	free(chn->pdata->enable_fn);
 	free(chn->pdata);
-err_free_chn:
-	free(chn);
 	return ERR_PTR(err);
 }
 
@@ -1512,7 +1975,6 @@ static int add_channel(struct iio_device *dev, const char *name,
 		chn = dev->channels[i];
 		if (!strcmp(chn->id, channel_id)
 				&& chn->is_output == (name[0] == 'o')) {
-			free(channel_id);
 			ret = add_attr_to_channel(chn, name, path,
 					dir_is_scan_elements);
 			chn->is_scan_element |= dir_is_scan_elements && !ret;
@@ -1521,18 +1983,14 @@ static int add_channel(struct iio_device *dev, const char *name,
 	}
 
 	chn = create_channel(dev, channel_id, name, path, dir_is_scan_elements);
-	if (IS_ERR(chn)) {
-		free(channel_id);
+	if (IS_ERR(chn))
 		return PTR_ERR(chn);
-	}
 
 	iio_channel_init_finalize(chn);
 
 	ret = add_channel_to_device(dev, chn);
-	if (ret) {
+	if (ret)
 		local_free_channel_pdata(chn);
-		free_channel(chn);
-	}
 	return ret;
 }
 
@@ -1637,10 +2095,8 @@ static int detect_and_move_global_attrs(struct iio_device *dev)
 				return ret;
 		}
 
-		if (match) {
-			free(dev->attrs.names[i]);
+		if (match)
 			dev->attrs.names[i] = NULL;
-		}
 	}
 
 	/* Find channels without an index */
@@ -1656,7 +2112,6 @@ static int detect_and_move_global_attrs(struct iio_device *dev)
 			if (ret)
 				return ret;
 
-			free(dev->attrs.names[i]);
 			dev->attrs.names[i] = NULL;
 		}
 	}
@@ -1667,10 +2122,8 @@ static int detect_and_move_global_attrs(struct iio_device *dev)
 	}
 
 	dev->attrs.num = ptr - dev->attrs.names;
-	if (!dev->attrs.num) {
-		free(dev->attrs.names);
+	if (!dev->attrs.num)
 		dev->attrs.names = NULL;
-	}
 
 	return 0;
 }
@@ -1685,7 +2138,7 @@ static int add_buffer_attr(void *d, const char *path)
 		if (!strcmp(buffer_attrs_reserved[i], name))
 			return 0;
 
-	return add_iio_dev_attr(&dev->buffer_attrs, name, " buffer", dev->id);
+	return add_iio_dev_attr(dev, &dev->buffer_attrs, name, " buffer");
 }
 
 static int add_attr_or_channel_helper(struct iio_device *dev,
@@ -1802,41 +2255,206 @@ static int add_buffer_attributes(struct iio_device *dev, const char *devpath)
 	return 0;
 }
 
+static int add_buffer_attr_or_scan_element(void *d, const char *path)
+{
+	struct iio_device *dev = (struct iio_device *) d;
+	const char *name = strrchr(path, '/') + 1;
+	char buf[1024];
+
+	if (!is_channel(dev, name, true))
+		return add_buffer_attr(d, path);
+
+	iio_snprintf(buf, sizeof(buf), "buffer%u/%s",
+			dev->pdata->buffer_idx, name);
+
+	return add_channel(dev, name, buf, true);
+}
+
+/* The scan elements of an additional buffer only provide the "en", "index"
+ * and "type" attributes; inherit the name and the other attributes of the
+ * matching channel of the parent device. */
+static int inherit_channel(struct iio_channel *chn,
+		const struct iio_device *parent)
+{
+	struct iio_channel_pdata *pdata = chn->pdata;
+	const struct iio_channel *src = NULL;
+	unsigned int i;
+	size_t len;
+
+	for (i = 0; i < parent->nb_channels; i++) {
+		if (!strcmp(parent->channels[i]->id, chn->id) &&
+		    parent->channels[i]->is_output == chn->is_output) {
+			src = parent->channels[i];
+			break;
+		}
+	}
+
+	if (!src)
+		return set_channel_name(chn);
+
+	/* The channel is named after the one of the parent, even when the
+	 * latter has no name */
+	if (src->name) {
+		chn->name = src->name;
+
+		len = strlen(chn->name);
+		for (i = 0; i < pdata->nb_protected_attrs; i++) {
+			char *name = pdata->protected_attrs[i].name;
+
+			if (!strncmp(name, chn->name, len) && name[len] == '_')
+				strcut(name, (int) len + 1);
+		}
+	}
+
+	/* No attribute is added to the channels of a buffer device once they
+	 * are inherited, so the copy can have the exact size */
+	chn->attrs = iio_arena_dup(chn->dev->ctx->arena, src->attrs,
+				   src->nb_attrs * sizeof(*chn->attrs));
+	if (src->nb_attrs && !chn->attrs)
+		return -ENOMEM;
+
+	chn->nb_attrs = src->nb_attrs;
+
+	return 0;
+}
+
+struct buffer_device_ctx {
+	struct iio_context *ctx;
+	const struct iio_device *parent;
+};
+
+static int create_buffer_device(void *d, const char *path)
+{
+	const struct buffer_device_ctx *bctx = d;
+	const struct iio_device *parent = bctx->parent;
+	const char *name = strrchr(path, '/') + 1;
+	struct iio_device *dev;
+	unsigned long idx;
+	char *end, buf[1024];
+	unsigned int i;
+	int ret;
+
+	/* "buffer" and "buffer0" are the first buffer, which is accessed
+	 * through the parent device itself */
+	if (strncmp(name, "buffer", sizeof("buffer") - 1))
+		return 0;
+
+	idx = strtoul(name + sizeof("buffer") - 1, &end, 10);
+	if (end == name + sizeof("buffer") - 1 || *end || !idx || idx > UINT_MAX)
+		return 0;
+
+	dev = iio_arena_zalloc(bctx->ctx->arena, sizeof(*dev));
+	if (!dev)
+		return -ENOMEM;
+
+	dev->pdata = zalloc(sizeof(*dev->pdata));
+	if (!dev->pdata)
+		return -ENOMEM;
+
+	dev->pdata->fd = -1;
+	dev->pdata->reg_fd = -1;
+	dev->pdata->blocking = true;
+	dev->pdata->max_nb_blocks = NB_BLOCKS;
+	dev->pdata->parent = parent;
+	dev->pdata->buffer_idx = (unsigned int) idx;
+
+	dev->ctx = bctx->ctx;
+
+	iio_snprintf(buf, sizeof(buf), "%s.%s", parent->id, name);
+	dev->id = iio_arena_intern(bctx->ctx->arena, buf);
+	if (!dev->id) {
+		ret = -ENOMEM;
+		goto err_free_pdata;
+	}
+
+	dev->name = parent->name;
+	dev->label = parent->label;
+
+	ret = foreach_in_dir(dev, path, false, add_buffer_attr_or_scan_element);
+	if (ret < 0)
+		goto err_free_scan_elements;
+
+	qsort(dev->buffer_attrs.names, dev->buffer_attrs.num, sizeof(char *),
+		iio_buffer_attr_compare);
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		struct iio_channel *chn = dev->channels[i];
+
+		ret = inherit_channel(chn, parent);
+		if (ret < 0)
+			goto err_free_scan_elements;
+
+		ret = handle_scan_elements(chn);
+		free_protected_attrs(chn);
+		if (ret < 0)
+			goto err_free_scan_elements;
+
+		qsort(chn->attrs, chn->nb_attrs, sizeof(struct iio_channel_attr),
+			iio_channel_attr_compare);
+	}
+
+	dev->words = (dev->nb_channels + 31) / 32;
+	if (dev->words) {
+		dev->mask = iio_arena_zalloc(bctx->ctx->arena,
+					     dev->words * sizeof(*dev->mask));
+		if (!dev->mask) {
+			ret = -ENOMEM;
+			goto err_free_pdata;
+		}
+	}
+
+	ret = iio_context_add_device(bctx->ctx, dev);
+	if (!ret)
+		return 0;
+
+err_free_scan_elements:
+	for (i = 0; i < dev->nb_channels; i++)
+		free_protected_attrs(dev->channels[i]);
+err_free_pdata:
+	/* The device itself is stored in the arena of the context */
+	local_free_pdata(dev);
+	return ret;
+}
+
 static int create_device(void *d, const char *path)
 {
 	uint32_t *mask = NULL;
 	unsigned int i;
 	int ret;
 	struct iio_context *ctx = d;
-	struct iio_device *dev = zalloc(sizeof(*dev));
+	struct iio_device *dev = iio_arena_zalloc(ctx->arena, sizeof(*dev));
 	if (!dev)
 		return -ENOMEM;
 
 	dev->pdata = zalloc(sizeof(*dev->pdata));
-	if (!dev->pdata) {
-		free(dev);
+	if (!dev->pdata)
 		return -ENOMEM;
-	}
 
 	dev->pdata->fd = -1;
+	dev->pdata->reg_fd = -1;
 	dev->pdata->blocking = true;
 	dev->pdata->max_nb_blocks = NB_BLOCKS;
 
+	dev->pdata->reg_lock = iio_mutex_create();
+	if (!dev->pdata->reg_lock) {
+		local_free_pdata(dev);
+		return -ENOMEM;
+	}
+
 	dev->ctx = ctx;
-	dev->id = iio_strdup(strrchr(path, '/') + 1);
+	dev->id = iio_arena_intern(ctx->arena, strrchr(path, '/') + 1);
 	if (!dev->id) {
 		local_free_pdata(dev);
-		free(dev);
 		return -ENOMEM;
 	}
 
 	ret = foreach_in_dir(dev, path, false, add_attr_or_channel);
 	if (ret < 0)
-		goto err_free_device;
+		goto err_free_pdata;
 
 	ret = add_buffer_attributes(dev, path);
 	if (ret < 0)
-		goto err_free_device;
+		goto err_free_pdata;
 
 	ret = add_scan_elements(dev, path);
 	if (ret < 0)
@@ -1857,7 +2475,7 @@ static int create_device(void *d, const char *path)
 
 	ret = detect_and_move_global_attrs(dev);
 	if (ret < 0)
-		goto err_free_device;
+		goto err_free_pdata;
 
 	/* sorting is done after global attrs are added */
 	for (i = 0; i < dev->nb_channels; i++) {
@@ -1870,25 +2488,37 @@ static int create_device(void *d, const char *path)
 
 	dev->words = (dev->nb_channels + 31) / 32;
 	if (dev->words) {
-		mask = calloc(dev->words, sizeof(*mask));
+		mask = iio_arena_zalloc(ctx->arena, dev->words * sizeof(*mask));
 		if (!mask) {
 			ret = -ENOMEM;
-			goto err_free_device;
+			goto err_free_pdata;
 		}
 	}
 
 	dev->mask = mask;
 
 	ret = iio_context_add_device(ctx, dev);
-	if (!ret)
-		return 0;
+	if (ret < 0)
+		goto err_free_scan_elements;
+
+	/* Each additional buffer of the device is exposed as its own device,
+	 * named after its parent, e.g. "iio:device0.buffer1". */
+	if (!WITH_HWMON || !iio_device_is_hwmon(dev)) {
+		struct buffer_device_ctx bctx = {
+			.ctx = ctx,
+			.parent = dev,
+		};
+
+		return foreach_in_dir(&bctx, path, true, create_buffer_device);
+	}
+
+	return 0;
 
 err_free_scan_elements:
 	for (i = 0; i < dev->nb_channels; i++)
 		free_protected_attrs(dev->channels[i]);
-err_free_device:
+err_free_pdata:
 	local_free_pdata(dev);
-	free_device(dev);
 	return ret;
 }
 
@@ -1897,7 +2527,7 @@ static int add_debug_attr(void *d, const char *path)
 	struct iio_device *dev = d;
 	const char *attr = strrchr(path, '/') + 1;
 
-	return add_iio_dev_attr(&dev->debug_attrs, attr, " debug", dev->id);
+	return add_iio_dev_attr(dev, &dev->debug_attrs, attr, " debug");
 }
 
 static int add_debug(void *d, const char *path)
@@ -1934,10 +2564,243 @@ static void local_cancel(const struct iio_device *dev)
 	}
 }
 
-static struct iio_context * local_clone(
-		const struct iio_context *ctx __attribute__((unused)))
+static struct iio_event_stream_pdata *
+local_open_ev(const struct iio_device *dev)
+{
+	struct iio_event_stream_pdata *pdata;
+	char buf[1024];
+	int ret, fd, evfd;
+
+	if (WITH_HWMON && iio_device_is_hwmon(dev))
+		return ERR_PTR(-ENOSYS);
+
+	/* Events are generated by the IIO device, not by its buffers */
+	if (dev->pdata->parent)
+		dev = dev->pdata->parent;
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata)
+		return ERR_PTR(-ENOMEM);
+
+	/* The character device can only be opened once; reuse the file
+	 * descriptor of the buffer if there is one. */
+	fd = dev->pdata->fd;
+	if (fd == -1) {
+		iio_snprintf(buf, sizeof(buf), "%s/dev/%s",
+				local_root(dev->ctx), dev->id);
+		fd = open(buf, O_RDONLY | O_CLOEXEC);
+		if (fd == -1) {
+			ret = -errno;
+			goto err_free_pdata;
+		}
+	}
+
+	ret = ioctl_nointr(fd, IIO_GET_EVENT_FD_IOCTL, &evfd);
+
+	if (fd != dev->pdata->fd)
+		close(fd);
+	if (ret < 0)
+		goto err_free_pdata;
+
+	ret = set_nonblock(evfd);
+	if (ret < 0)
+		goto err_close_evfd;
+
+	pdata->cancel_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (pdata->cancel_fd == -1) {
+		ret = -errno;
+		goto err_close_evfd;
+	}
+
+	pdata->dev = dev;
+	pdata->fd = evfd;
+
+	return pdata;
+
+err_close_evfd:
+	close(evfd);
+err_free_pdata:
+	free(pdata);
+	return ERR_PTR(ret);
+}
+
+static void local_close_ev(struct iio_event_stream_pdata *pdata)
+{
+	close(pdata->cancel_fd);
+	close(pdata->fd);
+	free(pdata);
+}
+
+static void local_cancel_ev(struct iio_event_stream_pdata *pdata)
+{
+	uint64_t event = 1;
+	int ret;
+
+	ret = write(pdata->cancel_fd, &event, sizeof(event));
+	if (ret == -1) {
+		char err_str[1024];
+		iio_strerror(errno, err_str, sizeof(err_str));
+		IIO_ERROR("Unable to signal cancellation event: %s\n", err_str);
+	}
+}
+
+static int local_get_ev_fd(const struct iio_event_stream_pdata *pdata)
+{
+	return pdata->fd;
+}
+
+static ssize_t local_read_ev(struct iio_event_stream_pdata *pdata,
+		struct iio_event *events, size_t nb, bool nonblock)
+{
+	struct iio_context_pdata *ctx_pdata =
+		iio_context_get_pdata(pdata->dev->ctx);
+	struct pollfd pollfd[2] = {
+		{
+			.fd = pdata->fd,
+			.events = POLLIN,
+		}, {
+			.fd = pdata->cancel_fd,
+			.events = POLLIN,
+		}
+	};
+	struct timespec start;
+	ssize_t ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (true) {
+		do {
+			ret = poll(pollfd, 2, nonblock ? 0 :
+				   get_rel_timeout_ms(&start,
+						      ctx_pdata->rw_timeout_ms));
+		} while (ret == -1 && errno == EINTR);
+
+		if (ret == -1)
+			return -errno;
+		if (pollfd[1].revents & POLLIN)
+			return -EBADF;
+		if (ret == 0)
+			return nonblock ? -EAGAIN : -ETIMEDOUT;
+
+		/* The kernel returns as many events as fit in the buffer */
+		ret = read(pdata->fd, events, nb * sizeof(*events));
+		if (ret > 0)
+			return ret / (ssize_t) sizeof(*events);
+		if (ret == 0)
+			return -EIO;
+		if (errno != EINTR && errno != EAGAIN)
+			return -errno;
+	}
+}
+
+struct iio_hwmon_snapshot_pdata {
+	unsigned int nb;
+	int *fds;
+};
+
+static void local_close_hwmon(struct iio_hwmon_snapshot_pdata *pdata)
 {
-	return local_create_context();
+	unsigned int i;
+
+	for (i = 0; i < pdata->nb; i++)
+		if (pdata->fds[i] >= 0)
+			close(pdata->fds[i]);
+
+	free(pdata->fds);
+	free(pdata);
+}
+
+static struct iio_hwmon_snapshot_pdata *
+local_open_hwmon(const struct iio_context *ctx,
+		const struct iio_channel * const *chns,
+		const char * const *attrs, unsigned int nb)
+{
+	struct iio_hwmon_snapshot_pdata *pdata;
+	const char *filename;
+	char buf[1024];
+	unsigned int i;
+	int ret;
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata)
+		return ERR_PTR(-ENOMEM);
+
+	if (nb) {
+		pdata->fds = calloc(nb, sizeof(*pdata->fds));
+		if (!pdata->fds) {
+			free(pdata);
+			return ERR_PTR(-ENOMEM);
+		}
+	}
+
+	/* Keep the attribute files open, so that refreshing the snapshot only
+	 * costs one pread() per sensor. A file that cannot be opened only
+	 * results in an error for the corresponding channel. */
+	for (i = 0; i < nb; i++) {
+		filename = iio_channel_attr_get_filename(chns[i], attrs[i]);
+
+		ret = get_attr_path(chns[i]->dev, filename,
+				    IIO_ATTR_TYPE_DEVICE, buf, sizeof(buf));
+		if (ret == 0) {
+			ret = open(buf, O_RDONLY | O_CLOEXEC);
+			if (ret < 0)
+				ret = -errno;
+		}
+
+		pdata->fds[i] = ret;
+		pdata->nb++;
+	}
+
+	return pdata;
+}
+
+static int local_read_hwmon(struct iio_hwmon_snapshot_pdata *pdata,
+		struct iio_hwmon_value *values)
+{
+	char *end, buf[64];
+	unsigned int i;
+	long long val;
+	ssize_t ret;
+
+	for (i = 0; i < pdata->nb; i++) {
+		values[i].value = 0.0;
+
+		if (pdata->fds[i] < 0) {
+			values[i].error = pdata->fds[i];
+			continue;
+		}
+
+		/* sysfs regenerates the content when reading at offset 0 */
+		do {
+			ret = pread(pdata->fds[i], buf, sizeof(buf) - 1, 0);
+		} while (ret == -1 && errno == EINTR);
+
+		if (ret < 0) {
+			values[i].error = -errno;
+			continue;
+		}
+
+		buf[ret] = '\0';
+
+		errno = 0;
+		val = strtoll(buf, &end, 0);
+		if (end == buf || errno == ERANGE) {
+			values[i].error = -EINVAL;
+			continue;
+		}
+
+		values[i].value = (double) val;
+		values[i].error = 0;
+	}
+
+	return 0;
+}
+
+static struct iio_context * local_create_context_with_root(const char *root);
+
+static struct iio_context * local_clone(const struct iio_context *ctx)
+{
+	return local_create_context_with_root(iio_context_get_pdata(ctx)->root);
 }
 
 static char * local_get_description(const struct iio_context *ctx)
@@ -1965,6 +2828,9 @@ static const struct iio_backend_ops local_ops = {
 	.close = local_close,
 	.get_fd = local_get_fd,
 	.set_blocking_mode = local_set_blocking_mode,
+	.set_wait_policy = local_set_wait_policy,
+	.get_wait_stats = local_get_wait_stats,
+	.set_realtime_mode = local_set_realtime_mode,
 	.read = local_read,
 	.write = local_write,
 	.set_kernel_buffers_count = local_set_kernel_buffers_count,
@@ -1973,11 +2839,21 @@ static const struct iio_backend_ops local_ops = {
 	.write_device_attr = local_write_dev_attr,
 	.read_channel_attr = local_read_chn_attr,
 	.write_channel_attr = local_write_chn_attr,
+	.read_regs = local_read_regs,
+	.write_regs = local_write_regs,
 	.get_trigger = local_get_trigger,
 	.set_trigger = local_set_trigger,
 	.shutdown = local_shutdown,
 	.set_timeout = local_set_timeout,
 	.cancel = local_cancel,
+	.open_ev = local_open_ev,
+	.close_ev = local_close_ev,
+	.read_ev = local_read_ev,
+	.get_ev_fd = local_get_ev_fd,
+	.cancel_ev = local_cancel_ev,
+	.open_hwmon = local_open_hwmon,
+	.close_hwmon = local_close_hwmon,
+	.read_hwmon = local_read_hwmon,
 };
 
 static const struct iio_backend local_backend = {
@@ -2074,13 +2950,15 @@ out_close_ini:
 	return ret;
 }
 
-struct iio_context * local_create_context(void)
+static struct iio_context * local_create_context_with_root(const char *root)
 {
+	struct iio_context_pdata *pdata;
 	struct iio_context *ctx;
-	char *description;
+	char *description, buf[PATH_MAX];
 	int ret = -ENOMEM;
 	struct utsname uts;
 	bool no_iio;
+	size_t len;
 
 	description = local_get_description(NULL);
 
@@ -2091,7 +2969,26 @@ struct iio_context * local_create_context(void)
 
 	local_set_timeout(ctx, DEFAULT_TIMEOUT_MS);
 
-	ret = foreach_in_dir(ctx, "/sys/bus/iio/devices", true, create_device);
+	if (root) {
+		/* Drop the trailing slashes, all paths start with one */
+		len = strlen(root);
+		while (len && root[len - 1] == '/')
+			len--;
+
+		if (len) {
+			pdata = iio_context_get_pdata(ctx);
+			pdata->root = iio_strndup(root, len);
+			if (!pdata->root) {
+				ret = -ENOMEM;
+				goto err_context_destroy;
+			}
+		}
+	}
+
+	root = local_root(ctx);
+
+	iio_snprintf(buf, sizeof(buf), "%s/sys/bus/iio/devices", root);
+	ret = foreach_in_dir(ctx, buf, true, create_device);
 	no_iio = ret == -ENOENT;
 	if (WITH_HWMON && no_iio)
 	      ret = 0; /* Not an error, unless we also have no hwmon devices */
@@ -2099,7 +2996,8 @@ struct iio_context * local_create_context(void)
 	      goto err_context_destroy;
 
 	if (WITH_HWMON) {
-		ret = foreach_in_dir(ctx, "/sys/class/hwmon", true, create_device);
+		iio_snprintf(buf, sizeof(buf), "%s/sys/class/hwmon", root);
+		ret = foreach_in_dir(ctx, buf, true, create_device);
 		if (ret == -ENOENT && !no_iio)
 			ret = 0; /* IIO devices but no hwmon devices - not an error */
 		if (ret < 0)
@@ -2109,12 +3007,14 @@ struct iio_context * local_create_context(void)
 	qsort(ctx->devices, ctx->nb_devices, sizeof(struct iio_device *),
 		iio_device_compare);
 
-	foreach_in_dir(ctx, "/sys/kernel/debug/iio", true, add_debug);
+	iio_snprintf(buf, sizeof(buf), "%s/sys/kernel/debug/iio", root);
+	foreach_in_dir(ctx, buf, true, add_debug);
 
 	init_scan_elements(ctx);
 
 	if (WITH_LOCAL_CONFIG) {
-		ret = populate_context_attrs(ctx, "/etc/libiio.ini");
+		iio_snprintf(buf, sizeof(buf), "%s/etc/libiio.ini", root);
+		ret = populate_context_attrs(ctx, buf);
 		if (ret < 0)
 			IIO_WARNING("Unable to read INI file: %d\n", ret);
 	}
@@ -2124,7 +3024,12 @@ struct iio_context * local_create_context(void)
 	if (ret < 0)
 		goto err_context_destroy;
 
-	ret = iio_context_add_attr(ctx, "uri", "local:");
+	if (root[0])
+		iio_snprintf(buf, sizeof(buf), "local:root=%s", root);
+	else
+		iio_strlcpy(buf, "local:", sizeof(buf));
+
+	ret = iio_context_add_attr(ctx, "uri", buf);
 	if (ret < 0)
 		goto err_context_destroy;
 
@@ -2141,6 +3046,27 @@ err_set_errno:
 	return NULL;
 }
 
+struct iio_context * local_create_context(void)
+{
+	return local_create_context_with_root(NULL);
+}
+
+struct iio_context * local_create_context_from_uri(const char *uri)
+{
+	const char *params = uri + sizeof("local:") - 1;
+
+	if (!params[0])
+		return local_create_context();
+
+	if (strncmp(params, "root=", sizeof("root=") - 1)) {
+		IIO_ERROR("Invalid local URI: %s\n", uri);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return local_create_context_with_root(params + sizeof("root=") - 1);
+}
+
 #define BUF_SIZE 128
 
 static char * cat_file(const char *path)
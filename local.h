@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2023 Analog Devices, Inc.
+ */
+
+#ifndef __IIO_LOCAL_H
+#define __IIO_LOCAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+struct local_uring;
+
+struct local_uring * local_uring_create(int fd, int cancel_fd);
+void local_uring_destroy(struct local_uring *ring);
+
+/* Performs one read (or write) of at most len bytes, once the file
+ * descriptor is ready. Returns the number of bytes transferred, -ETIMEDOUT
+ * if timeout_ms (-1 for none) expired, -EBADF if the cancel file descriptor
+ * was signaled, or another negative error code. */
+ssize_t local_uring_transfer(struct local_uring *ring, void *buf, size_t len,
+			     bool is_write, int timeout_ms);
+
+#endif /* __IIO_LOCAL_H */
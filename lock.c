@@ -78,3 +78,62 @@ void iio_mutex_unlock(struct iio_mutex *lock)
 #endif
 #endif
 }
+
+struct iio_cond {
+#ifdef NO_THREADS
+	int foo; /* avoid complaints about empty structure */
+#else
+#ifdef _WIN32
+	CONDITION_VARIABLE cond;
+#else
+	pthread_cond_t cond;
+#endif
+#endif
+};
+
+struct iio_cond * iio_cond_create(void)
+{
+	struct iio_cond *cond = malloc(sizeof(*cond));
+
+	if (!cond)
+		return NULL;
+
+#ifndef NO_THREADS
+#ifdef _WIN32
+	InitializeConditionVariable(&cond->cond);
+#else
+	pthread_cond_init(&cond->cond, NULL);
+#endif
+#endif
+	return cond;
+}
+
+void iio_cond_destroy(struct iio_cond *cond)
+{
+#if !defined(NO_THREADS) && !defined(_WIN32)
+	pthread_cond_destroy(&cond->cond);
+#endif
+	free(cond);
+}
+
+void iio_cond_wait(struct iio_cond *cond, struct iio_mutex *lock)
+{
+#ifndef NO_THREADS
+#ifdef _WIN32
+	SleepConditionVariableCS(&cond->cond, &lock->lock, INFINITE);
+#else
+	pthread_cond_wait(&cond->cond, &lock->lock);
+#endif
+#endif
+}
+
+void iio_cond_broadcast(struct iio_cond *cond)
+{
+#ifndef NO_THREADS
+#ifdef _WIN32
+	WakeAllConditionVariable(&cond->cond);
+#else
+	pthread_cond_broadcast(&cond->cond);
+#endif
+#endif
+}
@@ -55,6 +55,22 @@
 
 #define DEFAULT_TIMEOUT_MS 5000
 
+/* Size of the receive buffer of the connections. Reads at least this large
+ * go straight to their destination. */
+#define NETWORK_RECV_BUF_SIZE 16384
+
+/* Number of blocks that can be pushed to an output device before waiting
+ * for the server to acknowledge them, unless set with
+ * iio_device_set_kernel_buffers_count(). With one, each push waits for the
+ * answer of the server, so that errors are reported by the push that caused
+ * them. */
+#define NETWORK_TX_DEFAULT_DEPTH 1
+
+/* Amount of data the server can send ahead of the refills of a stream; it
+ * should cover the bandwidth-delay product of the link. */
+#define NETWORK_STREAM_WINDOW (4 * 1024 * 1024)
+#define NETWORK_STREAM_MIN_CREDITS 2
+
 struct iio_context_pdata {
 	struct iiod_client_pdata io_ctx;
 	struct addrinfo *addrinfo;
@@ -65,14 +81,31 @@ struct iio_context_pdata {
 struct iio_device_pdata {
 	struct iiod_client_pdata io_ctx;
 #ifdef WITH_NETWORK_GET_BUFFER
-	int memfd;
+	/* Ring of blocks of the zero-copy interface, and pipe used to splice
+	 * them to the socket */
+	int memfd, pipefd[2];
 	void *mmap_addr;
-	size_t mmap_len;
+	size_t mmap_len, pipe_size;
+	unsigned int cur_block, nb_blocks;
+	bool has_block;
 #endif
-	bool wait_for_err_code, is_cyclic, is_tx;
+	bool is_tx;
+
+	/* Number of WRITEBUF commands sent whose answer was not read yet, and
+	 * maximum number of them */
+	unsigned int tx_pending, tx_depth;
+
+	/* Stream of input samples */
+	struct iiod_client_rx rx;
+
 	struct iio_mutex *lock;
 };
 
+struct iio_event_stream_pdata {
+	struct iiod_client_pdata io_ctx;
+	const struct iio_device *dev;
+};
+
 static ssize_t network_recv(struct iiod_client_pdata *io_ctx,
 		void *data, size_t len, int flags)
 {
@@ -103,6 +136,36 @@ static ssize_t network_recv(struct iiod_client_pdata *io_ctx,
 	return ret;
 }
 
+/* Serves the data from the receive buffer, and refills it when empty */
+static ssize_t network_recv_buffered(struct iiod_client_pdata *io_ctx,
+				     void *dst, size_t len)
+{
+	size_t avail = io_ctx->rbuf_len - io_ctx->rbuf_pos;
+	ssize_t ret;
+
+	if (!avail) {
+		if (!io_ctx->rbuf || len >= NETWORK_RECV_BUF_SIZE)
+			return network_recv(io_ctx, dst, len, 0);
+
+		ret = network_recv(io_ctx, io_ctx->rbuf,
+				   NETWORK_RECV_BUF_SIZE, 0);
+		if (ret < 0)
+			return ret;
+
+		io_ctx->rbuf_pos = 0;
+		io_ctx->rbuf_len = (size_t) ret;
+		avail = (size_t) ret;
+	}
+
+	if (len > avail)
+		len = avail;
+
+	memcpy(dst, io_ctx->rbuf + io_ctx->rbuf_pos, len);
+	io_ctx->rbuf_pos += len;
+
+	return (ssize_t) len;
+}
+
 static ssize_t network_send(struct iiod_client_pdata *io_ctx,
 		const void *data, size_t len, int flags)
 {
@@ -347,6 +410,107 @@ static char * network_get_description(struct addrinfo *res)
 	return description;
 }
 
+#ifdef WITH_NETWORK_GET_BUFFER
+/* The pages of a block that was sent are referenced by the network stack
+ * until they are acknowledged, so the block cannot be handed out right
+ * away. A block is only handed out again once the server answered the
+ * transfer of its previous content, so the zero-copy ring has one block
+ * more than the number of blocks in flight. */
+
+/* Upper bound of the size requested for the splice pipe */
+#define NETWORK_PIPE_MAX_SIZE (1024 * 1024)
+
+static int network_create_memfd(void)
+{
+#ifdef HAS_MEMFD_CREATE
+	return memfd_create("libiio", MFD_CLOEXEC);
+#else
+	return open(P_tmpdir, O_RDWR | O_TMPFILE | O_EXCL | O_CLOEXEC, S_IRWXU);
+#endif
+}
+
+static void network_free_zero_copy(struct iio_device_pdata *pdata)
+{
+	if (pdata->mmap_addr) {
+		munmap(pdata->mmap_addr,
+		       pdata->mmap_len * pdata->nb_blocks);
+		pdata->mmap_addr = NULL;
+	}
+
+	if (pdata->pipefd[0] >= 0) {
+		close(pdata->pipefd[0]);
+		close(pdata->pipefd[1]);
+		pdata->pipefd[0] = -1;
+		pdata->pipefd[1] = -1;
+	}
+
+	if (pdata->memfd >= 0) {
+		close(pdata->memfd);
+		pdata->memfd = -1;
+	}
+}
+
+/* The ring and the pipe are created once per buffer. On failure, the buffer
+ * uses the copying interface instead.
+ *
+ * Only output buffers use the ring: splicing from the socket to a file
+ * copies the data to the page cache anyway, and costs two calls per chunk
+ * received instead of one. */
+static int network_setup_zero_copy(struct iio_device_pdata *pdata)
+{
+	size_t size;
+	int ret;
+
+	pdata->nb_blocks = pdata->tx_depth + 1;
+	size = pdata->mmap_len * pdata->nb_blocks;
+
+	pdata->memfd = network_create_memfd();
+	if (pdata->memfd < 0)
+		return -errno;
+
+	if (ftruncate(pdata->memfd, (off_t) size) < 0) {
+		ret = -errno;
+		goto err_free_zero_copy;
+	}
+
+	pdata->mmap_addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+				MAP_SHARED, pdata->memfd, 0);
+	if (pdata->mmap_addr == MAP_FAILED) {
+		pdata->mmap_addr = NULL;
+		ret = -errno;
+		goto err_free_zero_copy;
+	}
+
+	if (pipe2(pdata->pipefd, O_CLOEXEC | O_NONBLOCK) < 0) {
+		ret = -errno;
+		goto err_free_zero_copy;
+	}
+
+	/* A larger pipe means fewer splice() calls per block. The request is
+	 * capped by /proc/sys/fs/pipe-max-size, so keep the default size if
+	 * it fails. */
+	ret = fcntl(pdata->pipefd[1], F_SETPIPE_SZ,
+		    (int) (pdata->mmap_len < NETWORK_PIPE_MAX_SIZE ?
+			   pdata->mmap_len : NETWORK_PIPE_MAX_SIZE));
+	if (ret < 0)
+		ret = fcntl(pdata->pipefd[1], F_GETPIPE_SZ);
+	if (ret < 0) {
+		ret = -errno;
+		goto err_free_zero_copy;
+	}
+
+	pdata->pipe_size = (size_t) ret;
+	pdata->cur_block = 0;
+	pdata->has_block = false;
+
+	return 0;
+
+err_free_zero_copy:
+	network_free_zero_copy(pdata);
+	return ret;
+}
+#endif /* WITH_NETWORK_GET_BUFFER */
+
 static int network_open(const struct iio_device *dev,
 		size_t samples_count, bool cyclic)
 {
@@ -368,6 +532,14 @@ static int network_open(const struct iio_device *dev,
 	ppdata->io_ctx.cancelled = false;
 	ppdata->io_ctx.cancellable = false;
 	ppdata->io_ctx.timeout_ms = DEFAULT_TIMEOUT_MS;
+	ppdata->io_ctx.rbuf_pos = 0;
+	ppdata->io_ctx.rbuf_len = 0;
+
+	ppdata->io_ctx.rbuf = malloc(NETWORK_RECV_BUF_SIZE);
+	if (!ppdata->io_ctx.rbuf) {
+		ret = -ENOMEM;
+		goto err_close_socket;
+	}
 
 	ret = iiod_client_open_unlocked(pdata->iiod_client,
 			&ppdata->io_ctx, dev, samples_count, cyclic);
@@ -389,10 +561,20 @@ static int network_open(const struct iio_device *dev,
 	ppdata->io_ctx.timeout_ms = pdata->io_ctx.timeout_ms;
 	ppdata->io_ctx.cancellable = true;
 	ppdata->is_tx = iio_device_is_tx(dev);
-	ppdata->is_cyclic = cyclic;
-	ppdata->wait_for_err_code = false;
+	ppdata->tx_pending = 0;
+	ppdata->rx.len = 0;
+	ppdata->rx.supported = !ppdata->is_tx;
+	memset(&ppdata->rx.stats, 0, sizeof(ppdata->rx.stats));
+	if (ppdata->rx.supported)
+		ppdata->rx.codec = iiod_client_get_default_codec(&ppdata->rx.codec_level);
 #ifdef WITH_NETWORK_GET_BUFFER
 	ppdata->mmap_len = samples_count * iio_device_get_sample_size(dev);
+
+	if (!cyclic && ppdata->is_tx) {
+		ret = network_setup_zero_copy(ppdata);
+		if (ret < 0)
+			IIO_DEBUG("Zero-copy interface unavailable: %d\n", ret);
+	}
 #endif
 
 	iio_mutex_unlock(ppdata->lock);
@@ -402,6 +584,8 @@ static int network_open(const struct iio_device *dev,
 err_cleanup_cancel:
 	cleanup_cancel(&ppdata->io_ctx);
 err_close_socket:
+	free(ppdata->io_ctx.rbuf);
+	ppdata->io_ctx.rbuf = NULL;
 	close(ppdata->io_ctx.fd);
 	ppdata->io_ctx.fd = -1;
 out_mutex_unlock:
@@ -409,16 +593,84 @@ out_mutex_unlock:
 	return ret;
 }
 
+/* Reads the answers to the blocks pushed, until no more than 'max_pending'
+ * of them are left; returns the first error reported by the server. */
+static int network_wait_tx(const struct iio_device *dev,
+			   unsigned int max_pending)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	ssize_t ret;
+	int err = 0;
+
+	while (pdata->tx_pending > max_pending) {
+		ret = iiod_client_write_result_unlocked(ctx_pdata->iiod_client,
+							&pdata->io_ctx);
+		if (ret < 0) {
+			/* Don't wait for the other answers once the
+			 * connection is lost */
+			if (ret == -ETIMEDOUT || ret == -EPIPE ||
+			    ret == -ECONNRESET) {
+				pdata->tx_pending = 0;
+				return (int) ret;
+			}
+
+			if (!err)
+				err = (int) ret;
+		}
+
+		pdata->tx_pending--;
+	}
+
+	return err;
+}
+
+/* Blocks are only sent ahead of the answers if several of them can be in
+ * flight, and if the server reads the blocks it rejects. */
+static bool network_tx_pipelined(const struct iio_device *dev)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	return pdata->tx_depth > 1 &&
+		iiod_client_can_pipeline_write_unlocked(ctx_pdata->iiod_client,
+							&pdata->io_ctx, dev);
+}
+
+static int network_flush(const struct iio_device *dev)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret;
+
+	iio_mutex_lock(pdata->lock);
+	ret = network_wait_tx(dev, 0);
+	iio_mutex_unlock(pdata->lock);
+
+	return ret;
+}
+
 static int network_close(const struct iio_device *dev)
 {
 	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
 	struct iio_device_pdata *pdata = dev->pdata;
-	int ret = -EBADF;
+	int err, ret = -EBADF;
 
 	iio_mutex_lock(pdata->lock);
 
 	if (pdata->io_ctx.fd >= 0) {
-		if (!pdata->io_ctx.cancelled) {
+		/* Don't wait for the blocks of a stream still in flight; the
+		 * server ends the session and closes the device as soon as
+		 * the connection is closed. */
+		if (!pdata->io_ctx.cancelled && !pdata->rx.len) {
+			/* Wait for the blocks pushed to be processed, so that
+			 * they are not discarded by the server. There is no
+			 * one left to report an error to; iio_buffer_flush()
+			 * is the way to get it. */
+			err = network_wait_tx(dev, 0);
+			if (err < 0)
+				IIO_ERROR("Unable to write the last blocks: %d\n",
+					  err);
+
 			ret = iiod_client_close_unlocked(
 					ctx_pdata->iiod_client,
 					&pdata->io_ctx, dev);
@@ -431,33 +683,65 @@ static int network_close(const struct iio_device *dev)
 		cleanup_cancel(&pdata->io_ctx);
 		close(pdata->io_ctx.fd);
 		pdata->io_ctx.fd = -1;
-	}
 
-#ifdef WITH_NETWORK_GET_BUFFER
-	if (pdata->memfd >= 0)
-		close(pdata->memfd);
-	pdata->memfd = -1;
+		free(pdata->io_ctx.rbuf);
+		pdata->io_ctx.rbuf = NULL;
 
-	if (pdata->mmap_addr) {
-		munmap(pdata->mmap_addr, pdata->mmap_len);
-		pdata->mmap_addr = NULL;
+		if (pdata->rx.len) {
+			iiod_client_free_stream(pdata->rx.stream);
+			pdata->rx.len = 0;
+		}
+
+		free(pdata->rx.codec);
+		pdata->rx.codec = NULL;
 	}
+
+#ifdef WITH_NETWORK_GET_BUFFER
+	network_free_zero_copy(pdata);
 #endif
 
 	iio_mutex_unlock(pdata->lock);
 	return ret;
 }
 
+/* Number of blocks of the given size that the server can send ahead */
+static unsigned int network_stream_credits(size_t len)
+{
+	unsigned int credits = (unsigned int) (NETWORK_STREAM_WINDOW / len);
+
+	if (credits < NETWORK_STREAM_MIN_CREDITS)
+		credits = NETWORK_STREAM_MIN_CREDITS;
+
+	return credits;
+}
+
+/* (Re)opens the stream of input samples with blocks of the given size;
+ * returns -ENOSYS if the server does not support it. */
+static int network_open_stream(const struct iio_device *dev, size_t len)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	return iiod_client_rx_open_unlocked(ctx_pdata->iiod_client,
+			&pdata->io_ctx, dev, &pdata->rx, len,
+			network_stream_credits(len), dev->words);
+}
+
 static ssize_t network_read(const struct iio_device *dev, void *dst, size_t len,
 		uint32_t *mask, size_t words)
 {
 	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
 	struct iio_device_pdata *pdata = dev->pdata;
-	ssize_t ret;
+	ssize_t ret = -ENOSYS;
 
 	iio_mutex_lock(pdata->lock);
-	ret = iiod_client_read_unlocked(ctx_pdata->iiod_client,
-			&pdata->io_ctx, dev, dst, len, mask, words);
+	if (pdata->rx.supported)
+		ret = iiod_client_rx_read_unlocked(ctx_pdata->iiod_client,
+				&pdata->io_ctx, dev, &pdata->rx, dst, len,
+				network_stream_credits(len), mask, words);
+	if (ret == -ENOSYS)
+		ret = iiod_client_read_unlocked(ctx_pdata->iiod_client,
+				&pdata->io_ctx, dev, dst, len, mask, words);
 	iio_mutex_unlock(pdata->lock);
 
 	return ret;
@@ -471,319 +755,154 @@ static ssize_t network_write(const struct iio_device *dev,
 	ssize_t ret;
 
 	iio_mutex_lock(pdata->lock);
-	ret = iiod_client_write_unlocked(ctx_pdata->iiod_client,
-			&pdata->io_ctx, dev, src, len);
-	iio_mutex_unlock(pdata->lock);
-
-	return ret;
-}
 
-#ifdef WITH_NETWORK_GET_BUFFER
-
-static ssize_t read_all(struct iiod_client_pdata *io_ctx,
-		void *dst, size_t len)
-{
-	uintptr_t ptr = (uintptr_t) dst;
-	while (len) {
-		ssize_t ret = network_recv(io_ctx, (void *) ptr, len, 0);
-		if (ret < 0) {
-			IIO_ERROR("NETWORK RECV: %zu\n", ret);
-			return ret;
-		}
-		ptr += ret;
-		len -= ret;
-	}
-	return (ssize_t)(ptr - (uintptr_t) dst);
-}
-
-static int read_integer(struct iiod_client_pdata *io_ctx, long *val)
-{
-	unsigned int i;
-	char buf[1024], *ptr;
-	ssize_t ret;
-	bool found = false;
-
-	for (i = 0; i < sizeof(buf) - 1; i++) {
-		ret = read_all(io_ctx, buf + i, 1);
-		if (ret < 0)
-			return (int) ret;
-
-		/* Skip the eventual first few carriage returns.
-		 * Also stop when a dot is found (for parsing floats) */
-		if (buf[i] != '\n' && buf[i] != '.')
-			found = true;
-		else if (found)
-			break;
-	}
-
-	buf[i] = '\0';
-	errno = 0;
-	ret = (ssize_t) strtol(buf, &ptr, 10);
-	if (ptr == buf || errno == ERANGE)
-		return -EINVAL;
-	*val = (long) ret;
-	return 0;
-}
-
-static ssize_t network_read_mask(struct iiod_client_pdata *io_ctx,
-		uint32_t *mask, size_t words)
-{
-	long read_len;
-	ssize_t ret;
-
-	ret = read_integer(io_ctx, &read_len);
-	if (ret < 0) {
-		IIO_ERROR("READ INTEGER: %zu\n", ret);
-		return ret;
+	if (!network_tx_pipelined(dev)) {
+		/* Blocks might still be in flight if the depth was lowered */
+		ret = network_wait_tx(dev, 0);
+		if (ret == 0)
+			ret = iiod_client_write_unlocked(ctx_pdata->iiod_client,
+					&pdata->io_ctx, dev, src, len);
+		goto out_unlock;
 	}
 
-	if (read_len > 0 && mask) {
-		size_t i;
-		char buf[9];
-
-		buf[8] = '\0';
-		IIO_DEBUG("Reading mask\n");
+	/* The answer to the block is read when pushing a later one, so that
+	 * several blocks can be in flight; an error is reported by the push
+	 * that reads it. */
+	ret = network_wait_tx(dev, pdata->tx_depth - 1);
+	if (ret < 0)
+		goto out_unlock;
 
-		for (i = words; i > 0; i--) {
-			ret = read_all(io_ctx, buf, 8);
-			if (ret < 0)
-				return ret;
+	ret = iiod_client_send_write_unlocked(ctx_pdata->iiod_client,
+			&pdata->io_ctx, dev, src, len);
+	if (ret < 0)
+		goto out_unlock;
 
-			iio_sscanf(buf, "%08x", &mask[i - 1]);
-			IIO_DEBUG("mask[%lu] = 0x%x\n",
-					(unsigned long)(i - 1), mask[i - 1]);
-		}
-	}
+	pdata->tx_pending++;
+	ret = (ssize_t) len;
 
-	if (read_len > 0) {
-		char c;
-		ssize_t nb = read_all(io_ctx, &c, 1);
-		if (nb > 0 && c != '\n')
-			read_len = -EIO;
-	}
+out_unlock:
+	iio_mutex_unlock(pdata->lock);
 
-	return (ssize_t) read_len;
+	return ret;
 }
 
-static ssize_t read_error_code(struct iiod_client_pdata *io_ctx)
-{
-	/*
-	 * The server returns two integer codes.
-	 * The first one is returned right after the WRITEBUF command is issued,
-	 * and corresponds to the error code returned when the server attempted
-	 * to open the device.
-	 * If zero, a second error code is returned, that corresponds (if positive)
-	 * to the number of bytes written.
-	 *
-	 * To speed up things, we delay error reporting. We just send out the
-	 * data without reading the error code that the server gives us, because
-	 * the answer will take too much time. If an error occurred, it will be
-	 * reported by the next call to iio_buffer_push().
-	 */
-
-	unsigned int i;
-	long resp = 0;
-
-	for (i = 0; i < 2; i++) {
-		ssize_t ret = read_integer(io_ctx, &resp);
-		if (ret < 0)
-			return ret;
-		if (resp < 0)
-			return (ssize_t) resp;
-	}
-
-	return (ssize_t) resp;
-}
+#ifdef WITH_NETWORK_GET_BUFFER
 
-static ssize_t write_rwbuf_command(const struct iio_device *dev,
-		const char *cmd)
+/* Empties the pipe after a failed transfer */
+static void network_drain_pipe(struct iio_device_pdata *pdata)
 {
-	struct iio_device_pdata *pdata = dev->pdata;
-
-	if (pdata->wait_for_err_code) {
-		ssize_t ret = read_error_code(&pdata->io_ctx);
-
-		pdata->wait_for_err_code = false;
-		if (ret < 0)
-			return ret;
-	}
+	char buf[4096];
 
-	return write_command(&pdata->io_ctx, cmd);
+	while (read(pdata->pipefd[0], buf, sizeof(buf)) > 0);
 }
 
-static ssize_t network_do_splice(struct iio_device_pdata *pdata, size_t len,
-		bool read)
+static ssize_t network_splice_to_socket(struct iio_device_pdata *pdata,
+					off_t offset, size_t len)
 {
-	int pipefd[2];
-	int fd_in, fd_out;
-	ssize_t ret, read_len = len, write_len = 0;
-
-	ret = (ssize_t) pipe2(pipefd, O_CLOEXEC);
-	if (ret < 0)
-		return -errno;
-
-	if (read) {
-	    fd_in = pdata->io_ctx.fd;
-	    fd_out = pdata->memfd;
-	} else {
-	    fd_in = pdata->memfd;
-	    fd_out = pdata->io_ctx.fd;
-	}
+	struct iiod_client_pdata *io_ctx = &pdata->io_ctx;
+	loff_t off = offset;
+	size_t left = len;
+	ssize_t ret, nb;
+
+	while (left) {
+		nb = splice(pdata->memfd, &off, pdata->pipefd[1], NULL,
+			    left < pdata->pipe_size ? left : pdata->pipe_size,
+			    SPLICE_F_MOVE);
+		if (nb < 0 && errno == EINTR)
+			continue;
+		if (nb <= 0)
+			return nb ? -errno : -EIO;
+
+		left -= nb;
+
+		while (nb) {
+			ret = wait_cancellable(io_ctx, false);
+			if (ret < 0)
+				goto err_drain_pipe;
 
-	do {
-		ret = wait_cancellable(&pdata->io_ctx, read);
-		if (ret < 0)
-			goto err_close_pipe;
-
-		if (read_len) {
-			/*
-			 * SPLICE_F_NONBLOCK is just here to avoid a deadlock when
-			 * splicing from a socket. As the socket is not in
-			 * non-blocking mode, it should never return -EAGAIN.
-			 * TODO(pcercuei): Find why it locks...
-			 * */
-			ret = splice(fd_in, NULL, pipefd[1], NULL, read_len,
-					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
-			if (!ret)
-				ret = -EIO;
-			if (ret < 0 && errno != EAGAIN) {
-				ret = -errno;
-				goto err_close_pipe;
-			} else if (ret > 0) {
-				write_len += ret;
-				read_len -= ret;
+			ret = splice(pdata->pipefd[0], NULL, io_ctx->fd, NULL,
+				     nb, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+				continue;
+			if (ret <= 0) {
+				ret = ret ? -errno : -EPIPE;
+				goto err_drain_pipe;
 			}
-		}
 
-		if (write_len) {
-			ret = splice(pipefd[0], NULL, fd_out, NULL, write_len,
-					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
-			if (!ret)
-				ret = -EIO;
-			if (ret < 0 && errno != EAGAIN) {
-				ret = -errno;
-				goto err_close_pipe;
-			} else if (ret > 0) {
-				write_len -= ret;
-			}
+			nb -= ret;
 		}
+	}
 
-	} while (write_len || read_len);
+	return (ssize_t) len;
 
-err_close_pipe:
-	close(pipefd[0]);
-	close(pipefd[1]);
-	return ret < 0 ? ret : (ssize_t)len;
+err_drain_pipe:
+	network_drain_pipe(pdata);
+	return ret;
 }
 
 static ssize_t network_get_buffer(const struct iio_device *dev,
 		void **addr_ptr, size_t bytes_used,
 		uint32_t *mask, size_t words)
 {
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
 	struct iio_device_pdata *pdata = dev->pdata;
-	ssize_t ret, read = 0;
-	int memfd;
+	ssize_t ret = (ssize_t) bytes_used;
+	bool pipelined;
 
-	if (pdata->is_cyclic)
-		return -ENOSYS;
-
-	/* We check early that the temporary file can be created, so that we can
-	 * return -ENOSYS in case it fails, which will indicate that the
-	 * high-speed interface is not available.
-	 *
-	 * O_TMPFILE -> Linux 3.11.
-	 * TODO: use memfd_create (Linux 3.17) */
-	memfd = open(P_tmpdir, O_RDWR | O_TMPFILE | O_EXCL | O_CLOEXEC, S_IRWXU);
-	if (memfd < 0)
+	/* Input or cyclic buffers, or failure to create the ring */
+	if (pdata->memfd < 0)
 		return -ENOSYS;
 
-	if (!addr_ptr || words != (dev->nb_channels + 31) / 32) {
-		close(memfd);
+	if (!addr_ptr || words != (dev->nb_channels + 31) / 32 ||
+	    bytes_used > pdata->mmap_len)
 		return -EINVAL;
-	}
-
-	if (pdata->mmap_addr)
-		munmap(pdata->mmap_addr, pdata->mmap_len);
-
-	if (pdata->mmap_addr && pdata->is_tx) {
-		char buf[1024];
 
-		iio_snprintf(buf, sizeof(buf), "WRITEBUF %s %lu\r\n",
-				dev->id, (unsigned long) bytes_used);
+	iio_mutex_lock(pdata->lock);
 
-		iio_mutex_lock(pdata->lock);
+	/* The first call only hands out the block to fill */
+	if (pdata->has_block) {
+		pipelined = network_tx_pipelined(dev);
 
-		ret = write_rwbuf_command(dev, buf);
+		/* Make sure that the next block of the ring is not in
+		 * flight anymore once this one is sent */
+		ret = network_wait_tx(dev, pipelined ? pdata->nb_blocks - 2 : 0);
 		if (ret < 0)
-			goto err_close_memfd;
+			goto out_unlock;
 
-		ret = network_do_splice(pdata, bytes_used, false);
+		if (pipelined)
+			ret = iiod_client_send_write_unlocked(
+					ctx_pdata->iiod_client, &pdata->io_ctx,
+					dev, NULL, bytes_used);
+		else
+			ret = iiod_client_start_write_unlocked(
+					ctx_pdata->iiod_client, &pdata->io_ctx,
+					dev, bytes_used);
 		if (ret < 0)
-			goto err_close_memfd;
-
-		pdata->wait_for_err_code = true;
-		iio_mutex_unlock(pdata->lock);
-	}
-
-	if (pdata->memfd >= 0)
-		close(pdata->memfd);
-
-	pdata->memfd = memfd;
+			goto out_unlock;
 
-	ret = (ssize_t) ftruncate(pdata->memfd, pdata->mmap_len);
-	if (ret < 0) {
-		ret = -errno;
-		IIO_ERROR("Unable to truncate temp file: %zi\n", -ret);
-		return ret;
-	}
-
-	if (!pdata->is_tx) {
-		char buf[1024];
-		size_t len = pdata->mmap_len;
-
-		iio_snprintf(buf, sizeof(buf), "READBUF %s %lu\r\n",
-				dev->id, (unsigned long) len);
-
-		iio_mutex_lock(pdata->lock);
-		ret = write_rwbuf_command(dev, buf);
+		ret = network_splice_to_socket(pdata,
+				(off_t) pdata->cur_block * pdata->mmap_len,
+				bytes_used);
 		if (ret < 0)
-			goto err_unlock;
-
-		do {
-			ret = network_read_mask(&pdata->io_ctx, mask, words);
-			if (!ret)
-				break;
-			if (ret < 0)
-				goto err_unlock;
+			goto out_unlock;
 
-			mask = NULL; /* We read the mask only once */
+		pdata->tx_pending++;
+		pdata->cur_block = (pdata->cur_block + 1) % pdata->nb_blocks;
 
-			ret = network_do_splice(pdata, ret, true);
+		if (!pipelined) {
+			ret = network_wait_tx(dev, 0);
 			if (ret < 0)
-				goto err_unlock;
-
-			read += ret;
-			len -= ret;
-		} while (len);
+				goto out_unlock;
 
-		iio_mutex_unlock(pdata->lock);
-	}
-
-	pdata->mmap_addr = mmap(NULL, pdata->mmap_len,
-			PROT_READ | PROT_WRITE, MAP_SHARED, pdata->memfd, 0);
-	if (pdata->mmap_addr == MAP_FAILED) {
-		pdata->mmap_addr = NULL;
-		ret = -errno;
-		IIO_ERROR("Unable to mmap: %zi\n", -ret);
-		return ret;
+			ret = (ssize_t) bytes_used;
+		}
 	}
 
-	*addr_ptr = pdata->mmap_addr;
-	return read ? read : (ssize_t) bytes_used;
+	pdata->has_block = true;
+	*addr_ptr = (char *) pdata->mmap_addr +
+		(size_t) pdata->cur_block * pdata->mmap_len;
 
-err_close_memfd:
-	close(memfd);
-err_unlock:
+out_unlock:
 	iio_mutex_unlock(pdata->lock);
 	return ret;
 }
@@ -849,8 +968,9 @@ static void network_shutdown(struct iio_context *ctx)
 	unsigned int i;
 
 	iiod_client_mutex_lock(pdata->iiod_client);
-	write_command(&pdata->io_ctx, "\r\nEXIT\r\n");
+	iiod_client_exit(pdata->iiod_client, &pdata->io_ctx);
 	close(pdata->io_ctx.fd);
+	free(pdata->io_ctx.rbuf);
 	iiod_client_mutex_unlock(pdata->iiod_client);
 
 	for (i = 0; i < iio_context_get_devices_count(ctx); i++) {
@@ -906,20 +1026,251 @@ static int network_set_timeout(struct iio_context *ctx, unsigned int timeout)
 	return ret;
 }
 
+static int network_read_regs(const struct iio_device *dev,
+		const uint32_t *addrs, uint32_t *values, size_t nb)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+
+	return iiod_client_read_regs(pdata->iiod_client,
+			&pdata->io_ctx, dev, addrs, values, nb);
+}
+
+static int network_write_regs(const struct iio_device *dev,
+		const uint32_t *addrs, const uint32_t *values, size_t nb)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+
+	return iiod_client_write_regs(pdata->iiod_client,
+			&pdata->io_ctx, dev, addrs, values, nb);
+}
+
 static int network_set_kernel_buffers_count(const struct iio_device *dev,
 		unsigned int nb_blocks)
 {
 	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+	int ret;
 
-	return iiod_client_set_kernel_buffers_count(pdata->iiod_client,
+	ret = iiod_client_set_kernel_buffers_count(pdata->iiod_client,
 			 &pdata->io_ctx, dev, nb_blocks);
+	if (ret < 0)
+		return ret;
+
+	/* Keep as many blocks in flight as the server queues */
+	iio_mutex_lock(dev->pdata->lock);
+	dev->pdata->tx_depth = nb_blocks ? nb_blocks : 1;
+	iio_mutex_unlock(dev->pdata->lock);
+
+	return 0;
+}
+
+#ifndef _WIN32
+static struct iio_event_stream_pdata *
+network_open_ev(const struct iio_device *dev)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_event_stream_pdata *ev_pdata;
+	int ret;
+
+	ev_pdata = zalloc(sizeof(*ev_pdata));
+	if (!ev_pdata)
+		return ERR_PTR(-ENOMEM);
+
+	/* Events are received on a dedicated connection */
+	ret = create_socket(pdata->addrinfo);
+	if (ret < 0) {
+		IIO_ERROR("Create socket: %d\n", ret);
+		goto err_free_pdata;
+	}
+
+	ev_pdata->dev = dev;
+	ev_pdata->io_ctx.fd = ret;
+	ev_pdata->io_ctx.timeout_ms = DEFAULT_TIMEOUT_MS;
+
+	ret = iiod_client_open_event_stream(pdata->iiod_client,
+					    &ev_pdata->io_ctx, dev);
+	if (ret < 0)
+		goto err_close_socket;
+
+	/* Waiting for events is handled by network_read_ev() */
+	ret = set_socket_timeout(ev_pdata->io_ctx.fd, 0);
+	if (ret < 0)
+		goto err_close_socket;
+
+	ret = setup_cancel(&ev_pdata->io_ctx);
+	if (ret < 0)
+		goto err_close_socket;
+
+	ev_pdata->io_ctx.cancellable = true;
+
+	return ev_pdata;
+
+err_close_socket:
+	close(ev_pdata->io_ctx.fd);
+err_free_pdata:
+	free(ev_pdata);
+	return ERR_PTR(ret);
+}
+
+static void network_close_ev(struct iio_event_stream_pdata *pdata)
+{
+	/* Closing the connection is enough to unsubscribe */
+	cleanup_cancel(&pdata->io_ctx);
+	close(pdata->io_ctx.fd);
+	free(pdata);
+}
+
+static void network_cancel_ev(struct iio_event_stream_pdata *pdata)
+{
+	do_cancel(&pdata->io_ctx);
+
+	pdata->io_ctx.cancelled = true;
+}
+
+static int network_get_ev_fd(const struct iio_event_stream_pdata *pdata)
+{
+	return pdata->io_ctx.fd;
+}
+
+static ssize_t network_read_ev(struct iio_event_stream_pdata *pdata,
+		struct iio_event *events, size_t nb, bool nonblock)
+{
+	struct iio_context_pdata *ctx_pdata =
+		iio_context_get_pdata(pdata->dev->ctx);
+	struct pollfd pfd[2] = {
+		{
+			.fd = pdata->io_ctx.fd,
+			.events = POLLIN,
+		}, {
+			.fd = pdata->io_ctx.cancel_fd[0],
+			.events = POLLIN,
+		}
+	};
+	int ret, timeout_ms;
+
+	if (nonblock)
+		timeout_ms = 0;
+	else if (ctx_pdata->io_ctx.timeout_ms > 0)
+		timeout_ms = (int) ctx_pdata->io_ctx.timeout_ms;
+	else
+		timeout_ms = -1;
+
+	do {
+		ret = poll(pfd, 2, timeout_ms);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret < 0)
+		return -errno;
+	if (pfd[1].revents & POLLIN)
+		return -EBADF;
+	if (ret == 0)
+		return nonblock ? -EAGAIN : -ETIMEDOUT;
+
+	return iiod_client_read_events(ctx_pdata->iiod_client,
+				       &pdata->io_ctx, events, nb);
 }
+#endif /* _WIN32 */
+
+static int network_set_realtime_mode(const struct iio_device *dev,
+		size_t len, bool enable)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret = 0;
+#ifdef WITH_NETWORK_GET_BUFFER
+	size_t size = pdata->mmap_len * pdata->nb_blocks;
+
+	/* The blocks of the ring are locked here rather than by the core, as
+	 * it only knows about the current one. Locking them also faults them
+	 * in. */
+	if (pdata->mmap_addr) {
+		if (enable && mlock(pdata->mmap_addr, size))
+			return -errno;
+		if (!enable)
+			munlock(pdata->mmap_addr, size);
+	}
+#endif
+
+	/* The stream, and the decoder of its codec, are otherwise allocated
+	 * by the first refill */
+	if (enable && !iio_device_is_tx(dev)) {
+		iio_mutex_lock(pdata->lock);
+		if (pdata->rx.supported && pdata->rx.len != len)
+			ret = network_open_stream(dev, len);
+		iio_mutex_unlock(pdata->lock);
+
+		if (ret == -ENOSYS)
+			ret = 0;
+	}
+
+	return ret;
+}
+
+static int network_get_stream_stats(const struct iio_device *dev,
+		struct iio_buffer_stream_stats *stats)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret = 0;
+
+	iio_mutex_lock(pdata->lock);
+
+	if (pdata->io_ctx.fd < 0)
+		ret = -EBADF;
+	else if (!pdata->rx.supported)
+		ret = -ENOSYS;
+	else
+		*stats = pdata->rx.stats;
+
+	iio_mutex_unlock(pdata->lock);
+	return ret;
+}
+
+static int network_set_compression(const struct iio_device *dev,
+		const char *codec, int level)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	char *new_codec = NULL;
+	int ret = 0;
+
+	if (codec) {
+		new_codec = iio_strdup(codec);
+		if (!new_codec)
+			return -ENOMEM;
+	}
+
+	iio_mutex_lock(pdata->lock);
+
+	if (pdata->io_ctx.fd < 0)
+		ret = -EBADF;
+	else if (pdata->is_tx)
+		ret = -ENOSYS;
+	if (ret) {
+		free(new_codec);
+		goto out_unlock;
+	}
+
+	free(pdata->rx.codec);
+	pdata->rx.codec = new_codec;
+	pdata->rx.codec_level = level;
+
+	/* Restart the stream already opened with the new codec */
+	if (pdata->rx.supported && pdata->rx.len)
+		ret = network_open_stream(dev, pdata->rx.len);
+	if (ret == -ENOSYS)
+		ret = 0;
+
+out_unlock:
+	iio_mutex_unlock(pdata->lock);
+	return ret;
+}
+
+static struct iio_context *
+network_create_context_common(const char *hostname,
+			      const struct iio_context *src);
 
 static struct iio_context * network_clone(const struct iio_context *ctx)
 {
 	const char *addr = iio_context_get_attr_value(ctx, "ip,ip-addr");
 
-	return iio_create_network_context(addr);
+	return network_create_context_common(addr, ctx);
 }
 
 static const struct iio_backend_ops network_ops = {
@@ -935,14 +1286,27 @@ static const struct iio_backend_ops network_ops = {
 	.write_device_attr = network_write_dev_attr,
 	.read_channel_attr = network_read_chn_attr,
 	.write_channel_attr = network_write_chn_attr,
+	.read_regs = network_read_regs,
+	.write_regs = network_write_regs,
 	.get_trigger = network_get_trigger,
 	.set_trigger = network_set_trigger,
 	.shutdown = network_shutdown,
 	.get_version = network_get_version,
 	.set_timeout = network_set_timeout,
 	.set_kernel_buffers_count = network_set_kernel_buffers_count,
+	.set_realtime_mode = network_set_realtime_mode,
+	.set_compression = network_set_compression,
+	.get_stream_stats = network_get_stream_stats,
+	.flush = network_flush,
 
 	.cancel = network_cancel,
+#ifndef _WIN32
+	.open_ev = network_open_ev,
+	.close_ev = network_close_ev,
+	.read_ev = network_read_ev,
+	.get_ev_fd = network_get_ev_fd,
+	.cancel_ev = network_cancel_ev,
+#endif
 };
 
 static ssize_t network_write_data(struct iio_context_pdata *pdata,
@@ -960,12 +1324,56 @@ static ssize_t network_read_data(struct iio_context_pdata *pdata,
 {
 	struct iiod_client_pdata *io_ctx = io_data;
 
-	return network_recv(io_ctx, dst, len, 0);
+	return network_recv_buffered(io_ctx, dst, len);
 }
 
-static ssize_t network_read_line(struct iio_context_pdata *pdata,
-				 struct iiod_client_pdata *io_data,
-				 char *dst, size_t len)
+static ssize_t network_read_line_buffered(struct iiod_client_pdata *io_ctx,
+					  char *dst, size_t len)
+{
+	size_t avail, bytes_read = 0;
+	const char *ptr, *end;
+	ssize_t ret;
+
+	while (len) {
+		if (io_ctx->rbuf_pos == io_ctx->rbuf_len) {
+			ret = network_recv(io_ctx, io_ctx->rbuf,
+					   NETWORK_RECV_BUF_SIZE, 0);
+			if (ret < 0)
+				return ret;
+
+			io_ctx->rbuf_pos = 0;
+			io_ctx->rbuf_len = (size_t) ret;
+		}
+
+		ptr = io_ctx->rbuf + io_ctx->rbuf_pos;
+		avail = io_ctx->rbuf_len - io_ctx->rbuf_pos;
+		if (avail > len)
+			avail = len;
+
+		/* Lookup for the trailing \n */
+		end = memchr(ptr, '\n', avail);
+		if (end)
+			avail = (size_t) (end - ptr) + 1;
+
+		memcpy(dst, ptr, avail);
+		io_ctx->rbuf_pos += avail;
+		bytes_read += avail;
+		dst += avail;
+		len -= avail;
+
+		if (end)
+			return (ssize_t) bytes_read;
+	}
+
+	IIO_ERROR("EIO: line too long\n");
+	return -EIO;
+}
+
+/* For the connections without a receive buffer, which must not consume
+ * more than the line from the socket */
+static ssize_t network_read_line_unbuffered(struct iio_context_pdata *pdata,
+					    struct iiod_client_pdata *io_data,
+					    char *dst, size_t len)
 {
 	bool found = false;
 	size_t i;
@@ -1032,6 +1440,16 @@ static ssize_t network_read_line(struct iio_context_pdata *pdata,
 #endif
 }
 
+static ssize_t network_read_line(struct iio_context_pdata *pdata,
+				 struct iiod_client_pdata *io_data,
+				 char *dst, size_t len)
+{
+	if (io_data->rbuf)
+		return network_read_line_buffered(io_data, dst, len);
+
+	return network_read_line_unbuffered(pdata, io_data, dst, len);
+}
+
 static const struct iiod_client_ops network_iiod_client_ops = {
 	.write = network_write_data,
 	.read = network_read_data,
@@ -1060,7 +1478,11 @@ static bool msg_trunc_supported(struct iiod_client_pdata *io_ctx)
 }
 #endif
 
-struct iio_context * network_create_context(const char *hostname)
+/* If a context is given, its devices and channels are reused instead of
+ * being downloaded from the remote */
+static struct iio_context *
+network_create_context_common(const char *hostname,
+			      const struct iio_context *src)
 {
 	struct addrinfo hints, *res;
 	struct iio_context *ctx;
@@ -1234,6 +1656,12 @@ struct iio_context * network_create_context(const char *hostname)
 	if (!iiod_client)
 		goto err_free_description;
 
+	pdata->io_ctx.rbuf = malloc(NETWORK_RECV_BUF_SIZE);
+	if (!pdata->io_ctx.rbuf) {
+		errno = ENOMEM;
+		goto err_destroy_iiod_client;
+	}
+
 	pdata->iiod_client = iiod_client;
 	pdata->io_ctx.fd = fd;
 	pdata->addrinfo = res;
@@ -1245,8 +1673,20 @@ struct iio_context * network_create_context(const char *hostname)
 	else
 		IIO_DEBUG("MSG_TRUNC is NOT supported\n");
 
+	ret = iiod_client_enable_binary(pdata->iiod_client, &pdata->io_ctx);
+	if (ret == -ENOSYS)
+		IIO_DEBUG("Binary protocol not supported, using text\n");
+	else if (ret < 0) {
+		errno = -ret;
+		goto err_destroy_iiod_client;
+	}
+
 	IIO_DEBUG("Creating context...\n");
-	ctx = iiod_client_create_context(pdata->iiod_client, &pdata->io_ctx);
+	if (src)
+		ctx = iio_context_create_shared(src);
+	else
+		ctx = iiod_client_create_context(pdata->iiod_client,
+						 &pdata->io_ctx);
 	if (!ctx)
 		goto err_destroy_iiod_client;
 
@@ -1291,8 +1731,11 @@ struct iio_context * network_create_context(const char *hostname)
 
 		dev->pdata->io_ctx.fd = -1;
 		dev->pdata->io_ctx.timeout_ms = DEFAULT_TIMEOUT_MS;
+		dev->pdata->tx_depth = NETWORK_TX_DEFAULT_DEPTH;
 #ifdef WITH_NETWORK_GET_BUFFER
 		dev->pdata->memfd = -1;
+		dev->pdata->pipefd[0] = -1;
+		dev->pdata->pipefd[1] = -1;
 #endif
 
 		dev->pdata->lock = iio_mutex_create();
@@ -1302,7 +1745,10 @@ struct iio_context * network_create_context(const char *hostname)
 		}
 	}
 
-	if (ctx->description) {
+	if (src) {
+		/* Already includes the network description */
+		free(description);
+	} else if (ctx->description) {
 		size_t desc_len = strlen(description);
 		size_t new_size = desc_len + strlen(ctx->description) + 2;
 		char *ptr, *new_description = realloc(description, new_size);
@@ -1334,6 +1780,7 @@ err_network_shutdown:
 	return NULL;
 
 err_destroy_iiod_client:
+	free(pdata->io_ctx.rbuf);
 	iiod_client_destroy(iiod_client);
 err_free_description:
 	free(description);
@@ -1345,3 +1792,8 @@ err_free_addrinfo:
 	freeaddrinfo(res);
 	return NULL;
 }
+
+struct iio_context * network_create_context(const char *hostname)
+{
+	return network_create_context_common(hostname, NULL);
+}
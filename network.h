@@ -23,6 +23,11 @@ struct iiod_client_pdata {
 	void * events[2];
 	int cancel_fd[2];
 	unsigned int timeout_ms;
+
+	/* Data received but not consumed yet. Connections without a receive
+	 * buffer read straight from the socket. */
+	char *rbuf;
+	size_t rbuf_pos, rbuf_len;
 };
 
 int setup_cancel(struct iiod_client_pdata *io_ctx);
@@ -0,0 +1,122 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Generate a synthetic IIO sysfs tree, usable with the "local:root=<dir>" URI
+#
+# Copyright (C) 2023 Analog Devices, Inc.
+#
+# Every device gets a set of voltage channels and a timestamp channel, each
+# one being a scan element, as well as two buffers; the second one is exposed
+# by libiio as the "iio:deviceX.buffer1" device. The samples are read from
+# <root>/dev/iio:deviceX, which is either a regular file of the given size or
+# a named pipe that has to be fed by the user, e.g.:
+#   cat /dev/urandom > <root>/dev/iio:device0 &
+
+set -e
+
+NB_DEVICES=1
+NB_CHANNELS=4
+DATA_SIZE=16777216
+USE_FIFO=0
+
+usage() {
+	cat <<EOF
+Usage: $0 [-d <devices>] [-c <channels>] [-s <bytes>] [-f] <root>
+
+  -d <devices>   Number of IIO devices to create (default: ${NB_DEVICES})
+  -c <channels>  Number of voltage channels per device (default: ${NB_CHANNELS})
+  -s <bytes>     Size of the data file of each device (default: ${DATA_SIZE})
+  -f             Create the data nodes as named pipes instead of files
+EOF
+	exit 1
+}
+
+while getopts "d:c:s:fh" opt ; do
+	case "$opt" in
+	d) NB_DEVICES="$OPTARG" ;;
+	c) NB_CHANNELS="$OPTARG" ;;
+	s) DATA_SIZE="$OPTARG" ;;
+	f) USE_FIFO=1 ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+[ $# -eq 1 ] || usage
+ROOT="$1"
+
+if [ -e "${ROOT}/sys" ] || [ -e "${ROOT}/dev" ] ; then
+	echo "${ROOT} already contains a sysfs or /dev tree" >&2
+	exit 1
+fi
+
+mkdir -p "${ROOT}/sys/bus/iio/devices" "${ROOT}/sys/kernel/debug/iio" "${ROOT}/dev"
+
+# write_attr <file> <value>
+write_attr() {
+	printf '%s\n' "$2" > "$1"
+}
+
+# add_scan_element <dir> <name> <index> <type>
+add_scan_element() {
+	write_attr "$1/$2_en" 0
+	write_attr "$1/$2_index" "$3"
+	write_attr "$1/$2_type" "$4"
+}
+
+dev=0
+while [ "$dev" -lt "$NB_DEVICES" ] ; do
+	id="iio:device${dev}"
+	devdir="${ROOT}/sys/bus/iio/devices/${id}"
+
+	mkdir -p "${devdir}/buffer" "${devdir}/scan_elements" \
+		"${devdir}/trigger" "${ROOT}/sys/kernel/debug/iio/${id}"
+
+	write_attr "${devdir}/name" "fake-adc${dev}"
+	write_attr "${devdir}/sampling_frequency" 1000000
+	write_attr "${devdir}/sampling_frequency_available" "1000000 2000000"
+	write_attr "${devdir}/in_voltage_scale" 0.500000
+	write_attr "${devdir}/trigger/current_trigger" ""
+
+	write_attr "${devdir}/buffer/enable" 0
+	write_attr "${devdir}/buffer/length" 0
+	write_attr "${devdir}/buffer/watermark" 1
+	write_attr "${devdir}/buffer/data_available" 0
+
+	write_attr "${ROOT}/sys/kernel/debug/iio/${id}/direct_reg_access" 0x0
+
+	chn=0
+	while [ "$chn" -lt "$NB_CHANNELS" ] ; do
+		write_attr "${devdir}/in_voltage${chn}_raw" "$chn"
+		add_scan_element "${devdir}/scan_elements" "in_voltage${chn}" \
+			"$chn" "le:s16/16>>0"
+		chn=$((chn + 1))
+	done
+
+	add_scan_element "${devdir}/scan_elements" in_timestamp \
+		"$NB_CHANNELS" "le:s64/64>>0"
+
+	# The scan elements of the additional buffers live in the buffer
+	# directory itself, and the other channel attributes are only
+	# available from the parent device
+	mkdir -p "${devdir}/buffer1"
+	write_attr "${devdir}/buffer1/enable" 0
+	write_attr "${devdir}/buffer1/length" 0
+	write_attr "${devdir}/buffer1/watermark" 1
+	write_attr "${devdir}/buffer1/data_available" 0
+
+	chn=0
+	while [ "$chn" -lt "$NB_CHANNELS" ] ; do
+		add_scan_element "${devdir}/buffer1" "in_voltage${chn}" \
+			"$chn" "le:s16/16>>0"
+		chn=$((chn + 1))
+	done
+
+	if [ "$USE_FIFO" -eq 1 ] ; then
+		mkfifo "${ROOT}/dev/${id}"
+	else
+		head -c "$DATA_SIZE" /dev/urandom > "${ROOT}/dev/${id}"
+	fi
+
+	dev=$((dev + 1))
+done
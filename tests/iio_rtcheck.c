@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * iio_rtcheck - Part of the Industrial I/O (IIO) utilities
+ *
+ * Copyright (C) 2023 Analog Devices, Inc.
+ *
+ * Checks that iio_buffer_refill() or iio_buffer_push() of a buffer in
+ * real-time mode neither allocate heap memory nor cause page faults, using
+ * the instrumentation hook of the real-time mode.
+ * */
+
+/* Required for RUSAGE_THREAD */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <getopt.h>
+#include <iio.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "iio_common.h"
+
+#define MY_NAME "iio_rtcheck"
+
+#define DEFAULT_BUFFER_SIZE 256
+#define DEFAULT_ITERATIONS 64
+
+/*
+ * The allocator of the C library is replaced by wrappers, which count the
+ * calls made while the thread is on the real-time path. The wrappers can't
+ * print anything, as that might allocate. They have to be exported, for the
+ * calls made by the library to resolve to them.
+ */
+#define __export __attribute__((visibility("default")))
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t nmemb, size_t size);
+extern void * __libc_realloc(void *ptr, size_t size);
+extern void * __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static __thread bool on_rt_path;
+static unsigned long nb_allocs, nb_frees;
+static long nb_faults;
+static const char *first_violation;
+
+static void count_alloc(const char *fn)
+{
+	if (on_rt_path) {
+		nb_allocs++;
+		if (!first_violation)
+			first_violation = fn;
+	}
+}
+
+__export void * malloc(size_t size)
+{
+	count_alloc("malloc");
+	return __libc_malloc(size);
+}
+
+__export void * calloc(size_t nmemb, size_t size)
+{
+	count_alloc("calloc");
+	return __libc_calloc(nmemb, size);
+}
+
+__export void * realloc(void *ptr, size_t size)
+{
+	count_alloc("realloc");
+	return __libc_realloc(ptr, size);
+}
+
+__export int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+
+	count_alloc("posix_memalign");
+
+	ptr = __libc_memalign(alignment, size);
+	if (!ptr)
+		return ENOMEM;
+
+	*memptr = ptr;
+	return 0;
+}
+
+__export void free(void *ptr)
+{
+	if (on_rt_path && ptr) {
+		nb_frees++;
+		if (!first_violation)
+			first_violation = "free";
+	}
+
+	__libc_free(ptr);
+}
+
+static long get_page_faults(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_THREAD, &usage))
+		return 0;
+
+	return usage.ru_minflt + usage.ru_majflt;
+}
+
+static bool count_faults;
+static long faults_on_enter;
+
+static void rt_hook(const struct iio_buffer *buf, bool enter, void *d)
+{
+	if (enter) {
+		faults_on_enter = get_page_faults();
+		on_rt_path = true;
+	} else {
+		on_rt_path = false;
+		if (count_faults)
+			nb_faults += get_page_faults() - faults_on_enter;
+	}
+}
+
+static const struct option options[] = {
+	{"buffer-size", required_argument, 0, 'b'},
+	{"iterations", required_argument, 0, 's'},
+	{0, 0, 0, 0},
+};
+
+static const char *options_descriptions[] = {
+	"[-b <buffer-size>] [-s <iterations>] <iio_device>",
+	"Size of the buffer, in samples. Default is 256.",
+	"Number of refills or pushes. Default is 64.",
+};
+
+#define MY_OPTS "b:s:"
+
+int main(int argc, char **argv)
+{
+	char **argw;
+	struct iio_context *ctx;
+	struct iio_device *dev;
+	struct iio_buffer *buffer = NULL;
+	size_t buffer_size = DEFAULT_BUFFER_SIZE;
+	unsigned long i, iterations = DEFAULT_ITERATIONS;
+	unsigned int nb_channels, nb_enabled = 0;
+	struct option *opts;
+	bool is_tx;
+	ssize_t nbytes;
+	int c, ret = EXIT_FAILURE;
+
+	argw = dup_argv(MY_NAME, argc, argv);
+
+	ctx = handle_common_opts(MY_NAME, argc, argw, MY_OPTS,
+				 options, options_descriptions, &ret);
+	opts = add_common_options(options);
+	if (!opts) {
+		fprintf(stderr, "Failed to add common options\n");
+		return EXIT_FAILURE;
+	}
+	while ((c = getopt_long(argc, argw, "+" COMMON_OPTIONS MY_OPTS, /* Flawfinder: ignore */
+			opts, NULL)) != -1) {
+		switch (c) {
+		/* All these are handled in the common */
+		case 'h':
+		case 'V':
+		case 'n':
+		case 'x':
+		case 'u':
+		case 'T':
+			break;
+		case 'S':
+		case 'a':
+			if (!optarg && argc > optind && argv[optind] != NULL
+					&& argv[optind][0] != '-')
+				optind++;
+			break;
+		case 'b':
+			buffer_size = sanitize_clamp("buffer size", optarg, 1, SIZE_MAX);
+			break;
+		case 's':
+			iterations = sanitize_clamp("iterations", optarg, 2, ULONG_MAX);
+			break;
+		case '?':
+			printf("Unknown argument '%c'\n", c);
+			return EXIT_FAILURE;
+		}
+	}
+	free(opts);
+
+	if (argc != optind + 1) {
+		fprintf(stderr, "Incorrect number of arguments.\n\n");
+		usage(MY_NAME, options, options_descriptions);
+		return EXIT_FAILURE;
+	}
+
+	if (!ctx)
+		return ret;
+
+	ret = EXIT_FAILURE;
+
+	dev = iio_context_find_device(ctx, argw[optind]);
+	if (!dev) {
+		fprintf(stderr, "Device %s not found\n", argw[optind]);
+		goto err_destroy_context;
+	}
+
+	/* Use all the scan elements of the device; it is a TX device if it
+	 * has output scan elements */
+	is_tx = false;
+	nb_channels = iio_device_get_channels_count(dev);
+
+	for (i = 0; i < nb_channels; i++) {
+		struct iio_channel *ch = iio_device_get_channel(dev, i);
+
+		if (iio_channel_is_scan_element(ch) && iio_channel_is_output(ch))
+			is_tx = true;
+	}
+
+	for (i = 0; i < nb_channels; i++) {
+		struct iio_channel *ch = iio_device_get_channel(dev, i);
+
+		if (iio_channel_is_scan_element(ch) &&
+		    iio_channel_is_output(ch) == is_tx) {
+			iio_channel_enable(ch);
+			nb_enabled++;
+		}
+	}
+
+	if (!nb_enabled) {
+		fprintf(stderr, "Device %s has no scan elements\n", argw[optind]);
+		goto err_destroy_context;
+	}
+
+	buffer = iio_device_create_buffer(dev, buffer_size, false);
+	if (!buffer) {
+		perror("Unable to allocate buffer");
+		goto err_destroy_context;
+	}
+
+	ret = iio_buffer_set_realtime_mode(buffer, true);
+	if (ret < 0) {
+		errno = -ret;
+		perror("Unable to enable the real-time mode");
+		ret = EXIT_FAILURE;
+		goto err_destroy_buffer;
+	}
+
+	iio_buffer_set_realtime_hook(buffer, rt_hook, NULL);
+
+	/* The first iteration faults in the code and the stack used by the
+	 * real-time path, as the whole address space of the program is not
+	 * locked; only the allocations are counted. */
+	for (i = 0; i < iterations; i++) {
+		count_faults = i > 0;
+
+		if (is_tx)
+			nbytes = iio_buffer_push(buffer);
+		else
+			nbytes = iio_buffer_refill(buffer);
+		if (nbytes < 0) {
+			errno = -(int) nbytes;
+			perror(is_tx ? "Unable to push buffer" :
+			       "Unable to refill buffer");
+			ret = EXIT_FAILURE;
+			goto err_destroy_buffer;
+		}
+	}
+
+	printf("%lu %s: %lu allocations, %lu frees, %ld page faults\n",
+	       iterations, is_tx ? "pushes" : "refills",
+	       nb_allocs, nb_frees, nb_faults);
+
+	if (first_violation)
+		printf("First violation: %s()\n", first_violation);
+
+	ret = (nb_allocs || nb_frees || nb_faults) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+err_destroy_buffer:
+	iio_buffer_destroy(buffer);
+err_destroy_context:
+	iio_context_destroy(ctx);
+	free_argw(argc, argw);
+	return ret;
+}
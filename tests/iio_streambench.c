@@ -0,0 +1,261 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * iio_streambench - Part of the Industrial I/O (IIO) utilities
+ *
+ * Copyright (C) 2026 Analog Devices, Inc.
+ *
+ * Measures the throughput of an input buffer, the CPU time spent by the
+ * client and the amount of data actually received, for each of the given
+ * codecs of the stream of samples sent by the IIO Daemon.
+ * */
+
+#include <errno.h>
+#include <getopt.h>
+#include <iio.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "iio_common.h"
+
+#define MY_NAME "iio_streambench"
+
+#define DEFAULT_BUFFER_SIZE 65536
+#define DEFAULT_REFILLS 256
+#define DEFAULT_CODECS "none,packed,zstd:-5,zstd:1,zstd:3"
+
+static uint64_t get_cpu_time_us(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage))
+		return 0;
+
+	return (uint64_t) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+		* 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/* Reads the samples with the given codec, "<codec>[:<level>]" or "none" */
+static int bench_codec(struct iio_device *dev, char *codec,
+		size_t buffer_size, unsigned long refills)
+{
+	struct iio_buffer_stream_stats stats_start, stats;
+	struct iio_buffer *buffer;
+	uint64_t start, cpu_start, elapsed, cpu;
+	bool has_stats;
+	unsigned long i;
+	size_t nbytes = 0;
+	ssize_t ret;
+	char *level;
+	int lvl = 1;
+
+	level = strchr(codec, ':');
+	if (level) {
+		*level = '\0';
+		lvl = atoi(level + 1);
+	}
+
+	buffer = iio_device_create_buffer(dev, buffer_size, false);
+	if (!buffer) {
+		perror("Unable to allocate buffer");
+		return -errno;
+	}
+
+	ret = iio_buffer_set_compression(buffer,
+			strcmp(codec, "none") ? codec : NULL, lvl);
+	if (ret < 0)
+		goto out_destroy_buffer;
+
+	/* The first refill starts the stream */
+	ret = iio_buffer_refill(buffer);
+	if (ret < 0)
+		goto out_destroy_buffer;
+
+	/* Not available if the samples are not streamed */
+	has_stats = !iio_buffer_get_stream_stats(buffer, &stats_start);
+
+	start = get_time_us();
+	cpu_start = get_cpu_time_us();
+
+	for (i = 0; i < refills; i++) {
+		ret = iio_buffer_refill(buffer);
+		if (ret < 0)
+			goto out_destroy_buffer;
+
+		nbytes += (size_t) ret;
+	}
+
+	elapsed = get_time_us() - start;
+	cpu = get_cpu_time_us() - cpu_start;
+	if (!elapsed)
+		elapsed = 1;
+
+	if (has_stats)
+		has_stats = !iio_buffer_get_stream_stats(buffer, &stats);
+
+	if (level)
+		printf("%-8s %5d", codec, lvl);
+	else
+		printf("%-8s %5s", codec, "-");
+
+	printf(" %10.2f %10.1f %10.1f %6.1f%%",
+	       (double) nbytes / elapsed, elapsed / 1000.0, cpu / 1000.0,
+	       100.0 * cpu / elapsed);
+
+	/* Bytes received for the measured refills, and how much smaller
+	 * they are than the samples */
+	if (has_stats) {
+		uint64_t raw = stats.nb_bytes - stats_start.nb_bytes;
+		uint64_t encoded = stats.nb_encoded_bytes -
+			stats_start.nb_encoded_bytes;
+
+		printf(" %12.2f %7.2f\n", encoded / 1e6,
+		       encoded ? (double) raw / encoded : 0.0);
+	} else {
+		printf(" %12s %7s\n", "-", "-");
+	}
+
+out_destroy_buffer:
+	iio_buffer_destroy(buffer);
+	return ret < 0 ? (int) ret : 0;
+}
+
+static const struct option options[] = {
+	{"buffer-size", required_argument, 0, 'b'},
+	{"refills", required_argument, 0, 's'},
+	{"codecs", required_argument, 0, 'c'},
+	{0, 0, 0, 0},
+};
+
+static const char *options_descriptions[] = {
+	"[-b <buffer-size>] [-s <refills>] [-c <codec>[:<level>],...] "
+		"<iio_device>",
+	"Size of the buffer, in samples. Default is 65536.",
+	"Number of refills measured for each codec. Default is 256.",
+	"Comma-separated list of the codecs to measure, \"none\" for "
+		"uncompressed.\n\t\t\tDefault is \"" DEFAULT_CODECS "\".",
+};
+
+#define MY_OPTS "b:s:c:"
+
+int main(int argc, char **argv)
+{
+	char **argw;
+	struct iio_context *ctx;
+	struct iio_device *dev;
+	size_t buffer_size = DEFAULT_BUFFER_SIZE;
+	unsigned long i, refills = DEFAULT_REFILLS;
+	unsigned int nb_channels, nb_enabled = 0;
+	const char *codecs = DEFAULT_CODECS;
+	char *list, *codec, *saveptr = NULL;
+	struct option *opts;
+	int c, err, ret = EXIT_FAILURE;
+
+	argw = dup_argv(MY_NAME, argc, argv);
+
+	ctx = handle_common_opts(MY_NAME, argc, argw, MY_OPTS,
+				 options, options_descriptions, &ret);
+	opts = add_common_options(options);
+	if (!opts) {
+		fprintf(stderr, "Failed to add common options\n");
+		return EXIT_FAILURE;
+	}
+	while ((c = getopt_long(argc, argw, "+" COMMON_OPTIONS MY_OPTS, /* Flawfinder: ignore */
+			opts, NULL)) != -1) {
+		switch (c) {
+		/* All these are handled in the common */
+		case 'h':
+		case 'V':
+		case 'n':
+		case 'x':
+		case 'u':
+		case 'T':
+			break;
+		case 'S':
+		case 'a':
+			if (!optarg && argc > optind && argv[optind] != NULL
+					&& argv[optind][0] != '-')
+				optind++;
+			break;
+		case 'b':
+			buffer_size = sanitize_clamp("buffer size", optarg, 1, SIZE_MAX);
+			break;
+		case 's':
+			refills = sanitize_clamp("refills", optarg, 1, ULONG_MAX);
+			break;
+		case 'c':
+			codecs = optarg;
+			break;
+		case '?':
+			printf("Unknown argument '%c'\n", c);
+			return EXIT_FAILURE;
+		}
+	}
+	free(opts);
+
+	if (argc != optind + 1) {
+		fprintf(stderr, "Incorrect number of arguments.\n\n");
+		usage(MY_NAME, options, options_descriptions);
+		return EXIT_FAILURE;
+	}
+
+	if (!ctx)
+		return ret;
+
+	ret = EXIT_FAILURE;
+
+	dev = iio_context_find_device(ctx, argw[optind]);
+	if (!dev) {
+		fprintf(stderr, "Device %s not found\n", argw[optind]);
+		goto err_destroy_context;
+	}
+
+	nb_channels = iio_device_get_channels_count(dev);
+
+	for (i = 0; i < nb_channels; i++) {
+		struct iio_channel *ch = iio_device_get_channel(dev, i);
+
+		if (iio_channel_is_scan_element(ch) &&
+		    !iio_channel_is_output(ch)) {
+			iio_channel_enable(ch);
+			nb_enabled++;
+		}
+	}
+
+	if (!nb_enabled) {
+		fprintf(stderr, "Device %s has no input scan elements\n",
+			argw[optind]);
+		goto err_destroy_context;
+	}
+
+	list = cmn_strndup(codecs, NAME_MAX);
+	if (!list) {
+		fprintf(stderr, "Out of memory\n");
+		goto err_destroy_context;
+	}
+
+	printf("%-8s %5s %10s %10s %10s %7s %12s %7s\n", "codec", "level",
+	       "MB/s", "wall (ms)", "CPU (ms)", "CPU", "wire (MB)",
+	       "ratio");
+
+	ret = EXIT_SUCCESS;
+
+	for (codec = strtok_r(list, ",", &saveptr); codec;
+	     codec = strtok_r(NULL, ",", &saveptr)) {
+		err = bench_codec(dev, codec, buffer_size, refills);
+		if (err < 0) {
+			fprintf(stderr, "%s: %s\n", codec, strerror(-err));
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	free(list);
+err_destroy_context:
+	iio_context_destroy(ctx);
+	free_argw(argc, argw);
+	return ret;
+}
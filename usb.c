@@ -28,6 +28,10 @@
 
 #define IIO_INTERFACE_NAME	"IIO"
 
+/* Number of blocks of a stream that the server can send ahead of the
+ * refills; the server prepares the next ones while a block is read. */
+#define USB_STREAM_CREDITS 4
+
 struct iio_usb_ep_couple {
 	unsigned char addr_in, addr_out;
 	uint16_t pipe_id;
@@ -41,6 +45,11 @@ struct iiod_client_pdata {
 
 	struct iio_mutex *lock;
 	bool cancelled;
+
+	/* Allocated once, and reused by every transfer */
+	struct libusb_transfer *xfer;
+
+	/* Transfer in progress, NULL if none */
 	struct libusb_transfer *transfer;
 };
 
@@ -67,6 +76,9 @@ struct iio_device_pdata {
 
 	bool opened;
 	struct iiod_client_pdata io_ctx;
+
+	/* Stream of input samples */
+	struct iiod_client_rx rx;
 };
 
 static const unsigned int libusb_to_errno_codes[] = {
@@ -111,6 +123,13 @@ static int usb_io_context_init(struct iiod_client_pdata *io_ctx)
 	if (!io_ctx->lock)
 		return -ENOMEM;
 
+	io_ctx->xfer = libusb_alloc_transfer(0);
+	if (!io_ctx->xfer) {
+		iio_mutex_destroy(io_ctx->lock);
+		io_ctx->lock = NULL;
+		return -ENOMEM;
+	}
+
 	return 0;
 }
 
@@ -120,6 +139,11 @@ static void usb_io_context_exit(struct iiod_client_pdata *io_ctx)
 		iio_mutex_destroy(io_ctx->lock);
 		io_ctx->lock = NULL;
 	}
+
+	if (io_ctx->xfer) {
+		libusb_free_transfer(io_ctx->xfer);
+		io_ctx->xfer = NULL;
+	}
 }
 
 static int usb_get_version(const struct iio_context *ctx,
@@ -286,6 +310,11 @@ static int usb_open(const struct iio_device *dev,
 	}
 
 	pdata->opened = !ret;
+	pdata->rx.len = 0;
+	pdata->rx.supported = WITH_USB_STREAM && !iio_device_is_tx(dev);
+	memset(&pdata->rx.stats, 0, sizeof(pdata->rx.stats));
+	if (pdata->opened && pdata->rx.supported)
+		pdata->rx.codec = iiod_client_get_default_codec(&pdata->rx.codec_level);
 
 	iio_mutex_unlock(pdata->lock);
 
@@ -310,6 +339,22 @@ static int usb_close(const struct iio_device *dev)
 		goto out_unlock;
 
 	iio_mutex_lock(pdata->lock);
+
+	/* The pipe is kept, so the blocks of the stream still in flight have
+	 * to be read before closing the device. A cancelled stream is
+	 * dropped, as closing the pipe ends the session on the server. */
+	if (pdata->rx.len) {
+		if (pdata->io_ctx.cancelled)
+			iiod_client_free_stream(pdata->rx.stream);
+		else
+			iiod_client_close_stream_unlocked(ctx_pdata->iiod_client,
+					&pdata->io_ctx, pdata->rx.stream, dev->words);
+		pdata->rx.len = 0;
+	}
+
+	free(pdata->rx.codec);
+	pdata->rx.codec = NULL;
+
 	ret = iiod_client_close_unlocked(ctx_pdata->iiod_client, &pdata->io_ctx,
 			dev);
 	pdata->opened = false;
@@ -325,16 +370,33 @@ out_unlock:
 	return ret;
 }
 
+/* (Re)opens the stream of input samples with blocks of the given size;
+ * returns -ENOSYS if the server does not support it. */
+static int usb_open_stream(const struct iio_device *dev, size_t len)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	return iiod_client_rx_open_unlocked(ctx_pdata->iiod_client,
+			&pdata->io_ctx, dev, &pdata->rx, len,
+			USB_STREAM_CREDITS, dev->words);
+}
+
 static ssize_t usb_read(const struct iio_device *dev, void *dst, size_t len,
 		uint32_t *mask, size_t words)
 {
 	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
 	struct iio_device_pdata *pdata = dev->pdata;
-	ssize_t ret;
+	ssize_t ret = -ENOSYS;
 
 	iio_mutex_lock(pdata->lock);
-	ret = iiod_client_read_unlocked(ctx_pdata->iiod_client,
-			&pdata->io_ctx, dev, dst, len, mask, words);
+	if (pdata->rx.supported)
+		ret = iiod_client_rx_read_unlocked(ctx_pdata->iiod_client,
+				&pdata->io_ctx, dev, &pdata->rx, dst, len,
+				USB_STREAM_CREDITS, mask, words);
+	if (ret == -ENOSYS)
+		ret = iiod_client_read_unlocked(ctx_pdata->iiod_client,
+				&pdata->io_ctx, dev, dst, len, mask, words);
 	iio_mutex_unlock(pdata->lock);
 
 	return ret;
@@ -395,6 +457,24 @@ static ssize_t usb_write_chn_attr(const struct iio_channel *chn,
 			src, len, false);
 }
 
+static int usb_read_regs(const struct iio_device *dev,
+		const uint32_t *addrs, uint32_t *values, size_t nb)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+
+	return iiod_client_read_regs(pdata->iiod_client,
+			&pdata->io_ctx, dev, addrs, values, nb);
+}
+
+static int usb_write_regs(const struct iio_device *dev,
+		const uint32_t *addrs, const uint32_t *values, size_t nb)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+
+	return iiod_client_write_regs(pdata->iiod_client,
+			&pdata->io_ctx, dev, addrs, values, nb);
+}
+
 static int usb_set_kernel_buffers_count(const struct iio_device *dev,
 		unsigned int nb_blocks)
 {
@@ -530,6 +610,98 @@ static int iio_usb_match_device(struct libusb_device *dev,
 	return ret;
 }
 
+static int usb_set_realtime_mode(const struct iio_device *dev,
+		size_t len, bool enable)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret = 0;
+
+	/* The transfers are preallocated; the stream, and the decoder of its
+	 * codec, are otherwise allocated by the first refill */
+	if (enable && !iio_device_is_tx(dev)) {
+		iio_mutex_lock(pdata->lock);
+		if (pdata->rx.supported && pdata->rx.len != len)
+			ret = usb_open_stream(dev, len);
+		iio_mutex_unlock(pdata->lock);
+
+		if (ret == -ENOSYS)
+			ret = 0;
+	}
+
+	return ret;
+}
+
+static int usb_set_compression(const struct iio_device *dev,
+		const char *codec, int level)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	char *new_codec = NULL;
+	int ret = 0;
+
+	if (!WITH_USB_STREAM || iio_device_is_tx(dev))
+		return -ENOSYS;
+
+	if (codec) {
+		new_codec = iio_strdup(codec);
+		if (!new_codec)
+			return -ENOMEM;
+	}
+
+	/* The lock of the device is the one of its endpoint, only valid
+	 * while the device is opened */
+	iio_mutex_lock(ctx_pdata->ep_lock);
+
+	if (!pdata->opened) {
+		free(new_codec);
+		iio_mutex_unlock(ctx_pdata->ep_lock);
+		return -EBADF;
+	}
+
+	iio_mutex_lock(pdata->lock);
+
+	free(pdata->rx.codec);
+	pdata->rx.codec = new_codec;
+	pdata->rx.codec_level = level;
+
+	/* Restart the stream already opened with the new codec */
+	if (pdata->rx.supported && pdata->rx.len)
+		ret = usb_open_stream(dev, pdata->rx.len);
+	if (ret == -ENOSYS)
+		ret = 0;
+
+	iio_mutex_unlock(pdata->lock);
+	iio_mutex_unlock(ctx_pdata->ep_lock);
+	return ret;
+}
+
+static int usb_get_stream_stats(const struct iio_device *dev,
+		struct iio_buffer_stream_stats *stats)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret = 0;
+
+	/* Same as usb_set_compression() */
+	iio_mutex_lock(ctx_pdata->ep_lock);
+
+	if (!pdata->opened) {
+		iio_mutex_unlock(ctx_pdata->ep_lock);
+		return -EBADF;
+	}
+
+	iio_mutex_lock(pdata->lock);
+
+	if (!pdata->rx.supported)
+		ret = -ENOSYS;
+	else
+		*stats = pdata->rx.stats;
+
+	iio_mutex_unlock(pdata->lock);
+	iio_mutex_unlock(ctx_pdata->ep_lock);
+	return ret;
+}
+
 static void usb_cancel(const struct iio_device *dev)
 {
 	struct iio_device_pdata *ppdata = dev->pdata;
@@ -551,10 +723,15 @@ static const struct iio_backend_ops usb_ops = {
 	.read_channel_attr = usb_read_chn_attr,
 	.write_device_attr = usb_write_dev_attr,
 	.write_channel_attr = usb_write_chn_attr,
+	.read_regs = usb_read_regs,
+	.write_regs = usb_write_regs,
 	.get_trigger = usb_get_trigger,
 	.set_trigger = usb_set_trigger,
 	.set_kernel_buffers_count = usb_set_kernel_buffers_count,
 	.set_timeout = usb_set_timeout,
+	.set_realtime_mode = usb_set_realtime_mode,
+	.set_compression = usb_set_compression,
+	.get_stream_stats = usb_get_stream_stats,
 	.shutdown = usb_shutdown,
 
 	.cancel = usb_cancel,
@@ -603,12 +780,7 @@ static int usb_sync_transfer(struct iio_context_pdata *pdata,
 		goto unlock;
 	}
 
-	transfer = libusb_alloc_transfer(0);
-	if (!transfer) {
-		ret = -ENOMEM;
-		goto unlock;
-	}
-
+	transfer = io_ctx->xfer;
 	transfer->user_data = &completed;
 
 	libusb_fill_bulk_transfer(transfer, pdata->hdl, ep,
@@ -619,7 +791,6 @@ static int usb_sync_transfer(struct iio_context_pdata *pdata,
 	ret = libusb_submit_transfer(transfer);
 	if (ret) {
 		ret = -(int) libusb_to_errno(ret);
-		libusb_free_transfer(transfer);
 		goto unlock;
 	}
 
@@ -666,8 +837,6 @@ unlock:
 	io_ctx->transfer = NULL;
 	iio_mutex_unlock(io_ctx->lock);
 
-	libusb_free_transfer(transfer);
-
 	return ret;
 }
 
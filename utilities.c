@@ -161,8 +161,166 @@ static int write_double_locale(char *buf, size_t len, double val)
 #endif
 #endif
 
+static bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/* Parses the decimal notation used by sysfs attributes, without depending on
+ * the locale. The result is exact when the mantissa fits in 53 bits and the
+ * power of ten is exactly representable; anything else (long mantissas,
+ * large exponents, hexadecimal, inf, nan...) returns -EAGAIN, and has to go
+ * through strtod(). */
+static int read_double_fast(const char *str, double *val)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+	const char *ptr = str;
+	unsigned int digits = 0;
+	uint64_t mantissa = 0;
+	bool neg = false, exp_neg, has_digits = false;
+	int exp10 = 0, exp;
+	double value;
+
+	while (*ptr == ' ' || (*ptr >= '\t' && *ptr <= '\r'))
+		ptr++;
+
+	if (*ptr == '-' || *ptr == '+')
+		neg = *ptr++ == '-';
+
+	if (ptr[0] == '0' && (ptr[1] == 'x' || ptr[1] == 'X'))
+		return -EAGAIN;
+
+	for (; is_digit(*ptr); ptr++) {
+		has_digits = true;
+
+		if (mantissa || *ptr != '0') {
+			if (++digits > 19)
+				return -EAGAIN;
+
+			mantissa = mantissa * 10 + (uint64_t) (*ptr - '0');
+		}
+	}
+
+	if (*ptr == '.') {
+		for (ptr++; is_digit(*ptr); ptr++) {
+			has_digits = true;
+			exp10--;
+
+			if (mantissa || *ptr != '0') {
+				if (++digits > 19)
+					return -EAGAIN;
+
+				mantissa = mantissa * 10 + (uint64_t) (*ptr - '0');
+			}
+		}
+	}
+
+	if (!has_digits)
+		return -EAGAIN;
+
+	/* Like strtod(), ignore an 'e' that is not followed by digits */
+	if (*ptr == 'e' || *ptr == 'E') {
+		ptr++;
+		exp_neg = *ptr == '-';
+		if (*ptr == '-' || *ptr == '+')
+			ptr++;
+
+		for (exp = 0; is_digit(*ptr); ptr++) {
+			if (exp < 1000)
+				exp = exp * 10 + (*ptr - '0');
+		}
+
+		exp10 += exp_neg ? -exp : exp;
+	}
+
+	if (mantissa > (1ull << 53) || exp10 < -22 || exp10 > 22)
+		return -EAGAIN;
+
+	value = (double) mantissa;
+	if (exp10 < 0)
+		value /= pow10[-exp10];
+	else
+		value *= pow10[exp10];
+
+	*val = neg ? -value : value;
+	return 0;
+}
+
+/* Formats the value like "%f" would in the C locale, i.e. rounded to the
+ * nearest millionth, ties to even, using integer arithmetic on the binary
+ * representation of the double. Values of 9e9 and above return -EAGAIN. */
+static int write_double_fast(char *buf, size_t len, double val)
+{
+	uint64_t bits, mantissa, ml, mh, lo, hi, nb, rem_lo, rem_hi,
+		 half_lo, half_hi;
+	unsigned int shift;
+	int exp;
+
+	/* Also false for NaN */
+	if (!(val > -9e9 && val < 9e9))
+		return -EAGAIN;
+
+	memcpy(&bits, &val, sizeof(bits));
+
+	exp = (int) ((bits >> 52) & 0x7ff);
+	mantissa = bits & ((1ull << 52) - 1);
+	if (exp)
+		mantissa |= 1ull << 52;
+	else
+		exp = 1;
+
+	/* |val| = mantissa * 2^exp */
+	exp -= 1075;
+
+	if (exp >= 0) {
+		nb = (mantissa << exp) * 1000000;
+	} else if (exp <= -75) {
+		/* mantissa * 1e6 < 2^73, less than half of 2^-exp */
+		nb = 0;
+	} else {
+		shift = (unsigned int) -exp;
+
+		/* hi:lo = mantissa * 1e6, on 128 bits */
+		ml = mantissa & 0xffffffff;
+		mh = mantissa >> 32;
+		lo = ml * 1000000;
+		hi = mh * 1000000;
+		lo += hi << 32;
+		hi = (hi >> 32) + (lo < (hi << 32));
+
+		if (shift >= 64) {
+			nb = hi >> (shift - 64);
+			rem_hi = hi & ((1ull << (shift - 64)) - 1);
+			rem_lo = lo;
+			half_hi = shift > 64 ? 1ull << (shift - 65) : 0;
+			half_lo = shift > 64 ? 0 : 1ull << 63;
+		} else {
+			nb = (lo >> shift) | (shift ? hi << (64 - shift) : 0);
+			rem_hi = 0;
+			rem_lo = lo & ((1ull << shift) - 1);
+			half_hi = 0;
+			half_lo = 1ull << (shift - 1);
+		}
+
+		if (rem_hi > half_hi || (rem_hi == half_hi &&
+		    (rem_lo > half_lo || (rem_lo == half_lo && (nb & 1)))))
+			nb++;
+	}
+
+	iio_snprintf(buf, len, "%s%llu.%06llu", bits >> 63 ? "-" : "",
+		     (unsigned long long) (nb / 1000000),
+		     (unsigned long long) (nb % 1000000));
+	return 0;
+}
+
 int read_double(const char *str, double *val)
 {
+	if (!read_double_fast(str, val))
+		return 0;
+
 #ifdef LOCALE_SUPPORT
 	return read_double_locale(str, val);
 #else
@@ -181,6 +339,9 @@ int read_double(const char *str, double *val)
 
 int write_double(char *buf, size_t len, double val)
 {
+	if (!write_double_fast(buf, len, val))
+		return 0;
+
 #ifdef LOCALE_SUPPORT
 	return write_double_locale(buf, len, val);
 #else
@@ -189,6 +350,20 @@ int write_double(char *buf, size_t len, double val)
 #endif
 }
 
+int read_longlong(const char *str, long long *val)
+{
+	char *end;
+	long long value;
+
+	errno = 0;
+	value = strtoll(str, &end, 0);
+	if (end == str || errno == ERANGE)
+		return -EINVAL;
+
+	*val = value;
+	return 0;
+}
+
 void iio_library_get_version(unsigned int *major,
 		unsigned int *minor, char git_tag[8])
 {
@@ -352,20 +527,141 @@ wrong_str:
 	return NULL;
 }
 
-ssize_t __iio_printf iio_snprintf(char *buf, size_t len, const char *fmt, ...)
+ssize_t iio_vsnprintf(char *buf, size_t len, const char *fmt, va_list ap)
 {
-	va_list ap;
 	int ret;
 
-	va_start(ap, fmt);
 	ret = vsnprintf(buf, len, fmt, ap);
 	if (len && ret >= (ssize_t)len)
 		ret = -ERANGE;
-	va_end(ap);
 
 	return (ssize_t)ret;
 }
 
+ssize_t __iio_printf iio_snprintf(char *buf, size_t len, const char *fmt, ...)
+{
+	va_list ap;
+	ssize_t ret;
+
+	va_start(ap, fmt);
+	ret = iio_vsnprintf(buf, len, fmt, ap);
+	va_end(ap);
+
+	return ret;
+}
+
+static int iio_strbuf_reserve(struct iio_strbuf *sb, size_t len)
+{
+	size_t size = sb->size ? sb->size : 4096;
+	char *str;
+
+	if (sb->err)
+		return sb->err;
+
+	if (sb->len + len < sb->size)
+		return 0;
+
+	while (size <= sb->len + len)
+		size *= 2;
+
+	str = realloc(sb->str, size);
+	if (!str) {
+		sb->err = -ENOMEM;
+		return sb->err;
+	}
+
+	sb->str = str;
+	sb->size = size;
+
+	return 0;
+}
+
+void iio_strbuf_append(struct iio_strbuf *sb, const char *str, size_t len)
+{
+	if (iio_strbuf_reserve(sb, len))
+		return;
+
+	memcpy(sb->str + sb->len, str, len);
+	sb->len += len;
+	sb->str[sb->len] = '\0';
+}
+
+void iio_strbuf_puts(struct iio_strbuf *sb, const char *str)
+{
+	iio_strbuf_append(sb, str, strlen(str));
+}
+
+void iio_strbuf_puts_sanitized(struct iio_strbuf *sb, const char *str)
+{
+	size_t len;
+
+	for (;;) {
+		/* Copy the runs of regular characters at once */
+		len = strcspn(str, "&<>'\"");
+		iio_strbuf_append(sb, str, len);
+		str += len;
+
+		switch (*str) {
+		case '&':
+			iio_strbuf_puts(sb, "&amp;");
+			break;
+		case '<':
+			iio_strbuf_puts(sb, "&lt;");
+			break;
+		case '>':
+			iio_strbuf_puts(sb, "&gt;");
+			break;
+		case '\'':
+			iio_strbuf_puts(sb, "&apos;");
+			break;
+		case '"':
+			iio_strbuf_puts(sb, "&quot;");
+			break;
+		default:
+			return;
+		}
+
+		str++;
+	}
+}
+
+void iio_strbuf_printf(struct iio_strbuf *sb, const char *fmt, ...)
+{
+	va_list ap;
+	ssize_t ret;
+
+	if (iio_strbuf_reserve(sb, 0))
+		return;
+
+	va_start(ap, fmt);
+	ret = iio_vsnprintf(sb->str + sb->len, sb->size - sb->len, fmt, ap);
+	va_end(ap);
+
+	if (ret == -ERANGE) {
+		/* Not enough room; measure, grow the buffer and try again */
+		va_start(ap, fmt);
+		ret = iio_vsnprintf(NULL, 0, fmt, ap);
+		va_end(ap);
+
+		if (ret >= 0) {
+			if (iio_strbuf_reserve(sb, (size_t) ret))
+				return;
+
+			va_start(ap, fmt);
+			ret = iio_vsnprintf(sb->str + sb->len,
+					    sb->size - sb->len, fmt, ap);
+			va_end(ap);
+		}
+	}
+
+	if (ret < 0) {
+		sb->err = -EINVAL;
+		return;
+	}
+
+	sb->len += (size_t) ret;
+}
+
 uint64_t iio_read_counter_us(void)
 {
 	uint64_t value;
@@ -7,28 +7,30 @@
  */
 
 #include "debug.h"
+#include "iio-config.h"
 #include "iio-private.h"
 
 #include <errno.h>
 #include <libxml/tree.h>
+#include <libxml/xmlreader.h>
 #include <string.h>
 
+/* Validating against the DTD only reports the errors, but it is slow;
+ * make it opt-in */
+#define XML_PARSE_OPTIONS (WITH_XML_VALIDATION ? XML_PARSE_DTDVALID : 0)
+
 static int add_attr_to_channel(struct iio_channel *chn, xmlNode *n)
 {
+	struct iio_arena *arena = chn->dev->ctx->arena;
 	xmlAttr *attr;
-	char *name = NULL, *filename = NULL;
+	const char *name = NULL, *filename = NULL;
 	struct iio_channel_attr *attrs;
-	int err = -ENOMEM;
 
 	for (attr = n->properties; attr; attr = attr->next) {
 		if (!strcmp((char *) attr->name, "name")) {
-			name = iio_strdup((char *) attr->children->content);
-			if (!name)
-				goto err_free;
+			name = (const char *) attr->children->content;
 		} else if (!strcmp((char *) attr->name, "filename")) {
-			filename = iio_strdup((char *) attr->children->content);
-			if (!filename)
-				goto err_free;
+			filename = (const char *) attr->children->content;
 		} else {
 			IIO_DEBUG("Unknown field \'%s\' in channel %s\n",
 				  attr->name, chn->id);
@@ -37,30 +39,27 @@ static int add_attr_to_channel(struct iio_channel *chn, xmlNode *n)
 
 	if (!name) {
 		IIO_ERROR("Incomplete attribute in channel %s\n", chn->id);
-		err = -EINVAL;
-		goto err_free;
+		return -EINVAL;
 	}
 
-	if (!filename) {
-		filename = iio_strdup(name);
-		if (!filename)
-			goto err_free;
-	}
+	if (!filename)
+		filename = name;
 
-	attrs = realloc(chn->attrs, (1 + chn->nb_attrs) *
-			sizeof(struct iio_channel_attr));
+	attrs = iio_arena_grow(arena, chn->attrs, chn->nb_attrs,
+			       sizeof(struct iio_channel_attr));
 	if (!attrs)
-		goto err_free;
+		return -ENOMEM;
 
-	attrs[chn->nb_attrs].filename = filename;
-	attrs[chn->nb_attrs++].name = name;
 	chn->attrs = attrs;
-	return 0;
 
-err_free:
-	free(name);
-	free(filename);
-	return err;
+	/* The names are shared with the other channels of the context */
+	attrs[chn->nb_attrs].name = iio_arena_intern(arena, name);
+	attrs[chn->nb_attrs].filename = iio_arena_intern(arena, filename);
+	if (!attrs[chn->nb_attrs].name || !attrs[chn->nb_attrs].filename)
+		return -ENOMEM;
+
+	chn->nb_attrs++;
+	return 0;
 }
 
 static int add_attr_to_device(struct iio_device *dev, xmlNode *n, enum iio_attr_type type)
@@ -84,11 +83,11 @@ static int add_attr_to_device(struct iio_device *dev, xmlNode *n, enum iio_attr_
 
 	switch(type) {
 		case IIO_ATTR_TYPE_DEBUG:
-			return add_iio_dev_attr(&dev->debug_attrs, name, " debug", dev->id);
+			return add_iio_dev_attr(dev, &dev->debug_attrs, name, " debug");
 		case IIO_ATTR_TYPE_DEVICE:
-			return add_iio_dev_attr(&dev->attrs, name, " ", dev->id);
+			return add_iio_dev_attr(dev, &dev->attrs, name, " ");
 		case IIO_ATTR_TYPE_BUFFER:
-			return add_iio_dev_attr(&dev->buffer_attrs, name, " buffer", dev->id);
+			return add_iio_dev_attr(dev, &dev->buffer_attrs, name, " buffer");
 		default:
 			return -EINVAL;
 	}
@@ -170,11 +169,12 @@ static int setup_scan_element(struct iio_channel *chn, xmlNode *n)
 
 static struct iio_channel * create_channel(struct iio_device *dev, xmlNode *n)
 {
+	struct iio_arena *arena = dev->ctx->arena;
 	xmlAttr *attr;
 	struct iio_channel *chn;
-	int err = -ENOMEM;
+	int err;
 
-	chn = zalloc(sizeof(*chn));
+	chn = iio_arena_zalloc(arena, sizeof(*chn));
 	if (!chn)
 		return ERR_PTR(-ENOMEM);
 
@@ -187,13 +187,13 @@ static struct iio_channel * create_channel(struct iio_device *dev, xmlNode *n)
 		const char *name = (const char *) attr->name,
 		      *content = (const char *) attr->children->content;
 		if (!strcmp(name, "name")) {
-			chn->name = iio_strdup(content);
+			chn->name = iio_arena_intern(arena, content);
 			if (!chn->name)
-				goto err_free_channel;
+				return ERR_PTR(-ENOMEM);
 		} else if (!strcmp(name, "id")) {
-			chn->id = iio_strdup(content);
+			chn->id = iio_arena_intern(arena, content);
 			if (!chn->id)
-				goto err_free_channel;
+				return ERR_PTR(-ENOMEM);
 		} else if (!strcmp(name, "type")) {
 			if (!strcmp(content, "output"))
 				chn->is_output = true;
@@ -207,20 +207,19 @@ static struct iio_channel * create_channel(struct iio_device *dev, xmlNode *n)
 
 	if (!chn->id) {
 		IIO_ERROR("Incomplete <attribute>\n");
-		err = -EINVAL;
-		goto err_free_channel;
+		return ERR_PTR(-EINVAL);
 	}
 
 	for (n = n->children; n; n = n->next) {
 		if (!strcmp((char *) n->name, "attribute")) {
 			err = add_attr_to_channel(chn, n);
 			if (err < 0)
-				goto err_free_channel;
+				return ERR_PTR(err);
 		} else if (!strcmp((char *) n->name, "scan-element")) {
 			chn->is_scan_element = true;
 			err = setup_scan_element(chn, n);
 			if (err < 0)
-				goto err_free_channel;
+				return ERR_PTR(err);
 		} else if (strcmp((char *) n->name, "text")) {
 			IIO_DEBUG("Unknown children \'%s\' in <channel>\n",
 				  n->name);
@@ -231,19 +230,18 @@ static struct iio_channel * create_channel(struct iio_device *dev, xmlNode *n)
 	iio_channel_init_finalize(chn);
 
 	return chn;
-
-err_free_channel:
-	free_channel(chn);
-	return ERR_PTR(err);
 }
 
+/* Creates the device from the attributes of its <device> node; its
+ * children are added by parse_device_child() as they are read. */
 static struct iio_device * create_device(struct iio_context *ctx, xmlNode *n)
 {
+	struct iio_arena *arena = ctx->arena;
 	xmlAttr *attr;
 	struct iio_device *dev;
-	int err = -ENOMEM;
+	char **str;
 
-	dev = zalloc(sizeof(*dev));
+	dev = iio_arena_zalloc(arena, sizeof(*dev));
 	if (!dev)
 		return ERR_PTR(-ENOMEM);
 
@@ -251,90 +249,100 @@ static struct iio_device * create_device(struct iio_context *ctx, xmlNode *n)
 
 	for (attr = n->properties; attr; attr = attr->next) {
 		if (!strcmp((char *) attr->name, "name")) {
-			dev->name = iio_strdup(
-					(char *) attr->children->content);
-			if (!dev->name)
-				goto err_free_device;
+			str = &dev->name;
 		} else if (!strcmp((char *) attr->name, "label")) {
-			dev->label = iio_strdup((char *) attr->children->content);
-			if (!dev->label)
-				goto err_free_device;
+			str = &dev->label;
 		} else if (!strcmp((char *) attr->name, "id")) {
-			dev->id = iio_strdup((char *) attr->children->content);
-			if (!dev->id)
-				goto err_free_device;
+			str = &dev->id;
 		} else {
 			IIO_DEBUG("Unknown attribute \'%s\' in <device>\n",
 				  attr->name);
+			continue;
 		}
+
+		*str = iio_arena_intern(arena,
+					(char *) attr->children->content);
+		if (!*str)
+			return ERR_PTR(-ENOMEM);
 	}
 
 	if (!dev->id) {
 		IIO_ERROR("Unable to read device ID\n");
-		err = -EINVAL;
-		goto err_free_device;
+		return ERR_PTR(-EINVAL);
 	}
 
-	for (n = n->children; n; n = n->next) {
-		if (!strcmp((char *) n->name, "channel")) {
-			struct iio_channel **chns,
-					   *chn = create_channel(dev, n);
-			if (IS_ERR(chn)) {
-				err = PTR_ERR(chn);
-				IIO_ERROR("Unable to create channel: %d\n", err);
-				goto err_free_device;
-			}
+	return dev;
+}
 
-			chns = realloc(dev->channels, (1 + dev->nb_channels) *
-					sizeof(struct iio_channel *));
-			if (!chns) {
-				err = -ENOMEM;
-				IIO_ERROR("Unable to allocate memory\n");
-				free(chn);
-				goto err_free_device;
-			}
+static int add_channel_to_device(struct iio_device *dev, xmlNode *n)
+{
+	struct iio_channel **chns, *chn;
+	int err;
 
-			chns[dev->nb_channels++] = chn;
-			dev->channels = chns;
-		} else if (!strcmp((char *) n->name, "attribute")) {
-			err = add_attr_to_device(dev, n, IIO_ATTR_TYPE_DEVICE);
-			if (err < 0)
-				goto err_free_device;
-		} else if (!strcmp((char *) n->name, "debug-attribute")) {
-			err = add_attr_to_device(dev, n, IIO_ATTR_TYPE_DEBUG);
-			if (err < 0)
-				goto err_free_device;
-		} else if (!strcmp((char *) n->name, "buffer-attribute")) {
-			err = add_attr_to_device(dev, n, IIO_ATTR_TYPE_BUFFER);
-			if (err < 0)
-				goto err_free_device;
-		} else if (strcmp((char *) n->name, "text")) {
-			IIO_DEBUG("Unknown children \'%s\' in <device>\n",
-				  n->name);
-			continue;
-		}
+	chn = create_channel(dev, n);
+	if (IS_ERR(chn)) {
+		err = PTR_ERR(chn);
+		IIO_ERROR("Unable to create channel: %d\n", err);
+		return err;
 	}
 
-	dev->words = (dev->nb_channels + 31) / 32;
-	if (dev->words) {
-		dev->mask = calloc(dev->words, sizeof(*dev->mask));
-		if (!dev->mask) {
-			err = -ENOMEM;
-			goto err_free_device;
-		}
+	chns = iio_arena_grow(dev->ctx->arena, dev->channels, dev->nb_channels,
+			      sizeof(struct iio_channel *));
+	if (!chns) {
+		IIO_ERROR("Unable to allocate memory\n");
+		return -ENOMEM;
 	}
 
-	return dev;
+	chns[dev->nb_channels++] = chn;
+	dev->channels = chns;
+
+	return 0;
+}
+
+static int parse_device_child(struct iio_device *dev, xmlTextReaderPtr reader)
+{
+	const char *name = (const char *) xmlTextReaderConstName(reader);
+	xmlNode *n;
+
+	if (!strcmp(name, "channel")) {
+		/* Only the subtree of the channel is built */
+		n = xmlTextReaderExpand(reader);
+		if (!n)
+			return -EINVAL;
+
+		return add_channel_to_device(dev, n);
+	}
+
+	n = xmlTextReaderCurrentNode(reader);
+
+	if (!strcmp(name, "attribute"))
+		return add_attr_to_device(dev, n, IIO_ATTR_TYPE_DEVICE);
+	else if (!strcmp(name, "debug-attribute"))
+		return add_attr_to_device(dev, n, IIO_ATTR_TYPE_DEBUG);
+	else if (!strcmp(name, "buffer-attribute"))
+		return add_attr_to_device(dev, n, IIO_ATTR_TYPE_BUFFER);
+
+	IIO_DEBUG("Unknown children \'%s\' in <device>\n", name);
+	return 0;
+}
 
-err_free_device:
-	free_device(dev);
+static int add_device_to_context(struct iio_context *ctx,
+				 struct iio_device *dev)
+{
+	dev->words = (dev->nb_channels + 31) / 32;
+	if (dev->words) {
+		dev->mask = iio_arena_zalloc(ctx->arena,
+					     dev->words * sizeof(*dev->mask));
+		if (!dev->mask)
+			return -ENOMEM;
+	}
 
-	return ERR_PTR(err);
+	return iio_context_add_device(ctx, dev);
 }
 
 static struct iio_context * xml_clone(const struct iio_context *ctx)
 {
-	return xml_create_context_mem(ctx->xml, strlen(ctx->xml));
+	return iio_context_create_shared(ctx);
 }
 
 static const struct iio_backend_ops xml_ops = {
@@ -367,45 +375,79 @@ static int parse_context_attr(struct iio_context *ctx, xmlNode *n)
 		return iio_context_add_attr(ctx, name, value);
 }
 
-static int iio_populate_xml_context_helper(struct iio_context *ctx, xmlNode *root)
+/* Reads the children of the <context> node, creating the devices and
+ * channels while the document is streamed, so that the whole tree is never
+ * held in memory */
+static int iio_populate_xml_context_helper(struct iio_context *ctx,
+					   xmlTextReaderPtr reader)
 {
-	xmlNode *n;
-	int err;
+	struct iio_device *dev = NULL;
+	const char *name;
+	int ret, err = 0;
 
-	for (n = root->children; n; n = n->next) {
-		struct iio_device *dev;
+	while ((ret = xmlTextReaderRead(reader)) == 1) {
+		int type = xmlTextReaderNodeType(reader),
+		    depth = xmlTextReaderDepth(reader);
 
-		if (!strcmp((char *) n->name, "context-attribute")) {
-			err = parse_context_attr(ctx, n);
+		if (depth == 1 && dev && type == XML_READER_TYPE_END_ELEMENT) {
+			err = add_device_to_context(ctx, dev);
+			dev = NULL;
 			if (err)
 				return err;
 
 			continue;
-		} else if (strcmp((char *) n->name, "device")) {
-			if (strcmp((char *) n->name, "text"))
-				IIO_DEBUG("Unknown children \'%s\' in "
-					  "<context>\n", n->name);
-			continue;
 		}
 
-		dev = create_device(ctx, n);
-		if (IS_ERR(dev)) {
-			err = PTR_ERR(dev);
-			IIO_ERROR("Unable to create device: %d\n", err);
-			return err;
-		}
+		if (type != XML_READER_TYPE_ELEMENT)
+			continue;
+
+		name = (const char *) xmlTextReaderConstName(reader);
+
+		if (depth == 2 && dev) {
+			err = parse_device_child(dev, reader);
+			if (err)
+				return err;
+		} else if (depth != 1) {
+			/* Children of a channel or of an unknown node */
+			continue;
+		} else if (!strcmp(name, "context-attribute")) {
+			err = parse_context_attr(ctx,
+					xmlTextReaderCurrentNode(reader));
+			if (err)
+				return err;
+		} else if (!strcmp(name, "device")) {
+			dev = create_device(ctx, xmlTextReaderCurrentNode(reader));
+			if (IS_ERR(dev)) {
+				err = PTR_ERR(dev);
+				IIO_ERROR("Unable to create device: %d\n", err);
+				return err;
+			}
 
-		err = iio_context_add_device(ctx, dev);
-		if (err) {
-			free(dev);
-			return err;
+			if (xmlTextReaderIsEmptyElement(reader)) {
+				err = add_device_to_context(ctx, dev);
+				dev = NULL;
+				if (err)
+					return err;
+			}
+		} else {
+			IIO_DEBUG("Unknown children \'%s\' in <context>\n",
+				  name);
 		}
 	}
 
+	if (ret < 0) {
+		IIO_ERROR("Unable to parse XML file\n");
+		return -EINVAL;
+	}
+
+	/* The devices which are not complete are freed with the arena */
+	if (dev)
+		return -EINVAL;
+
 	return iio_context_init(ctx);
 }
 
-static struct iio_context * iio_create_xml_context_helper(xmlDoc *doc)
+static struct iio_context * iio_create_xml_context_helper(xmlTextReaderPtr reader)
 {
 	const char *description = NULL, *git_tag = NULL, *content;
 	struct iio_context *ctx;
@@ -415,7 +457,18 @@ static struct iio_context * iio_create_xml_context_helper(xmlDoc *doc)
 	char *end;
 	int err;
 
-	root = xmlDocGetRootElement(doc);
+	/* Move to the root node */
+	do {
+		err = xmlTextReaderRead(reader);
+	} while (err == 1 && xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT);
+
+	if (err != 1) {
+		IIO_ERROR("Unable to parse XML file\n");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	root = xmlTextReaderCurrentNode(reader);
 	if (strcmp((char *) root->name, "context")) {
 		IIO_ERROR("Unrecognized XML file\n");
 		errno = EINVAL;
@@ -461,7 +514,10 @@ static struct iio_context * iio_create_xml_context_helper(xmlDoc *doc)
 		}
 	}
 
-	err = iio_populate_xml_context_helper(ctx, root);
+	if (xmlTextReaderIsEmptyElement(reader))
+		err = iio_context_init(ctx);
+	else
+		err = iio_populate_xml_context_helper(ctx, reader);
 	if (err) {
 		iio_context_destroy(ctx);
 		errno = -err;
@@ -474,38 +530,39 @@ static struct iio_context * iio_create_xml_context_helper(xmlDoc *doc)
 struct iio_context * xml_create_context(const char *xml_file)
 {
 	struct iio_context *ctx;
-	xmlDoc *doc;
+	xmlTextReaderPtr reader;
 
 	LIBXML_TEST_VERSION;
 
-	doc = xmlReadFile(xml_file, NULL, XML_PARSE_DTDVALID);
-	if (!doc) {
+	reader = xmlReaderForFile(xml_file, NULL, XML_PARSE_OPTIONS);
+	if (!reader) {
 		IIO_ERROR("Unable to parse XML file\n");
 		errno = EINVAL;
 		return NULL;
 	}
 
-	ctx = iio_create_xml_context_helper(doc);
-	xmlFreeDoc(doc);
+	ctx = iio_create_xml_context_helper(reader);
+	xmlFreeTextReader(reader);
 	return ctx;
 }
 
 struct iio_context * xml_create_context_mem(const char *xml, size_t len)
 {
 	struct iio_context *ctx;
-	xmlDoc *doc;
+	xmlTextReaderPtr reader;
 
 	LIBXML_TEST_VERSION;
 
-	doc = xmlReadMemory(xml, (int) len, NULL, NULL, XML_PARSE_DTDVALID);
-	if (!doc) {
+	reader = xmlReaderForMemory(xml, (int) len, NULL, NULL,
+				   XML_PARSE_OPTIONS);
+	if (!reader) {
 		IIO_ERROR("Unable to parse XML file\n");
 		errno = EINVAL;
 		return NULL;
 	}
 
-	ctx = iio_create_xml_context_helper(doc);
-	xmlFreeDoc(doc);
+	ctx = iio_create_xml_context_helper(reader);
+	xmlFreeTextReader(reader);
 	return ctx;
 }
 